@@ -0,0 +1,195 @@
+#include "EventRing.h"
+
+#define EVENT_RECORDER_STACK 4096
+#define EVENT_RING_ALIGN 4
+
+EventRing::EventRing()
+    : arena(NULL), arenaBytes(0), entries(NULL), maxFrames(0), head(0), count(0), recordIntervalMs(0), pool(NULL),
+      lock(NULL)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool EventRing::begin(size_t bytes, uint16_t frames, uint32_t intervalMs)
+{
+    arena = (uint8_t *)ps_malloc(bytes);
+    entries = (ClipFrame *)calloc(frames, sizeof(ClipFrame));
+    if (arena == NULL || entries == NULL)
+    {
+        Serial.println("Not enough memory for the event ring.");
+        return false;
+    }
+
+    arenaBytes = bytes;
+    maxFrames = frames;
+    recordIntervalMs = intervalMs;
+    stats.bytesTotal = bytes;
+    lock = xSemaphoreCreateMutex();
+    return true;
+}
+
+void EventRing::startRecorder(FramePool &framePool, BaseType_t core)
+{
+    pool = &framePool;
+    xTaskCreatePinnedToCore(recorderEntry, "event_ring", EVENT_RECORDER_STACK, this, 1, NULL, core);
+}
+
+ClipFrame &EventRing::entry(uint16_t index)
+{
+    return entries[(head + index) % maxFrames];
+}
+
+ClipFrame *EventRing::pinNext(uint32_t afterSeq, int64_t sinceUs)
+{
+    ClipFrame *frame = NULL;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < count && frame == NULL; i++)
+    {
+        ClipFrame &candidate = entry(i);
+        if (candidate.seq > afterSeq && candidate.captureUs >= sinceUs)
+        {
+            frame = &candidate;
+            frame->pins++;
+        }
+    }
+    xSemaphoreGive(lock);
+    return frame;
+}
+
+void EventRing::unpin(ClipFrame *frame)
+{
+    if (frame == NULL)
+        return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    frame->pins--;
+    xSemaphoreGive(lock);
+}
+
+uint32_t EventRing::spanMs()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t span = count > 1 ? (entry(count - 1).captureUs - entry(0).captureUs) / 1000 : 0;
+    xSemaphoreGive(lock);
+    return span;
+}
+
+void EventRing::countClip()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats.clipsServed++;
+    xSemaphoreGive(lock);
+}
+
+EventRingStats EventRing::getStats()
+{
+    if (lock == NULL)
+        return stats;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    EventRingStats copy = stats;
+    copy.frames = count;
+    copy.bytesUsed = 0;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        copy.bytesUsed += entry(i).len;
+    }
+    copy.spanMs = count > 1 ? (entry(count - 1).captureUs - entry(0).captureUs) / 1000 : 0;
+    xSemaphoreGive(lock);
+    return copy;
+}
+
+void EventRing::printStats()
+{
+    EventRingStats s = getStats();
+    Serial.println("Event ring: " + String(s.frames) + " frames, " + String(s.bytesUsed / 1024) + " of " +
+                   String(s.bytesTotal / 1024) + " KB, " + String(s.spanMs) + " ms span, " + String(s.recorded) +
+                   " recorded, " + String(s.evicted) + " evicted, " + String(s.pinnedDrops) + " pinned drops, " +
+                   String(s.clipsServed) + " clips served");
+}
+
+void EventRing::recorderEntry(void *arg)
+{
+    static_cast<EventRing *>(arg)->record();
+}
+
+void EventRing::record()
+{
+    uint32_t lastSeq = 0;
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true)
+    {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(recordIntervalMs));
+
+        PooledFrame *frame = pool->acquireLatest(lastSeq);
+        if (frame == NULL)
+            continue;
+        lastSeq = frame->seq;
+        append(frame);
+        pool->release(frame);
+    }
+}
+
+// Frames are stored back to back after the newest one. When the arena end
+// is reached the rest of it is given up and writing restarts at the front;
+// either way the frames in the way are the oldest ones.
+bool EventRing::append(const PooledFrame *frame)
+{
+    size_t len = frame->len;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (len > arenaBytes)
+    {
+        stats.oversized++;
+        xSemaphoreGive(lock);
+        return false;
+    }
+
+    size_t pos = 0;
+    size_t tailStart = arenaBytes; // Start of the skipped space at the end after a wrap
+    if (count > 0)
+    {
+        ClipFrame &newest = entry(count - 1);
+        pos = (newest.buf - arena) + ((newest.len + EVENT_RING_ALIGN - 1) & ~(size_t)(EVENT_RING_ALIGN - 1));
+        if (pos + len > arenaBytes)
+        {
+            tailStart = pos;
+            pos = 0;
+        }
+    }
+
+    while (count > 0)
+    {
+        ClipFrame &oldest = entry(0);
+        size_t start = oldest.buf - arena;
+        bool inTail = start >= tailStart;
+        bool overlaps = start < pos + len && start + oldest.len > pos;
+        if (!inTail && !overlaps && count < maxFrames)
+            break;
+
+        if (oldest.pins > 0)
+        {
+            stats.pinnedDrops++;
+            xSemaphoreGive(lock);
+            return false;
+        }
+        head = (head + 1) % maxFrames;
+        count--;
+        stats.evicted++;
+    }
+    xSemaphoreGive(lock);
+
+    // No entry refers to this space any more, so it is filled unlocked
+    memcpy(arena + pos, frame->buf, len);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ClipFrame &slot = entry(count);
+    slot.buf = arena + pos;
+    slot.len = len;
+    slot.seq = frame->seq;
+    slot.captureUs = frame->captureUs;
+    slot.timestamp = frame->timestamp;
+    slot.pins = 0;
+    count++;
+    stats.recorded++;
+    xSemaphoreGive(lock);
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "../FramePool/FramePool.h"
+
+// JPEG kept in the ring; buf points into the ring arena
+struct ClipFrame
+{
+    const uint8_t *buf;
+    size_t len;
+    uint32_t seq;
+    int64_t captureUs;
+    struct timeval timestamp;
+    uint16_t pins; // Readers sending this frame, guarded by the ring lock
+};
+
+struct EventRingStats
+{
+    uint16_t frames;      // Frames currently held
+    size_t bytesUsed;
+    size_t bytesTotal;
+    uint32_t spanMs;      // Capture time between the oldest and newest frame
+    uint32_t recorded;
+    uint32_t evicted;     // Oldest frames overwritten by new ones
+    uint32_t pinnedDrops; // New frames skipped because the oldest was being sent
+    uint32_t oversized;
+    uint32_t clipsServed;
+};
+
+// Rolling pre-event footage. A recorder task copies a pool frame into a
+// fixed PSRAM arena a few times a second; frames are laid out back to back
+// and wrap around, so recording never allocates and always overwrites the
+// oldest frames first. Clip readers pin the frame they are sending and read
+// it straight from the arena; a pinned frame is never overwritten.
+class EventRing
+{
+public:
+    EventRing();
+
+    bool begin(size_t arenaBytes, uint16_t maxFrames, uint32_t recordIntervalMs);
+    void startRecorder(FramePool &pool, BaseType_t core);
+
+    // Oldest frame with a sequence number above afterSeq captured at or after
+    // sinceUs, pinned; NULL if there is none (yet)
+    ClipFrame *pinNext(uint32_t afterSeq, int64_t sinceUs);
+    void unpin(ClipFrame *frame);
+
+    uint32_t spanMs();
+    void countClip();
+    EventRingStats getStats();
+    void printStats();
+
+private:
+    static void recorderEntry(void *arg);
+    void record();
+    bool append(const PooledFrame *frame);
+    ClipFrame &entry(uint16_t index);
+
+    uint8_t *arena;
+    size_t arenaBytes;
+    ClipFrame *entries; // Circular, oldest at head
+    uint16_t maxFrames;
+    uint16_t head;
+    uint16_t count;
+    uint32_t recordIntervalMs;
+    FramePool *pool;
+    SemaphoreHandle_t lock;
+    EventRingStats stats;
+};
+
+#endif
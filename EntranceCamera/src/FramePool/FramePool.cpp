@@ -0,0 +1,185 @@
+#include "FramePool.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "../Metrics/Metrics.h"
+
+#define FRAME_PRODUCER_STACK 4096
+#define FRAME_PRODUCER_PRIORITY 2
+#define FRAME_WAIT_POLL_MS 5
+
+FramePool::FramePool()
+    : frames(NULL), slotCount(0), slotSize(0), latest(NULL), nextSeq(0), frameIntervalMs(0), frameListener(NULL),
+      lock(NULL)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool FramePool::begin(uint8_t slots, size_t size)
+{
+    frames = (PooledFrame *)calloc(slots, sizeof(PooledFrame));
+    if (frames == NULL)
+        return false;
+
+    for (uint8_t i = 0; i < slots; i++)
+    {
+        frames[i].buf = (uint8_t *)ps_malloc(size);
+        if (frames[i].buf == NULL)
+        {
+            Serial.println("Frame pool: only " + String(i) + " of " + String(slots) + " slots fit in PSRAM.");
+            if (i < 2)
+                return false;
+            slots = i;
+            break;
+        }
+    }
+
+    slotCount = slots;
+    slotSize = size;
+    lock = xSemaphoreCreateMutex();
+    return true;
+}
+
+void FramePool::startProducer(BaseType_t core)
+{
+    xTaskCreatePinnedToCore(producerEntry, "frame_producer", FRAME_PRODUCER_STACK, this, FRAME_PRODUCER_PRIORITY, NULL, core);
+}
+
+void FramePool::setFrameInterval(uint32_t intervalMs)
+{
+    frameIntervalMs = intervalMs;
+}
+
+PooledFrame *FramePool::acquireLatest(uint32_t afterSeq)
+{
+    PooledFrame *frame = NULL;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (latest != NULL && latest->seq > afterSeq)
+    {
+        frame = latest;
+        frame->refs++;
+    }
+    xSemaphoreGive(lock);
+    return frame;
+}
+
+PooledFrame *FramePool::waitForFrame(uint32_t afterSeq, uint32_t timeoutMs)
+{
+    uint32_t start = millis();
+    PooledFrame *frame = acquireLatest(afterSeq);
+    while (frame == NULL && millis() - start < timeoutMs)
+    {
+        vTaskDelay(pdMS_TO_TICKS(FRAME_WAIT_POLL_MS));
+        frame = acquireLatest(afterSeq);
+    }
+    return frame;
+}
+
+uint32_t FramePool::latestSeq()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t seq = latest != NULL ? latest->seq : 0;
+    xSemaphoreGive(lock);
+    return seq;
+}
+
+void FramePool::notifyOnFrame(TaskHandle_t task)
+{
+    frameListener = task;
+}
+
+void FramePool::release(PooledFrame *frame)
+{
+    if (frame == NULL)
+        return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    frame->refs--;
+    xSemaphoreGive(lock);
+}
+
+FramePoolStats FramePool::getStats()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    FramePoolStats copy = stats;
+    xSemaphoreGive(lock);
+    return copy;
+}
+
+// A slot nobody reads and that is not the newest frame. Readers only ever
+// acquire the newest frame, so the producer can fill it without the lock.
+PooledFrame *FramePool::findFreeSlot()
+{
+    PooledFrame *slot = NULL;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < slotCount && slot == NULL; i++)
+    {
+        if (frames[i].refs == 0 && &frames[i] != latest)
+            slot = &frames[i];
+    }
+    xSemaphoreGive(lock);
+    return slot;
+}
+
+void FramePool::producerEntry(void *arg)
+{
+    static_cast<FramePool *>(arg)->produce();
+}
+
+void FramePool::produce()
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true)
+    {
+        if (frameIntervalMs > 0)
+            vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(frameIntervalMs));
+
+        int64_t waitStartUs = esp_timer_get_time();
+        camera_fb_t *fb = esp_camera_fb_get();
+        int64_t captureUs = esp_timer_get_time();
+        cameraMetrics.capture.record(captureUs - waitStartUs);
+        if (!fb)
+        {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            stats.captureFailures++;
+            xSemaphoreGive(lock);
+            Serial.println("Camera capture failed.");
+            vTaskDelay(pdMS_TO_TICKS(100));
+            lastWake = xTaskGetTickCount();
+            continue;
+        }
+
+        size_t len = fb->len;
+        PooledFrame *slot = len <= slotSize ? findFreeSlot() : NULL;
+        if (slot != NULL)
+        {
+            memcpy(slot->buf, fb->buf, len);
+            cameraMetrics.poolCopy.record(esp_timer_get_time() - captureUs);
+            slot->len = len;
+            slot->width = fb->width;
+            slot->height = fb->height;
+            slot->captureUs = captureUs;
+            slot->timestamp = fb->timestamp;
+        }
+        esp_camera_fb_return(fb);
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        if (slot != NULL)
+        {
+            slot->seq = ++nextSeq;
+            latest = slot;
+            stats.produced++;
+        }
+        else if (len > slotSize)
+        {
+            stats.oversized++;
+        }
+        else
+        {
+            stats.droppedNoSlot++;
+        }
+        xSemaphoreGive(lock);
+
+        TaskHandle_t listener = frameListener;
+        if (slot != NULL && listener != NULL)
+            xTaskNotifyGive(listener);
+    }
+}
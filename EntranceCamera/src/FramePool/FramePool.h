@@ -0,0 +1,82 @@
+#pragma once
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <sys/time.h>
+
+// JPEG frame copied out of the camera driver into a pool slot
+struct PooledFrame
+{
+    uint8_t *buf;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint32_t seq;      // Increases by one per produced frame
+    int64_t captureUs; // esp_timer time the frame was grabbed
+    struct timeval timestamp; // Capture wall clock time from the driver
+    uint16_t refs;     // Readers holding the frame, guarded by the pool lock
+};
+
+struct FramePoolStats
+{
+    uint32_t produced;
+    uint32_t droppedNoSlot; // Every slot was held by a reader
+    uint32_t oversized;     // Frame larger than a slot
+    uint32_t captureFailures;
+};
+
+// Owns the camera: a producer task grabs frames (grab-latest, so the sensor
+// never waits for a reader) and copies each one into a free PSRAM slot.
+// Readers take a reference to the newest frame, send it at their own pace and
+// release it; a slow reader only pins its own slot and skips ahead to the
+// newest frame when it is done, so it never holds the others back.
+class FramePool
+{
+public:
+    FramePool();
+
+    bool begin(uint8_t slots, size_t slotSize);
+    void startProducer(BaseType_t core);
+
+    // Minimum time between two produced frames, 0 for sensor rate
+    void setFrameInterval(uint32_t intervalMs);
+
+    // Newest frame with a sequence number above afterSeq, with a reference
+    // held; NULL if there is none yet
+    PooledFrame *acquireLatest(uint32_t afterSeq = 0);
+
+    // acquireLatest(), waiting up to timeoutMs for a newer frame
+    PooledFrame *waitForFrame(uint32_t afterSeq, uint32_t timeoutMs);
+
+    // Sequence number of the newest frame, 0 before the first one
+    uint32_t latestSeq();
+
+    // Task given a notification (xTaskNotifyGive) after every new frame
+    void notifyOnFrame(TaskHandle_t task);
+
+    void release(PooledFrame *frame);
+
+    FramePoolStats getStats();
+
+private:
+    static void producerEntry(void *arg);
+    void produce();
+    PooledFrame *findFreeSlot();
+
+    PooledFrame *frames;
+    uint8_t slotCount;
+    size_t slotSize;
+    PooledFrame *latest;
+    uint32_t nextSeq;
+    volatile uint32_t frameIntervalMs;
+    TaskHandle_t volatile frameListener;
+    SemaphoreHandle_t lock;
+    FramePoolStats stats;
+};
+
+#endif
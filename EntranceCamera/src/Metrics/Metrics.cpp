@@ -0,0 +1,77 @@
+#include "Metrics.h"
+
+// Upper bucket bounds in microseconds
+static const uint32_t bucketBounds[LATENCY_BUCKETS] = {
+    500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000};
+
+CameraMetrics cameraMetrics;
+
+CameraMetrics::CameraMetrics()
+    : capture("camera_capture_seconds", "Time spent waiting for a sensor frame"),
+      poolCopy("camera_pool_copy_seconds", "Time to copy a frame into the frame pool"),
+      frameAge("camera_frame_age_seconds", "Frame age when a stream starts sending it"),
+      streamSend("camera_stream_send_seconds", "Time to hand one frame to a stream socket"),
+      snapshot("camera_snapshot_seconds", "Time to serve one /capture request"),
+      motion("camera_motion_analyze_seconds", "Motion detector decode and diff time"),
+      thumbEncode("camera_thumb_encode_seconds", "Time to decode, downscale and encode one thumbnail"),
+      thumb("camera_thumb_seconds", "Time to serve one /thumb request")
+{
+}
+
+LatencyHistogram::LatencyHistogram(const char *name, const char *help)
+    : name(name), help(help), sumMicros(0), count(0)
+{
+    portMUX_INITIALIZE(&mux);
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void LatencyHistogram::record(uint32_t micros)
+{
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS && micros > bucketBounds[bucket])
+        bucket++;
+
+    portENTER_CRITICAL(&mux);
+    buckets[bucket]++;
+    sumMicros += micros;
+    count++;
+    portEXIT_CRITICAL(&mux);
+}
+
+size_t LatencyHistogram::format(char *buf, size_t size)
+{
+    uint32_t snapshot[LATENCY_BUCKETS + 1];
+    portENTER_CRITICAL(&mux);
+    memcpy(snapshot, buckets, sizeof(snapshot));
+    uint64_t sum = sumMicros;
+    uint32_t total = count;
+    portEXIT_CRITICAL(&mux);
+
+    size_t length = 0;
+    int written = snprintf(buf, size, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    if (written < 0 || (size_t)written >= size)
+        return 0;
+    length += written;
+
+    uint32_t cumulative = 0;
+    for (int i = 0; i <= LATENCY_BUCKETS; i++)
+    {
+        cumulative += snapshot[i];
+        if (i < LATENCY_BUCKETS)
+            written = snprintf(buf + length, size - length, "%s_bucket{le=\"%u.%06u\"} %u\n", name,
+                               (unsigned)(bucketBounds[i] / 1000000), (unsigned)(bucketBounds[i] % 1000000),
+                               (unsigned)cumulative);
+        else
+            written = snprintf(buf + length, size - length, "%s_bucket{le=\"+Inf\"} %u\n", name, (unsigned)cumulative);
+        if (written < 0 || (size_t)written >= size - length)
+            return 0;
+        length += written;
+    }
+
+    written = snprintf(buf + length, size - length, "%s_sum %llu.%06llu\n%s_count %u\n", name,
+                       (unsigned long long)(sum / 1000000), (unsigned long long)(sum % 1000000), name,
+                       (unsigned)total);
+    if (written < 0 || (size_t)written >= size - length)
+        return 0;
+    return length + written;
+}
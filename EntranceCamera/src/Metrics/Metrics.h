@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+#define LATENCY_BUCKETS 12
+
+// Fixed-memory latency histogram with Prometheus-style cumulative output.
+// record() is a few instructions under a spinlock, so any task can call it
+// on its hot path.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(const char *name, const char *help);
+
+    void record(uint32_t micros);
+
+    // Appends the histogram in Prometheus text format; returns the length
+    // written, 0 if it did not fit
+    size_t format(char *buf, size_t size);
+
+private:
+    const char *name;
+    const char *help;
+    portMUX_TYPE mux;
+    uint32_t buckets[LATENCY_BUCKETS + 1]; // Last one is +Inf
+    uint64_t sumMicros;
+    uint32_t count;
+};
+
+// Stage timings of the camera pipeline, exposed at /metrics. The sensor
+// produces JPEG itself, the only CPU encode is the one for thumbnails.
+struct CameraMetrics
+{
+    LatencyHistogram capture;     // Waiting for esp_camera_fb_get()
+    LatencyHistogram poolCopy;    // Copying the JPEG into a pool slot
+    LatencyHistogram frameAge;    // Capture until a stream starts sending the frame
+    LatencyHistogram streamSend;  // Handing one frame to a stream socket
+    LatencyHistogram snapshot;    // Whole /capture request
+    LatencyHistogram motion;      // Motion detector decode and diff
+    LatencyHistogram thumbEncode; // Scaled decode and encode of a thumbnail
+    LatencyHistogram thumb;       // Whole /thumb request, cache hits included
+
+    CameraMetrics();
+};
+
+extern CameraMetrics cameraMetrics;
+
+#endif
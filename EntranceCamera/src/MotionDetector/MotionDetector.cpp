@@ -0,0 +1,207 @@
+#include "MotionDetector.h"
+#include "img_converters.h"
+#include "esp_timer.h"
+#include "../Metrics/Metrics.h"
+
+#define MOTION_MAX_WIDTH ((800 + 7) / 8) // SVGA at 1/8 scale
+#define MOTION_MAX_HEIGHT ((600 + 7) / 8)
+#define MOTION_SAMPLE_INTERVAL_MS 250
+#define MOTION_PIXEL_THRESHOLD 24 // Luma change that counts a pixel as changed
+#define MOTION_SCORE_THRESHOLD 20 // Changed pixels per mille that count as motion
+#define MOTION_CONFIRM_SAMPLES 2  // Consecutive motion samples before an event
+#define MOTION_COOLDOWN_MS 10000
+#define MOTION_STATS_INTERVAL_MS 60000
+#define MOTION_TASK_STACK 8192
+
+#define MOTION_KERNEL_BLOCK 4096 // Pixels between flushes of the 16-bit lane counters
+
+// Two pixels in the low bytes of 16-bit lanes. 256 + a - b never borrows
+// from the next lane, and the biases carry into bit 15 when the difference
+// is beyond the threshold either way; 1 per such lane. The ESP32 has no
+// SIMD unit, and 8-bit lanes need three saturating subtracts per word.
+static inline uint32_t changedLanes(uint32_t a, uint32_t b, uint32_t above, uint32_t below)
+{
+    uint32_t diff = (a | 0x01000100u) - b;
+    return (((diff + above) | (below - diff)) & 0x80008000u) >> 15;
+}
+
+MotionDetector::MotionDetector(FramePool &pool, const char *boardName)
+    : pool(pool), boardName(boardName), rgb(NULL), luma(NULL), reference(NULL), width(0), height(0),
+      hasReference(false)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool MotionDetector::begin(const String &address, BaseType_t core)
+{
+    size_t pixels = MOTION_MAX_WIDTH * MOTION_MAX_HEIGHT;
+    rgb = (uint8_t *)malloc(pixels * 2);
+    luma = (uint8_t *)malloc(pixels);
+    reference = (uint8_t *)malloc(pixels);
+    if (rgb == NULL || luma == NULL || reference == NULL)
+    {
+        Serial.println("Not enough memory for motion detection.");
+        return false;
+    }
+
+    hubAddress = address;
+    xTaskCreatePinnedToCore(taskEntry, "motion", MOTION_TASK_STACK, this, 1, NULL, core);
+    return true;
+}
+
+MotionStats MotionDetector::getStats() const
+{
+    return stats;
+}
+
+void MotionDetector::printStats()
+{
+    Serial.println("Motion: " + String(stats.samples) + " samples, score last " + String(stats.lastScore) +
+                   ", max " + String(stats.maxScore) + ", analyze last " + String(stats.lastAnalyzeUs) +
+                   " us, max " + String(stats.maxAnalyzeUs) + " us, " + String(stats.events) + " events, " +
+                   String(stats.uploadFailures) + " failed uploads, " + String(stats.decodeFailures) +
+                   " decode failures");
+}
+
+uint16_t MotionDetector::changedPermille(const uint8_t *current, const uint8_t *reference, size_t count,
+                                         uint8_t threshold)
+{
+    if (count == 0)
+        return 0;
+
+    uint32_t above = (0x7FFFu - 256 - threshold) * 0x00010001u; // Bit 15 once a - b > threshold
+    uint32_t below = (0x8000u + 255 - threshold) * 0x00010001u; // Bit 15 once b - a > threshold
+    uint32_t changed = 0;
+    size_t words = count & ~(size_t)3;
+    size_t i = 0;
+    while (i < words)
+    {
+        uint32_t lanes = 0; // Two 16-bit counters
+        size_t end = min(words, i + MOTION_KERNEL_BLOCK);
+        for (; i < end; i += 4)
+        {
+            uint32_t a, b;
+            memcpy(&a, current + i, 4);
+            memcpy(&b, reference + i, 4);
+            lanes += changedLanes(a & 0x00FF00FFu, b & 0x00FF00FFu, above, below);
+            lanes += changedLanes((a >> 8) & 0x00FF00FFu, (b >> 8) & 0x00FF00FFu, above, below);
+        }
+        changed += (lanes & 0xFFFF) + (lanes >> 16);
+    }
+    for (; i < count; i++)
+    {
+        int diff = current[i] - reference[i];
+        if (diff > threshold || -diff > threshold)
+            changed++;
+    }
+    return changed * 1000 / count;
+}
+
+void MotionDetector::taskEntry(void *arg)
+{
+    static_cast<MotionDetector *>(arg)->run();
+}
+
+void MotionDetector::run()
+{
+    hub.begin(hubAddress);
+
+    uint32_t lastSeq = 0;
+    uint8_t motionSamples = 0;
+    unsigned long lastEventMs = 0;
+    unsigned long lastStatsPrint = millis();
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(MOTION_SAMPLE_INTERVAL_MS));
+
+        if (millis() - lastStatsPrint > MOTION_STATS_INTERVAL_MS)
+        {
+            printStats();
+            lastStatsPrint = millis();
+        }
+
+        PooledFrame *frame = pool.acquireLatest(lastSeq);
+        if (frame == NULL)
+            continue;
+        lastSeq = frame->seq;
+
+        uint16_t score = 0;
+        if (analyze(frame, score) && score >= MOTION_SCORE_THRESHOLD)
+            motionSamples++;
+        else
+            motionSamples = 0;
+
+        bool coolingDown = stats.events > 0 && millis() - lastEventMs < MOTION_COOLDOWN_MS;
+        if (motionSamples >= MOTION_CONFIRM_SAMPLES && !coolingDown)
+        {
+            stats.events++;
+            lastEventMs = millis();
+            motionSamples = 0;
+            Serial.println("Motion detected, score " + String(score));
+            upload(frame, score);
+        }
+        pool.release(frame);
+    }
+}
+
+// Decodes the frame at 1/8 scale and scores it against the previous sample
+bool MotionDetector::analyze(PooledFrame *frame, uint16_t &score)
+{
+    int64_t start = esp_timer_get_time();
+    uint16_t w = (frame->width + 7) / 8;
+    uint16_t h = (frame->height + 7) / 8;
+    if (w > MOTION_MAX_WIDTH || h > MOTION_MAX_HEIGHT || !jpg2rgb565(frame->buf, frame->len, rgb, JPG_SCALE_8X))
+    {
+        stats.decodeFailures++;
+        return false;
+    }
+
+    // A resolution change makes the previous sample useless
+    if (w != width || h != height)
+    {
+        width = w;
+        height = h;
+        hasReference = false;
+    }
+
+    size_t pixels = (size_t)w * h;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        // jpg2rgb565 stores the high byte first
+        uint8_t hi = rgb[i * 2];
+        uint8_t lo = rgb[i * 2 + 1];
+        uint32_t r = hi & 0xF8;
+        uint32_t g = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+        uint32_t b = (lo & 0x1F) << 3;
+        luma[i] = (r * 77 + g * 150 + b * 29) >> 8;
+    }
+
+    score = hasReference ? changedPermille(luma, reference, pixels, MOTION_PIXEL_THRESHOLD) : 0;
+    uint8_t *previous = reference;
+    reference = luma;
+    luma = previous;
+    hasReference = true;
+
+    stats.samples++;
+    stats.lastScore = score;
+    stats.maxScore = max(stats.maxScore, score);
+    stats.lastAnalyzeUs = esp_timer_get_time() - start;
+    cameraMetrics.motion.record(stats.lastAnalyzeUs);
+    stats.maxAnalyzeUs = max(stats.maxAnalyzeUs, stats.lastAnalyzeUs);
+    return true;
+}
+
+void MotionDetector::upload(PooledFrame *frame, uint16_t score)
+{
+    if (!hub.isConfigured())
+        return;
+
+    char path[96];
+    snprintf(path, sizeof(path), "/motion_snapshot?name=%s&score=%u", boardName, score);
+    int httpCode = hub.post(path, frame->buf, frame->len, "image/jpeg");
+    if (httpCode != 200)
+    {
+        stats.uploadFailures++;
+        Serial.println("Failed to upload motion snapshot. HTTP code: " + String(httpCode));
+    }
+}
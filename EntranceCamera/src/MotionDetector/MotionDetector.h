@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef MOTION_DETECTOR_H
+#define MOTION_DETECTOR_H
+
+#include <Arduino.h>
+#include <HubClient.h>
+#include "../FramePool/FramePool.h"
+
+struct MotionStats
+{
+    uint32_t samples;
+    uint32_t decodeFailures;
+    uint32_t events;
+    uint32_t uploadFailures;
+    uint16_t lastScore; // Changed pixels per mille
+    uint16_t maxScore;
+    uint32_t lastAnalyzeUs; // Decode + grayscale + diff of one sample
+    uint32_t maxAnalyzeUs;
+};
+
+// Watches the frame pool for motion. A few times a second the newest JPEG
+// is decoded at 1/8 scale, reduced to 8-bit luma and compared with the
+// previous sample; when enough pixels changed on consecutive samples the
+// frame is posted to the hub with its motion score, at most once per
+// cooldown. Runs in its own task with its own hub connection.
+class MotionDetector
+{
+public:
+    MotionDetector(FramePool &pool, const char *boardName);
+
+    bool begin(const String &hubAddress, BaseType_t core = 0);
+
+    MotionStats getStats() const;
+    void printStats();
+
+    // Pixels per mille whose luma differs by more than threshold between
+    // the two buffers, four pixels per 32-bit word in 16-bit lanes
+    static uint16_t changedPermille(const uint8_t *current, const uint8_t *reference, size_t count,
+                                    uint8_t threshold);
+
+private:
+    static void taskEntry(void *arg);
+    void run();
+    bool analyze(PooledFrame *frame, uint16_t &score);
+    void upload(PooledFrame *frame, uint16_t score);
+
+    FramePool &pool;
+    const char *boardName;
+    String hubAddress;
+    HubClient hub; // Owned by the detector task
+
+    uint8_t *rgb;       // Decoded 1/8 scale frame, RGB565
+    uint8_t *luma;      // Luma of the newest sample
+    uint8_t *reference; // Luma of the previous sample
+    uint16_t width;
+    uint16_t height;
+    bool hasReference;
+
+    MotionStats stats;
+};
+
+#endif
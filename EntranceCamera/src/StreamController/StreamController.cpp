@@ -0,0 +1,104 @@
+#include "StreamController.h"
+#include <algorithm>
+
+#define CONTROLLER_CALM_PERIODS 2 // Calm periods before stepping up again
+#define CONTROLLER_QUALITY_BACKOFF 5
+#define CONTROLLER_INTERVAL_STEP_MS 10
+
+StreamController::StreamController(const StreamLimits &limits, const StreamSettings &initial, uint16_t targetSendMs,
+                                   uint32_t maxKbps)
+    : limits(limits), initial(initial), settings(initial), targetSendMs(targetSendMs), maxKbps(maxKbps),
+      smoothedSendMs(0), kbps(0), calmPeriods(0)
+{
+}
+
+bool StreamController::update(const StreamWindow &window, uint32_t periodMs)
+{
+    // Nothing sent: keep the settings until there is something to measure
+    if (window.frames == 0 || periodMs == 0)
+        return false;
+
+    uint16_t meanSendMs = window.sendMs / window.frames;
+    smoothedSendMs = smoothedSendMs == 0 ? meanSendMs : (smoothedSendMs * 3 + meanSendMs) / 4;
+    kbps = window.bytes * 8 / periodMs;
+
+    StreamSettings before = settings;
+    bool congested = meanSendMs > targetSendMs + targetSendMs / 4 || (maxKbps > 0 && kbps > maxKbps);
+    bool calm = smoothedSendMs < targetSendMs / 2 && (maxKbps == 0 || kbps < maxKbps * 3 / 4);
+
+    if (congested)
+    {
+        calmPeriods = 0;
+        backOff();
+    }
+    else if (calm && ++calmPeriods >= CONTROLLER_CALM_PERIODS)
+    {
+        calmPeriods = 0;
+        recover();
+    }
+    else if (!calm)
+    {
+        calmPeriods = 0;
+    }
+
+    return before.intervalMs != settings.intervalMs || before.quality != settings.quality ||
+           before.sizeStep != settings.sizeStep;
+}
+
+// Multiplicative decrease of quality and frame rate; smaller frames once
+// both are exhausted
+void StreamController::backOff()
+{
+    if (settings.quality >= limits.worstQuality && settings.intervalMs >= limits.maxIntervalMs)
+    {
+        if (settings.sizeStep > 0)
+        {
+            settings.sizeStep--;
+            settings.quality = (limits.bestQuality + limits.worstQuality) / 2;
+        }
+        return;
+    }
+
+    settings.quality = std::min<int>(limits.worstQuality, settings.quality + CONTROLLER_QUALITY_BACKOFF);
+    settings.intervalMs = std::min<int>(limits.maxIntervalMs, settings.intervalMs * 3 / 2);
+}
+
+// Additive increase: frame rate first, then quality, then resolution. The
+// interval and quality stop at the initial settings or the limits, whichever
+// is more conservative.
+void StreamController::recover()
+{
+    int fastestMs = std::max<int>(limits.minIntervalMs, initial.intervalMs);
+    int bestQuality = std::max<int>(limits.bestQuality, initial.quality);
+    if (settings.intervalMs > fastestMs)
+    {
+        // A fixed step in frames per second, so recovery from 1 fps is not glacial
+        int step = std::max<int>(CONTROLLER_INTERVAL_STEP_MS, settings.intervalMs / 5);
+        settings.intervalMs = std::max<int>(fastestMs, settings.intervalMs - step);
+    }
+    else if (settings.quality > bestQuality)
+    {
+        settings.quality--;
+    }
+    else if (settings.sizeStep + 1 < limits.sizeSteps)
+    {
+        // A bigger frame at the best quality would overshoot right away
+        settings.sizeStep++;
+        settings.quality = std::min<int>(limits.worstQuality, settings.quality + CONTROLLER_QUALITY_BACKOFF);
+    }
+}
+
+StreamSettings StreamController::getSettings() const
+{
+    return settings;
+}
+
+uint16_t StreamController::lastSendMs() const
+{
+    return smoothedSendMs;
+}
+
+uint32_t StreamController::lastKbps() const
+{
+    return kbps;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef STREAM_CONTROLLER_H
+#define STREAM_CONTROLLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// What the controller steers. sizeStep indexes a resolution ladder owned by
+// the caller, 0 being the smallest frame size.
+struct StreamSettings
+{
+    uint16_t intervalMs; // Time between produced frames
+    uint8_t quality;     // esp32-camera JPEG quality, lower is better
+    uint8_t sizeStep;
+};
+
+// What one viewer sent during a control period
+struct StreamWindow
+{
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t sendMs; // Sum over the frames
+};
+
+struct StreamLimits
+{
+    uint16_t minIntervalMs;
+    uint16_t maxIntervalMs;
+    uint8_t bestQuality;
+    uint8_t worstQuality;
+    uint8_t sizeSteps;
+};
+
+// Closed-loop frame rate / quality / resolution control for the link of
+// one viewer. Once per control period update() compares the mean send time
+// of the frames sent (and optionally the bitrate) with the target and
+// adjusts the settings AIMD style: back off multiplicatively as soon as the
+// link is congested, recover additively only after several calm periods.
+// Quality and frame rate go first, the resolution only changes once both
+// are at their limit. Recovery stops at the initial settings, the rate and
+// quality the camera was configured for.
+//
+// Plain arithmetic without locks or FreeRTOS: the caller collects the
+// windows, and a recorded link trace can be replayed off the device.
+class StreamController
+{
+public:
+    StreamController(const StreamLimits &limits, const StreamSettings &initial, uint16_t targetSendMs,
+                     uint32_t maxKbps = 0);
+
+    // Call once per control period with what was sent during it; true if
+    // the settings changed
+    bool update(const StreamWindow &window, uint32_t periodMs);
+
+    StreamSettings getSettings() const;
+    uint16_t lastSendMs() const;
+    uint32_t lastKbps() const;
+
+private:
+    void backOff();
+    void recover();
+
+    StreamLimits limits;
+    StreamSettings initial;
+    StreamSettings settings;
+    uint16_t targetSendMs;
+    uint32_t maxKbps;
+
+    uint16_t smoothedSendMs; // EWMA of the per-period mean send time
+    uint32_t kbps;
+    uint8_t calmPeriods;
+};
+
+#endif
@@ -0,0 +1,600 @@
+#include "StreamServer.h"
+#include <ESPAsyncWebServer.h>
+#include <JsonWriter.h>
+#include "esp_timer.h"
+#include "../Metrics/Metrics.h"
+
+#define CLIP_DEFAULT_PRE_S 5
+#define CLIP_DEFAULT_POST_S 5
+#define CLIP_MAX_S 30
+#define CLIP_END_GRACE_US 2000000 // Wait this long past the clip end for its last frames
+#define STREAM_PACER_STACK 3072
+#define STREAM_PACER_PRIORITY 3 // Same as async_tcp
+#define STREAM_PACER_CORE 1
+
+static const char *STREAM_CONTENT_TYPE = "multipart/x-mixed-replace; boundary=frame";
+// Sequence numbers let clients count dropped frames, the capture timestamp
+// (same format as the esp32-camera example server) their end-to-end latency
+static const char *STREAM_PART = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                                 "X-Frame-Seq: %u\r\nX-Timestamp: %ld.%06ld\r\n\r\n";
+
+struct StreamClientStats
+{
+    uint32_t id;
+    uint32_t startMs;
+    uint32_t frames;
+    uint32_t dropped; // Frames skipped while sending an older one or held back by the pacing
+};
+
+class JpegStreamResponse;
+
+// One slot per connected viewer. Responses fill in their stats and window
+// on the async_tcp task, updateControl() and printStats() read them from
+// the loop task, so both sides take clientsMux. intervalMs is only written
+// by updateControl() and read by the response on its own.
+struct StreamClient
+{
+    bool active;
+    bool fresh; // Claimed since the last control update, its controller starts over
+    StreamClientStats stats;
+    StreamWindow window;
+    volatile uint16_t intervalMs;
+    // Set by a response with no frame due; the pacer resumes it once dueUs
+    // has passed and the pool has a frame newer than lastSeq
+    JpegStreamResponse *parked;
+    int64_t dueUs;
+    uint32_t lastSeq;
+    volatile bool resuming; // The pacer is sending for it, the response must wait before going away
+};
+
+static portMUX_TYPE clientsMux = portMUX_INITIALIZER_UNLOCKED;
+static StreamClient clients[STREAM_MAX_CLIENTS];
+static TaskHandle_t pacerTask = NULL;
+
+static StreamClient *claimClient(uint32_t id, uint16_t intervalMs)
+{
+    StreamClient *client = NULL;
+    portENTER_CRITICAL(&clientsMux);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (!clients[i].active)
+        {
+            client = &clients[i];
+            memset(client, 0, sizeof(*client));
+            client->active = true;
+            client->fresh = true;
+            client->stats.id = id;
+            client->stats.startMs = millis();
+            client->intervalMs = intervalMs;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&clientsMux);
+    return client;
+}
+
+static void releaseClient(StreamClient *client)
+{
+    portENTER_CRITICAL(&clientsMux);
+    client->active = false;
+    portEXIT_CRITICAL(&clientsMux);
+}
+
+static float framesPerSecond(const StreamClientStats &stats)
+{
+    uint32_t elapsedMs = millis() - stats.startMs;
+    return elapsedMs > 0 ? stats.frames * 1000.0f / elapsedMs : 0.0f;
+}
+
+// One part of a multipart JPEG response: part header, JPEG and the
+// trailing CRLF, handed out in pieces as the socket accepts them. The JPEG
+// is read in place, never copied.
+class MultipartFrame
+{
+public:
+    MultipartFrame() : jpeg(NULL), jpegLen(0), headerLen(0), offset(0) {}
+
+    void start(const uint8_t *data, size_t len, uint32_t seq, const struct timeval &timestamp)
+    {
+        jpeg = data;
+        jpegLen = len;
+        headerLen = snprintf(header, sizeof(header), STREAM_PART, (unsigned int)len, (unsigned int)seq,
+                             (long)timestamp.tv_sec, (long)timestamp.tv_usec);
+        offset = 0;
+    }
+
+    size_t fill(uint8_t *buf, size_t maxLen)
+    {
+        size_t written = 0;
+        while (written < maxLen && offset < length())
+        {
+            const uint8_t *src;
+            size_t available;
+            if (offset < headerLen)
+            {
+                src = (const uint8_t *)header + offset;
+                available = headerLen - offset;
+            }
+            else if (offset < headerLen + jpegLen)
+            {
+                src = jpeg + (offset - headerLen);
+                available = headerLen + jpegLen - offset;
+            }
+            else
+            {
+                src = (const uint8_t *)"\r\n" + (offset - headerLen - jpegLen);
+                available = length() - offset;
+            }
+
+            size_t count = min(available, maxLen - written);
+            memcpy(buf + written, src, count);
+            written += count;
+            offset += count;
+        }
+        return written;
+    }
+
+    bool done() const
+    {
+        return offset == length();
+    }
+
+    size_t length() const
+    {
+        return headerLen + jpegLen + 2;
+    }
+
+private:
+    const uint8_t *jpeg;
+    size_t jpegLen;
+    char header[144];
+    size_t headerLen;
+    size_t offset;
+};
+
+// Chunked multipart response. _fillBuffer() is called by the async_tcp task
+// whenever the socket can take more data and copies as much of the current
+// part (header, JPEG, trailing CRLF) as fits; once a part is complete it
+// moves on to the newest frame in the pool, but not before the viewer's
+// interval has passed since the previous part started. It never waits:
+// async_tcp serves every viewer and the other routes, so one viewer's
+// pacing must not hold it. Without a frame due it parks in its client slot
+// and returns RESPONSE_TRY_AGAIN; with nothing in flight AsyncTCP would
+// only call again on its poll about 500 ms later, so the pacer task calls
+// _ack() once the frame is due. sendLock keeps the pacer and async_tcp
+// from filling at the same time.
+class JpegStreamResponse : public AsyncAbstractResponse
+{
+public:
+    JpegStreamResponse(FramePool &pool, uint16_t intervalMs)
+        : pool(pool), request(NULL), frame(NULL), lastSeq(0), partStartUs(0)
+    {
+        static uint32_t nextClientId = 1;
+
+        _callback = nullptr;
+        _code = 200;
+        _contentLength = 0;
+        _contentType = STREAM_CONTENT_TYPE;
+        _sendContentLength = false;
+        _chunked = true;
+
+        // Responses are created on the async_tcp task after a slot count
+        // check on the same task, so there is always a free slot
+        client = claimClient(nextClientId++, intervalMs);
+        sendLock = xSemaphoreCreateMutex();
+        Serial.println("Stream client " + String(client->stats.id) + " connected.");
+    }
+
+    ~JpegStreamResponse()
+    {
+        // Out of the pacer's reach before anything goes away
+        portENTER_CRITICAL(&clientsMux);
+        client->parked = NULL;
+        portEXIT_CRITICAL(&clientsMux);
+        while (client->resuming)
+            vTaskDelay(1);
+        vSemaphoreDelete(sendLock);
+
+        pool.release(frame);
+        StreamClientStats &stats = client->stats;
+        Serial.println("Stream client " + String(stats.id) + " disconnected: " + String(stats.frames) + " frames, " +
+                       String(framesPerSecond(stats), 1) + " fps, " + String(stats.dropped) + " dropped.");
+        releaseClient(client);
+    }
+
+    bool _sourceValid() const
+    {
+        return true;
+    }
+
+    void _respond(AsyncWebServerRequest *request) override
+    {
+        this->request = request;
+        AsyncAbstractResponse::_respond(request);
+    }
+
+    size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time) override
+    {
+        xSemaphoreTake(sendLock, portMAX_DELAY);
+        size_t sent = AsyncAbstractResponse::_ack(request, len, time);
+        xSemaphoreGive(sendLock);
+        return sent;
+    }
+
+    // From the pacer task, with the next frame due
+    void resume()
+    {
+        _ack(request, 0, 0);
+    }
+
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+        if (frame == NULL && !nextFrame())
+        {
+            park();
+            return RESPONSE_TRY_AGAIN;
+        }
+
+        size_t written = part.fill(buf, maxLen);
+        if (part.done())
+        {
+            uint32_t sendUs = esp_timer_get_time() - partStartUs;
+            cameraMetrics.streamSend.record(sendUs);
+
+            portENTER_CRITICAL(&clientsMux);
+            client->window.frames++;
+            client->window.bytes += part.length();
+            client->window.sendMs += sendUs / 1000;
+            client->stats.frames++;
+            portEXIT_CRITICAL(&clientsMux);
+
+            pool.release(frame);
+            frame = NULL;
+        }
+        return written;
+    }
+
+private:
+    bool nextFrame()
+    {
+        // Paced by the viewer's own controller, skipped frames count as
+        // dropped
+        if (lastSeq != 0 && esp_timer_get_time() < partStartUs + (int64_t)client->intervalMs * 1000)
+            return false;
+
+        frame = pool.acquireLatest(lastSeq);
+        if (frame == NULL)
+            return false;
+
+        portENTER_CRITICAL(&clientsMux);
+        client->parked = NULL;
+        if (lastSeq != 0)
+            client->stats.dropped += frame->seq - lastSeq - 1;
+        portEXIT_CRITICAL(&clientsMux);
+        lastSeq = frame->seq;
+
+        part.start(frame->buf, frame->len, frame->seq, frame->timestamp);
+        partStartUs = esp_timer_get_time();
+        cameraMetrics.frameAge.record(partStartUs - frame->captureUs);
+        return true;
+    }
+
+    // Leaves the next frame to the pacer, which is woken on the first call
+    void park()
+    {
+        portENTER_CRITICAL(&clientsMux);
+        bool wasParked = client->parked != NULL;
+        client->parked = this;
+        client->dueUs = lastSeq != 0 ? partStartUs + (int64_t)client->intervalMs * 1000 : 0;
+        client->lastSeq = lastSeq;
+        portEXIT_CRITICAL(&clientsMux);
+        if (!wasParked && pacerTask != NULL)
+            xTaskNotifyGive(pacerTask);
+    }
+
+    FramePool &pool;
+    AsyncWebServerRequest *request;
+    SemaphoreHandle_t sendLock;
+    StreamClient *client;
+    PooledFrame *frame; // Held until its whole part has been queued
+    uint32_t lastSeq;
+    MultipartFrame part;
+    int64_t partStartUs;
+};
+
+// Pre-roll plus post-roll from the event ring as one multipart response.
+// Frames are sent from the ring arena while pinned; post-roll frames are
+// picked up as the recorder adds them and the response ends once a frame
+// past the clip end shows up.
+class EventClipResponse : public AsyncAbstractResponse
+{
+public:
+    EventClipResponse(EventRing &ring, uint32_t preS, uint32_t postS)
+        : ring(ring), frame(NULL), lastSeq(0), frames(0)
+    {
+        _callback = nullptr;
+        _code = 200;
+        _contentLength = 0;
+        _contentType = STREAM_CONTENT_TYPE;
+        _sendContentLength = false;
+        _chunked = true;
+
+        int64_t now = esp_timer_get_time();
+        sinceUs = now - (int64_t)preS * 1000000;
+        endUs = now + (int64_t)postS * 1000000;
+        ring.countClip();
+    }
+
+    ~EventClipResponse()
+    {
+        ring.unpin(frame);
+        Serial.println("Event clip sent: " + String(frames) + " frames.");
+    }
+
+    bool _sourceValid() const
+    {
+        return true;
+    }
+
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+        if (frame == NULL)
+        {
+            frame = ring.pinNext(lastSeq, sinceUs);
+            if (frame != NULL && frame->captureUs > endUs)
+            {
+                ring.unpin(frame);
+                return 0; // Clip complete, ends the chunked response
+            }
+            if (frame == NULL)
+                return esp_timer_get_time() > endUs + CLIP_END_GRACE_US ? 0 : RESPONSE_TRY_AGAIN;
+
+            lastSeq = frame->seq;
+            part.start(frame->buf, frame->len, frame->seq, frame->timestamp);
+        }
+
+        size_t written = part.fill(buf, maxLen);
+        if (part.done())
+        {
+            frames++;
+            ring.unpin(frame);
+            frame = NULL;
+        }
+        return written;
+    }
+
+private:
+    EventRing &ring;
+    ClipFrame *frame; // Pinned until its whole part has been queued
+    uint32_t lastSeq;
+    int64_t sinceUs;
+    int64_t endUs;
+    MultipartFrame part;
+    uint32_t frames;
+};
+
+static uint32_t clipSeconds(AsyncWebServerRequest *request, const char *name, uint32_t fallback)
+{
+    if (!request->hasParam(name))
+        return fallback;
+    long seconds = request->getParam(name)->value().toInt();
+    return seconds < 0 ? 0 : min(seconds, (long)CLIP_MAX_S);
+}
+
+StreamServer::StreamServer(FramePool &pool, const StreamController &controller)
+    : pool(pool), initialController(controller), settings(controller.getSettings()), server(NULL)
+{
+    memset(controllers, 0, sizeof(controllers));
+}
+
+void StreamServer::begin()
+{
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+        controllers[i] = new StreamController(initialController);
+
+    server = new AsyncWebServer(STREAM_PORT);
+    server->on("/live_video", HTTP_GET, [this](AsyncWebServerRequest *request)
+               {
+                   // Responses are created and destroyed on the async_tcp task only,
+                   // so the count cannot change between this check and the response
+                   if (clientCount() >= STREAM_MAX_CLIENTS)
+                   {
+                       request->send(503, "text/plain", "Too many stream clients");
+                       return;
+                   }
+
+                   AsyncWebServerResponse *response = new JpegStreamResponse(pool, initialController.getSettings().intervalMs);
+                   response->addHeader("Access-Control-Allow-Origin", "*");
+                   request->send(response); });
+    xTaskCreatePinnedToCore(pacerEntry, "stream_pacer", STREAM_PACER_STACK, this, STREAM_PACER_PRIORITY, &pacerTask,
+                            STREAM_PACER_CORE);
+    pool.notifyOnFrame(pacerTask);
+
+    server->begin();
+    Serial.println("Stream server listening on port " + String(STREAM_PORT));
+}
+
+void StreamServer::pacerEntry(void *arg)
+{
+    static_cast<StreamServer *>(arg)->pace();
+}
+
+// Resumes parked viewers whose frame is due and in the pool. Woken by
+// responses as they park and by the producer on every new frame, otherwise
+// sleeps until the next parked viewer is due.
+void StreamServer::pace()
+{
+    while (true)
+    {
+        int64_t now = esp_timer_get_time();
+        uint32_t newestSeq = pool.latestSeq();
+        int64_t nextDueUs = INT64_MAX;
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+        {
+            JpegStreamResponse *response = NULL;
+            portENTER_CRITICAL(&clientsMux);
+            StreamClient &client = clients[i];
+            if (client.parked != NULL)
+            {
+                if (client.dueUs > now)
+                {
+                    if (client.dueUs < nextDueUs)
+                        nextDueUs = client.dueUs;
+                }
+                else if (newestSeq > client.lastSeq)
+                {
+                    response = client.parked;
+                    client.parked = NULL;
+                    client.resuming = true;
+                }
+            }
+            portEXIT_CRITICAL(&clientsMux);
+
+            if (response != NULL)
+            {
+                response->resume();
+                client.resuming = false;
+            }
+        }
+
+        TickType_t wait = portMAX_DELAY;
+        if (nextDueUs != INT64_MAX)
+            wait = pdMS_TO_TICKS((nextDueUs - now + 999) / 1000);
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+void StreamServer::serveEventClips(EventRing &ring)
+{
+    // /event_clip?pre=<s>&post=<s>
+    server->on("/event_clip", HTTP_GET, [&ring](AsyncWebServerRequest *request)
+               {
+                   uint32_t preS = clipSeconds(request, "pre", CLIP_DEFAULT_PRE_S);
+                   uint32_t postS = clipSeconds(request, "post", CLIP_DEFAULT_POST_S);
+                   AsyncWebServerResponse *response = new EventClipResponse(ring, preS, postS);
+                   response->addHeader("Access-Control-Allow-Origin", "*");
+                   request->send(response); });
+
+    server->on("/event_ring", HTTP_GET, [&ring](AsyncWebServerRequest *request)
+               {
+                   EventRingStats s = ring.getStats();
+                   JsonWriter<320> json;
+                   json.beginObject()
+                       .field(JSON_KEY("frames"), (unsigned int)s.frames)
+                       .field(JSON_KEY("bytes_used"), (unsigned long)s.bytesUsed)
+                       .field(JSON_KEY("bytes_total"), (unsigned long)s.bytesTotal)
+                       .field(JSON_KEY("span_ms"), (unsigned long)s.spanMs)
+                       .field(JSON_KEY("recorded"), (unsigned long)s.recorded)
+                       .field(JSON_KEY("evicted"), (unsigned long)s.evicted)
+                       .field(JSON_KEY("pinned_drops"), (unsigned long)s.pinnedDrops)
+                       .field(JSON_KEY("oversized"), (unsigned long)s.oversized)
+                       .field(JSON_KEY("clips_served"), (unsigned long)s.clipsServed)
+                       .endObject();
+                   request->send(200, "application/json", json.c_str()); });
+}
+
+bool StreamServer::updateControl(uint32_t periodMs)
+{
+    StreamWindow windows[STREAM_MAX_CLIENTS];
+    bool active[STREAM_MAX_CLIENTS];
+    bool fresh[STREAM_MAX_CLIENTS];
+    portENTER_CRITICAL(&clientsMux);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        windows[i] = clients[i].window;
+        memset(&clients[i].window, 0, sizeof(clients[i].window));
+        active[i] = clients[i].active;
+        fresh[i] = clients[i].fresh;
+        clients[i].fresh = false;
+    }
+    portEXIT_CRITICAL(&clientsMux);
+
+    // The camera produces for the most demanding viewer, the others are
+    // paced down by their own intervals
+    StreamSettings wanted = {UINT16_MAX, UINT8_MAX, 0};
+    uint16_t intervals[STREAM_MAX_CLIENTS];
+    bool anyActive = false;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (!active[i])
+            continue;
+        if (fresh[i])
+            *controllers[i] = initialController;
+        controllers[i]->update(windows[i], periodMs);
+
+        StreamSettings viewer = controllers[i]->getSettings();
+        intervals[i] = viewer.intervalMs;
+        wanted.intervalMs = min(wanted.intervalMs, viewer.intervalMs);
+        wanted.quality = min(wanted.quality, viewer.quality);
+        wanted.sizeStep = max(wanted.sizeStep, viewer.sizeStep);
+        anyActive = true;
+    }
+
+    // A slot released and claimed again meanwhile keeps its initial interval
+    portENTER_CRITICAL(&clientsMux);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (active[i] && clients[i].active && !clients[i].fresh)
+            clients[i].intervalMs = intervals[i];
+    }
+    portEXIT_CRITICAL(&clientsMux);
+
+    // Nobody watching: keep the settings until there is something to measure
+    if (!anyActive)
+        return false;
+
+    StreamSettings before = settings;
+    settings = wanted;
+    return before.intervalMs != settings.intervalMs || before.quality != settings.quality ||
+           before.sizeStep != settings.sizeStep;
+}
+
+StreamSettings StreamServer::getSettings() const
+{
+    return settings;
+}
+
+uint8_t StreamServer::clientCount()
+{
+    uint8_t count = 0;
+    portENTER_CRITICAL(&clientsMux);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (clients[i].active)
+            count++;
+    }
+    portEXIT_CRITICAL(&clientsMux);
+    return count;
+}
+
+void StreamServer::printStats()
+{
+    FramePoolStats poolStats = pool.getStats();
+    Serial.println("Frame pool: " + String(poolStats.produced) + " produced, " + String(poolStats.droppedNoSlot) +
+                   " dropped (no free slot), " + String(poolStats.oversized) + " oversized, " +
+                   String(poolStats.captureFailures) + " capture failures");
+
+    StreamClientStats snapshot[STREAM_MAX_CLIENTS];
+    int slots[STREAM_MAX_CLIENTS];
+    int count = 0;
+    portENTER_CRITICAL(&clientsMux);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (clients[i].active)
+        {
+            slots[count] = i;
+            snapshot[count++] = clients[i].stats;
+        }
+    }
+    portEXIT_CRITICAL(&clientsMux);
+
+    for (int i = 0; i < count; i++)
+    {
+        // Controllers are only touched by updateControl(), on this task
+        const StreamController *controller = controllers[slots[i]];
+        Serial.println("Stream client " + String(snapshot[i].id) + ": " + String(framesPerSecond(snapshot[i]), 1) +
+                       " fps, " + String(snapshot[i].frames) + " frames, " + String(snapshot[i].dropped) +
+                       " dropped, " + String(controller->getSettings().intervalMs) + " ms interval, send " +
+                       String(controller->lastSendMs()) + " ms, " + String(controller->lastKbps()) + " kbps");
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef STREAM_SERVER_H
+#define STREAM_SERVER_H
+
+#include <Arduino.h>
+#include "../FramePool/FramePool.h"
+#include "../StreamController/StreamController.h"
+#include "../EventRing/EventRing.h"
+
+#define STREAM_PORT 81
+#define STREAM_MAX_CLIENTS 4 // Further viewers get 503 instead of starving the others
+
+// ESPAsyncWebServer and esp_http_server both declare HTTP_GET, so the async
+// server is kept out of this header and main.cpp only sees this class.
+class AsyncWebServer;
+
+// MJPEG fan-out of the frame pool on its own port. Every /live_video client
+// gets its own response that always sends the newest pooled frame, and its
+// own StreamController that paces it from its send times, so a slow viewer
+// gets fewer frames instead of slowing the others down. The camera runs at
+// the settings of the most demanding viewer: shortest interval, best
+// quality, largest frame size. A viewer waiting for its next frame with
+// nothing in flight is resumed by a pacer task once the frame is due.
+class StreamServer
+{
+public:
+    // Every new viewer's controller starts out as a copy of controller
+    StreamServer(FramePool &pool, const StreamController &controller);
+
+    void begin();
+
+    // Adds /event_clip and the /event_ring stats; call after begin()
+    void serveEventClips(EventRing &ring);
+
+    // Call once per control period: runs every viewer's controller over
+    // what it sent since the last call. True if the camera settings changed.
+    bool updateControl(uint32_t periodMs);
+
+    // What the camera should run at for the current viewers
+    StreamSettings getSettings() const;
+
+    uint8_t clientCount();
+
+    // Logs fps, dropped frames and pacing of every connected client; call
+    // from the task that calls updateControl()
+    void printStats();
+
+private:
+    static void pacerEntry(void *arg);
+    void pace();
+
+    FramePool &pool;
+    StreamController initialController;
+    StreamController *controllers[STREAM_MAX_CLIENTS]; // One per client slot
+    StreamSettings settings;
+    AsyncWebServer *server;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "ThumbnailCache.h"
+#include "img_converters.h"
+#include "esp_timer.h"
+#include "../Metrics/Metrics.h"
+
+// Decoder scale of each cache entry, entry i is 1/2^(i+1) of the frame
+static const jpg_scale_t thumbScales[THUMB_SCALES] = {JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X};
+
+ThumbnailCache::ThumbnailCache(FramePool &pool)
+    : pool(pool), rgb(NULL), rgbSize(0), quality(0), lock(NULL), frameWidth(0)
+{
+    portMUX_INITIALIZE(&mux);
+    memset(cache, 0, sizeof(cache));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool ThumbnailCache::begin(uint16_t maxFrameWidth, uint16_t maxFrameHeight, uint8_t jpegQuality)
+{
+    rgbSize = (size_t)((maxFrameWidth + 1) / 2) * ((maxFrameHeight + 1) / 2) * 2;
+    rgb = (uint8_t *)ps_malloc(rgbSize);
+    lock = xSemaphoreCreateMutex();
+    if (rgb == NULL || lock == NULL)
+    {
+        Serial.println("Not enough memory for thumbnails.");
+        return false;
+    }
+    quality = jpegQuality;
+    return true;
+}
+
+const Thumbnail *ThumbnailCache::acquire(uint16_t minWidth, uint32_t maxAgeMs, uint32_t timeoutMs)
+{
+    if (lock == NULL)
+        return NULL;
+
+    // Within its age bucket a thumbnail is served without the lock or a frame.
+    // The frame width may be stale after a resolution change, reuse() checks
+    // the entry itself is still wide enough.
+    uint16_t width = frameWidth;
+    if (width != 0)
+    {
+        Thumbnail *thumb = reuse(scaleIndex(width, minWidth), minWidth, width, maxAgeMs, 0);
+        if (thumb != NULL)
+            return thumb;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    PooledFrame *frame = pool.waitForFrame(0, timeoutMs);
+    if (frame == NULL)
+    {
+        xSemaphoreGive(lock);
+        return NULL;
+    }
+
+    // A request ahead of this one may have made it while this one waited,
+    // or the camera has nothing newer than the cached thumbnail
+    uint8_t index = scaleIndex(frame->width, minWidth);
+    Thumbnail *thumb = reuse(index, minWidth, frame->width, maxAgeMs, frame->seq);
+    if (thumb == NULL)
+    {
+        thumb = encode(frame, index);
+        if (thumb != NULL)
+        {
+            frameWidth = frame->width;
+            replace(index, thumb);
+        }
+        else
+        {
+            portENTER_CRITICAL(&mux);
+            stats.failures++;
+            portEXIT_CRITICAL(&mux);
+        }
+    }
+    pool.release(frame);
+    xSemaphoreGive(lock);
+    return thumb;
+}
+
+void ThumbnailCache::release(const Thumbnail *thumb)
+{
+    if (thumb == NULL)
+        return;
+    Thumbnail *held = (Thumbnail *)thumb;
+    portENTER_CRITICAL(&mux);
+    bool last = --held->refs == 0;
+    portEXIT_CRITICAL(&mux);
+    if (last)
+        drop(held);
+}
+
+// Smallest scale that still gives the requested width, never upscaled
+uint8_t ThumbnailCache::scaleIndex(uint16_t frameWidth, uint16_t minWidth)
+{
+    uint8_t index = THUMB_SCALES - 1;
+    while (index > 0 && (frameWidth >> (index + 1)) < minWidth)
+        index--;
+    return index;
+}
+
+// The cached entry with a reference taken, if it is young enough or made
+// from newestSeq, and at least minWidth wide or as wide as a frame width
+// pixels wide allows. An entry made before a resolution change can be
+// narrower; it is left to be made again.
+Thumbnail *ThumbnailCache::reuse(uint8_t index, uint16_t minWidth, uint16_t width, uint32_t maxAgeMs,
+                                 uint32_t newestSeq)
+{
+    uint16_t neededWidth = min(minWidth, (uint16_t)((width + 1) / 2));
+    uint32_t now = millis();
+    Thumbnail *thumb = NULL;
+    portENTER_CRITICAL(&mux);
+    Thumbnail *cached = cache[index];
+    if (cached != NULL && cached->width >= neededWidth &&
+        (now - cached->madeMs < maxAgeMs || cached->seq == newestSeq))
+    {
+        cached->refs++;
+        stats.hits++;
+        thumb = cached;
+    }
+    portEXIT_CRITICAL(&mux);
+    return thumb;
+}
+
+// Makes thumb the entry, holding a reference for the caller; the old entry
+// is freed once its last reader is done
+void ThumbnailCache::replace(uint8_t index, Thumbnail *thumb)
+{
+    thumb->refs = 2;
+    portENTER_CRITICAL(&mux);
+    Thumbnail *old = cache[index];
+    cache[index] = thumb;
+    bool last = old != NULL && --old->refs == 0;
+    stats.encodes++;
+    stats.lastEncodeUs = thumb->encodeUs;
+    stats.maxEncodeUs = max(stats.maxEncodeUs, thumb->encodeUs);
+    portEXIT_CRITICAL(&mux);
+    if (last)
+        drop(old);
+}
+
+Thumbnail *ThumbnailCache::encode(PooledFrame *frame, uint8_t index)
+{
+    int64_t start = esp_timer_get_time();
+    uint8_t divisor = 2 << index;
+    uint16_t w = (frame->width + divisor - 1) / divisor;
+    uint16_t h = (frame->height + divisor - 1) / divisor;
+    size_t rgbLen = (size_t)w * h * 2;
+    if (rgbLen > rgbSize || !jpg2rgb565(frame->buf, frame->len, rgb, thumbScales[index]))
+        return NULL;
+
+    Thumbnail *thumb = (Thumbnail *)malloc(sizeof(Thumbnail));
+    if (thumb == NULL)
+        return NULL;
+    thumb->jpeg = NULL;
+    if (!fmt2jpg(rgb, rgbLen, w, h, PIXFORMAT_RGB565, quality, &thumb->jpeg, &thumb->len))
+    {
+        free(thumb);
+        return NULL;
+    }
+    thumb->width = w;
+    thumb->height = h;
+    thumb->seq = frame->seq;
+    thumb->madeMs = millis();
+    thumb->timestamp = frame->timestamp;
+    thumb->refs = 0;
+    thumb->encodeUs = esp_timer_get_time() - start;
+    cameraMetrics.thumbEncode.record(thumb->encodeUs);
+    return thumb;
+}
+
+void ThumbnailCache::drop(Thumbnail *thumb)
+{
+    free(thumb->jpeg);
+    free(thumb);
+}
+
+ThumbnailStats ThumbnailCache::getStats()
+{
+    portENTER_CRITICAL(&mux);
+    ThumbnailStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+}
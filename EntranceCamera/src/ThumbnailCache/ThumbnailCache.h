@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <sys/time.h>
+#include "../FramePool/FramePool.h"
+
+#define THUMB_SCALES 3 // 1/2, 1/4 and 1/8 of the frame
+
+struct Thumbnail
+{
+    uint8_t *jpeg;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint32_t seq;    // Pool frame it was made from
+    uint32_t madeMs; // millis() of the encode, starts its age bucket
+    uint32_t encodeUs;
+    struct timeval timestamp;
+    uint16_t refs;   // The cache entry and each reader, guarded by the cache
+};
+
+struct ThumbnailStats
+{
+    uint32_t hits;     // Served from the cache
+    uint32_t encodes;  // New frame, decoded and encoded again
+    uint32_t failures;
+    uint32_t lastEncodeUs;
+    uint32_t maxEncodeUs;
+};
+
+// Downscaled JPEGs of the newest pool frame, for previews that do not need
+// the full frame. The JPEG decoder scales by 1/2, 1/4 or 1/8 while it
+// decodes, so a thumbnail costs one scaled decode plus a small encode. A
+// thumbnail is reused for every request of its size until it is older than
+// the age the request accepts, whatever the camera produced meanwhile, so
+// pollers share one encode per age bucket instead of one per frame.
+// Readers hold a reference rather than a lock: a slow send keeps its own
+// copy alive and never holds up the next request or encode.
+class ThumbnailCache
+{
+public:
+    ThumbnailCache(FramePool &pool);
+
+    // Decode buffer for the largest thumbnail, half the given frame size
+    bool begin(uint16_t maxFrameWidth, uint16_t maxFrameHeight, uint8_t quality);
+
+    // Thumbnail at the smallest scale that is still at least minWidth wide,
+    // at most maxAgeMs old or made from the newest frame (maxAgeMs 0 asks
+    // for the newest). Held until release(); NULL without a frame within
+    // timeoutMs or when it could not be made.
+    const Thumbnail *acquire(uint16_t minWidth, uint32_t maxAgeMs, uint32_t timeoutMs);
+    void release(const Thumbnail *thumb);
+
+    ThumbnailStats getStats();
+
+private:
+    static uint8_t scaleIndex(uint16_t frameWidth, uint16_t minWidth);
+    Thumbnail *reuse(uint8_t index, uint16_t minWidth, uint16_t width, uint32_t maxAgeMs, uint32_t newestSeq);
+    void replace(uint8_t index, Thumbnail *thumb);
+    Thumbnail *encode(PooledFrame *frame, uint8_t index);
+    static void drop(Thumbnail *thumb);
+
+    FramePool &pool;
+    uint8_t *rgb;
+    size_t rgbSize;
+    uint8_t quality;
+    SemaphoreHandle_t lock; // One encode at a time, they share rgb
+    portMUX_TYPE mux;       // Cache entries, references and stats
+    volatile uint16_t frameWidth; // Of the last frame encoded, 0 before; only a hint for the fast path
+    Thumbnail *cache[THUMB_SCALES];
+    ThumbnailStats stats;
+};
+
+#endif
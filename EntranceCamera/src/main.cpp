@@ -2,20 +2,103 @@
 #include "esp_camera.h"
 #include "WiFi.h"
 #include "esp_http_server.h"
-#include <HTTPClient.h>
+#include <HubClient.h>
+#include <WiFiSupervisor.h>
+#include <HubDiscovery.h>
+#include <UdpHeartbeat.h>
+#include <BoardRuntime.h>
 #include "esp_timer.h"
 #include "img_converters.h"
 #include "Arduino.h"
 #include "camera_pins.h"
 #include "credentials.h"
+#include "FramePool/FramePool.h"
+#include "StreamServer/StreamServer.h"
+#include "MotionDetector/MotionDetector.h"
+#include "EventRing/EventRing.h"
+#include "Metrics/Metrics.h"
+#include "ThumbnailCache/ThumbnailCache.h"
+
+#define FRAME_POOL_SLOTS (STREAM_MAX_CLIENTS + 5) // Newest, one being filled, motion, event ring, thumbnails and streams
+#define FRAME_SLOT_SIZE (96 * 1024) // Largest SVGA JPEG kept, bigger frames are dropped
+#define FRAME_INTERVAL_MS 100 // About 10 fps, like the old inline stream
+#define EVENT_RING_BYTES (1536 * 1024) // About 7 s of SVGA frames at the record interval
+#define EVENT_RING_MAX_FRAMES 64
+#define EVENT_RING_INTERVAL_MS 200
+#define STREAM_TARGET_SEND_MS 120 // Per-frame send time the stream controller steers toward
+#define STREAM_MAX_KBPS 0 // Optional bitrate cap per viewer, 0 for none
+#define STREAM_CONTROL_PERIOD_MS 1000
+#define STREAM_STATS_INTERVAL_MS 10000
+#define THUMB_MAX_FRAME_WIDTH 800 // Largest size on the stream ladder (SVGA)
+#define THUMB_MAX_FRAME_HEIGHT 600
+#define THUMB_DEFAULT_WIDTH 160
+#define THUMB_DEFAULT_MAX_AGE_MS 1000 // Thumbnails are reused this long unless the request asks otherwise
+#define THUMB_JPEG_QUALITY 60 // fmt2jpg scale, 0-100
+
+// Snapshot server: above the frame producer and async_tcp so a busy stream
+// never delays /capture, and few sockets since only the hub and web UI call it
+#define SNAPSHOT_SERVER_PRIORITY 6
+#define SNAPSHOT_SERVER_CORE 1
+#define SNAPSHOT_MAX_SOCKETS 4
+#define SNAPSHOT_SEND_TIMEOUT_S 2
+
+// Longest setup() waits for an address before starting the servers anyway
+#define WIFI_BOOT_TIMEOUT_MS 10000
 
 // Wi-Fi credentials
 const char *ssid = SSID;
 const char *password = PASSWORD;
+WiFiSupervisor wifi(ssid, password);
 String hub_address = String(HUB);
+HubClient hub;
 
-const char *board_name = "EntranceCamera";
-int board_status_milis = 0;
+// The camera takes no hub commands
+constexpr BoardDescriptor board = BOARD_DESCRIPTOR("EntranceCamera");
+
+const char *board_name = board.name;
+HubDiscovery hubDiscovery(board_name); // Local hub over mDNS, cloud URL as fallback
+UdpHeartbeat heartbeat(board_name);    // Signed UDP heartbeat to the LAN hub
+
+// Registration and heartbeat
+BoardRuntime runtime(board, wifi, hub, hubDiscovery, heartbeat);
+
+unsigned long stream_stats_milis = 0;
+unsigned long stream_control_milis = 0;
+
+// /capture handling time, written by the snapshot server task
+volatile uint32_t snapshot_count = 0;
+volatile uint32_t snapshot_last_ms = 0;
+volatile uint32_t snapshot_max_ms = 0;
+
+// Hub link and heartbeat counters as of the last loop() pass. HubClient and
+// UdpHeartbeat are only touched from loop(), so /metrics reads this copy.
+struct HubLinkSnapshot
+{
+    HubBreakerState breaker;
+    HubClientStats hub;
+    HeartbeatStats heartbeat;
+};
+static HubLinkSnapshot hub_snapshot = {};
+static portMUX_TYPE hub_snapshot_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Frames are produced once and shared by /capture and every stream client
+FramePool framePool;
+
+// Downscaled copies of the newest frame for /thumb
+ThumbnailCache thumbnails(framePool);
+// Random per boot and part of every /thumb ETag: millis() and the frame
+// sequence start over after a reset, so a cached ETag must not match again
+uint32_t thumb_boot_id = 0;
+
+// Resolution ladder of the stream controller, the last entry is the configured size
+const framesize_t stream_frame_sizes[] = {FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA};
+const StreamLimits stream_limits = {50, 1000, 10, 40, sizeof(stream_frame_sizes) / sizeof(stream_frame_sizes[0])};
+const StreamSettings stream_initial = {FRAME_INTERVAL_MS, 12, 2}; // Same as camera_config
+// Every stream viewer gets a copy of this controller when it connects
+StreamController streamController(stream_limits, stream_initial, STREAM_TARGET_SEND_MS, STREAM_MAX_KBPS);
+StreamServer streamServer(framePool, streamController);
+MotionDetector motionDetector(framePool, board_name);
+EventRing eventRing;
 
 // HTTP server handle
 httpd_handle_t camera_httpd = NULL;
@@ -44,63 +127,16 @@ camera_config_t camera_config = {
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE_SVGA,
     .jpeg_quality = 12,
-    .fb_count = 1};
+    .fb_count = 2, // The sensor fills one buffer while the producer copies the other
+    .fb_location = CAMERA_FB_IN_PSRAM,
+    .grab_mode = CAMERA_GRAB_LATEST};
 
 // Function prototypes
-bool connectToWiFi(const char *ssid, const char *password);
 void startServer();
 static esp_err_t capture_handler(httpd_req_t *req);
 static esp_err_t live_video_handler(httpd_req_t *req);
-
-// Wi-Fi setup
-bool connectToWiFi(const char *ssid, const char *password)
-{
-    WiFi.begin(ssid, password);
-    Serial.print("Connecting to Wi-Fi: ");
-    Serial.println(ssid);
-
-    int retries = 20; // Retry limit
-    while (WiFi.status() != WL_CONNECTED && retries > 0)
-    {
-        delay(500);
-        Serial.print(".");
-        retries--;
-    }
-
-    if (WiFi.status() == WL_CONNECTED)
-    {
-        Serial.println("\nConnected to Wi-Fi: " + String(ssid));
-        Serial.println("IP Address: " + WiFi.localIP().toString());
-        return true;
-    }
-    else
-    {
-        Serial.println("\nFailed to connect to Wi-Fi: " + String(ssid));
-        return false;
-    }
-}
-
-// Register the board with the hub
-void registerBoard()
-{
-    if (hub_address == "")
-        return;
-    HTTPClient http;
-    http.begin(hub_address + "/register");
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"name\":\"" + String(board_name) + "\",\"ip\":\"" + WiFi.localIP().toString() + "\"}";
-    int httpCode = http.POST(payload);
-    if (httpCode == 200)
-    {
-        Serial.println("Board registered successfully.");
-    }
-    else
-    {
-        Serial.println("Failed to register board. HTTP code: " + String(httpCode));
-    }
-    http.end();
-}
+static esp_err_t metrics_handler(httpd_req_t *req);
+static esp_err_t thumb_handler(httpd_req_t *req);
 
 esp_err_t test_handler(httpd_req_t *req)
 {
@@ -113,6 +149,11 @@ esp_err_t test_handler(httpd_req_t *req)
 void startServer()
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.task_priority = SNAPSHOT_SERVER_PRIORITY;
+    config.core_id = SNAPSHOT_SERVER_CORE;
+    config.max_open_sockets = SNAPSHOT_MAX_SOCKETS;
+    config.lru_purge_enable = true; // Close idle keep-alive sockets instead of refusing new clients
+    config.send_wait_timeout = SNAPSHOT_SEND_TIMEOUT_S;
 
     httpd_uri_t capture_uri = {
         .uri = "/capture",
@@ -125,80 +166,199 @@ void startServer()
         .method = HTTP_GET,
         .handler = live_video_handler,
         .user_ctx = NULL};
+
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = NULL};
+
+    httpd_uri_t thumb_uri = {
+        .uri = "/thumb",
+        .method = HTTP_GET,
+        .handler = thumb_handler,
+        .user_ctx = NULL};
     if (httpd_start(&camera_httpd, &config) == ESP_OK)
     {
         httpd_register_uri_handler(camera_httpd, &capture_uri);
         httpd_register_uri_handler(camera_httpd, &live_video_uri);
+        httpd_register_uri_handler(camera_httpd, &metrics_uri);
+        httpd_register_uri_handler(camera_httpd, &thumb_uri);
     }
 }
 
 static esp_err_t capture_handler(httpd_req_t *req)
 {
-    for (int retries = 0; retries < 3; retries++)
+    int64_t startUs = esp_timer_get_time();
+    PooledFrame *frame = framePool.waitForFrame(0, 1000);
+    if (!frame)
     {
-        camera_fb_t *fb = esp_camera_fb_get();
-        if (fb)
-        {
-            // Send image if capture is successful
-            httpd_resp_set_type(req, "image/jpeg");
-            httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
-            esp_err_t res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
-            esp_camera_fb_return(fb);
-            return res;
-        }
-        else
-        {
-            Serial.println("Camera capture failed. Retrying...");
-            delay(100);
-        }
+        Serial.println("No camera frame available.");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
     }
-    // After retries, send an error response
-    httpd_resp_send_500(req);
-    return ESP_FAIL;
+
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+
+    // Same frame headers as the MJPEG parts
+    char seq[12];
+    char timestamp[24];
+    snprintf(seq, sizeof(seq), "%u", (unsigned int)frame->seq);
+    snprintf(timestamp, sizeof(timestamp), "%ld.%06ld", (long)frame->timestamp.tv_sec, (long)frame->timestamp.tv_usec);
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    httpd_resp_set_hdr(req, "X-Timestamp", timestamp);
+
+    esp_err_t res = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+    framePool.release(frame);
+
+    uint32_t elapsedUs = esp_timer_get_time() - startUs;
+    cameraMetrics.snapshot.record(elapsedUs);
+    snapshot_last_ms = elapsedUs / 1000;
+    snapshot_max_ms = max((uint32_t)snapshot_max_ms, (uint32_t)snapshot_last_ms);
+    snapshot_count++;
+    return res;
 }
 
-// Live video stream route
-static esp_err_t live_video_handler(httpd_req_t *req)
+// Downscaled JPEG of the newest frame, /thumb?w=<minimum width>&max_age=<ms>.
+// The size is the smallest of 1/2, 1/4 and 1/8 of the frame that is at least
+// that wide. A thumbnail up to max_age old is served from the cache, 0 asks
+// for the newest frame. The ETag is the boot id, the size and the encode
+// time, so a dashboard that polls with If-None-Match gets a 304 until the
+// thumbnail is made again or the camera restarts.
+static esp_err_t thumb_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "multipart/x-mixed-replace; boundary=frame");
+    int64_t startUs = esp_timer_get_time();
+    uint16_t minWidth = THUMB_DEFAULT_WIDTH;
+    uint32_t maxAgeMs = THUMB_DEFAULT_MAX_AGE_MS;
+    char query[48];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    {
+        if (httpd_query_key_value(query, "w", value, sizeof(value)) == ESP_OK)
+            minWidth = atoi(value);
+        if (httpd_query_key_value(query, "max_age", value, sizeof(value)) == ESP_OK)
+            maxAgeMs = strtoul(value, NULL, 10);
+    }
 
-    while (true)
+    const Thumbnail *thumb = thumbnails.acquire(minWidth, maxAgeMs, 1000);
+    if (!thumb)
     {
-        camera_fb_t *fb = esp_camera_fb_get();
-        if (!fb)
-        {
-            Serial.println("Camera frame failed");
-            return ESP_FAIL;
-        }
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
 
-        char part_buf[64];
-        size_t hlen = snprintf((char *)part_buf, 64, "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", fb->len);
-        if (httpd_resp_send_chunk(req, (const char *)part_buf, hlen) != ESP_OK)
-        {
-            esp_camera_fb_return(fb);
-            Serial.println("Client disconnected.");
-            break;
-        }
+    char etag[40];
+    char ifNoneMatch[40];
+    snprintf(etag, sizeof(etag), "\"%08lx-%u-%lu\"", (unsigned long)thumb_boot_id, (unsigned int)thumb->width,
+             (unsigned long)thumb->madeMs);
+    httpd_resp_set_hdr(req, "ETag", etag);
 
-        if (httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len) != ESP_OK)
-        {
-            esp_camera_fb_return(fb);
-            Serial.println("Client disconnected.");
-            break;
-        }
+    esp_err_t res;
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", ifNoneMatch, sizeof(ifNoneMatch)) == ESP_OK &&
+        strcmp(ifNoneMatch, etag) == 0)
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        res = httpd_resp_send(req, NULL, 0);
+    }
+    else
+    {
+        char seq[12];
+        char timestamp[24];
+        snprintf(seq, sizeof(seq), "%u", (unsigned int)thumb->seq);
+        snprintf(timestamp, sizeof(timestamp), "%ld.%06ld", (long)thumb->timestamp.tv_sec,
+                 (long)thumb->timestamp.tv_usec);
+        httpd_resp_set_type(req, "image/jpeg");
+        httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=thumb.jpg");
+        httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+        httpd_resp_set_hdr(req, "X-Timestamp", timestamp);
+        res = httpd_resp_send(req, (const char *)thumb->jpeg, thumb->len);
+    }
+    thumbnails.release(thumb);
+
+    cameraMetrics.thumb.record(esp_timer_get_time() - startUs);
+    return res;
+}
+
+// Live video moved to the stream server, keep the old URL working
+static esp_err_t live_video_handler(httpd_req_t *req)
+{
+    IPAddress ip = WiFi.localIP();
+    char location[48];
+    snprintf(location, sizeof(location), "http://%u.%u.%u.%u:%d/live_video", ip[0], ip[1], ip[2], ip[3], STREAM_PORT);
 
-        esp_camera_fb_return(fb);
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", location);
+    return httpd_resp_send(req, NULL, 0);
+}
 
-        if (httpd_resp_send_chunk(req, "\r\n", 2) != ESP_OK)
+// Prometheus text format: stage histograms followed by pipeline counters
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    LatencyHistogram *histograms[] = {&cameraMetrics.capture, &cameraMetrics.poolCopy, &cameraMetrics.frameAge,
+                                      &cameraMetrics.streamSend, &cameraMetrics.snapshot, &cameraMetrics.motion,
+                                      &cameraMetrics.thumbEncode, &cameraMetrics.thumb};
+    const size_t bufferSize = 2048;
+    char *buf = (char *)malloc(bufferSize);
+    if (!buf)
+    {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++)
+    {
+        size_t length = histograms[i]->format(buf, bufferSize);
+        if (length > 0 && httpd_resp_send_chunk(req, buf, length) != ESP_OK)
         {
-            Serial.println("Client disconnected.");
-            break;
+            free(buf);
+            return ESP_FAIL;
         }
-
-        delay(100); // Adjust delay for frame rate
     }
 
-    return ESP_OK;
+    FramePoolStats pool = framePool.getStats();
+    EventRingStats ring = eventRing.getStats();
+    MotionStats motion = motionDetector.getStats();
+    ThumbnailStats thumb = thumbnails.getStats();
+    portENTER_CRITICAL(&hub_snapshot_mux);
+    HubLinkSnapshot link = hub_snapshot;
+    portEXIT_CRITICAL(&hub_snapshot_mux);
+    int length = snprintf(buf, bufferSize,
+                          "camera_frames_produced_total %u\n"
+                          "camera_frames_dropped_total{reason=\"no_slot\"} %u\n"
+                          "camera_frames_dropped_total{reason=\"oversized\"} %u\n"
+                          "camera_capture_failures_total %u\n"
+                          "camera_stream_clients %u\n"
+                          "camera_snapshots_total %u\n"
+                          "camera_event_ring_frames %u\n"
+                          "camera_event_ring_bytes_used %u\n"
+                          "camera_event_ring_evicted_total %u\n"
+                          "camera_event_ring_pinned_drops_total %u\n"
+                          "camera_motion_events_total %u\n"
+                          "camera_hub_breaker_state %u\n"
+                          "camera_hub_breaker_trips_total %lu\n"
+                          "camera_hub_requests_refused_total %lu\n"
+                          "camera_hub_deadline_misses_total %lu\n"
+                          "camera_heartbeat_udp_sent_total %lu\n"
+                          "camera_heartbeat_udp_failures_total %lu\n"
+                          "camera_heartbeat_udp_encode_max_us %lu\n"
+                          "camera_thumb_cache_hits_total %u\n"
+                          "camera_thumb_encodes_total %u\n"
+                          "camera_thumb_failures_total %u\n",
+                          (unsigned)pool.produced, (unsigned)pool.droppedNoSlot, (unsigned)pool.oversized,
+                          (unsigned)pool.captureFailures, (unsigned)streamServer.clientCount(),
+                          (unsigned)snapshot_count, (unsigned)ring.frames, (unsigned)ring.bytesUsed,
+                          (unsigned)ring.evicted, (unsigned)ring.pinnedDrops, (unsigned)motion.events,
+                          (unsigned)link.breaker, link.hub.trips, link.hub.shortCircuits, link.hub.deadlineMisses,
+                          (unsigned long)link.heartbeat.sent, (unsigned long)link.heartbeat.sendFailures,
+                          (unsigned long)link.heartbeat.maxEncodeUs, (unsigned)thumb.hits,
+                          (unsigned)thumb.encodes, (unsigned)thumb.failures);
+    esp_err_t res = httpd_resp_send_chunk(req, buf, min(length, (int)bufferSize - 1));
+    free(buf);
+    if (res == ESP_OK)
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    return res;
 }
 
 void setup()
@@ -206,9 +366,13 @@ void setup()
     Serial.begin(115200);
     Serial.println("Starting ESP32-CAM...");
 
-    delay(1000);
+    // Association and DHCP run on core 0 while the sensor comes up here
+    wifi.start(0);
+    heartbeat.begin(HEARTBEAT_KEY);
+    // random() draws from the hardware RNG, which is seeded by the radio
+    thumb_boot_id = random(0x7FFFFFFF);
 
-    // Initialize the camera
+    unsigned long phaseStart = millis();
     if (esp_camera_init(&camera_config) != ESP_OK)
     {
         Serial.println("Camera initialization failed. Please check the wiring and power supply.");
@@ -217,45 +381,109 @@ void setup()
             delay(1000); // Halt execution
         }
     }
+    unsigned long cameraMs = millis() - phaseStart;
 
-    if (connectToWiFi(ssid, password))
-    {
-        Serial.println("Wi-Fi connected.");
-    }
-    else
+    phaseStart = millis();
+    if (!framePool.begin(FRAME_POOL_SLOTS, FRAME_SLOT_SIZE))
     {
-        Serial.println("Wi-Fi connection failed.");
+        Serial.println("Frame pool allocation failed. Is PSRAM enabled?");
         while (true)
         {
             delay(1000); // Halt execution
         }
     }
+    framePool.setFrameInterval(FRAME_INTERVAL_MS);
+    thumbnails.begin(THUMB_MAX_FRAME_WIDTH, THUMB_MAX_FRAME_HEIGHT, THUMB_JPEG_QUALITY);
+    framePool.startProducer(1);
 
-    registerBoard();
-
-    // Register the camera with the hub
+    // Pre-event footage is optional, the camera works without it
+    bool eventRingReady = eventRing.begin(EVENT_RING_BYTES, EVENT_RING_MAX_FRAMES, EVENT_RING_INTERVAL_MS);
+    if (eventRingReady)
+    {
+        eventRing.startRecorder(framePool, 1);
+    }
+    unsigned long buffersMs = millis() - phaseStart;
+
+    // Usually already up by now. No halt when Wi-Fi is down: the supervisor
+    // keeps reconnecting and the servers answer once the link is back.
+    phaseStart = millis();
+    bool online = wifi.waitConnected(WIFI_BOOT_TIMEOUT_MS);
+    unsigned long wifiWaitMs = millis() - phaseStart;
+    hub.begin(hub_address);
+    runtime.begin(hub_address);
+
+    // Snapshot and stream servers
+    phaseStart = millis();
     startServer();
+    streamServer.begin();
+    if (eventRingReady)
+    {
+        streamServer.serveEventClips(eventRing);
+    }
+    unsigned long serversMs = millis() - phaseStart;
+    motionDetector.begin(hub_address, 0);
+
+    // Registration with the hub runs from loop(), it never holds up the servers
+    Serial.println("Boot: camera " + String(cameraMs) + " ms, buffers " + String(buffersMs) + " ms, Wi-Fi wait " +
+                   String(wifiWaitMs) + " ms" + (online ? "" : " (timed out)") + ", servers " + String(serversMs) +
+                   " ms, serving " + String(millis()) + " ms after reset");
 }
 
-static void send_board_status()
+// Pushes new stream settings to the frame producer and the sensor.
+// Snapshots come from the same pool, so they follow the stream resolution.
+static void apply_stream_settings(const StreamSettings &settings)
 {
-    HTTPClient http;
-    String url = hub_address + "/send_status";
-    http.begin(url);
-    http.addHeader("Content-Type", "application/json");
+    framePool.setFrameInterval(settings.intervalMs);
 
-    String payload = "{\"message\":\"Board is up\", \"name\":\"" + String(board_name) + "\"}";
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (sensor)
+    {
+        framesize_t frameSize = stream_frame_sizes[settings.sizeStep];
+        if (sensor->status.quality != settings.quality)
+            sensor->set_quality(sensor, settings.quality);
+        if (sensor->status.framesize != frameSize)
+            sensor->set_framesize(sensor, frameSize);
+    }
 
-    int httpCode = http.POST(payload);
+    Serial.println("Stream settings: " + String(settings.intervalMs) + " ms interval, quality " +
+                   String(settings.quality) + ", size step " + String(settings.sizeStep) + " for " +
+                   String(streamServer.clientCount()) + " stream clients");
+}
 
-    http.end();
+// Copied outside the lock, then published in one short critical section
+static void publish_hub_snapshot()
+{
+    HubLinkSnapshot link;
+    link.breaker = hub.breakerState();
+    link.hub = hub.getStats();
+    link.heartbeat = heartbeat.getStats();
+    portENTER_CRITICAL(&hub_snapshot_mux);
+    hub_snapshot = link;
+    portEXIT_CRITICAL(&hub_snapshot_mux);
 }
 
 void loop()
 {
-    if (millis() - board_status_milis > 1000)
+    runtime.update(0);
+    publish_hub_snapshot();
+
+    if (millis() - stream_control_milis > STREAM_CONTROL_PERIOD_MS)
+    {
+        unsigned long now = millis();
+        if (streamServer.updateControl(now - stream_control_milis))
+        {
+            apply_stream_settings(streamServer.getSettings());
+        }
+        stream_control_milis = now;
+    }
+
+    if (millis() - stream_stats_milis > STREAM_STATS_INTERVAL_MS)
     {
-        board_status_milis = millis();
-        send_board_status();
+        stream_stats_milis = millis();
+        streamServer.printStats();
+        eventRing.printStats();
+        Serial.println("Snapshots: " + String(snapshot_count) + " served, last " + String(snapshot_last_ms) +
+                       " ms, max " + String(snapshot_max_ms) + " ms, " + String(streamServer.clientCount()) +
+                       " stream clients");
     }
 }
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <esp_camera.h>
+#include <img_converters.h>
+#include <sim.h>
+#include <chrono>
+#include <vector>
+#include "../../src/MotionDetector/MotionDetector.h"
+
+// MotionDetector::changedPermille() against the plain per-pixel loop: same
+// scores on random buffers and on frames recorded from the camera the way
+// the detector samples them (1/8 scale, 8-bit luma, every 250 ms), and a
+// host benchmark of both. Host numbers; the ESP32 has no SIMD either, so
+// only the ratio carries over.
+
+#define SAMPLE_INTERVAL_US 250000
+#define RECORD_US 10000000
+#define MOTION_AT_US 4000000
+#define MOTION_FOR_US 3000000
+#define PIXEL_THRESHOLD 24 // As in MotionDetector.cpp
+#define SCORE_THRESHOLD 20
+#define BENCH_ROUNDS 2000
+
+struct Sample
+{
+    uint64_t atUs;
+    std::vector<uint8_t> luma;
+};
+
+static std::vector<Sample> recording;
+static uint32_t randomState = 1;
+
+static uint8_t nextByte()
+{
+    randomState = randomState * 1103515245 + 12345;
+    return randomState >> 16;
+}
+
+static uint16_t scalarPermille(const uint8_t *current, const uint8_t *reference, size_t count, uint8_t threshold)
+{
+    if (count == 0)
+        return 0;
+    uint32_t changed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (abs(current[i] - reference[i]) > threshold)
+            changed++;
+    }
+    return changed * 1000 / count;
+}
+
+// SVGA frames from the camera through the detector's decode and luma steps
+static void record()
+{
+    camera_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.frame_size = FRAMESIZE_SVGA;
+    config.jpeg_quality = 12;
+    esp_camera_init(&config);
+
+    uint64_t startUs = sim::nowUs();
+    sim::camera().motion(startUs + MOTION_AT_US, MOTION_FOR_US);
+    std::vector<uint8_t> rgb(100 * 75 * 2);
+    while (sim::nowUs() < startUs + RECORD_US)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        TEST_ASSERT_TRUE(jpg2rgb565(fb->buf, fb->len, rgb.data(), JPG_SCALE_8X));
+        esp_camera_fb_return(fb);
+
+        Sample sample;
+        sample.atUs = sim::nowUs() - startUs;
+        sample.luma.resize(100 * 75);
+        for (size_t i = 0; i < sample.luma.size(); i++)
+        {
+            uint8_t hi = rgb[i * 2];
+            uint8_t lo = rgb[i * 2 + 1];
+            uint32_t r = hi & 0xF8;
+            uint32_t g = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+            uint32_t b = (lo & 0x1F) << 3;
+            sample.luma[i] = (r * 77 + g * 150 + b * 29) >> 8;
+        }
+        recording.push_back(sample);
+        sim::sleepFor(SAMPLE_INTERVAL_US);
+    }
+}
+
+static double nsPerFrame(uint16_t (*kernel)(const uint8_t *, const uint8_t *, size_t, uint8_t))
+{
+    uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (size_t i = 1; i < recording.size(); i++)
+            sink += kernel(recording[i].luma.data(), recording[i - 1].luma.data(), recording[i].luma.size(),
+                           PIXEL_THRESHOLD);
+    }
+    auto end = std::chrono::steady_clock::now();
+    TEST_ASSERT_GREATER_THAN(0, sink);
+    return std::chrono::duration<double, std::nano>(end - start).count() / (BENCH_ROUNDS * (recording.size() - 1));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// Odd lengths exercise the scalar tail, extreme thresholds the lane borrows
+void test_kernel_matches_the_scalar_loop_on_random_buffers()
+{
+    static const uint8_t thresholds[] = {0, 1, 24, 127, 128, 254, 255};
+    uint8_t current[403];
+    uint8_t reference[403];
+    for (int round = 0; round < 200; round++)
+    {
+        size_t count = nextByte() % 404;
+        for (size_t i = 0; i < count; i++)
+        {
+            current[i] = nextByte();
+            // Half the pixels close to the reference, as in a still scene
+            reference[i] = (round & 1) ? nextByte() : current[i] + nextByte() % 61 - 30;
+        }
+        for (uint8_t threshold : thresholds)
+            TEST_ASSERT_EQUAL(scalarPermille(current, reference, count, threshold),
+                              MotionDetector::changedPermille(current, reference, count, threshold));
+    }
+}
+
+// Well past the block the lane counters are flushed after, every pixel changed
+void test_kernel_counts_past_the_counter_block()
+{
+    std::vector<uint8_t> current(20000);
+    std::vector<uint8_t> reference(20000);
+    for (size_t i = 0; i < current.size(); i++)
+    {
+        current[i] = nextByte() | 0x80;
+        reference[i] = current[i] - 0x80;
+    }
+    TEST_ASSERT_EQUAL(1000, MotionDetector::changedPermille(current.data(), reference.data(), current.size(), 0));
+    TEST_ASSERT_EQUAL(1000, MotionDetector::changedPermille(reference.data(), current.data(), current.size(), 127));
+    TEST_ASSERT_EQUAL(0, MotionDetector::changedPermille(current.data(), reference.data(), current.size(), 128));
+}
+
+void test_kernel_matches_the_scalar_loop_on_recorded_frames()
+{
+    for (size_t i = 1; i < recording.size(); i++)
+    {
+        const uint8_t *current = recording[i].luma.data();
+        const uint8_t *reference = recording[i - 1].luma.data();
+        size_t count = recording[i].luma.size();
+        TEST_ASSERT_EQUAL(scalarPermille(current, reference, count, PIXEL_THRESHOLD),
+                          MotionDetector::changedPermille(current, reference, count, PIXEL_THRESHOLD));
+    }
+}
+
+// Sensor noise stays under the score threshold, the passer-by does not
+void test_recorded_motion_scores_above_the_threshold()
+{
+    int quietOver = 0;
+    int motionOver = 0;
+    int motionSamples = 0;
+    for (size_t i = 1; i < recording.size(); i++)
+    {
+        uint16_t score = MotionDetector::changedPermille(recording[i].luma.data(), recording[i - 1].luma.data(),
+                                                         recording[i].luma.size(), PIXEL_THRESHOLD);
+        bool moving = recording[i].atUs > MOTION_AT_US + SAMPLE_INTERVAL_US &&
+                      recording[i].atUs < MOTION_AT_US + MOTION_FOR_US;
+        bool still = recording[i - 1].atUs > MOTION_AT_US + MOTION_FOR_US || recording[i].atUs < MOTION_AT_US;
+        if (moving)
+        {
+            motionSamples++;
+            motionOver += score >= SCORE_THRESHOLD;
+        }
+        else if (still)
+        {
+            quietOver += score >= SCORE_THRESHOLD;
+        }
+    }
+    TEST_ASSERT_EQUAL(0, quietOver);
+    TEST_ASSERT_GREATER_THAN(5, motionSamples);
+    TEST_ASSERT_EQUAL(motionSamples, motionOver);
+}
+
+void test_benchmark_against_the_scalar_loop()
+{
+    double scalarNs = nsPerFrame(scalarPermille);
+    double lanesNs = nsPerFrame(MotionDetector::changedPermille);
+    printf("100x75 luma diff: scalar %.0f ns, 16-bit lanes %.0f ns per frame (%.1fx), %u recorded frames\n", scalarNs,
+           lanesNs, scalarNs / lanesNs, (unsigned)recording.size());
+}
+
+int main()
+{
+    record();
+    UNITY_BEGIN();
+    RUN_TEST(test_kernel_matches_the_scalar_loop_on_random_buffers);
+    RUN_TEST(test_kernel_counts_past_the_counter_block);
+    RUN_TEST(test_kernel_matches_the_scalar_loop_on_recorded_frames);
+    RUN_TEST(test_recorded_motion_scores_above_the_threshold);
+    RUN_TEST(test_benchmark_against_the_scalar_loop);
+    return UNITY_END();
+}
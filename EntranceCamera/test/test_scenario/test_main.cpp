@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+
+// Runs the EntranceCamera firmware (src/main.cpp) in virtual time: snapshots
+// from the hub while two MJPEG viewers watch, one of them on a slow link, and
+// motion in front of the lens. Prints the loop() pass distribution, snapshot
+// latency, stream frame rates and the time from motion to the hub upload.
+
+extern const char *HUB;
+
+#define SNAPSHOT_PORT 80
+#define STREAM_PORT 81
+#define LOOP_PASS_COST_US 10 // Code between the stand-in calls
+
+static sim::Hub cloud(HUB);
+static sim::Histogram passes;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void run(uint64_t forUs)
+{
+    sim::runLoop(loop, forUs, LOOP_PASS_COST_US, &passes);
+}
+
+static double framesPerSecond(const sim::StreamViewer &viewer, uint64_t fromUs, uint64_t toUs)
+{
+    size_t frames = 0;
+    for (uint64_t us : viewer.frameUs)
+    {
+        if (us >= fromUs && us < toUs)
+            frames++;
+    }
+    return frames * 1000000.0 / (toUs - fromUs);
+}
+
+void test_boot_registers_and_serves()
+{
+    setup();
+    run(15000000);
+
+    const sim::Hub::Entry *registered = cloud.first("/register");
+    TEST_ASSERT_NOT_NULL(registered);
+    TEST_ASSERT_EQUAL(200, registered->code);
+    TEST_ASSERT_TRUE(sim::serialContains("Boot: camera"));
+    printf("Boot to registration: %llu ms\n", (unsigned long long)registered->atUs / 1000);
+}
+
+void test_snapshots_while_streaming()
+{
+    passes.clear();
+    sim::StreamViewer fast(STREAM_PORT, "/live_video", 2000000);
+    sim::StreamViewer slow(STREAM_PORT, "/live_video", 40000);
+
+    // The hub polls /capture twice a second from its own task
+    static sim::Histogram snapshots;
+    static uint32_t failed = 0;
+    snapshots.clear();
+    uint64_t endUs = sim::nowUs() + 20000000;
+    sim::spawn("hub_poller", [endUs]
+               {
+                   while (sim::nowUs() < endUs)
+                   {
+                       sim::ClientResponse response = sim::httpdRequest(SNAPSHOT_PORT, "GET", "/capture");
+                       if (response.code == 200)
+                           snapshots.record(response.endUs - response.startUs);
+                       else
+                           failed++;
+                       sim::sleepFor(500000);
+                   }
+               });
+    uint64_t startUs = sim::nowUs();
+    run(21000000);
+
+    TEST_ASSERT_EQUAL(200, fast.code);
+    TEST_ASSERT_EQUAL(0, failed);
+    TEST_ASSERT_GREATER_THAN(30, snapshots.count());
+    snapshots.print("/capture with 2 streams");
+    double fastFps = framesPerSecond(fast, startUs + 5000000, startUs + 20000000);
+    passes.print("loop() passes, streaming");
+    // Other routes on the stream server share async_tcp with the viewers
+    static sim::Histogram ringRequests;
+    ringRequests.clear();
+    for (int i = 0; i < 20; i++)
+    {
+        uint64_t requestUs = sim::nowUs();
+        sim::StreamViewer ring(STREAM_PORT, "/event_ring", 1000000);
+        while (ring.code == 0 && sim::nowUs() < requestUs + 2000000)
+            run(1000);
+        ringRequests.record(sim::nowUs() - requestUs);
+        ring.close();
+        run(137000);
+    }
+    ringRequests.print("/event_ring with 2 streams");
+
+    double slowFps = framesPerSecond(slow, startUs + 5000000, startUs + 20000000);
+    printf("Stream frame rate: fast viewer %.1f fps, slow viewer %.1f fps\n", fastFps, slowFps);
+    fast.close();
+    slow.close();
+    // The slow viewer is paced down on its own, the fast one keeps its rate:
+    // the pacer resumes it when its frame is due, not the AsyncTCP poll
+    TEST_ASSERT_GREATER_THAN(90, (int)(fastFps * 10));
+    TEST_ASSERT_LESS_THAN(fastFps, slowFps);
+    // No viewer's pacing holds async_tcp, so other routes answer within a send
+    TEST_ASSERT_LESS_THAN(50000, ringRequests.percentile(99));
+}
+
+void test_motion_reaches_the_hub()
+{
+    passes.clear();
+    uint64_t motionUs = sim::nowUs() + 2000000;
+    sim::camera().motion(motionUs, 3000000);
+    run(8000000);
+
+    const sim::Hub::Entry *upload = cloud.first("/motion_snapshot", motionUs);
+    TEST_ASSERT_NOT_NULL(upload);
+    TEST_ASSERT_EQUAL(200, upload->code);
+    printf("Motion to /motion_snapshot at the hub: %llu ms\n", (unsigned long long)(upload->atUs - motionUs) / 1000);
+    passes.print("loop() passes, motion");
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_registers_and_serves);
+    RUN_TEST(test_snapshots_while_streaming);
+    RUN_TEST(test_motion_reaches_the_hub);
+    return UNITY_END();
+}
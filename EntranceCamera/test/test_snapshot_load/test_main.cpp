@@ -0,0 +1,136 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+
+// Load test of /capture on the EntranceCamera firmware: two clients poll
+// snapshots as fast as they can while 0, 2 and then the maximum of 4 MJPEG
+// viewers stream from port 81. Prints the snapshot latency at each level.
+
+extern const char *HUB;
+
+#define SNAPSHOT_PORT 80
+#define STREAM_PORT 81
+#define STREAM_MAX_CLIENTS 4
+#define SNAPSHOT_CLIENTS 2
+#define LEVEL_US 15000000
+#define VIEWER_BYTES_PER_SECOND 1000000
+#define LOOP_PASS_COST_US 10
+
+static sim::Hub cloud(HUB);
+
+struct LoadLevel
+{
+    sim::Histogram latency;
+    uint32_t failed;
+    uint32_t served;
+};
+
+// Snapshot clients back to back for LEVEL_US with viewers streaming
+static void measure(int viewers, LoadLevel &level)
+{
+    std::vector<sim::StreamViewer *> streams;
+    for (int i = 0; i < viewers; i++)
+        streams.push_back(new sim::StreamViewer(STREAM_PORT, "/live_video", VIEWER_BYTES_PER_SECOND));
+    sim::runLoop(loop, 2000000, LOOP_PASS_COST_US); // Streams settle
+
+    level.failed = 0;
+    level.served = 0;
+    uint64_t endUs = sim::nowUs() + LEVEL_US;
+    for (int i = 0; i < SNAPSHOT_CLIENTS; i++)
+    {
+        sim::spawn("snapshot_client", [&level, endUs]
+                   {
+                       while (sim::nowUs() < endUs)
+                       {
+                           sim::ClientResponse response = sim::httpdRequest(SNAPSHOT_PORT, "GET", "/capture");
+                           if (response.code == 200)
+                           {
+                               level.latency.record(response.endUs - response.startUs);
+                               level.served++;
+                           }
+                           else
+                           {
+                               level.failed++;
+                           }
+                       } });
+    }
+    sim::runLoop(loop, LEVEL_US + 1000000, LOOP_PASS_COST_US);
+
+    for (sim::StreamViewer *stream : streams)
+    {
+        TEST_ASSERT_EQUAL(200, stream->code);
+        TEST_ASSERT_GREATER_THAN(0, stream->frameSeqs.size());
+        delete stream;
+    }
+    sim::runLoop(loop, 1000000, LOOP_PASS_COST_US);
+
+    char name[48];
+    snprintf(name, sizeof(name), "/capture, %d streams", viewers);
+    level.latency.print(name);
+    printf("%d streams: %.1f snapshots/s, %u failed\n", viewers, level.served * 1000000.0 / LEVEL_US,
+           (unsigned)level.failed);
+}
+
+static LoadLevel idle;
+static LoadLevel half;
+static LoadLevel full;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_boot()
+{
+    setup();
+    sim::runLoop(loop, 12000000, LOOP_PASS_COST_US);
+    TEST_ASSERT_TRUE(sim::serialContains("Stream server listening"));
+}
+
+void test_capture_latency_without_streams()
+{
+    measure(0, idle);
+    TEST_ASSERT_EQUAL(0, idle.failed);
+}
+
+void test_capture_latency_with_two_streams()
+{
+    measure(2, half);
+    TEST_ASSERT_EQUAL(0, half.failed);
+}
+
+void test_capture_latency_with_all_streams()
+{
+    measure(STREAM_MAX_CLIENTS, full);
+    TEST_ASSERT_EQUAL(0, full.failed);
+    // Streams cost the snapshot server some CPU, but never starve it
+    TEST_ASSERT_LESS_THAN(idle.latency.percentile(99) * 2, full.latency.percentile(99));
+}
+
+void test_viewer_beyond_the_limit_is_refused()
+{
+    std::vector<sim::StreamViewer *> streams;
+    for (int i = 0; i <= STREAM_MAX_CLIENTS; i++)
+        streams.push_back(new sim::StreamViewer(STREAM_PORT, "/live_video", VIEWER_BYTES_PER_SECOND));
+    sim::runLoop(loop, 2000000, LOOP_PASS_COST_US);
+
+    TEST_ASSERT_EQUAL(200, streams[0]->code);
+    TEST_ASSERT_EQUAL(503, streams[STREAM_MAX_CLIENTS]->code);
+    for (sim::StreamViewer *stream : streams)
+        delete stream;
+    sim::runLoop(loop, 1000000, LOOP_PASS_COST_US);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boot);
+    RUN_TEST(test_capture_latency_without_streams);
+    RUN_TEST(test_capture_latency_with_two_streams);
+    RUN_TEST(test_capture_latency_with_all_streams);
+    RUN_TEST(test_viewer_beyond_the_limit_is_refused);
+    return UNITY_END();
+}
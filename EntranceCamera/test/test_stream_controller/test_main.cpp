@@ -0,0 +1,179 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "../../src/StreamController/StreamController.h"
+
+// Link traces replayed through one viewer's StreamController, set up the way
+// EntranceCamera does it: 100 ms / quality 12 / SVGA to start, 120 ms target
+// send time, 1 s control periods. The link model sends the frames one after
+// the other; a frame's size follows the resolution and the JPEG quality.
+
+#define PERIOD_MS 1000
+#define TARGET_SEND_MS 120
+
+static const StreamLimits limits = {50, 1000, 10, 40, 3};
+static const StreamSettings initial = {100, 12, 2};
+static const uint32_t frameBytesAtQ12[] = {6000, 14000, 25000}; // QVGA, VGA, SVGA
+
+static uint32_t frameBytes(const StreamSettings &settings)
+{
+    return frameBytesAtQ12[settings.sizeStep] * 12 / settings.quality;
+}
+
+// What the viewer sends in one period over a link of bytesPerSecond
+static StreamWindow sendPeriod(const StreamSettings &settings, uint32_t bytesPerSecond)
+{
+    uint32_t bytes = frameBytes(settings);
+    uint32_t sendMs = max<uint32_t>(1, (uint64_t)bytes * 1000 / bytesPerSecond);
+    StreamWindow window;
+    window.frames = max<uint32_t>(1, PERIOD_MS / max<uint32_t>(settings.intervalMs, sendMs));
+    window.bytes = window.frames * bytes;
+    window.sendMs = window.frames * sendMs;
+    return window;
+}
+
+struct TraceResult
+{
+    StreamSettings fastest; // Shortest interval and best quality seen
+    int firstBackOff;       // Period of the first change, -1 if none
+};
+
+// Replays periods of a constant link rate
+static TraceResult replay(StreamController &controller, int periods, uint32_t bytesPerSecond)
+{
+    TraceResult result = {controller.getSettings(), -1};
+    for (int i = 0; i < periods; i++)
+    {
+        StreamWindow window = sendPeriod(controller.getSettings(), bytesPerSecond);
+        if (controller.update(window, PERIOD_MS) && result.firstBackOff < 0)
+            result.firstBackOff = i;
+
+        StreamSettings settings = controller.getSettings();
+        result.fastest.intervalMs = min(result.fastest.intervalMs, settings.intervalMs);
+        result.fastest.quality = min(result.fastest.quality, settings.quality);
+    }
+    return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// 1 MB/s sends an SVGA frame in 25 ms: nothing to improve on
+void test_fast_link_keeps_the_initial_settings()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS);
+    TraceResult result = replay(controller, 30, 1000000);
+
+    StreamSettings settings = controller.getSettings();
+    TEST_ASSERT_EQUAL(100, result.fastest.intervalMs);
+    TEST_ASSERT_EQUAL(12, result.fastest.quality);
+    TEST_ASSERT_EQUAL(100, settings.intervalMs);
+    TEST_ASSERT_EQUAL(2, settings.sizeStep);
+}
+
+// 40 kB/s needs 625 ms per SVGA frame at quality 12
+void test_slow_link_backs_off_at_once_and_settles()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS);
+    TraceResult result = replay(controller, 30, 40000);
+
+    TEST_ASSERT_EQUAL(0, result.firstBackOff);
+    StreamSettings settings = controller.getSettings();
+    StreamWindow last = sendPeriod(settings, 40000);
+    TEST_ASSERT_LESS_OR_EQUAL(TARGET_SEND_MS + TARGET_SEND_MS / 4, last.sendMs / last.frames);
+    TEST_ASSERT_LESS_THAN(2, settings.sizeStep);
+    printf("40 kB/s settles at %u ms, quality %u, size step %u, %u ms per frame\n", settings.intervalMs,
+           settings.quality, settings.sizeStep, (unsigned)(last.sendMs / last.frames));
+}
+
+// Quality and frame rate go first, the resolution only once both are spent
+void test_resolution_drops_only_at_the_limits()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS);
+    StreamWindow congested = {2, 50000, 2000};
+    int periods = 0;
+    while (controller.getSettings().sizeStep == initial.sizeStep && periods < 20)
+    {
+        StreamSettings before = controller.getSettings();
+        controller.update(congested, PERIOD_MS);
+        periods++;
+        if (controller.getSettings().sizeStep != initial.sizeStep)
+        {
+            TEST_ASSERT_EQUAL(limits.maxIntervalMs, before.intervalMs);
+            TEST_ASSERT_EQUAL(limits.worstQuality, before.quality);
+        }
+    }
+    TEST_ASSERT_EQUAL(initial.sizeStep - 1, controller.getSettings().sizeStep);
+    TEST_ASSERT_LESS_OR_EQUAL(limits.maxIntervalMs, controller.getSettings().intervalMs);
+}
+
+// A Wi-Fi dip and back: recovery climbs to the initial settings and stops
+// there, never past 100 ms although the limit allows 50 ms
+void test_recovery_stops_at_the_initial_settings()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS);
+    replay(controller, 10, 1000000);
+    replay(controller, 15, 30000);
+    StreamSettings dipped = controller.getSettings();
+    TEST_ASSERT_GREATER_THAN(initial.intervalMs, dipped.intervalMs);
+
+    TraceResult result = replay(controller, 120, 1000000);
+    StreamSettings settings = controller.getSettings();
+    TEST_ASSERT_EQUAL(initial.intervalMs, result.fastest.intervalMs);
+    TEST_ASSERT_EQUAL(initial.quality, result.fastest.quality);
+    TEST_ASSERT_EQUAL(initial.intervalMs, settings.intervalMs);
+    TEST_ASSERT_EQUAL(initial.sizeStep, settings.sizeStep);
+}
+
+// One slow period in a calm run resets the calm count, so recovery waits
+void test_recovery_waits_for_calm_periods()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS);
+    replay(controller, 5, 30000);
+    StreamSettings dipped = controller.getSettings();
+
+    StreamWindow calm = {5, 50000, 50};
+    StreamWindow borderline = {5, 50000, 5 * TARGET_SEND_MS};
+    TEST_ASSERT_FALSE(controller.update(calm, PERIOD_MS));
+    TEST_ASSERT_FALSE(controller.update(borderline, PERIOD_MS));
+    TEST_ASSERT_FALSE(controller.update(calm, PERIOD_MS));
+    TEST_ASSERT_EQUAL(dipped.intervalMs, controller.getSettings().intervalMs);
+}
+
+void test_idle_period_changes_nothing()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS);
+    StreamWindow idle = {0, 0, 0};
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_FALSE(controller.update(idle, PERIOD_MS));
+    TEST_ASSERT_EQUAL(initial.intervalMs, controller.getSettings().intervalMs);
+    TEST_ASSERT_EQUAL(initial.quality, controller.getSettings().quality);
+}
+
+// Fast sends but above the bitrate cap: backs off on the bitrate alone
+void test_bitrate_cap_backs_off_a_fast_link()
+{
+    StreamController controller(limits, initial, TARGET_SEND_MS, 1000);
+    TraceResult result = replay(controller, 20, 1000000);
+
+    TEST_ASSERT_EQUAL(0, result.firstBackOff);
+    StreamWindow last = sendPeriod(controller.getSettings(), 1000000);
+    TEST_ASSERT_LESS_OR_EQUAL(1000, last.bytes * 8 / PERIOD_MS);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fast_link_keeps_the_initial_settings);
+    RUN_TEST(test_slow_link_backs_off_at_once_and_settles);
+    RUN_TEST(test_resolution_drops_only_at_the_limits);
+    RUN_TEST(test_recovery_stops_at_the_initial_settings);
+    RUN_TEST(test_recovery_waits_for_calm_periods);
+    RUN_TEST(test_idle_period_changes_nothing);
+    RUN_TEST(test_bitrate_cap_backs_off_a_fast_link);
+    return UNITY_END();
+}
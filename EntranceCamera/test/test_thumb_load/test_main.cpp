@@ -0,0 +1,159 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include <esp_camera.h>
+#include "../../src/ThumbnailCache/ThumbnailCache.h"
+
+// Load test of /thumb on the EntranceCamera firmware: dashboard clients poll
+// thumbnails back to back, first asking for the newest frame every time
+// (max_age=0, one encode per camera frame as before the age buckets), then
+// with the default age, then revalidating with If-None-Match. Prints the
+// requests per second and latency of each run. Then a resolution change
+// within an age bucket.
+
+extern const char *HUB;
+extern ThumbnailCache thumbnails;
+
+#define SNAPSHOT_PORT 80
+#define DASHBOARD_CLIENTS 3
+#define RUN_US 10000000
+#define LOOP_PASS_COST_US 10
+
+static sim::Hub cloud(HUB);
+
+struct LoadRun
+{
+    sim::Histogram latency;
+    uint32_t served;
+    uint32_t notModified;
+    uint32_t failed;
+    uint32_t encodes;
+
+    double perSecond() const { return (served + notModified) * 1000000.0 / RUN_US; }
+};
+
+static uint32_t metric(const char *name)
+{
+    sim::ClientResponse response = sim::httpdRequest(SNAPSHOT_PORT, "GET", "/metrics");
+    size_t at = response.body.find(std::string(name) + " ");
+    TEST_ASSERT_TRUE(at != std::string::npos);
+    return strtoul(response.body.c_str() + at + strlen(name) + 1, NULL, 10);
+}
+
+// Clients back to back for RUN_US; revalidating clients send the last ETag
+static void measure(const char *uri, bool revalidate, LoadRun &run, const char *name)
+{
+    run.served = 0;
+    run.notModified = 0;
+    run.failed = 0;
+    uint32_t encodesBefore = metric("camera_thumb_encodes_total");
+    uint64_t endUs = sim::nowUs() + RUN_US;
+    for (int i = 0; i < DASHBOARD_CLIENTS; i++)
+    {
+        sim::spawn("dashboard", [&run, uri, revalidate, endUs]
+                   {
+                       std::string etag;
+                       while (sim::nowUs() < endUs)
+                       {
+                           std::map<std::string, std::string> headers;
+                           if (revalidate && !etag.empty())
+                               headers["If-None-Match"] = etag;
+                           sim::ClientResponse response = sim::httpdRequest(SNAPSHOT_PORT, "GET", uri, headers);
+                           run.latency.record(response.endUs - response.startUs);
+                           if (response.code == 200)
+                           {
+                               run.served++;
+                               etag = response.headers["etag"];
+                           }
+                           else if (response.code == 304)
+                           {
+                               run.notModified++;
+                           }
+                           else
+                           {
+                               run.failed++;
+                           }
+                       } });
+    }
+    sim::runLoop(loop, RUN_US + 1000000, LOOP_PASS_COST_US);
+    run.encodes = metric("camera_thumb_encodes_total") - encodesBefore;
+
+    run.latency.print(name);
+    printf("%s: %.1f req/s (%u 200, %u 304, %u failed), %u encodes\n", name, run.perSecond(), (unsigned)run.served,
+           (unsigned)run.notModified, (unsigned)run.failed, (unsigned)run.encodes);
+}
+
+static LoadRun fresh;
+static LoadRun bucketed;
+static LoadRun revalidated;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_boot()
+{
+    setup();
+    sim::runLoop(loop, 12000000, LOOP_PASS_COST_US);
+    TEST_ASSERT_TRUE(sim::serialContains("Stream server listening"));
+}
+
+void test_max_age_0_encodes_every_new_frame()
+{
+    measure("/thumb?w=160&max_age=0", false, fresh, "/thumb max_age=0");
+    TEST_ASSERT_EQUAL(0, fresh.failed);
+    // About one encode per camera frame (10 fps)
+    TEST_ASSERT_GREATER_THAN(RUN_US / 1000000 * 5, fresh.encodes);
+}
+
+void test_default_age_encodes_once_per_bucket()
+{
+    measure("/thumb?w=160", false, bucketed, "/thumb default age");
+    TEST_ASSERT_EQUAL(0, bucketed.failed);
+    TEST_ASSERT_LESS_OR_EQUAL(RUN_US / 1000000 + 1, bucketed.encodes);
+    TEST_ASSERT_GREATER_THAN(fresh.perSecond(), bucketed.perSecond());
+}
+
+void test_revalidation_gets_304s_within_the_bucket()
+{
+    measure("/thumb?w=160", true, revalidated, "/thumb If-None-Match");
+    TEST_ASSERT_EQUAL(0, revalidated.failed);
+    TEST_ASSERT_GREATER_THAN(revalidated.served, revalidated.notModified);
+    printf("Default age vs max_age=0: %.1fx req/s, with If-None-Match %.1fx\n",
+           bucketed.perSecond() / fresh.perSecond(), revalidated.perSecond() / fresh.perSecond());
+}
+
+// A 1/8 entry made from a QVGA frame is too narrow once the camera is back
+// at SVGA; it is made again instead of served for the rest of its bucket
+void test_resolution_change_rebuilds_narrow_entries()
+{
+    sensor_t *sensor = esp_camera_sensor_get();
+    sensor->set_framesize(sensor, FRAMESIZE_QVGA);
+    sim::runLoop(loop, 500000, LOOP_PASS_COST_US);
+    const Thumbnail *small = thumbnails.acquire(40, 0, 1000);
+    TEST_ASSERT_NOT_NULL(small);
+    TEST_ASSERT_EQUAL(40, small->width);
+    thumbnails.release(small);
+
+    sensor->set_framesize(sensor, FRAMESIZE_SVGA);
+    sim::runLoop(loop, 300000, LOOP_PASS_COST_US);
+    const Thumbnail *thumb = thumbnails.acquire(100, 1000, 1000);
+    TEST_ASSERT_NOT_NULL(thumb);
+    TEST_ASSERT_EQUAL(100, thumb->width);
+    thumbnails.release(thumb);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boot);
+    RUN_TEST(test_max_age_0_encodes_every_new_frame);
+    RUN_TEST(test_default_age_encodes_once_per_bucket);
+    RUN_TEST(test_revalidation_gets_304s_within_the_bucket);
+    RUN_TEST(test_resolution_change_rebuilds_narrow_entries);
+    return UNITY_END();
+}
@@ -0,0 +1,210 @@
+#include "FingerprintReader.h"
+
+#define FINGERPRINT_DEFAULT_BAUD 57600 // Factory setting of the sensor
+#define FINGERPRINT_FAST_BAUD 115200
+#define FINGERPRINT_POLL_INTERVAL_MS 100 // Presence checks without a touch line
+
+FingerprintReader::FingerprintReader(HardwareSerial &serial, int8_t rxPin, int8_t txPin)
+    : serial(serial), rxPin(rxPin), txPin(txPin), touchPin(-1), touchActiveHigh(true), finger(&serial),
+      state(IDLE), lastPollMs(0), touchStartMs(0), fingerSeenMs(0), id(0), score(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool FingerprintReader::connect(uint32_t baud)
+{
+    serial.begin(baud, SERIAL_8N1, rxPin, txPin);
+    stats.baudRate = baud;
+    return finger.verifyPassword();
+}
+
+bool FingerprintReader::begin()
+{
+    // The sensor keeps its baud rate across power cycles, so after the first
+    // negotiation it answers at the fast rate straight away
+    if (connect(FINGERPRINT_FAST_BAUD))
+        return true;
+
+    if (!connect(FINGERPRINT_DEFAULT_BAUD))
+        return false;
+
+    if (finger.setBaudRate(FINGERPRINT_BAUDRATE_115200) == FINGERPRINT_OK)
+    {
+        delay(100);
+        if (connect(FINGERPRINT_FAST_BAUD))
+        {
+            Serial.println("Fingerprint sensor switched to " + String(FINGERPRINT_FAST_BAUD) + " baud.");
+            return true;
+        }
+    }
+
+    // Rate not supported, or it only applies after a power cycle
+    Serial.println("Fingerprint sensor stays at " + String(FINGERPRINT_DEFAULT_BAUD) + " baud.");
+    return connect(FINGERPRINT_DEFAULT_BAUD) || connect(FINGERPRINT_FAST_BAUD);
+}
+
+void FingerprintReader::setTouchPin(int8_t pin, bool activeHigh)
+{
+    touchPin = pin;
+    touchActiveHigh = activeHigh;
+    touchStartMs = 0;
+    if (pin >= 0)
+        pinMode(pin, INPUT);
+}
+
+void FingerprintReader::start()
+{
+    if (state == IDLE)
+    {
+        state = WAIT_FINGER;
+        touchStartMs = 0;
+    }
+}
+
+void FingerprintReader::stop()
+{
+    state = IDLE;
+}
+
+bool FingerprintReader::isActive() const
+{
+    return state != IDLE;
+}
+
+bool FingerprintReader::touched()
+{
+    if (touchPin < 0)
+        return true;
+
+    bool level = digitalRead(touchPin) == HIGH;
+    if (level != touchActiveHigh)
+    {
+        touchStartMs = 0;
+        return false;
+    }
+    if (touchStartMs == 0)
+    {
+        touchStartMs = millis();
+    }
+    return true;
+}
+
+bool FingerprintReader::pollDue()
+{
+    if (millis() - lastPollMs < FINGERPRINT_POLL_INTERVAL_MS)
+        return false;
+    lastPollMs = millis();
+    stats.polls++;
+    return true;
+}
+
+FingerprintEvent FingerprintReader::update()
+{
+    uint8_t p;
+    switch (state)
+    {
+    case IDLE:
+        return FINGER_NONE;
+
+    case WAIT_FINGER:
+        // A GPIO read costs nothing, only talk to the sensor once touched
+        if (!touched() || !pollDue())
+            return FINGER_NONE;
+
+        p = finger.getImage();
+        if (p == FINGERPRINT_OK)
+        {
+            // Without a touch line the finger arrived at most one poll ago
+            fingerSeenMs = touchStartMs != 0 ? touchStartMs : lastPollMs;
+            stats.scans++;
+            state = CONVERT;
+        }
+        else if (p != FINGERPRINT_NOFINGER)
+        {
+            stats.commErrors++;
+        }
+        return FINGER_NONE;
+
+    case CONVERT:
+        p = finger.image2Tz();
+        if (p == FINGERPRINT_OK)
+        {
+            state = SEARCH;
+        }
+        else
+        {
+            // Smudged or partial image, take another one
+            stats.badImages++;
+            state = WAIT_FINGER;
+        }
+        return FINGER_NONE;
+
+    case SEARCH:
+        p = finger.fingerFastSearch();
+        if (p == FINGERPRINT_OK)
+        {
+            id = finger.fingerID;
+            score = finger.confidence;
+            stats.matches++;
+            stats.lastMatchMs = millis() - fingerSeenMs;
+            stats.maxMatchMs = max(stats.maxMatchMs, stats.lastMatchMs);
+            state = IDLE;
+            return FINGER_MATCHED;
+        }
+        if (p == FINGERPRINT_NOTFOUND)
+        {
+            stats.rejections++;
+            state = WAIT_LIFT;
+            return FINGER_REJECTED;
+        }
+        stats.commErrors++;
+        state = WAIT_FINGER;
+        return FINGER_NONE;
+
+    case WAIT_LIFT:
+        // One attempt per placement: the same finger is not searched again
+        if (touchPin >= 0)
+        {
+            if (!touched())
+            {
+                state = WAIT_FINGER;
+            }
+            return FINGER_NONE;
+        }
+        if (pollDue() && finger.getImage() == FINGERPRINT_NOFINGER)
+        {
+            state = WAIT_FINGER;
+        }
+        return FINGER_NONE;
+    }
+    return FINGER_NONE;
+}
+
+uint16_t FingerprintReader::matchedId() const
+{
+    return id;
+}
+
+uint16_t FingerprintReader::confidence() const
+{
+    return score;
+}
+
+unsigned long FingerprintReader::fingerDownMs() const
+{
+    return fingerSeenMs;
+}
+
+const FingerprintStats &FingerprintReader::getStats() const
+{
+    return stats;
+}
+
+void FingerprintReader::printStats()
+{
+    Serial.println("Fingerprint: " + String(stats.baudRate) + " baud, " + String(stats.polls) + " polls, " +
+                   String(stats.scans) + " scans (" + String(stats.badImages) + " bad), " +
+                   String(stats.matches) + " matches, " + String(stats.rejections) + " rejections, " +
+                   String(stats.commErrors) + " errors, time to match last " + String(stats.lastMatchMs) +
+                   " ms, max " + String(stats.maxMatchMs) + " ms");
+}
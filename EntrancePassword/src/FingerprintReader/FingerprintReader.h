@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef FINGERPRINT_READER_H
+#define FINGERPRINT_READER_H
+
+#include <Arduino.h>
+#include <Adafruit_Fingerprint.h>
+
+enum FingerprintEvent
+{
+    FINGER_NONE,
+    FINGER_MATCHED,
+    FINGER_REJECTED // Finger read but not enrolled, the reader waits for it to lift
+};
+
+struct FingerprintStats
+{
+    uint32_t baudRate;
+    uint32_t polls;     // Finger presence checks sent to the sensor
+    uint32_t scans;     // Images taken
+    uint32_t badImages; // Images the sensor could not turn into a template
+    uint32_t matches;
+    uint32_t rejections;
+    uint32_t commErrors;
+    unsigned long lastMatchMs; // Finger placement to match
+    unsigned long maxMatchMs;
+};
+
+// Fingerprint sensor driven as a state machine from loop(): every update()
+// sends at most one command (presence poll, image, template or search)
+// instead of the whole capture-convert-search chain, so ranging keeps
+// running while someone is at the door. Presence is polled at a fixed rate,
+// or read from the sensor's touch output when it is wired up.
+class FingerprintReader
+{
+public:
+    FingerprintReader(HardwareSerial &serial, int8_t rxPin, int8_t txPin);
+
+    // Finds the sensor and moves it to the fastest baud rate it accepts
+    bool begin();
+
+    // Optional finger detect line (WAKEUP/TOUCH on R503-style sensors, high
+    // while touched). Once set, the sensor is only asked about a finger
+    // while the line is active, so it must really be wired: give it an
+    // external pull to the idle level (10k to GND for an active-high line),
+    // since the sensor only drives it while powered and GPIO 34-39 have no
+    // internal pulls. Pass -1 to go back to polling every 100 ms over UART.
+    void setTouchPin(int8_t pin, bool activeHigh);
+
+    // Start and stop looking for a finger
+    void start();
+    void stop();
+    bool isActive() const;
+
+    // Call from loop(), runs one step of the acquisition
+    FingerprintEvent update();
+
+    // Result of the last FINGER_MATCHED
+    uint16_t matchedId() const;
+    uint16_t confidence() const;
+
+    // millis() the finger of the current attempt was first seen
+    unsigned long fingerDownMs() const;
+
+    const FingerprintStats &getStats() const;
+    void printStats();
+
+private:
+    enum State
+    {
+        IDLE,
+        WAIT_FINGER,
+        CONVERT,
+        SEARCH,
+        WAIT_LIFT
+    };
+
+    bool connect(uint32_t baud);
+    bool touched();
+    bool pollDue();
+
+    HardwareSerial &serial;
+    int8_t rxPin;
+    int8_t txPin;
+    int8_t touchPin;
+    bool touchActiveHigh;
+    Adafruit_Fingerprint finger;
+
+    State state;
+    unsigned long lastPollMs;
+    unsigned long touchStartMs;
+    unsigned long fingerSeenMs;
+    uint16_t id;
+    uint16_t score;
+
+    FingerprintStats stats;
+};
+
+#endif
@@ -1,10 +1,21 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <HTTPClient.h>
-#include <Adafruit_Fingerprint.h>
+#include <HubClient.h>
+#include <CommandChannel.h>
+#include <Ultrasonic.h>
+#include <DistanceFilter.h>
+#include <SpscQueue.h>
+#include <EventOutbox.h>
+#include <JsonWriter.h>
+#include <LoopProfiler.h>
+#include <WiFiSupervisor.h>
+#include <HubDiscovery.h>
+#include <UdpHeartbeat.h>
+#include <BoardRuntime.h>
 #include <ESP32Servo.h>
 #include <esp_http_server.h>
 #include "FS.h"
+#include "FingerprintReader/FingerprintReader.h"
 #include "credentials.h"
 
 // Pin definitions
@@ -18,23 +29,95 @@
 #define ECHO_PIN 18
 #define BUZZER_PIN 12
 
+// Fingerprint touch line, off unless the board has the wire (see
+// FingerprintReader::setTouchPin()); e.g. -DFINGERPRINT_TOUCH_PIN=34.
+// Without it finger presence is polled over UART.
+#ifndef FINGERPRINT_TOUCH_PIN
+#define FINGERPRINT_TOUCH_PIN -1
+#endif
+#ifndef FINGERPRINT_TOUCH_ACTIVE_HIGH
+#define FINGERPRINT_TOUCH_ACTIVE_HIGH true
+#endif
+
+// Sonar rate: 2 Hz while the scene is empty, 25 Hz once something is within
+// a metre, back to idle 2 s after it left
+#define SONAR_IDLE_INTERVAL_MS 500
+#define SONAR_ACTIVE_INTERVAL_MS 40
+#define SONAR_ACTIVE_RANGE_CM 100
+#define SONAR_ACTIVE_HOLD_MS 2000
+
 // Network and hub configuration
 const char *ssid = SSID;
 const char *passowrd = PASSWORD;
+WiFiSupervisor wifi(ssid, passowrd); // Cached fast join and background reconnect
 
 String hub_address = String(HUB);
+HubClient hub;
 
 int alarmActivated = false;
 
-int board_status_milis = 1000;
+void startAlarm();
+void stopAlarm();
+void openDoor();
+
+// Commands the hub can send, with the /send_status code that carries them
+// while the command stream is down
+constexpr BoardCommand board_commands[] = {
+    {"activate_alarm", 203, startAlarm},
+    {"deactivate_alarm", 204, stopAlarm},
+    {"open_door", 205, openDoor},
+};
+static_assert(boardCommandsUnique(board_commands), "Hub command names and status codes must be unique");
+constexpr BoardDescriptor board = BOARD_DESCRIPTOR("FrontDoorESP32", board_commands);
+
+const char *board_name = board.name;
+HubDiscovery hubDiscovery(board_name); // Local hub over mDNS, cloud URL as fallback
+UdpHeartbeat heartbeat(board_name);    // Signed UDP heartbeat to the LAN hub
+CommandChannel commandChannel(board_name);
+EventOutbox outbox(board_name); // Flash-backed queue for hub notifications
+
+// Registration, heartbeat and hub commands
+BoardRuntime runtime(board, wifi, hub, hubDiscovery, heartbeat);
+
+// Network I/O runs in its own task on core 0, sensing and actuation stay in
+// loop() on core 1. The two only talk through these lock-free queues.
+enum BoardEventType
+{
+    MOVEMENT_EVENT,
+    FRONT_DOOR_ALARM_EVENT
+};
+
+struct BoardEvent
+{
+    BoardEventType type;
+    int value;
+    unsigned long timestamp;
+};
+
+// loop() publishes the heartbeat state, the network task only reads it
+volatile uint8_t heartbeatState = 0;
+SpscQueue<BoardEvent, 16> eventQueue;        // loop() -> network task
+SpscQueue<HubCommand, 8> statusCommandQueue; // network task -> loop(), status code fallback
+
+// Function prototypes
+void networkTask(void *arg);
 
-const char *board_name = "FrontDoorESP32";
 // Fingerprint sensor
-Adafruit_Fingerprint finger(&Serial2);
+FingerprintReader fingerprint(Serial2, RX_PIN, TX_PIN);
 
 // Servo motor
 Servo myServo;
 
+// Iteration time distribution of loop(), printed once a minute
+#define LOOP_REPORT_INTERVAL_MS 60000
+LoopProfiler loopProfiler("FrontDoor");
+
+// Ultrasonic sensor
+Ultrasonic sonar(TRIG_PIN, ECHO_PIN);
+
+// Someone within 25 cm of the door, gone again beyond 30 cm
+DistanceFilter presence(25, 30);
+
 // Variables for fingerprint waiting mechanism
 unsigned long detectionStartTime = 0;
 unsigned long presenceEndTime = 0;
@@ -45,75 +128,19 @@ unsigned long fingerprintStartTime = 0;
 // Function to test hub connectivity
 bool testHubConnection(const char *hub_ip)
 {
-    HTTPClient http;
-    String test_url = hub_address + "/test";
-    http.begin(test_url);
-    int httpCode = http.GET();
-    http.end();
+    int httpCode = hub.get("/test");
     return (httpCode == 200);
 }
 
-// Register the board with the hub
-void registerBoard()
-{
-    if (hub_address == "")
-        return;
-    HTTPClient http;
-    http.begin(hub_address + "/register");
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"name\":\"" + String(board_name) + "\",\"ip\":\"" + WiFi.localIP().toString() + "\"}";
-    int httpCode = http.POST(payload);
-    if (httpCode == 200)
-    {
-        Serial.println("Board registered successfully.");
-    }
-    else
-    {
-        Serial.println("Failed to register board. HTTP code: " + String(httpCode));
-    }
-    http.end();
-}
-
-// Attempt to connect to Wi-Fi
-bool connectToWiFi(const char *ssid, const char *password)
-{
-    WiFi.begin(ssid, password);
-    Serial.print("Connecting to Wi-Fi: ");
-    Serial.println(ssid);
-
-    int retries = 20; // Retry limit
-    while (WiFi.status() != WL_CONNECTED && retries > 0)
-    {
-        delay(500);
-        Serial.print(".");
-        retries--;
-    }
-
-    if (WiFi.status() == WL_CONNECTED)
-    {
-        Serial.println("\nConnected to Wi-Fi: " + String(ssid));
-        Serial.println("IP Address: " + WiFi.localIP().toString());
-        return true;
-    }
-    else
-    {
-        Serial.println("\nFailed to connect to Wi-Fi: " + String(ssid));
-        return false;
-    }
-}
-
 // Function to send proximity event
 void sendProximityEvent(int distance)
 {
     if (hub_address == "")
         return;
-    HTTPClient http;
-    http.begin(hub_address + "/proximity_event");
-    http.addHeader("Content-Type", "application/json");
 
-    String payload = "{\"name\":\"FrontDoorESP32\",\"distance\":" + String(distance) + "}";
-    int httpCode = http.POST(payload);
+    JsonWriter<64> payload;
+    payload.beginObject().field(JSON_KEY("name"), board_name).field(JSON_KEY("distance"), distance).endObject();
+    int httpCode = hub.post("/proximity_event", payload.c_str(), payload.size());
     if (httpCode == 200)
     {
         Serial.println("Proximity event sent successfully.");
@@ -122,26 +149,23 @@ void sendProximityEvent(int distance)
     {
         Serial.println("Failed to send proximity event. HTTP code: " + String(httpCode));
     }
-    http.end();
 }
 
 // Function to send fingerprint result
-void sendFingerprintResult(String status, int id = -1)
+void sendFingerprintResult(const char *status, int id = -1)
 {
     if (hub_address == "")
         return;
-    HTTPClient http;
-    http.begin(hub_address + "/fingerprint_result");
-    http.addHeader("Content-Type", "application/json");
 
-    String payload = "{\"name\":\"FrontDoorESP32\",\"status\":\"" + status + "\"";
+    JsonWriter<96> payload;
+    payload.beginObject().field(JSON_KEY("name"), board_name).field(JSON_KEY("status"), status);
     if (id != -1)
     {
-        payload += ",\"id\":" + String(id);
+        payload.field(JSON_KEY("id"), id);
     }
-    payload += "}";
+    payload.endObject();
 
-    int httpCode = http.POST(payload);
+    int httpCode = hub.post("/fingerprint_result", payload.c_str(), payload.size());
     if (httpCode == 200)
     {
         Serial.println("Fingerprint result sent successfully.");
@@ -150,21 +174,27 @@ void sendFingerprintResult(String status, int id = -1)
     {
         Serial.println("Failed to send fingerprint result. HTTP code: " + String(httpCode));
     }
-    http.end();
 }
 
-// Ultrasonic sensor
+// Ultrasonic sensor, returns the filtered distance without waiting
 long getDistance()
 {
-    digitalWrite(TRIG_PIN, LOW);
-    delayMicroseconds(2);
-    digitalWrite(TRIG_PIN, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(TRIG_PIN, LOW);
-
-    long duration = pulseIn(ECHO_PIN, HIGH);
-    long distance = duration * 0.034 / 2; // Convert duration to distance
-    return distance;
+    sonar.update();
+    if (sonar.hasNewReading())
+    {
+        PresenceEvent event = presence.update(sonar.getDistance());
+        if (event == PRESENCE_BEGIN)
+        {
+            Serial.println("Presence confirmed " + String(millis() - sonar.activeSince()) +
+                           " ms after first sighting (idle gap up to " + String(sonar.getStats().lastWakeGapMs) +
+                           " ms).");
+        }
+        else if (event == PRESENCE_END)
+        {
+            sonar.printStats();
+        }
+    }
+    return presence.getDistance();
 }
 
 // RGB LED
@@ -190,24 +220,6 @@ void rotateServo(int durationMillis, int direction)
     myServo.write(90);
 }
 
-// Fingerprint handling
-int getFingerprintID()
-{
-    int p = finger.getImage();
-    if (p != FINGERPRINT_OK)
-        return -1;
-
-    p = finger.image2Tz();
-    if (p != FINGERPRINT_OK)
-        return -1;
-
-    p = finger.fingerFastSearch();
-    if (p != FINGERPRINT_OK)
-        return -1;
-
-    return finger.fingerID;
-}
-
 // Buzzer
 void buzz(int duration)
 {
@@ -216,44 +228,56 @@ void buzz(int duration)
     digitalWrite(BUZZER_PIN, LOW);
 }
 
-void handleSuccess()
+// fingerDownMs is when the matched finger was placed, 0 when not opened by fingerprint
+void handleSuccess(unsigned long fingerDownMs = 0)
 {
     setRGBColor(0, 255, 0);
     buzz(200);
+    if (fingerDownMs != 0)
+    {
+        Serial.println("Time to door open: " + String(millis() - fingerDownMs) + " ms.");
+    }
     rotateServo(2000, 1);
     delay(2000);
     rotateServo(2000, 0);
     setRGBColor(0, 0, 0);
 }
 
-void handleWrongFingerprint()
+// Hands an event to the network task without waiting for the hub
+void queueEvent(BoardEventType type, int value)
 {
-    alarmActivated = true;
+    BoardEvent event = {type, value, millis()};
+    if (!eventQueue.push(event))
+    {
+        Serial.println("Event queue full, event dropped.");
+    }
+}
 
+void notifyFrontDoorAlarm(unsigned long timestamp)
+{
     if (!hub_address.isEmpty())
     {
-        HTTPClient http;
-        String url = hub_address + "/front_door_alarm";
-        http.begin(url);
-        http.addHeader("Content-Type", "application/json");
+        JsonWriter<96> payload;
+        payload.beginObject()
+            .field(JSON_KEY("message"), "Front Door Alarm Triggered")
+            .field(JSON_KEY("timestamp"), timestamp)
+            .endObject();
 
-        String payload = "{\"message\":\"Front Door Alarm Triggered\",\"timestamp\":\"" + String(millis()) + "\"}";
-
-        int httpCode = http.POST(payload);
-        if (httpCode == 200)
-        {
-            Serial.println("Front Door Alarm notification sent successfully.");
-        }
-        else
+        if (outbox.append("/front_door_alarm", payload.c_str()))
         {
-            Serial.println("Failed to send Front Door Alarm notification. HTTP code: " + String(httpCode));
+            Serial.println("Front Door Alarm notification queued.");
         }
-        http.end();
     }
     else
     {
         Serial.println("Hub address is empty. Cannot send Front Door Alarm notification.");
     }
+}
+
+void handleWrongFingerprint()
+{
+    alarmActivated = true;
+    queueEvent(FRONT_DOOR_ALARM_EVENT, 0);
 
     for (int i = 0; i < 3; i++)
     {
@@ -270,21 +294,12 @@ void sendMovementEvent(int distance)
     if (hub_address == "")
         return;
 
-    HTTPClient http;
-    http.begin(hub_address + "/movement_event");
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"name\":\"FrontDoorESP32\",\"distance\":" + String(distance) + "}";
-    int httpCode = http.POST(payload);
-    if (httpCode == 200)
-    {
-        Serial.println("Movement event sent successfully.");
-    }
-    else
+    JsonWriter<64> payload;
+    payload.beginObject().field(JSON_KEY("name"), board_name).field(JSON_KEY("distance"), distance).endObject();
+    if (outbox.append("/movement_event", payload.c_str()))
     {
-        Serial.println("Failed to send movement event. HTTP code: " + String(httpCode));
+        Serial.println("Movement event queued.");
     }
-    http.end();
 }
 
 // Handler for activating the alarm
@@ -399,19 +414,21 @@ void setup()
     myServo.write(90);
 
     // Ultrasonic sensor setup
-    pinMode(TRIG_PIN, OUTPUT);
-    pinMode(ECHO_PIN, INPUT);
+    sonar.begin();
+    sonar.setAdaptiveInterval(SONAR_IDLE_INTERVAL_MS, SONAR_ACTIVE_INTERVAL_MS, SONAR_ACTIVE_RANGE_CM,
+                              SONAR_ACTIVE_HOLD_MS);
 
     // Buzzer setup
     pinMode(BUZZER_PIN, OUTPUT);
     digitalWrite(BUZZER_PIN, LOW);
 
     // Fingerprint sensor setup
-    Serial2.begin(57600, SERIAL_8N1, RX_PIN, TX_PIN);
-    finger.begin(57600);
-
-    if (finger.verifyPassword())
+    if (fingerprint.begin())
     {
+        if (FINGERPRINT_TOUCH_PIN >= 0)
+        {
+            fingerprint.setTouchPin(FINGERPRINT_TOUCH_PIN, FINGERPRINT_TOUCH_ACTIVE_HIGH);
+        }
         Serial.println("Fingerprint sensor detected successfully.");
         setRGBColor(0, 0, 255);
         delay(2000);
@@ -425,14 +442,14 @@ void setup()
             ;
     }
 
-    // Connect to Wi-Fi
-    if (!connectToWiFi(ssid, passowrd))
-    {
-        Serial.println("Failed to connect to Wi-Fi. Check credentials.");
-        return;
-    }
+    // Connect to Wi-Fi; the door works offline and the supervisor keeps
+    // reconnecting in the background
+    wifi.begin(10000);
+    heartbeat.begin(HEARTBEAT_KEY);
 
-    registerBoard();
+    hub.begin(hub_address);
+    outbox.begin(hub_address);
+    xTaskCreatePinnedToCore(networkTask, "network", 8192, NULL, 1, NULL, 0);
 
     // Start the HTTP server
     startServer();
@@ -444,59 +461,72 @@ void openDoor()
     handleSuccess();
     personDetected = false;
     waitingForFingerprint = false;
+    fingerprint.stop();
     setRGBColor(0, 0, 0); // Turn off LED
 }
 
-static void send_board_status()
+void sendBoardEvent(const BoardEvent &event)
 {
-    HTTPClient http;
-    String url = hub_address + "/send_status";
-    http.begin(url);
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"message\":\"Board is up\", \"name\":\"" + String(board_name) + "\"}";
-
-    int httpCode = http.POST(payload);
-    // http code 202 -> received no command
-    // http code 203 -> activate alarm command
-    // http code 204 -> deactivate alarm command
-    Serial.println("HTTP code: " + String(httpCode));
-    if (httpCode == 202)
-    {
-        Serial.println("No command received.");
-    }
-    else if (httpCode == 203)
+    if (event.type == MOVEMENT_EVENT)
     {
-        Serial.println("Activate alarm command received.");
-        startAlarm();
+        sendMovementEvent(event.value);
     }
-    else if (httpCode == 204)
+    else if (event.type == FRONT_DOOR_ALARM_EVENT)
     {
-        Serial.println("Deactivate alarm command received.");
-        stopAlarm();
+        notifyFrontDoorAlarm(event.timestamp);
     }
-    else if (httpCode == 205)
+}
+
+// Pinned to core 0: heartbeats and hub notifications keep going while loop()
+// is busy with a door sequence, and a slow hub never delays sensing
+void networkTask(void *arg)
+{
+    commandChannel.begin(hub_address);
+    runtime.setCommandChannel(commandChannel);
+    runtime.begin(hub_address);
+
+    while (true)
     {
-        Serial.println("Door is opened");
-        openDoor();
-    }
+        // Commands from the status fallback run in loop(), like streamed ones
+        const char *statusCommand = runtime.update(heartbeatState);
+        if (statusCommand != NULL)
+        {
+            HubCommand hubCommand = {0, ""};
+            strncpy(hubCommand.name, statusCommand, sizeof(hubCommand.name) - 1);
+            if (!statusCommandQueue.push(hubCommand))
+            {
+                Serial.println("Command queue full, dropped: " + String(statusCommand));
+            }
+        }
 
-    http.end();
+        BoardEvent event;
+        while (eventQueue.pop(event))
+        {
+            sendBoardEvent(event);
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
 }
 
 void loop()
 {
+    loopProfiler.tick();
+    loopProfiler.report(LOOP_REPORT_INTERVAL_MS);
+
     long distance = getDistance();
     unsigned long currentMillis = millis();
+    heartbeatState = (alarmActivated ? HEARTBEAT_STATE_ALARM : 0) |
+                     (presence.isPresent() ? HEARTBEAT_STATE_PRESENCE : 0);
 
-    if (millis() - board_status_milis > 1000)
+    HubCommand command;
+    while (statusCommandQueue.pop(command) || commandChannel.poll(command))
     {
-        send_board_status();
-        board_status_milis = millis();
+        runtime.dispatch(command.name);
     }
 
     // Check for presence
-    if (distance > 0 && distance < 25)
+    if (presence.isPresent())
     {
         if (!personDetected)
         {
@@ -513,8 +543,9 @@ void loop()
             setRGBColor(0, 0, 255); // Blue: Waiting for fingerprint
             waitingForFingerprint = true;
             fingerprintStartTime = currentMillis;
+            fingerprint.start();
 
-            sendMovementEvent(distance);
+            queueEvent(MOVEMENT_EVENT, distance);
         }
 
         presenceEndTime = currentMillis; // Update the presence end time
@@ -527,6 +558,7 @@ void loop()
             Serial.println("No presence detected. Resetting...");
             personDetected = false;
             waitingForFingerprint = false;
+            fingerprint.stop();
             setRGBColor(0, 0, 0); // Turn off LED
         }
     }
@@ -536,16 +568,22 @@ void loop()
     {
         if (currentMillis - fingerprintStartTime <= 20000)
         {
-            int fingerprintID = getFingerprintID();
-            if (fingerprintID != -1)
+            // One sensor command per pass, ranging keeps going in between
+            FingerprintEvent result = fingerprint.update();
+            if (result == FINGER_MATCHED)
             {
-                Serial.print("Fingerprint matched! ID: ");
-                Serial.println(fingerprintID);
+                Serial.println("Fingerprint matched! ID: " + String(fingerprint.matchedId()) + ", time to match " +
+                               String(fingerprint.getStats().lastMatchMs) + " ms.");
                 setRGBColor(0, 255, 0); // Green: Access granted
-                handleSuccess();
+                handleSuccess(fingerprint.fingerDownMs());
                 personDetected = false;
                 waitingForFingerprint = false;
                 setRGBColor(0, 0, 0); // Turn off LED
+                fingerprint.printStats();
+            }
+            else if (result == FINGER_REJECTED)
+            {
+                Serial.println("Fingerprint not enrolled, lift the finger and try again.");
             }
         }
         else
@@ -554,6 +592,7 @@ void loop()
             setRGBColor(255, 0, 0); // Red: Access denied
             handleWrongFingerprint();
             waitingForFingerprint = false;
+            fingerprint.stop();
             personDetected = false;
             setRGBColor(0, 0, 0); // Turn off LED
         }
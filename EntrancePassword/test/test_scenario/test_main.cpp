@@ -0,0 +1,146 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include "../../src/FingerprintReader/FingerprintReader.h"
+
+// Runs the EntrancePassword firmware (src/main.cpp) in virtual time: a
+// visitor walks up, the board waits for a finger and opens the door, then a
+// stranger lets the 20 s fingerprint window run out. Prints the loop() pass
+// distribution and the time from each event to the door or the hub.
+
+extern const char *HUB;
+extern int alarmActivated;
+extern FingerprintReader fingerprint;
+
+#define TRIG_PIN 5
+#define ECHO_PIN 18
+#define FINGERPRINT_TOUCH_PIN 34
+#define LOOP_PASS_COST_US 10 // Code between the stand-in calls
+
+static sim::Hub cloud(HUB);
+static sim::Sonar ranger(TRIG_PIN, ECHO_PIN);
+static sim::Histogram passes;
+
+// Nobody in front of the door (3 m) outside [arriveUs, leaveUs)
+static uint64_t arriveUs = UINT64_MAX;
+static uint64_t leaveUs = UINT64_MAX;
+
+static long scene(uint64_t us)
+{
+    static uint32_t ping = 0;
+    ping++;
+    if (ping % 23 == 0)
+        return 0;
+    long jitter = (long)(ping % 3) - 1;
+    return (us >= arriveUs && us < leaveUs ? 15 : 300) + jitter;
+}
+
+// Time of the first line printed at or after sinceUs containing text
+static uint64_t printedAt(const char *text, uint64_t sinceUs)
+{
+    for (const sim::SerialLine &line : sim::serialLines())
+    {
+        if (line.atUs >= sinceUs && line.text.find(text) != std::string::npos)
+            return line.atUs;
+    }
+    return UINT64_MAX;
+}
+
+void setUp()
+{
+    ranger.distanceCm = scene;
+}
+
+void tearDown()
+{
+}
+
+static void run(uint64_t forUs)
+{
+    sim::runLoop(loop, forUs, LOOP_PASS_COST_US, &passes);
+}
+
+void test_boot_registers_with_the_hub()
+{
+    setup();
+    run(15000000);
+
+    const sim::Hub::Entry *registered = cloud.first("/register");
+    TEST_ASSERT_NOT_NULL(registered);
+    TEST_ASSERT_EQUAL(200, registered->code);
+    printf("Boot to registration: %llu ms\n", (unsigned long long)registered->atUs / 1000);
+}
+
+void test_enrolled_finger_opens_the_door()
+{
+    passes.clear();
+    arriveUs = sim::nowUs() + 1000000;
+    leaveUs = arriveUs + 10000000;
+    // Presence is confirmed after 2 s; the finger goes down a second later
+    uint64_t fingerUs = arriveUs + 3000000;
+    sim::fingerprint().place(fingerUs, 800000, 3);
+    uint32_t polls = fingerprint.getStats().polls;
+    run(14000000);
+    // No touch line by default, presence is polled over UART
+    TEST_ASSERT_GREATER_THAN(polls, fingerprint.getStats().polls);
+
+    uint64_t matchedUs = printedAt("Fingerprint matched! ID: 3", fingerUs);
+    uint64_t openUs = printedAt("Time to door open", fingerUs);
+    TEST_ASSERT_TRUE(matchedUs != UINT64_MAX);
+    TEST_ASSERT_TRUE(openUs != UINT64_MAX);
+    TEST_ASSERT_EQUAL(90, sim::servoAngle()); // Opened, closed and back to neutral
+
+    const sim::Hub::Entry *movement = cloud.first("/movement_event", arriveUs);
+    TEST_ASSERT_NOT_NULL(movement);
+    printf("Finger to match: %llu ms, to door open: %llu ms\n", (unsigned long long)(matchedUs - fingerUs) / 1000,
+           (unsigned long long)(openUs - fingerUs) / 1000);
+    printf("Arrival to /movement_event at the hub: %llu ms\n", (unsigned long long)(movement->atUs - arriveUs) / 1000);
+    passes.print("loop() passes, door");
+}
+
+void test_no_finger_raises_the_alarm_at_the_hub()
+{
+    passes.clear();
+    arriveUs = sim::nowUs() + 1000000;
+    leaveUs = arriveUs + 30000000;
+    // As on a board built with the touch line wired
+    sim::fingerprint().wireTouch(FINGERPRINT_TOUCH_PIN, true);
+    fingerprint.setTouchPin(FINGERPRINT_TOUCH_PIN, true);
+    uint32_t polls = fingerprint.getStats().polls;
+    run(32000000);
+
+    TEST_ASSERT_TRUE(alarmActivated);
+    // The touch line stays low, so the 20 s window sends nothing over UART
+    TEST_ASSERT_EQUAL(polls, fingerprint.getStats().polls);
+    uint64_t timeoutUs = printedAt("Fingerprint not recognized", arriveUs);
+    TEST_ASSERT_TRUE(timeoutUs != UINT64_MAX);
+    const sim::Hub::Entry *alarm = cloud.first("/front_door_alarm", arriveUs);
+    TEST_ASSERT_NOT_NULL(alarm);
+    printf("Fingerprint timeout to /front_door_alarm at the hub: %llu ms\n",
+           (unsigned long long)(alarm->atUs - timeoutUs) / 1000);
+    passes.print("loop() passes, alarm");
+}
+
+void test_hub_command_stops_the_alarm()
+{
+    passes.clear();
+    uint64_t sentUs = sim::nowUs() + 1000000;
+    sim::at(sentUs, []
+            { cloud.queueCommand("FrontDoorESP32", "deactivate_alarm"); });
+    run(5000000);
+
+    TEST_ASSERT_FALSE(alarmActivated);
+    uint64_t stoppedUs = printedAt("Alarm deactivated!", sentUs);
+    TEST_ASSERT_TRUE(stoppedUs != UINT64_MAX);
+    printf("Hub command to alarm off: %llu ms\n", (unsigned long long)(stoppedUs - sentUs) / 1000);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_registers_with_the_hub);
+    RUN_TEST(test_enrolled_finger_opens_the_door);
+    RUN_TEST(test_no_finger_raises_the_alarm_at_the_hub);
+    RUN_TEST(test_hub_command_stops_the_alarm);
+    return UNITY_END();
+}
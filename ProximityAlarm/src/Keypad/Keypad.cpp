@@ -1,8 +1,14 @@
 #include "Keypad.h"
 
-Keypad::Keypad(const int numRows, const int numCols, const int *rowPins, const int *colPins, const char **keys)
-    : numRows(numRows), numCols(numCols), rowPins(rowPins), colPins(colPins), keys(keys), lastKeyPressed('Z')
+#define KEYPAD_SCAN_INTERVAL_US 5000
+#define KEYPAD_DEBOUNCE_SCANS 4 // Stable scans before a press or release counts (20 ms)
+#define KEYPAD_IDLE_SCANS 10    // Scans with every key released before scanning stops
+
+Keypad::Keypad(const int numRows, const int numCols, const int *rowPins, const int *colPins, const char *const *keys)
+    : numRows(numRows), numCols(numCols), rowPins(rowPins), colPins(colPins), keys(keys), lastKeyPressed('Z'),
+      rowMask(0), colsLow(0), colsHigh(0), scanTimer(NULL), scanning(false), pressedKeys(0), idleScans(0), droppedEvents(0)
 {
+    memset(integrators, 0, sizeof(integrators));
 }
 
 int Keypad::getLastKeyPressed()
@@ -15,48 +21,140 @@ void Keypad::setLastKeyPressed(char key)
     lastKeyPressed = key;
 }
 
+uint32_t Keypad::getDroppedEvents()
+{
+    return droppedEvents;
+}
+
+uint16_t Keypad::getPressedKeys()
+{
+    return pressedKeys;
+}
+
 void Keypad::initialize()
 {
-    // Set row pins as inputs and enable pull-up resistorss
-    for (int i = 0; i < numRows; i++)
+    if (numRows * numCols > KEYPAD_MAX_KEYS)
     {
-        pinMode(rowPins[i], INPUT_PULLUP);
+        Serial.println("Keypad has more than " + String(KEYPAD_MAX_KEYS) + " keys.");
+        return;
     }
+    if (!keypad_detail::allLowBank(rowPins, numRows))
+    {
+        Serial.println("Keypad row pins must be GPIO 0-31.");
+        return;
+    }
+
+    rowMask = keypad_detail::lowBankMask(rowPins, numRows);
+    colsLow = keypad_detail::lowBankMask(colPins, numCols);
+    colsHigh = keypad_detail::highBankMask(colPins, numCols);
 
-    // Set column pins as outputs
+    // Set column pins as open-drain outputs, all pulled low while idle
     for (int i = 0; i < numCols; i++)
     {
-        pinMode(colPins[i], OUTPUT);
-        digitalWrite(colPins[i], HIGH); // Set columns to high to disable
+        pinMode(colPins[i], OUTPUT_OPEN_DRAIN);
+    }
+    idleColumns();
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onScanTimer;
+    timerArgs.arg = this;
+    timerArgs.name = "keypad_scan";
+    esp_timer_create(&timerArgs, &scanTimer);
+
+    // Set row pins as inputs and enable pull-up resistors; a press pulls the row low
+    for (int i = 0; i < numRows; i++)
+    {
+        pinMode(rowPins[i], INPUT_PULLUP);
+        attachInterruptArg(digitalPinToInterrupt(rowPins[i]), onRowChange, this, FALLING);
     }
 }
 
-char Keypad::getKey()
+// All columns low, so a press on any key shows up on its row
+void Keypad::idleColumns()
+{
+    keypad_detail::selectAllColumns(colsLow, colsHigh);
+}
+
+void IRAM_ATTR Keypad::onRowChange(void *arg)
+{
+    Keypad *keypad = static_cast<Keypad *>(arg);
+
+    // Rows also toggle while the scan drives the columns
+    if (keypad->scanning)
+        return;
+
+    keypad->scanning = true;
+    esp_timer_start_periodic(keypad->scanTimer, KEYPAD_SCAN_INTERVAL_US);
+}
+
+void Keypad::onScanTimer(void *arg)
+{
+    static_cast<Keypad *>(arg)->scan();
+}
+
+// Runs on the esp_timer task
+void Keypad::scan()
 {
-    for (int col = 0; col < numCols; col++)
+    uint16_t raw = keypad_detail::scanMatrix(rowPins, numRows, colPins, numCols, rowMask, colsLow, colsHigh);
+    idleColumns();
+
+    bool settling = false;
+    for (int index = 0; index < numRows * numCols; index++)
     {
-        // Enable the current column
-        digitalWrite(colPins[col], LOW);
+        bool down = raw & (1u << index);
+        bool wasPressed = pressedKeys & (1u << index);
+
+        // Integrator debounce: the state only flips after the raw
+        // reading agreed for KEYPAD_DEBOUNCE_SCANS scans in a row
+        if (down && integrators[index] < KEYPAD_DEBOUNCE_SCANS)
+            integrators[index]++;
+        else if (!down && integrators[index] > 0)
+            integrators[index]--;
 
-        // Check each row in this column
-        for (int row = 0; row < numRows; row++)
+        bool pressed = wasPressed ? integrators[index] > 0 : integrators[index] == KEYPAD_DEBOUNCE_SCANS;
+        if (pressed != wasPressed)
         {
-            // If a key is pressed (LOW), return its value
-            if (digitalRead(rowPins[row]) == LOW)
-            {
-                // Disable the current column
-                digitalWrite(colPins[col], HIGH);
-                return keys[row][col];
-            }
+            pressedKeys ^= (1u << index);
+            KeyEvent event = {keys[index / numCols][index % numCols], pressed, (uint32_t)millis()};
+            if (!events.push(event))
+                droppedEvents++;
         }
+        settling = settling || integrators[index] > 0;
+    }
+    idleScans = settling ? 0 : idleScans + 1;
+
+    if (idleScans < KEYPAD_IDLE_SCANS)
+        return;
 
-        // Disable the current column
-        digitalWrite(colPins[col], HIGH);
+    // Back to interrupt mode. A press that lands between idling the columns
+    // and clearing the flag is caught by checking the rows once more.
+    esp_timer_stop(scanTimer);
+    idleScans = 0;
+    scanning = false;
+    if ((~REG_READ(GPIO_IN_REG) & rowMask) != 0 && !scanning)
+    {
+        scanning = true;
+        esp_timer_start_periodic(scanTimer, KEYPAD_SCAN_INTERVAL_US);
     }
+}
 
-    // No key pressed, clear the flag
-    lastKeyPressed = 'Z';
-    return '\0'; // Return null if no key is pressed
+bool Keypad::getEvent(KeyEvent &event)
+{
+    return events.pop(event);
+}
+
+char Keypad::getKey()
+{
+    KeyEvent event;
+    while (getEvent(event))
+    {
+        if (event.pressed)
+        {
+            lastKeyPressed = event.key;
+            return event.key;
+        }
+    }
+    return '\0'; // Return null if no key was pressed
 }
 
 void Keypad::printPressedKey(char key)
@@ -64,6 +162,5 @@ void Keypad::printPressedKey(char key)
     if (key != '\0')
     {
         Serial.println("Key: " + String(key));
-        delay(250);
     }
-}
\ No newline at end of file
+}
@@ -4,7 +4,27 @@
 #define KEYPAD_H
 
 #include <Arduino.h>
+#include <esp_timer.h>
+#include <SpscQueue.h>
+#include "KeypadMatrix.h"
 
+#define KEYPAD_MAX_KEYS 16
+#define KEYPAD_EVENT_QUEUE 16
+
+struct KeyEvent
+{
+    char key;
+    bool pressed; // false for a release
+    uint32_t timeMs;
+};
+
+// Idle, all columns are driven low so any key press pulls its row low and
+// fires a pin-change interrupt. The interrupt starts a periodic esp_timer
+// scan; every key runs its own debounce integrator and press/release events
+// go into a fixed-size queue. Once all keys have been released for a while
+// the scan stops and the keypad goes back to waiting for an interrupt.
+// Each scan reads all rows of a column in one GPIO register access (see
+// KeypadMatrix.h), so row pins must be GPIO 0-31.
 class Keypad
 {
 private:
@@ -12,16 +32,50 @@ private:
     const int numCols;
     const int *rowPins;
     const int *colPins;
-    const char **keys;
+    const char *const *keys;
     int lastKeyPressed;
 
+    uint32_t rowMask; // Row and column bits in the GPIO registers
+    uint32_t colsLow;
+    uint32_t colsHigh;
+
+    esp_timer_handle_t scanTimer;
+    volatile bool scanning;
+    uint8_t integrators[KEYPAD_MAX_KEYS]; // Debounce state per key, only touched by the scan
+    uint16_t pressedKeys;                 // Debounced state, bit row * numCols + col
+    uint8_t idleScans;
+    SpscQueue<KeyEvent, KEYPAD_EVENT_QUEUE> events;
+    uint32_t droppedEvents;
+
+    static void IRAM_ATTR onRowChange(void *arg);
+    static void onScanTimer(void *arg);
+    void scan();
+    void idleColumns();
+
 public:
-    Keypad(const int numRows, const int numCols, const int *rowPins, const int *colPins, const char **keys);
+    Keypad(const int numRows, const int numCols, const int *rowPins, const int *colPins, const char *const *keys);
+
+    template <size_t Rows, size_t Cols>
+    explicit Keypad(const KeypadMatrix<Rows, Cols> &matrix)
+        : Keypad(Rows, Cols, matrix.rowPins, matrix.colPins, matrix.keys)
+    {
+    }
+
     void initialize();
+
+    // Key event from the queue, false if there is none; call from one task only
+    bool getEvent(KeyEvent &event);
+
+    // Next pressed key from the queue (releases are skipped), '\0' if none
     char getKey();
     void printPressedKey(char key);
     int getLastKeyPressed();
     void setLastKeyPressed(char key);
+    uint32_t getDroppedEvents();
+
+    // Debounced state of every key, bit row * numCols + col; several bits
+    // are set while keys are held together
+    uint16_t getPressedKeys();
 };
 
-#endif
\ No newline at end of file
+#endif
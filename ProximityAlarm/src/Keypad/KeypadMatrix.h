@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef KEYPAD_MATRIX_H
+#define KEYPAD_MATRIX_H
+
+#include <Arduino.h>
+#include <soc/gpio_reg.h>
+
+#define KEYPAD_SETTLE_US 3 // Row pull-ups recharging the lines after a column switch
+
+// Register-level matrix access shared by KeypadMatrix and Keypad. Columns are
+// driven through the W1TS/W1TC registers of both GPIO banks and every row is
+// read at once from GPIO_IN_REG, so a column costs one register read no
+// matter how many rows the keypad has. Columns are open-drain: two keys held
+// on one row would otherwise short a column driven high to the selected one.
+namespace keypad_detail
+{
+    constexpr uint32_t lowBankMask(const int *pins, size_t count)
+    {
+        return count == 0 ? 0 : (pins[count - 1] < 32 ? 1u << pins[count - 1] : 0) | lowBankMask(pins, count - 1);
+    }
+
+    constexpr uint32_t highBankMask(const int *pins, size_t count)
+    {
+        return count == 0 ? 0 : (pins[count - 1] >= 32 ? 1u << (pins[count - 1] - 32) : 0) | highBankMask(pins, count - 1);
+    }
+
+    constexpr bool allLowBank(const int *pins, size_t count)
+    {
+        return count == 0 || (pins[count - 1] >= 0 && pins[count - 1] < 32 && allLowBank(pins, count - 1));
+    }
+
+    // Pulls one column low and releases all others
+    inline void selectColumn(int pin, uint32_t colsLow, uint32_t colsHigh)
+    {
+        REG_WRITE(GPIO_OUT_W1TS_REG, colsLow);
+        REG_WRITE(GPIO_OUT1_W1TS_REG, colsHigh);
+        if (pin < 32)
+            REG_WRITE(GPIO_OUT_W1TC_REG, 1u << pin);
+        else
+            REG_WRITE(GPIO_OUT1_W1TC_REG, 1u << (pin - 32));
+        delayMicroseconds(KEYPAD_SETTLE_US);
+    }
+
+    inline void selectAllColumns(uint32_t colsLow, uint32_t colsHigh)
+    {
+        REG_WRITE(GPIO_OUT_W1TC_REG, colsLow);
+        REG_WRITE(GPIO_OUT1_W1TC_REG, colsHigh);
+    }
+
+    // Raw pressed-key mask, bit row * numCols + col; rows must be GPIO 0-31
+    inline uint16_t scanMatrix(const int *rowPins, int numRows, const int *colPins, int numCols, uint32_t rowMask,
+                               uint32_t colsLow, uint32_t colsHigh)
+    {
+        uint16_t pressed = 0;
+        for (int col = 0; col < numCols; col++)
+        {
+            selectColumn(colPins[col], colsLow, colsHigh);
+            uint32_t rowsDown = ~REG_READ(GPIO_IN_REG) & rowMask;
+            for (int row = 0; rowsDown != 0 && row < numRows; row++)
+            {
+                if (rowsDown & (1u << rowPins[row]))
+                    pressed |= 1u << (row * numCols + col);
+            }
+        }
+        return pressed;
+    }
+}
+
+// Keypad wiring and layout fixed at compile time. Pin masks are computed by
+// the compiler and the wiring can be checked with static_assert, e.g.
+//
+//   constexpr KeypadMatrix<4, 4> matrix(rowPins, colPins, keys);
+//   static_assert(matrix.rowsInLowBank(), "rows must be GPIO 0-31");
+//
+// scan() polls the whole matrix into a 16-bit mask, one bit per key, so any
+// combination of keys (N-key rollover, chords) is reported. For debounced,
+// interrupt-driven input pass the matrix to Keypad.
+template <size_t Rows, size_t Cols>
+class KeypadMatrix
+{
+    static_assert(Rows > 0 && Cols > 0 && Rows * Cols <= 16, "Pressed-key mask holds at most 16 keys");
+
+public:
+    constexpr KeypadMatrix(const int (&rowPins)[Rows], const int (&colPins)[Cols], const char *const (&keys)[Rows])
+        : rowPins(rowPins), colPins(colPins), keys(keys)
+    {
+    }
+
+    constexpr bool rowsInLowBank() const
+    {
+        return keypad_detail::allLowBank(rowPins, Rows);
+    }
+
+    constexpr uint32_t rowMask() const
+    {
+        return keypad_detail::lowBankMask(rowPins, Rows);
+    }
+
+    constexpr uint32_t colMaskLow() const
+    {
+        return keypad_detail::lowBankMask(colPins, Cols);
+    }
+
+    constexpr uint32_t colMaskHigh() const
+    {
+        return keypad_detail::highBankMask(colPins, Cols);
+    }
+
+    // Bit of a key in the pressed-key mask, 0 if the layout lacks it
+    constexpr uint16_t keyBit(char key, size_t index = 0) const
+    {
+        return index == Rows * Cols ? 0
+               : keys[index / Cols][index % Cols] == key ? (uint16_t)(1u << index)
+                                                         : keyBit(key, index + 1);
+    }
+
+    // Mask of several keys held together, e.g. chord("*#")
+    constexpr uint16_t chord(const char *combo) const
+    {
+        return *combo == '\0' ? 0 : keyBit(*combo) | chord(combo + 1);
+    }
+
+    void begin() const
+    {
+        for (size_t i = 0; i < Rows; i++)
+            pinMode(rowPins[i], INPUT_PULLUP);
+        for (size_t i = 0; i < Cols; i++)
+            pinMode(colPins[i], OUTPUT_OPEN_DRAIN);
+        keypad_detail::selectAllColumns(colMaskLow(), colMaskHigh());
+    }
+
+    // Undebounced state of every key; leaves all columns driven low
+    uint16_t scan() const
+    {
+        uint16_t pressed = keypad_detail::scanMatrix(rowPins, Rows, colPins, Cols, rowMask(), colMaskLow(), colMaskHigh());
+        keypad_detail::selectAllColumns(colMaskLow(), colMaskHigh());
+        return pressed;
+    }
+
+    const int (&rowPins)[Rows];
+    const int (&colPins)[Cols];
+    const char *const (&keys)[Rows];
+};
+
+#endif
@@ -1,4 +1,7 @@
 const char *SSID = "dumi";
 const char *PASSWORD = "kiki1234";
 
-const char *HUB = "https://murmuring-citadel-82885-21551507c6aa.herokuapp.com";
\ No newline at end of file
+const char *HUB = "https://murmuring-citadel-82885-21551507c6aa.herokuapp.com";
+
+// Pre-shared key of the UDP heartbeat (HEARTBEAT_KEY on the hub), empty keeps it off
+const char *HEARTBEAT_KEY = "";
@@ -1,7 +1,17 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiClient.h>
-#include <HTTPClient.h>
+#include <HubClient.h>
+#include <CommandChannel.h>
+#include <Ultrasonic.h>
+#include <DistanceFilter.h>
+#include <EventOutbox.h>
+#include <JsonWriter.h>
+#include <WiFiSupervisor.h>
+#include <HubDiscovery.h>
+#include <UdpHeartbeat.h>
+#include <BoardRuntime.h>
+#include <LoopProfiler.h>
+#include <SpscQueue.h>
 #include <esp_http_server.h>
 #include "FS.h"
 #include "Keypad/Keypad.h"
@@ -11,6 +21,13 @@
 #define TRIG_PIN 18
 #define ECHO_PIN 19
 
+// Sonar rate: 2 Hz while the scene is empty, 25 Hz once something is within
+// a metre, back to idle 2 s after it left
+#define SONAR_IDLE_INTERVAL_MS 500
+#define SONAR_ACTIVE_INTERVAL_MS 40
+#define SONAR_ACTIVE_RANGE_CM 100
+#define SONAR_ACTIVE_HOLD_MS 2000
+
 // Define Buzzer pin
 #define R1_PIN 13
 #define R2_PIN 12
@@ -25,127 +42,117 @@
 // Keypad setup
 const int numRows = 4;
 const int numCols = 4;
-const int rowPins[numRows] = {R1_PIN, R2_PIN, R3_PIN, R4_PIN};
-const int colPins[numCols] = {C1_PIN, C2_PIN, C3_PIN, C4_PIN};
+constexpr int rowPins[numRows] = {R1_PIN, R2_PIN, R3_PIN, R4_PIN};
+constexpr int colPins[numCols] = {C1_PIN, C2_PIN, C3_PIN, C4_PIN};
 
 // Keypad layout (4x4 matrix)
-const char *keys[] = {
+constexpr const char *keys[numRows] = {
     "123A",
     "456B",
     "789C",
     "*0#D"};
 
-Keypad keypad(numRows, numCols, rowPins, colPins, keys);
+constexpr KeypadMatrix<numRows, numCols> keypadMatrix(rowPins, colPins, keys);
+static_assert(keypadMatrix.rowsInLowBank(), "Keypad rows must be GPIO 0-31 to be read in one register access");
+
+Keypad keypad(keypadMatrix);
+
+// Iteration time distribution of loop(), printed once a minute
+#define LOOP_REPORT_INTERVAL_MS 60000
+LoopProfiler loopProfiler("ProximityAlarm");
+
+// HC-SR04 driver, measures in the background
+Ultrasonic sonar(TRIG_PIN, ECHO_PIN);
+
+// Something closer than 30 cm (but further than 10 cm) arms the alarm; it
+// only counts as gone again beyond 35 cm
+DistanceFilter proximity(30, 35, 11);
 
 // Network and hub configuration
 const char *ssid = SSID;         // WiFi SSID
 const char *password = PASSWORD; // WiFi password
+WiFiSupervisor wifi(ssid, password); // Cached fast join and background reconnect
 String hub_address = HUB;        // Hub address
+HubClient hub;                   // Keep-alive connection to the hub
+
+void startAlarm();
+void stopAlarm();
 
-const char *board_name = "ProximityBoard"; // Board name
+// Commands the hub can send, with the /send_status code that carries them
+// while the command stream is down
+constexpr BoardCommand board_commands[] = {
+    {"activate_alarm", 203, startAlarm},
+    {"deactivate_alarm", 204, stopAlarm},
+};
+static_assert(boardCommandsUnique(board_commands), "Hub command names and status codes must be unique");
+constexpr BoardDescriptor board = BOARD_DESCRIPTOR("ProximityBoard", board_commands);
+
+const char *board_name = board.name;       // Board name
+HubDiscovery hubDiscovery(board_name);     // Local hub over mDNS, cloud URL as fallback
+UdpHeartbeat heartbeat(board_name);        // Signed UDP heartbeat to the LAN hub
+CommandChannel commandChannel(board_name); // Push channel for hub commands
+EventOutbox outbox(board_name);            // Flash-backed queue for hub notifications
+
+// Registration, heartbeat and hub commands
+BoardRuntime runtime(board, wifi, hub, hubDiscovery, heartbeat);
+
+// Hub traffic runs in its own task on core 0, so a slow hub or a registration
+// retry never stalls the keypad and the sonar in loop(). loop() publishes the
+// heartbeat state, commands from the status code come back through the queue.
+volatile uint8_t heartbeatState = 0;
+SpscQueue<HubCommand, 8> statusCommandQueue; // network task -> loop(), status code fallback
+
+void networkTask(void *arg);
 
 // Password variables
 String enteredPassword = "";           // Stores entered password
 const String correctPassword = "1523"; // Set correct password
-char lastKeyPressed = '\0';            // To track debouncing
-unsigned long lastTimeKeyPressed = 0;  // Timestamp for last key press
 int wrongGuessCount = 0;               // Tracks wrong guesses
 
 bool alarmActive = false;
 unsigned long systemDisabledUntil = 0; // Timestamp to disable system for 60 seconds
 
-int board_status_milis = 0;
-
 // HTTP Server handle
 httpd_handle_t server = NULL;
 
-// Function to connect to WiFi
-bool connectToWiFi(const char *ssid, const char *password)
-{
-    Serial.println("Attempting to connect to WiFi: " + String(ssid));
-    WiFi.begin(ssid, password);
-
-    unsigned long startAttemptTime = millis();
-    const unsigned long timeout = 10000; // 10 seconds timeout
-
-    while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < timeout)
-    {
-        delay(500);
-        Serial.print(".");
-    }
-
-    if (WiFi.status() == WL_CONNECTED)
-    {
-        Serial.println("\nConnected to WiFi: " + String(ssid));
-        Serial.println("IP Address: " + WiFi.localIP().toString());
-        return true;
-    }
-    else
-    {
-        Serial.println("\nFailed to connect to WiFi: " + String(ssid));
-        return false;
-    }
-}
-
-// Function to register the board with the hub
-void registerBoard()
+// Function to measure distance with HC-SR04, returns the filtered distance
+long measureDistance()
 {
-    if (hub_address.isEmpty())
-        return;
-
-    HTTPClient http;
-    http.begin(hub_address + "/register");
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"name\":\"" + String(board_name) + "\",\"ip\":\"" + WiFi.localIP().toString() + "\"}";
-    int httpCode = http.POST(payload);
-    if (httpCode == 200)
+    sonar.update();
+    if (sonar.hasNewReading())
     {
-        Serial.println("Board registered successfully.");
-    }
-    else
-    {
-        Serial.println("Failed to register board. HTTP code: " + String(httpCode));
+        PresenceEvent event = proximity.update(sonar.getDistance());
+        if (event == PRESENCE_BEGIN)
+        {
+            // Detection latency: idle sampling gap before the first sighting,
+            // plus the filter confirming it at the active rate
+            Serial.println("Presence begins at " + String(proximity.getDistance()) + " cm, confirmed " +
+                           String(millis() - sonar.activeSince()) + " ms after first sighting (idle gap up to " +
+                           String(sonar.getStats().lastWakeGapMs) + " ms).");
+        }
+        else if (event == PRESENCE_END)
+        {
+            const DistanceFilterStats &stats = proximity.getStats();
+            Serial.println("Presence ends. " + String(stats.rejected) + " outliers rejected in " +
+                           String(stats.samples) + " samples.");
+            sonar.printStats();
+        }
     }
-    http.end();
-}
-
-// Function to measure distance with HC-SR04
-long measureDistance()
-{
-    digitalWrite(TRIG_PIN, LOW);
-    delayMicroseconds(2);
-    digitalWrite(TRIG_PIN, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(TRIG_PIN, LOW);
-
-    long duration = pulseIn(ECHO_PIN, HIGH);
-    long distance = duration * 0.034 / 2; // Convert to cm
-    return distance;
+    return proximity.getDistance();
 }
 
 // Send notification to the hub
-void sendNotificationToHub(String message)
+void sendNotificationToHub(const char *message)
 {
     if (!hub_address.isEmpty())
     {
-        HTTPClient http;
-        String url = hub_address + "/front_door_alarm";
-        http.begin(url);
-        http.addHeader("Content-Type", "application/json");
-
-        String payload = "{\"message\":\"" + message + "\",\"timestamp\":\"" + String(millis()) + "\"}";
+        JsonWriter<128> payload;
+        payload.beginObject().field(JSON_KEY("message"), message).field(JSON_KEY("timestamp"), millis()).endObject();
 
-        int httpCode = http.POST(payload);
-        if (httpCode == 200)
-        {
-            Serial.println("Notification sent to hub.");
-        }
-        else
+        if (outbox.append("/front_door_alarm", payload.c_str()))
         {
-            Serial.println("Failed to send notification. HTTP code: " + String(httpCode));
+            Serial.println("Notification queued for hub.");
         }
-        http.end();
     }
     else
     {
@@ -174,6 +181,7 @@ void stopAlarm()
         Serial.println("Alarm deactivated. System will restart in 60 seconds.");
         digitalWrite(BUZZER_PIN, HIGH);         // Turn off buzzer
         systemDisabledUntil = millis() + 60000; // Disable for 60 seconds
+        proximity.reset();                      // Not ranged during the lockout, the presence is stale
     }
 }
 
@@ -182,23 +190,16 @@ void notifyThreeWrongGuesses()
 {
     if (!hub_address.isEmpty())
     {
-        HTTPClient http;
-        String url = hub_address + "/three_wrong_guesses";
-        http.begin(url);
-        http.addHeader("Content-Type", "application/json");
+        JsonWriter<96> payload;
+        payload.beginObject()
+            .field(JSON_KEY("message"), "Three wrong guesses made")
+            .field(JSON_KEY("timestamp"), millis())
+            .endObject();
 
-        String payload = "{\"message\":\"Three wrong guesses made\",\"timestamp\":\"" + String(millis()) + "\"}";
-
-        int httpCode = http.POST(payload);
-        if (httpCode == 200)
-        {
-            Serial.println("Three wrong guesses notification sent.");
-        }
-        else
+        if (outbox.append("/three_wrong_guesses", payload.c_str()))
         {
-            Serial.println("Failed to send three wrong guesses notification. HTTP code: " + String(httpCode));
+            Serial.println("Three wrong guesses notification queued.");
         }
-        http.end();
     }
 }
 
@@ -212,36 +213,29 @@ void handlePasswordEntry(char key)
         return;
     }
 
-    // Avoid recognizing the same keypress repeatedly
-    if (key != lastKeyPressed)
-    {
-        lastKeyPressed = key;
-        lastTimeKeyPressed = millis();
-
-        // Add key to the entered password
-        enteredPassword += key;
-        Serial.println("Key pressed: " + String(key));
-        Serial.println("Current Password: " + enteredPassword);
+    // Add key to the entered password
+    enteredPassword += key;
+    Serial.println("Key pressed: " + String(key));
+    Serial.println("Current Password: " + enteredPassword);
 
-        // Check password length and validate
-        if (enteredPassword.length() == 4)
+    // Check password length and validate
+    if (enteredPassword.length() == 4)
+    {
+        if (enteredPassword == correctPassword)
         {
-            if (enteredPassword == correctPassword)
-            {
-                stopAlarm();         // Deactivate the alarm
-                wrongGuessCount = 0; // Reset wrong guess count
-            }
-            else
+            stopAlarm();         // Deactivate the alarm
+            wrongGuessCount = 0; // Reset wrong guess count
+        }
+        else
+        {
+            Serial.println("Incorrect password!");
+            wrongGuessCount++;
+            if (wrongGuessCount >= 3)
             {
-                Serial.println("Incorrect password!");
-                wrongGuessCount++;
-                if (wrongGuessCount >= 3)
-                {
-                    notifyThreeWrongGuesses(); // Notify the hub
-                }
+                notifyThreeWrongGuesses(); // Notify the hub
             }
-            enteredPassword = ""; // Reset the password for next attempt
         }
+        enteredPassword = ""; // Reset the password for next attempt
     }
 }
 
@@ -300,90 +294,102 @@ void startServer()
     }
 }
 
-static void send_board_status()
-{
-    HTTPClient http;
-    String url = hub_address + "/send_status";
-    http.begin(url);
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"message\":\"Board is up\", \"name\":\"" + String(board_name) + "\"}";
-
-    int httpCode = http.POST(payload);
-    // http code 202 -> received no command
-    // http code 203 -> activate alarm command
-    // http code 204 -> deactivate alarm command
-    Serial.println("HTTP code: " + String(httpCode));
-    if (httpCode == 202)
-    {
-        Serial.println("No command received.");
-    }
-    else if (httpCode == 203)
-    {
-        Serial.println("Activate alarm command received.");
-        startAlarm();
-    }
-    else if (httpCode == 204)
-    {
-        Serial.println("Deactivate alarm command received.");
-        stopAlarm();
-    }
-
-    http.end();
-}
-
 void setup()
 {
     Serial.begin(115200);
     Serial.println("Proximity Alarm System with Network Hub Integration");
 
-    pinMode(TRIG_PIN, OUTPUT);
-    pinMode(ECHO_PIN, INPUT);
+    sonar.begin();
+    sonar.setAdaptiveInterval(SONAR_IDLE_INTERVAL_MS, SONAR_ACTIVE_INTERVAL_MS, SONAR_ACTIVE_RANGE_CM,
+                              SONAR_ACTIVE_HOLD_MS);
     pinMode(BUZZER_PIN, OUTPUT);
 
     digitalWrite(BUZZER_PIN, HIGH); // Ensure buzzer is off initially
     keypad.initialize();
 
-    // Connect to WiFi
-    if (!connectToWiFi(ssid, password))
-    {
-        return;
-    }
+    // Connect to WiFi; the alarm works offline and the supervisor keeps
+    // reconnecting in the background
+    wifi.begin(10000);
+    heartbeat.begin(HEARTBEAT_KEY);
 
-    // Register the board with the hub if connected
-    registerBoard();
+    // Registration happens in the network task once the link is up
+    hub.begin(hub_address);
+    outbox.begin(hub_address);
+    xTaskCreatePinnedToCore(networkTask, "network", 8192, NULL, 1, NULL, 0);
 
     // Start the HTTP server
     startServer();
 }
 
+// Pinned to core 0 next to the Wi-Fi stack: registration, heartbeats and the
+// status fallback; the handlers of commands still run in loop()
+void networkTask(void *arg)
+{
+    commandChannel.begin(hub_address);
+    runtime.setCommandChannel(commandChannel);
+    runtime.begin(hub_address);
+
+    while (true)
+    {
+        const char *statusCommand = runtime.update(heartbeatState);
+        if (statusCommand != NULL)
+        {
+            HubCommand hubCommand = {0, ""};
+            strncpy(hubCommand.name, statusCommand, sizeof(hubCommand.name) - 1);
+            if (!statusCommandQueue.push(hubCommand))
+            {
+                Serial.println("Command queue full, dropped: " + String(statusCommand));
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
 void loop()
 {
-    if (millis() - board_status_milis > 1000)
+    loopProfiler.tick();
+    loopProfiler.report(LOOP_REPORT_INTERVAL_MS);
+
+    heartbeatState = (alarmActive ? HEARTBEAT_STATE_ALARM : 0) |
+                     (proximity.isPresent() ? HEARTBEAT_STATE_PRESENCE : 0) |
+                     (millis() < systemDisabledUntil ? HEARTBEAT_STATE_LOCKED_OUT : 0);
+
+    // Commands arrive on the stream or, while it is down, through the status code
+    HubCommand command;
+    while (statusCommandQueue.pop(command) || commandChannel.poll(command))
     {
-        send_board_status();
-        board_status_milis = millis();
+        runtime.dispatch(command.name);
     }
 
-    // Wait for 60 seconds if system is disabled
+    // Wait for 60 seconds if system is disabled; keys typed meanwhile are dropped
     if (millis() < systemDisabledUntil)
     {
+        while (keypad.getKey() != '\0')
+        {
+        }
         return;
     }
+    if (systemDisabledUntil != 0)
+    {
+        // Lockout over: start from a clean filter so whoever was there when
+        // the alarm was disarmed has to be seen again
+        systemDisabledUntil = 0;
+        proximity.reset();
+    }
 
     // Measure distance
-    long distance = measureDistance();
+    measureDistance();
 
     // Trigger alarm if proximity is detected
-    if (distance > 10 && distance < 30 && !alarmActive)
+    if (proximity.isPresent() && !alarmActive)
     {
         startAlarm();
     }
 
-    // Handle keypad input
-    char key = keypad.getKey();
-    if (key != '\0' && millis() - lastTimeKeyPressed > 250)
-    { // Debouncing
+    // Handle keypad input, every debounced press exactly once
+    char key;
+    while ((key = keypad.getKey()) != '\0')
+    {
         handlePasswordEntry(key);
     }
 }
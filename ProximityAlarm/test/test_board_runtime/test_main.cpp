@@ -0,0 +1,143 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include <BoardRuntime.h>
+#include <vector>
+
+// BoardRuntime against a stand-in hub: the descriptor checks that run at
+// compile time, dispatch by name, and registration retried with a jittered
+// backoff while the hub refuses it.
+
+#define HUB_URL "https://hub.example.com"
+#define RETRY_RUN_US 300000000
+
+static int started = 0;
+static int stopped = 0;
+
+static void start()
+{
+    started++;
+}
+
+static void stop()
+{
+    stopped++;
+}
+
+constexpr BoardCommand commands[] = {
+    {"activate_alarm", 203, start},
+    {"deactivate_alarm", 204, stop},
+};
+static_assert(boardCommandsUnique(commands), "unique");
+constexpr BoardDescriptor board = BOARD_DESCRIPTOR("ProximityBoard", commands);
+
+constexpr BoardCommand sameName[] = {{"activate_alarm", 203, start}, {"activate_alarm", 205, stop}};
+constexpr BoardCommand sameCode[] = {{"activate_alarm", 203, start}, {"deactivate_alarm", 203, stop}};
+constexpr BoardCommand noCommandCode[] = {{"activate_alarm", 202, start}};
+static_assert(!boardCommandsUnique(sameName), "same name");
+static_assert(!boardCommandsUnique(sameCode), "same status code");
+static_assert(!boardCommandsUnique(noCommandCode), "202 means no command");
+static_assert(commands[1].hash == boardCommandHash("deactivate_alarm"), "hash at compile time");
+static_assert(sizeof(BOARD_STATUS_PAYLOAD("ProximityBoard")) - 1 == 49, "payload length at compile time");
+
+static bool refuseRegistration = true;
+static std::vector<uint64_t> registerAttemptsUs;
+
+static sim::HttpResponse answer(const sim::HttpRequest &request)
+{
+    if (request.path == "/register")
+    {
+        registerAttemptsUs.push_back(request.atUs);
+        if (refuseRegistration)
+            return sim::HttpResponse{503, "", {}};
+        return sim::HttpResponse{200, "{\"status\":\"success\"}", {}};
+    }
+    return sim::HttpResponse{202, "{\"command\":\"no_command\"}", {}};
+}
+
+static sim::HttpServer hubServer(HUB_URL, answer);
+static WiFiSupervisor wifi("dumi", "kiki1234");
+static HubClient hub;
+static HubDiscovery discovery("ProximityBoard");
+static UdpHeartbeat heartbeat("ProximityBoard");
+static BoardRuntime runtime(board, wifi, hub, discovery, heartbeat);
+
+static void runFor(uint64_t us)
+{
+    uint64_t endUs = sim::nowUs() + us;
+    while (sim::nowUs() < endUs)
+    {
+        runtime.update(0);
+        delay(10);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_status_payload_is_a_literal()
+{
+    TEST_ASSERT_EQUAL_STRING("{\"message\":\"Board is up\",\"name\":\"ProximityBoard\"}", board.statusPayload);
+    TEST_ASSERT_EQUAL(strlen(board.statusPayload), board.statusPayloadLength);
+    TEST_ASSERT_EQUAL_STRING("ProximityBoard", board.name);
+}
+
+void test_dispatch_by_name()
+{
+    TEST_ASSERT_TRUE(runtime.dispatch("activate_alarm"));
+    TEST_ASSERT_TRUE(runtime.dispatch("deactivate_alarm"));
+    TEST_ASSERT_FALSE(runtime.dispatch("open_door"));
+    TEST_ASSERT_FALSE(runtime.dispatch("activate_alarm "));
+    TEST_ASSERT_EQUAL(1, started);
+    TEST_ASSERT_EQUAL(1, stopped);
+    TEST_ASSERT_EQUAL(2, runtime.getStats().commands);
+}
+
+// Attempts 2 s apart at first, doubling up to 60 s with jitter, while the
+// heartbeat keeps going; the first accepted one ends the retries
+void test_refused_registration_is_retried_with_backoff()
+{
+    TEST_ASSERT_TRUE(wifi.begin(10000));
+    hub.begin(HUB_URL);
+    runtime.begin(HUB_URL);
+    runFor(RETRY_RUN_US);
+
+    size_t attempts = registerAttemptsUs.size();
+    TEST_ASSERT_GREATER_THAN(6, attempts);
+    uint64_t longestUs = 0;
+    printf("Register attempts, gaps in s:");
+    for (size_t i = 1; i < attempts; i++)
+    {
+        uint64_t gapUs = registerAttemptsUs[i] - registerAttemptsUs[i - 1];
+        printf(" %.1f", gapUs / 1000000.0);
+        // Gaps fall on heartbeats, up to a second past the wait
+        TEST_ASSERT_GREATER_OR_EQUAL(2000000, gapUs);
+        TEST_ASSERT_LESS_OR_EQUAL(61500000, gapUs);
+        longestUs = max(longestUs, gapUs);
+    }
+    printf("\n");
+    TEST_ASSERT_GREATER_THAN(30000000, longestUs);
+    TEST_ASSERT_EQUAL(attempts, runtime.getStats().registrationFailures);
+    TEST_ASSERT_GREATER_THAN(250, runtime.getStats().statusPosts);
+
+    refuseRegistration = false;
+    runFor(61500000);
+    TEST_ASSERT_EQUAL(attempts + 1, registerAttemptsUs.size());
+    TEST_ASSERT_EQUAL(1, runtime.getStats().registrations);
+    runFor(120000000);
+    TEST_ASSERT_EQUAL(attempts + 1, registerAttemptsUs.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_status_payload_is_a_literal);
+    RUN_TEST(test_dispatch_by_name);
+    RUN_TEST(test_refused_registration_is_retried_with_backoff);
+    return UNITY_END();
+}
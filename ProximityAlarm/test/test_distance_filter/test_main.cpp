@@ -0,0 +1,154 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <DistanceFilter.h>
+
+// Noisy ultrasonic traces through the DistanceFilter the way ProximityAlarm
+// sets it up: enter below 30 cm, leave above 35 cm, nothing under 11 cm.
+
+static uint32_t noiseState;
+
+// Deterministic jitter in [-spread, spread]
+static long noise(long spread)
+{
+    noiseState = noiseState * 1103515245 + 12345;
+    return (long)((noiseState >> 16) % (2 * spread + 1)) - spread;
+}
+
+struct TraceResult
+{
+    int begins;
+    int ends;
+    int firstBegin; // Sample index of the first PRESENCE_BEGIN, -1 if none
+};
+
+// Feeds count samples of base +- spread; every dropoutEvery-th reading is a
+// lost echo (0) and every spikeEvery-th a stray echo at spikeCm
+static TraceResult feed(DistanceFilter &filter, int count, long base, long spread, int dropoutEvery = 0,
+                        int spikeEvery = 0, long spikeCm = 0)
+{
+    TraceResult result = {0, 0, -1};
+    for (int i = 1; i <= count; i++)
+    {
+        long cm = base + noise(spread);
+        if (dropoutEvery > 0 && i % dropoutEvery == 0)
+            cm = 0;
+        else if (spikeEvery > 0 && i % spikeEvery == 0)
+            cm = spikeCm;
+
+        PresenceEvent event = filter.update(cm);
+        if (event == PRESENCE_BEGIN)
+        {
+            result.begins++;
+            if (result.firstBegin < 0)
+                result.firstBegin = i;
+        }
+        else if (event == PRESENCE_END)
+        {
+            result.ends++;
+        }
+    }
+    return result;
+}
+
+void setUp()
+{
+    noiseState = 1;
+}
+
+void tearDown()
+{
+}
+
+void test_noisy_empty_room_stays_clear()
+{
+    DistanceFilter filter(30, 35, 11);
+    TraceResult result = feed(filter, 500, 220, 15, 7, 13, 25);
+    TEST_ASSERT_EQUAL(0, result.begins);
+    TEST_ASSERT_FALSE(filter.isPresent());
+    TEST_ASSERT_GREATER_THAN(0, filter.getStats().rejected);
+}
+
+void test_approach_begins_once_and_leaving_ends_once()
+{
+    DistanceFilter filter(30, 35, 11);
+    TraceResult result = feed(filter, 50, 200, 3, 17);
+    TEST_ASSERT_EQUAL(0, result.begins);
+
+    result = feed(filter, 100, 20, 2, 17);
+    TEST_ASSERT_EQUAL(1, result.begins);
+    TEST_ASSERT_EQUAL(0, result.ends);
+    TEST_ASSERT_LESS_OR_EQUAL(6, result.firstBegin);
+    TEST_ASSERT_INT_WITHIN(3, 20, filter.getDistance());
+
+    result = feed(filter, 50, 200, 3, 17);
+    TEST_ASSERT_EQUAL(0, result.begins);
+    TEST_ASSERT_EQUAL(1, result.ends);
+    TEST_ASSERT_FALSE(filter.isPresent());
+}
+
+void test_dropouts_and_spikes_do_not_end_a_presence()
+{
+    DistanceFilter filter(30, 35, 11);
+    feed(filter, 20, 20, 1);
+    TEST_ASSERT_TRUE(filter.isPresent());
+
+    // A lost echo every 4th reading and a wall reflection every 9th
+    TraceResult result = feed(filter, 300, 20, 2, 4, 9, 250);
+    TEST_ASSERT_EQUAL(0, result.ends);
+    TEST_ASSERT_TRUE(filter.isPresent());
+    TEST_ASSERT_GREATER_THAN(0, filter.getStats().rejected);
+}
+
+void test_hovering_between_thresholds_does_not_toggle()
+{
+    DistanceFilter filter(30, 35, 11);
+    feed(filter, 20, 20, 1);
+    TEST_ASSERT_TRUE(filter.isPresent());
+
+    // Standing right at the edge, readings wander over 31..34 cm
+    TraceResult result = feed(filter, 400, 32, 2);
+    TEST_ASSERT_EQUAL(0, result.begins);
+    TEST_ASSERT_EQUAL(0, result.ends);
+    TEST_ASSERT_TRUE(filter.isPresent());
+}
+
+void test_too_close_readings_count_as_nothing()
+{
+    DistanceFilter filter(30, 35, 11);
+    TraceResult result = feed(filter, 100, 6, 2);
+    TEST_ASSERT_EQUAL(0, result.begins);
+    TEST_ASSERT_EQUAL(100, filter.getStats().outOfRange);
+}
+
+// ProximityAlarm stops ranging during the 60 s lockout; whoever stood there
+// when it began must not raise the alarm once it ends
+void test_reset_forgets_a_stale_presence()
+{
+    DistanceFilter filter(30, 35, 11);
+    feed(filter, 20, 20, 1);
+    TEST_ASSERT_TRUE(filter.isPresent());
+    uint32_t samples = filter.getStats().samples;
+
+    filter.reset();
+    TEST_ASSERT_FALSE(filter.isPresent());
+    TEST_ASSERT_EQUAL(0, filter.getDistance());
+    TEST_ASSERT_EQUAL(samples, filter.getStats().samples);
+
+    // One near reading left over from before the lockout, then an empty hall
+    TraceResult result = feed(filter, 1, 20, 0);
+    result.begins += feed(filter, 50, 200, 3).begins;
+    TEST_ASSERT_EQUAL(0, result.begins);
+    TEST_ASSERT_FALSE(filter.isPresent());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_noisy_empty_room_stays_clear);
+    RUN_TEST(test_approach_begins_once_and_leaving_ends_once);
+    RUN_TEST(test_dropouts_and_spikes_do_not_end_a_presence);
+    RUN_TEST(test_hovering_between_thresholds_does_not_toggle);
+    RUN_TEST(test_too_close_readings_count_as_nothing);
+    RUN_TEST(test_reset_forgets_a_stale_presence);
+    return UNITY_END();
+}
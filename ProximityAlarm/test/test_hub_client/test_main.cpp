@@ -0,0 +1,182 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <sim.h>
+#include <HubClient.h>
+#include <CommandChannel.h>
+
+// HubClient against stand-in hub servers: connection reuse, reconnecting
+// after the hub dropped the connection, the deadline, the breaker and the
+// command sequence header.
+
+#define CLOUD_URL "https://hub.example.com"
+#define LAN_URL "http://192.168.1.2:3000"
+
+static uint64_t handlerDelayUs = 0;
+
+// Holds the answer for handlerDelayUs, or until the client gave up
+static sim::HttpResponse answer(const sim::HttpRequest &request)
+{
+    if (handlerDelayUs > 0)
+        sim::sleepUntil(std::min(sim::nowUs() + handlerDelayUs, request.deadlineUs));
+    sim::HttpResponse response = {200, "ok " + request.path, {}};
+    // deactivate_alarm through /send_status: a 204, Express drops the body
+    if (request.path == "/send_status_204")
+        response = {204, "", {{"x-command-seq", "1042"}}};
+    return response;
+}
+
+static sim::HttpServer cloud(CLOUD_URL, answer);
+static sim::HttpServer lan(LAN_URL, answer);
+
+void setUp()
+{
+    handlerDelayUs = 0;
+    cloud.setUp(true);
+    lan.setUp(true);
+    HubClient::setLanAddress("");
+}
+
+void tearDown()
+{
+}
+
+void test_requests_share_one_tls_connection()
+{
+    WiFi.begin("dumi", "kiki1234");
+    while (WiFi.status() != WL_CONNECTED)
+        delay(10);
+
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    unsigned long start = millis();
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    unsigned long coldMs = millis() - start;
+    TEST_ASSERT_EQUAL_STRING("ok /test", hub.lastResponse().c_str());
+
+    start = millis();
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(200, hub.post("/send_status", "{}"));
+    unsigned long warmMs = (millis() - start) / 10;
+
+    TEST_ASSERT_EQUAL(1, cloud.stats.tlsHandshakes);
+    TEST_ASSERT_EQUAL(11, cloud.stats.requests);
+    TEST_ASSERT_EQUAL(1, hub.getStats().handshakes);
+    TEST_ASSERT_LESS_THAN(coldMs / 4, warmMs);
+    printf("First request %lu ms (TLS handshake %lu ms), reused connection %lu ms\n", coldMs,
+           hub.getStats().lastHandshakeMs, warmMs);
+}
+
+void test_idle_close_opens_a_new_connection()
+{
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    delay(cloud.keepAliveUs / 1000 + 1000);
+
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    TEST_ASSERT_EQUAL(2, hub.getStats().handshakes);
+    TEST_ASSERT_EQUAL(0, hub.getStats().failures);
+}
+
+// The hub restarted without closing its sockets: the first send on the old
+// connection fails and the request goes out again on a new one
+void test_dropped_connection_is_reopened_and_retried()
+{
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    uint32_t stale = cloud.stats.staleSends;
+    cloud.restart();
+
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    TEST_ASSERT_EQUAL(stale + 1, cloud.stats.staleSends);
+    TEST_ASSERT_EQUAL(1, hub.getStats().reconnects);
+    TEST_ASSERT_EQUAL(2, hub.getStats().handshakes);
+}
+
+void test_slow_hub_is_cut_off_at_the_deadline()
+{
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    hub.setTimeout(2000);
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+
+    handlerDelayUs = 10000000;
+    unsigned long start = millis();
+    TEST_ASSERT_LESS_THAN(0, hub.get("/test"));
+    unsigned long elapsedMs = millis() - start;
+    TEST_ASSERT_UINT32_WITHIN(100, 2000, elapsedMs);
+    TEST_ASSERT_EQUAL(1, hub.getStats().deadlineMisses);
+}
+
+void test_breaker_opens_and_a_probe_closes_it()
+{
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    hub.setTimeout(1000);
+    cloud.setUp(false);
+    for (int i = 0; i < 3; i++)
+        TEST_ASSERT_LESS_THAN(0, hub.get("/test"));
+    TEST_ASSERT_EQUAL(HUB_BREAKER_OPEN, hub.breakerState());
+
+    // Refused without touching the network
+    unsigned long start = millis();
+    TEST_ASSERT_EQUAL(HUB_ERROR_BREAKER_OPEN, hub.get("/test"));
+    TEST_ASSERT_EQUAL(0, millis() - start);
+    TEST_ASSERT_EQUAL(1, hub.getStats().shortCircuits);
+
+    cloud.setUp(true);
+    delay(2000); // Longest first backoff
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    TEST_ASSERT_EQUAL(HUB_BREAKER_CLOSED, hub.breakerState());
+    TEST_ASSERT_EQUAL(1, hub.getStats().trips);
+}
+
+void test_lan_hub_is_preferred_and_falls_back_to_the_cloud()
+{
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    HubClient::setLanAddress(LAN_URL);
+    uint32_t lanRequests = lan.stats.requests;
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    TEST_ASSERT_EQUAL(lanRequests + 1, lan.stats.requests);
+    TEST_ASSERT_EQUAL(1, hub.getStats().pathRequests[HUB_PATH_LAN]);
+
+    lan.setUp(false);
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    TEST_ASSERT_EQUAL(1, hub.getStats().lanFallbacks);
+    TEST_ASSERT_EQUAL(1, hub.getStats().pathRequests[HUB_PATH_CLOUD]);
+}
+
+// The sequence number of a 204 reaches CommandChannel through the header,
+// so a command the stream already delivered is not run twice
+void test_command_seq_header_survives_a_204()
+{
+    HubClient hub;
+    hub.begin(CLOUD_URL);
+    TEST_ASSERT_EQUAL(204, hub.post("/send_status_204", "{}"));
+    TEST_ASSERT_EQUAL_STRING("", hub.lastResponse().c_str());
+    TEST_ASSERT_EQUAL_STRING("1042", hub.lastCommandSeq().c_str());
+
+    CommandChannel channel("ProximityBoard");
+    TEST_ASSERT_TRUE(channel.acceptStatusResponse(hub.lastCommandSeq(), hub.lastResponse()));
+    TEST_ASSERT_FALSE(channel.acceptStatusResponse(hub.lastCommandSeq(), hub.lastResponse()));
+    TEST_ASSERT_FALSE(channel.accept(1042));
+
+    TEST_ASSERT_EQUAL(200, hub.get("/test"));
+    TEST_ASSERT_EQUAL_STRING("", hub.lastCommandSeq().c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_requests_share_one_tls_connection);
+    RUN_TEST(test_idle_close_opens_a_new_connection);
+    RUN_TEST(test_dropped_connection_is_reopened_and_retried);
+    RUN_TEST(test_slow_hub_is_cut_off_at_the_deadline);
+    RUN_TEST(test_breaker_opens_and_a_probe_closes_it);
+    RUN_TEST(test_lan_hub_is_preferred_and_falls_back_to_the_cloud);
+    RUN_TEST(test_command_seq_header_survives_a_204);
+    return UNITY_END();
+}
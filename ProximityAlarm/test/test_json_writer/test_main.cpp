@@ -0,0 +1,201 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <JsonWriter.h>
+#include <chrono>
+#include <new>
+
+// JsonWriter output, and a host benchmark against the String concatenation
+// the boards used before: heap allocations and time per payload. Host
+// numbers; String here is the native env's, which like the ESP32 core keeps
+// short strings inline, so the allocation counts carry over, the times only
+// relative to each other.
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+#define BENCH_ROUNDS 200000
+
+static const char *boardName = "ProximityBoard";
+static unsigned long timestamp = 123456789;
+
+// ---- The payloads as the boards built them before
+
+static size_t registerWithString()
+{
+    String payload = "{\"name\":\"" + String(boardName) + "\",\"ip\":\"" + String("192.168.1.10") + "\"}";
+    return payload.length();
+}
+
+static size_t alarmWithString()
+{
+    String payload = "{\"message\":\"Front Door Alarm Triggered\",\"timestamp\":\"" + String(timestamp) + "\"}";
+    return payload.length();
+}
+
+static size_t batchWithString()
+{
+    String payload = "{\"name\":\"" + String(boardName) + "\",\"events\":[";
+    for (int i = 0; i < 8; i++)
+    {
+        if (i > 0)
+            payload += ",";
+        payload += "{\"id\":" + String(1000 + i) + ",\"route\":\"/movement_event\",\"age\":" + String(i * 40) +
+                   ",\"body\":{\"name\":\"" + String(boardName) + "\",\"distance\":" + String(20 + i) + "}}";
+    }
+    payload += "]}";
+    return payload.length();
+}
+
+// ---- The same with the writer
+
+static size_t registerWithWriter()
+{
+    JsonWriter<96> payload;
+    payload.beginObject().field(JSON_KEY("name"), boardName).field(JSON_KEY("ip"), "192.168.1.10").endObject();
+    return payload.size();
+}
+
+static size_t alarmWithWriter()
+{
+    JsonWriter<96> payload;
+    payload.beginObject()
+        .field(JSON_KEY("message"), "Front Door Alarm Triggered")
+        .field(JSON_KEY("timestamp"), timestamp)
+        .endObject();
+    return payload.size();
+}
+
+static size_t batchWithWriter()
+{
+    JsonWriter<1024> payload;
+    payload.beginObject().field(JSON_KEY("name"), boardName).beginArray(JSON_KEY("events"));
+    for (int i = 0; i < 8; i++)
+    {
+        char body[64];
+        snprintf(body, sizeof(body), "{\"name\":\"%s\",\"distance\":%d}", boardName, 20 + i);
+        payload.beginObject()
+            .field(JSON_KEY("id"), (unsigned long)(1000 + i))
+            .field(JSON_KEY("route"), "/movement_event")
+            .field(JSON_KEY("age"), (long)(i * 40))
+            .rawField(JSON_KEY("body"), body)
+            .endObject();
+    }
+    payload.endArray().endObject();
+    return payload.size();
+}
+
+struct BenchResult
+{
+    double allocationsPerPayload;
+    double nsPerPayload;
+};
+
+static BenchResult bench(size_t (*build)())
+{
+    size_t sink = 0;
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        sink += build();
+    auto end = std::chrono::steady_clock::now();
+    TEST_ASSERT_GREATER_THAN(0, sink);
+    BenchResult result;
+    result.allocationsPerPayload = (double)(allocations - before) / BENCH_ROUNDS;
+    result.nsPerPayload = std::chrono::duration<double, std::nano>(end - start).count() / BENCH_ROUNDS;
+    return result;
+}
+
+static void compare(const char *name, size_t (*withString)(), size_t (*withWriter)())
+{
+    BenchResult old = bench(withString);
+    BenchResult now = bench(withWriter);
+    printf("%-9s String: %5.1f allocations %7.0f ns | JsonWriter: %3.1f allocations %7.0f ns (%.1fx)\n", name,
+           old.allocationsPerPayload, old.nsPerPayload, now.allocationsPerPayload, now.nsPerPayload,
+           old.nsPerPayload / now.nsPerPayload);
+    TEST_ASSERT_EQUAL(0, (int)now.allocationsPerPayload);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_writes_nested_objects_and_arrays()
+{
+    JsonWriter<128> json;
+    json.beginObject()
+        .field(JSON_KEY("name"), "Board")
+        .field(JSON_KEY("count"), 3)
+        .field(JSON_KEY("up"), true)
+        .beginArray(JSON_KEY("list"))
+        .value(1L)
+        .value("two")
+        .endArray()
+        .rawField(JSON_KEY("raw"), "{\"a\":1}")
+        .endObject();
+    TEST_ASSERT_TRUE(json.ok());
+    TEST_ASSERT_EQUAL_STRING("{\"name\":\"Board\",\"count\":3,\"up\":true,\"list\":[1,\"two\"],\"raw\":{\"a\":1}}",
+                             json.c_str());
+    TEST_ASSERT_EQUAL(strlen(json.c_str()), json.size());
+}
+
+void test_escapes_string_values()
+{
+    JsonWriter<64> json;
+    json.beginObject().field(JSON_KEY("s"), "a\"b\\c\nd").endObject();
+    TEST_ASSERT_EQUAL_STRING("{\"s\":\"a\\\"b\\\\c\\nd\"}", json.c_str());
+}
+
+void test_overflow_is_reported_not_truncated()
+{
+    JsonWriter<16> json;
+    json.beginObject().field(JSON_KEY("message"), "far too long for the buffer").endObject();
+    TEST_ASSERT_FALSE(json.ok());
+}
+
+void test_writer_matches_the_string_payloads()
+{
+    // Timestamps are numbers now, everything else is byte for byte the same
+    TEST_ASSERT_EQUAL(registerWithString(), registerWithWriter());
+    TEST_ASSERT_EQUAL(alarmWithString() - 2, alarmWithWriter());
+    TEST_ASSERT_EQUAL(batchWithString(), batchWithWriter());
+}
+
+void test_benchmark_against_string()
+{
+    compare("register", registerWithString, registerWithWriter);
+    compare("alarm", alarmWithString, alarmWithWriter);
+    compare("batch", batchWithString, batchWithWriter);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_writes_nested_objects_and_arrays);
+    RUN_TEST(test_escapes_string_values);
+    RUN_TEST(test_overflow_is_reported_not_truncated);
+    RUN_TEST(test_writer_matches_the_string_payloads);
+    RUN_TEST(test_benchmark_against_string);
+    return UNITY_END();
+}
@@ -0,0 +1,154 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include <chrono>
+#include "../../src/Keypad/KeypadMatrix.h"
+
+// KeypadMatrix register scan against the digitalWrite()/digitalRead() scan
+// it replaced, on the ProximityAlarm wiring: the same keys for every single
+// press, chords, and the cost of one scan. The modelled time is the native
+// env's cost of each call on the ESP32 (250 ns per GPIO call, 50 ns per
+// register access, plus the settle delay); host time is only relative.
+
+#define BENCH_ROUNDS 20000
+
+static constexpr int rowPins[4] = {13, 12, 14, 27};
+static constexpr int colPins[4] = {26, 25, 33, 32};
+static constexpr const char *keys[4] = {"123A", "456B", "789C", "*0#D"};
+static constexpr KeypadMatrix<4, 4> matrix(rowPins, colPins, keys);
+
+// The scan Keypad had before KeypadMatrix, returning the same mask
+static uint16_t oldScan()
+{
+    uint16_t pressed = 0;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int i = 0; i < 4; i++)
+            digitalWrite(colPins[i], i == col ? LOW : HIGH);
+        for (int row = 0; row < 4; row++)
+        {
+            if (digitalRead(rowPins[row]) == LOW)
+                pressed |= 1u << (row * 4 + col);
+        }
+    }
+    for (int i = 0; i < 4; i++)
+        digitalWrite(colPins[i], LOW);
+    return pressed;
+}
+
+static uint16_t newScan()
+{
+    return matrix.scan();
+}
+
+static void hold(int row, int col, bool closed)
+{
+    sim::setContact(rowPins[row], colPins[col], closed);
+}
+
+struct ScanCost
+{
+    double modelledNs;
+    double hostNs;
+};
+
+static ScanCost measure(uint16_t (*scan)())
+{
+    uint32_t sink = 0;
+    uint64_t startNs = sim::nowNs();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        sink += scan();
+    auto end = std::chrono::steady_clock::now();
+    TEST_ASSERT_GREATER_THAN(0, sink);
+    ScanCost cost;
+    cost.modelledNs = (double)(sim::nowNs() - startNs) / BENCH_ROUNDS;
+    cost.hostNs = std::chrono::duration<double, std::nano>(end - start).count() / BENCH_ROUNDS;
+    return cost;
+}
+
+void setUp()
+{
+    matrix.begin();
+}
+
+void tearDown()
+{
+    for (int row = 0; row < 4; row++)
+        for (int col = 0; col < 4; col++)
+            hold(row, col, false);
+}
+
+void test_layout_bits_are_compile_time()
+{
+    static_assert(matrix.keyBit('1') == 1u << 0, "first key");
+    static_assert(matrix.keyBit('D') == 1u << 15, "last key");
+    static_assert(matrix.chord("*#") == ((1u << 12) | (1u << 14)), "chord");
+    static_assert(matrix.rowMask() == ((1u << 13) | (1u << 12) | (1u << 14) | (1u << 27)), "rows");
+    static_assert(matrix.colMaskHigh() == ((1u << 0) | (1u << 1)), "GPIO 32 and 33 are in the high bank");
+    TEST_ASSERT_EQUAL(0, matrix.keyBit('X'));
+}
+
+void test_every_single_key_matches_the_old_scan()
+{
+    TEST_ASSERT_EQUAL(0, newScan());
+    for (int row = 0; row < 4; row++)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            hold(row, col, true);
+            uint16_t expected = matrix.keyBit(keys[row][col]);
+            TEST_ASSERT_EQUAL_HEX16(expected, oldScan());
+            TEST_ASSERT_EQUAL_HEX16(expected, newScan());
+            hold(row, col, false);
+        }
+    }
+}
+
+// Keys on separate rows and columns are seen by both scans
+void test_chords_on_separate_lines_match_the_old_scan()
+{
+    hold(3, 0, true); // *
+    hold(0, 1, true); // 2
+    hold(1, 3, true); // B
+    TEST_ASSERT_EQUAL_HEX16(matrix.chord("*2B"), newScan());
+    TEST_ASSERT_EQUAL_HEX16(oldScan(), newScan());
+}
+
+// Two keys on one row tie their columns together. The old scan drove the
+// unselected column high against the selected one, so the row level was a
+// fight (here the high side wins); a released open-drain column leaves the
+// row to the selected one.
+void test_chords_on_one_row_are_seen()
+{
+    hold(3, 0, true); // *
+    hold(3, 2, true); // #
+    TEST_ASSERT_EQUAL_HEX16(matrix.chord("*#"), newScan());
+
+    hold(1, 2, true); // 6
+    TEST_ASSERT_EQUAL_HEX16(matrix.chord("*#6"), newScan());
+}
+
+void test_benchmark_against_the_old_scan()
+{
+    hold(2, 1, true);
+    ScanCost old = measure(oldScan);
+    ScanCost now = measure(newScan);
+    double settleNs = 4 * KEYPAD_SETTLE_US * 1000.0;
+    printf("4x4 scan, old: %.0f ns modelled %.0f ns host | registers: %.0f ns modelled (%.0f ns of it settling) "
+           "%.0f ns host\n",
+           old.modelledNs, old.hostNs, now.modelledNs, settleNs, now.hostNs);
+    // The GPIO work itself; the settle delay is the price of the open drain
+    TEST_ASSERT_LESS_THAN(old.modelledNs / 5, now.modelledNs - settleNs);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_layout_bits_are_compile_time);
+    RUN_TEST(test_every_single_key_matches_the_old_scan);
+    RUN_TEST(test_chords_on_separate_lines_match_the_old_scan);
+    RUN_TEST(test_chords_on_one_row_are_seen);
+    RUN_TEST(test_benchmark_against_the_old_scan);
+    return UNITY_END();
+}
@@ -0,0 +1,157 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <sim.h>
+#include <EventOutbox.h>
+
+// EventOutbox on simulated LittleFS against the hub stand-in: append cost,
+// batching, an outage, a full ring and a reboot with events still pending.
+
+#define HUB_URL "http://192.168.1.2:3000"
+
+static sim::Hub lanHub(HUB_URL);
+
+static void connectWifi()
+{
+    if (WiFi.status() == WL_CONNECTED)
+        return;
+    WiFi.begin("dumi", "kiki1234");
+    while (WiFi.status() != WL_CONNECTED)
+        delay(10);
+}
+
+static void appendEvent(EventOutbox &outbox, int value)
+{
+    char payload[32];
+    snprintf(payload, sizeof(payload), "{\"value\":%d}", value);
+    TEST_ASSERT_TRUE(outbox.append("/movement_event", payload));
+}
+
+// Bodies the hub logged for /movement_event, in arrival order
+static std::vector<std::string> delivered()
+{
+    std::vector<std::string> bodies;
+    for (const sim::Hub::Entry &entry : lanHub.log())
+    {
+        if (entry.path == "/movement_event")
+            bodies.push_back(entry.body);
+    }
+    return bodies;
+}
+
+void setUp()
+{
+    connectWifi();
+}
+
+void tearDown()
+{
+}
+
+void test_append_returns_before_the_upload_and_events_arrive_in_order()
+{
+    static EventOutbox outbox("ProximityBoard", "/outbox_a.log", 16);
+    TEST_ASSERT_TRUE(outbox.begin(HUB_URL));
+
+    uint32_t longestUs = 0;
+    for (int i = 1; i <= 5; i++)
+    {
+        uint32_t before = micros();
+        appendEvent(outbox, i);
+        longestUs = max(longestUs, (uint32_t)(micros() - before));
+    }
+    delay(2000);
+
+    std::vector<std::string> bodies = delivered();
+    TEST_ASSERT_EQUAL(5, bodies.size());
+    for (int i = 0; i < 5; i++)
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "{\"value\":%d}", i + 1);
+        TEST_ASSERT_EQUAL_STRING(expected, bodies[i].c_str());
+    }
+    OutboxStats stats = outbox.getStats();
+    TEST_ASSERT_EQUAL(5, stats.sent);
+    TEST_ASSERT_LESS_THAN(5, stats.batches);
+    TEST_ASSERT_EQUAL(0, outbox.depth());
+    printf("append() at most %u us (flash write), delivered in %u batches, latency max %u ms\n",
+           (unsigned)longestUs, (unsigned)stats.batches, (unsigned)stats.maxLatencyMs);
+    // A hub round trip alone is longer than any append
+    TEST_ASSERT_LESS_THAN(30000, longestUs);
+}
+
+void test_outage_keeps_events_until_the_hub_is_back()
+{
+    static EventOutbox outbox("EntranceBoard", "/outbox_b.log", 16);
+    TEST_ASSERT_TRUE(outbox.begin(HUB_URL));
+    size_t before = delivered().size();
+
+    lanHub.server.setUp(false);
+    for (int i = 0; i < 10; i++)
+    {
+        appendEvent(outbox, 100 + i);
+        delay(500);
+    }
+    TEST_ASSERT_EQUAL(10, outbox.depth());
+    TEST_ASSERT_GREATER_THAN(0, outbox.getStats().failures);
+
+    lanHub.server.setUp(true);
+    delay(70000); // Longest retry backoff plus the batches
+    TEST_ASSERT_EQUAL(0, outbox.depth());
+    TEST_ASSERT_EQUAL(before + 10, delivered().size());
+    TEST_ASSERT_EQUAL(0, outbox.getStats().dropped);
+}
+
+void test_full_ring_drops_the_oldest_events()
+{
+    static EventOutbox outbox("FullBoard", "/outbox_c.log", 4);
+    TEST_ASSERT_TRUE(outbox.begin(HUB_URL));
+    size_t before = delivered().size();
+
+    lanHub.server.setUp(false);
+    for (int i = 1; i <= 6; i++)
+        appendEvent(outbox, 200 + i);
+    TEST_ASSERT_EQUAL(4, outbox.depth());
+    TEST_ASSERT_EQUAL(2, outbox.getStats().dropped);
+
+    lanHub.server.setUp(true);
+    delay(70000);
+    std::vector<std::string> bodies = delivered();
+    TEST_ASSERT_EQUAL(before + 4, bodies.size());
+    TEST_ASSERT_EQUAL_STRING("{\"value\":203}", bodies[before].c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"value\":206}", bodies[before + 3].c_str());
+}
+
+// A second outbox on the same log plays the board after a reboot: the hub
+// was down for the first one, which never got its events out
+void test_pending_events_survive_a_reboot()
+{
+    static sim::HttpServer deadHub("http://192.168.1.3:3000", [](const sim::HttpRequest &)
+                                   { return sim::HttpResponse{200, "", {}}; });
+    deadHub.setUp(false);
+    static EventOutbox beforeReboot("RebootBoard", "/outbox_d.log", 16);
+    TEST_ASSERT_TRUE(beforeReboot.begin("http://192.168.1.3:3000"));
+    for (int i = 1; i <= 3; i++)
+        appendEvent(beforeReboot, 300 + i);
+    size_t before = delivered().size();
+
+    static EventOutbox afterReboot("RebootBoard", "/outbox_d.log", 16);
+    TEST_ASSERT_TRUE(afterReboot.begin(HUB_URL));
+    TEST_ASSERT_TRUE(sim::serialContains("Outbox recovered 3 pending events."));
+    delay(2000);
+
+    TEST_ASSERT_EQUAL(0, afterReboot.depth());
+    std::vector<std::string> bodies = delivered();
+    TEST_ASSERT_EQUAL(before + 3, bodies.size());
+    TEST_ASSERT_EQUAL_STRING("{\"value\":301}", bodies[before].c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_append_returns_before_the_upload_and_events_arrive_in_order);
+    RUN_TEST(test_outage_keeps_events_until_the_hub_is_back);
+    RUN_TEST(test_full_ring_drops_the_oldest_events);
+    RUN_TEST(test_pending_events_survive_a_reboot);
+    return UNITY_END();
+}
@@ -0,0 +1,153 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+
+// Runs the ProximityAlarm firmware (setup() and loop() of src/main.cpp) in
+// virtual time against a scripted scene: boot, someone walking up to the
+// sensor, a hub command and the disarm code typed on the keypad. Prints the
+// loop() pass distribution and the time from each event to the hub request.
+
+extern const char *HUB;
+extern bool alarmActive;
+
+#define TRIG_PIN 18
+#define ECHO_PIN 19
+#define BUZZER_PIN 4
+#define LOOP_PASS_COST_US 10 // Code between the stand-in calls
+
+static sim::Hub cloud(HUB);
+static sim::Sonar ranger(TRIG_PIN, ECHO_PIN);
+static sim::Histogram passes;
+
+// Empty hallway (2 m) until intrudeUs, then someone at 20 cm; readings
+// jitter by a centimetre and every 17th ping loses its echo
+static uint64_t intrudeUs = UINT64_MAX;
+static uint64_t leaveUs = UINT64_MAX;
+
+static long scene(uint64_t us)
+{
+    static uint32_t ping = 0;
+    ping++;
+    if (ping % 17 == 0)
+        return 0;
+    long jitter = (long)(ping % 3) - 1;
+    return (us >= intrudeUs && us < leaveUs ? 20 : 200) + jitter;
+}
+
+void setUp()
+{
+    ranger.distanceCm = scene;
+}
+
+void tearDown()
+{
+}
+
+static void run(uint64_t forUs)
+{
+    sim::runLoop(loop, forUs, LOOP_PASS_COST_US, &passes);
+}
+
+// Key of the 4x4 matrix by label, pressed for 80 ms with 2 ms of bounce
+static void typeKey(char key, uint64_t atUs)
+{
+    static const int rows[] = {13, 12, 14, 27};
+    static const int cols[] = {26, 25, 33, 32};
+    static const char *layout = "123A456B789C*0#D";
+    int index = strchr(layout, key) - layout;
+    sim::pressKey(rows[index / 4], cols[index % 4], atUs, 80000, 2000);
+}
+
+void test_boot_registers_with_the_hub()
+{
+    setup();
+    run(15000000);
+
+    const sim::Hub::Entry *registered = cloud.first("/register");
+    TEST_ASSERT_NOT_NULL(registered);
+    TEST_ASSERT_EQUAL(200, registered->code);
+    TEST_ASSERT_TRUE(sim::wifiConnected());
+    printf("Boot to registration: %llu ms\n", (unsigned long long)registered->atUs / 1000);
+}
+
+void test_presence_raises_the_alarm_and_reaches_the_hub()
+{
+    passes.clear();
+    intrudeUs = sim::nowUs() + 2000000;
+    leaveUs = intrudeUs + 3000000;
+    run(10000000);
+
+    TEST_ASSERT_TRUE(alarmActive);
+    TEST_ASSERT_EQUAL(LOW, sim::pinLevel(BUZZER_PIN));
+    const sim::Hub::Entry *event = cloud.first("/front_door_alarm", intrudeUs);
+    TEST_ASSERT_NOT_NULL(event);
+    printf("Presence to hub request: %llu ms (%u pings)\n", (unsigned long long)(event->atUs - intrudeUs) / 1000,
+           ranger.pings);
+    passes.print("loop() passes, intrusion");
+    TEST_ASSERT_LESS_THAN(3000000, event->atUs - intrudeUs);
+}
+
+void test_hub_command_reaches_the_board()
+{
+    passes.clear();
+    uint64_t sentUs = sim::nowUs() + 1000000;
+    sim::at(sentUs, []
+            { cloud.queueCommand("ProximityBoard", "deactivate_alarm"); });
+    run(5000000);
+
+    TEST_ASSERT_FALSE(alarmActive);
+    TEST_ASSERT_EQUAL(HIGH, sim::pinLevel(BUZZER_PIN));
+    TEST_ASSERT_EQUAL(1, cloud.streamedCommands);
+    passes.print("loop() passes, command");
+}
+
+void test_keypad_disarms_after_the_lockout()
+{
+    // The deactivate command started the 60 s lockout
+    run(61000000);
+    intrudeUs = sim::nowUs() + 500000;
+    leaveUs = intrudeUs + 1500000;
+    run(3000000);
+    TEST_ASSERT_TRUE(alarmActive);
+
+    passes.clear();
+    uint64_t startUs = sim::nowUs() + 200000;
+    const char *code = "1523";
+    for (int i = 0; i < 4; i++)
+        typeKey(code[i], startUs + i * 300000);
+    run(1500000);
+
+    TEST_ASSERT_FALSE(alarmActive);
+    TEST_ASSERT_TRUE(sim::serialContains("Alarm deactivated", startUs));
+    passes.print("loop() passes, keypad");
+}
+
+// Disarmed while the intruder still stands there, who leaves during the
+// lockout: the presence from before must not re-arm the alarm at its end
+void test_lockout_forgets_the_presence_it_began_with()
+{
+    run(61000000);
+    intrudeUs = sim::nowUs() + 500000;
+    leaveUs = intrudeUs + 10000000;
+    run(3000000);
+    TEST_ASSERT_TRUE(alarmActive);
+
+    uint64_t disarmUs = sim::nowUs() + 1000000;
+    sim::at(disarmUs, []
+            { cloud.queueCommand("ProximityBoard", "deactivate_alarm"); });
+    run(70000000);
+
+    TEST_ASSERT_FALSE(alarmActive);
+    TEST_ASSERT_FALSE(sim::serialContains("Alarm triggered!", disarmUs));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_registers_with_the_hub);
+    RUN_TEST(test_presence_raises_the_alarm_and_reaches_the_hub);
+    RUN_TEST(test_hub_command_reaches_the_board);
+    RUN_TEST(test_keypad_disarms_after_the_lockout);
+    RUN_TEST(test_lockout_forgets_the_presence_it_began_with);
+    return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include <WiFi.h>
+#include <mbedtls/md.h>
+#include <UdpHeartbeat.h>
+#include <BoardRuntime.h>
+#include <chrono>
+
+// UdpHeartbeat datagrams checked the way pi_server/app.js receives them:
+// layout, HMAC against a value computed independently (Python hmac), forged
+// and replayed datagrams. Then the encode cost and the bytes on the wire
+// against the JSON status POST over HTTPS it stands in for.
+
+#define KEY "test-heartbeat-key"
+#define HUB_URL "http://192.168.1.2:5000"
+#define BENCH_ROUNDS 20000
+
+// Wire overhead per packet: IPv4 and UDP or TCP headers without options,
+// a TLS 1.2 AES-GCM record (header, explicit nonce, tag)
+#define IP_UDP_BYTES 28
+#define IP_TCP_BYTES 40
+#define TLS_RECORD_BYTES 29
+
+static UdpHeartbeat heartbeat("FrontDoor");
+
+// What app.js does with a datagram: size and magic, MAC, then (boot, seq)
+// must be newer than the last accepted one
+struct Receiver
+{
+    uint32_t lastBoot = 0;
+    uint32_t lastSeq = 0;
+
+    bool accept(const std::vector<uint8_t> &packet)
+    {
+        if (packet.size() != HEARTBEAT_PACKET_SIZE || packet[0] != 0x53 || packet[1] != 0x48 || packet[2] != 1)
+            return false;
+        uint8_t mac[32];
+        size_t signedSize = HEARTBEAT_PACKET_SIZE - HEARTBEAT_MAC_SIZE;
+        mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)KEY, strlen(KEY),
+                        packet.data(), signedSize, mac);
+        if (memcmp(mac, packet.data() + signedSize, HEARTBEAT_MAC_SIZE) != 0)
+            return false;
+
+        uint32_t boot = get32(packet, 4);
+        uint32_t seq = get32(packet, 8);
+        if (boot < lastBoot || (boot == lastBoot && seq <= lastSeq))
+            return false;
+        lastBoot = boot;
+        lastSeq = seq;
+        return true;
+    }
+
+    static uint32_t get32(const std::vector<uint8_t> &packet, size_t at)
+    {
+        return packet[at] | packet[at + 1] << 8 | packet[at + 2] << 16 | (uint32_t)packet[at + 3] << 24;
+    }
+};
+
+static const std::vector<uint8_t> &lastPacket()
+{
+    return sim::udpPackets().back().data;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// The stand-in for mbedTLS, RFC 4231 test cases 2 and 6
+void test_hmac_sha256_matches_rfc_4231()
+{
+    const mbedtls_md_info_t *sha256 = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    uint8_t mac[32];
+
+    const char *data = "what do ya want for nothing?";
+    mbedtls_md_hmac(sha256, (const uint8_t *)"Jefe", 4, (const uint8_t *)data, strlen(data), mac);
+    static const uint8_t shortKey[8] = {0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e};
+    TEST_ASSERT_EQUAL_MEMORY(shortKey, mac, sizeof(shortKey));
+
+    // Key longer than a block is hashed first
+    uint8_t longKey[131];
+    memset(longKey, 0xaa, sizeof(longKey));
+    data = "Test Using Larger Than Block-Size Key - Hash Key First";
+    mbedtls_md_hmac(sha256, longKey, sizeof(longKey), (const uint8_t *)data, strlen(data), mac);
+    static const uint8_t hashedKey[8] = {0x60, 0xe4, 0x31, 0x59, 0x1e, 0xe0, 0xb6, 0x7f};
+    TEST_ASSERT_EQUAL_MEMORY(hashedKey, mac, sizeof(hashedKey));
+}
+
+void test_disabled_without_a_key_or_hub()
+{
+    UdpHeartbeat disabled("FrontDoor");
+    disabled.begin("");
+    disabled.setHub(HUB_URL);
+    TEST_ASSERT_FALSE(disabled.isEnabled());
+    TEST_ASSERT_FALSE(disabled.send(0));
+
+    UdpHeartbeat noHub("FrontDoor");
+    noHub.begin(KEY);
+    TEST_ASSERT_FALSE(noHub.setHub("https://hub.example.com"));
+    TEST_ASSERT_FALSE(noHub.send(0));
+}
+
+// Fresh NVS, 5 s after boot: every field is known, so is the MAC
+void test_first_datagram_layout_and_mac()
+{
+    sim::eraseFlash();
+    heartbeat.begin(KEY);
+    TEST_ASSERT_TRUE(heartbeat.setHub(HUB_URL));
+    WiFi.begin("dumi", "kiki1234");
+    sim::sleepUntil(5000000);
+    TEST_ASSERT_TRUE(sim::wifiConnected());
+
+    size_t before = sim::udpPackets().size();
+    TEST_ASSERT_TRUE(heartbeat.send(HEARTBEAT_STATE_ALARM | HEARTBEAT_STATE_PRESENCE));
+    TEST_ASSERT_EQUAL(before + 1, sim::udpPackets().size());
+    TEST_ASSERT_EQUAL_STRING("192.168.1.2", sim::udpPackets().back().ip.c_str());
+    TEST_ASSERT_EQUAL(HEARTBEAT_UDP_PORT, sim::udpPackets().back().port);
+
+    const std::vector<uint8_t> &packet = lastPacket();
+    TEST_ASSERT_EQUAL(56, packet.size());
+    TEST_ASSERT_EQUAL(0x03, packet[3]);
+    TEST_ASSERT_EQUAL(1, Receiver::get32(packet, 4)); // Boot counter
+    TEST_ASSERT_EQUAL(1, Receiver::get32(packet, 8)); // Sequence
+    TEST_ASSERT_EQUAL(5, Receiver::get32(packet, 12));
+    TEST_ASSERT_EQUAL(180000, Receiver::get32(packet, 16));
+    TEST_ASSERT_EQUAL(-58, (int8_t)packet[20]);
+    TEST_ASSERT_EQUAL_STRING("FrontDoor", (const char *)packet.data() + 24);
+
+    static const uint8_t expectedMac[HEARTBEAT_MAC_SIZE] = {0x5d, 0x8c, 0x8f, 0x9f, 0x0b, 0xb4, 0x81, 0x06,
+                                                            0x7b, 0xbd, 0x04, 0x14, 0x3f, 0x43, 0x0c, 0x56};
+    TEST_ASSERT_EQUAL_MEMORY(expectedMac, packet.data() + 40, HEARTBEAT_MAC_SIZE);
+}
+
+// Any changed bit, signed part or MAC, fails the check
+void test_forged_datagrams_are_rejected()
+{
+    heartbeat.send(0);
+    std::vector<uint8_t> packet = lastPacket();
+    for (size_t i = 0; i < packet.size(); i++)
+    {
+        Receiver receiver;
+        std::vector<uint8_t> forged = packet;
+        forged[i] ^= 0x01;
+        TEST_ASSERT_FALSE(receiver.accept(forged));
+    }
+    Receiver receiver;
+    TEST_ASSERT_TRUE(receiver.accept(packet));
+}
+
+// Replays within a boot and datagrams from before a reboot are dropped
+void test_replays_are_rejected_across_reboots()
+{
+    Receiver receiver;
+    heartbeat.send(0);
+    std::vector<uint8_t> first = lastPacket();
+    heartbeat.send(0);
+    std::vector<uint8_t> second = lastPacket();
+    TEST_ASSERT_TRUE(receiver.accept(first));
+    TEST_ASSERT_TRUE(receiver.accept(second));
+    TEST_ASSERT_FALSE(receiver.accept(first));
+    TEST_ASSERT_FALSE(receiver.accept(second));
+
+    // Reboot: the boot counter in NVS moves on, the sequence starts over
+    UdpHeartbeat rebooted("FrontDoor");
+    rebooted.begin(KEY);
+    rebooted.setHub(HUB_URL);
+    rebooted.send(0);
+    std::vector<uint8_t> afterReboot = lastPacket();
+    TEST_ASSERT_EQUAL(Receiver::get32(first, 4) + 1, Receiver::get32(afterReboot, 4));
+    TEST_ASSERT_EQUAL(1, Receiver::get32(afterReboot, 8));
+    TEST_ASSERT_TRUE(receiver.accept(afterReboot));
+    TEST_ASSERT_FALSE(receiver.accept(second));
+}
+
+// Encode cost per datagram, and one heartbeat on the wire: the datagram
+// against a warm keep-alive POST /send_status over TLS to the hub.
+// The HTTP headers are those of the arduino-esp32 HTTPClient and an
+// Express reply with cors(); the hosted hub's router adds more, and TCP
+// options and link framing are left out of both, so the POST is a
+// lower bound.
+void test_benchmark_encode_and_wire_bytes()
+{
+    uint8_t packet[HEARTBEAT_PACKET_SIZE];
+    uint64_t startNs = sim::nowNs();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        heartbeat.encode(0, packet);
+    auto end = std::chrono::steady_clock::now();
+    double modelledUs = (sim::nowNs() - startNs) / 1000.0 / BENCH_ROUNDS;
+    double hostNs = std::chrono::duration<double, std::nano>(end - start).count() / BENCH_ROUNDS;
+
+    String status = BOARD_STATUS_PAYLOAD("FrontDoor");
+    String request = String("POST /send_status HTTP/1.1\r\n") +
+                     "Host: murmuring-citadel-82885-21551507c6aa.herokuapp.com\r\n" +
+                     "User-Agent: ESP32HTTPClient\r\nConnection: keep-alive\r\n" +
+                     "Accept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n" +
+                     "Content-Type: application/json\r\nContent-Length: " + String(status.length()) +
+                     "\r\n\r\n" + status;
+    String reply = String("HTTP/1.1 202 Accepted\r\nX-Powered-By: Express\r\nAccess-Control-Allow-Origin: *\r\n") +
+                   "Content-Type: application/json; charset=utf-8\r\nContent-Length: 24\r\n" +
+                   "ETag: W/\"18-RVzmRVI2SjbI0mGxFNWwk5mVvSU\"\r\nDate: Sat, 17 Oct 2026 10:00:00 GMT\r\n" +
+                   "Connection: keep-alive\r\nKeep-Alive: timeout=5\r\n\r\n{\"command\":\"no_command\"}";
+    // Request, reply (carrying the ACK of the request) and the board's ACK
+    size_t postBytes = request.length() + TLS_RECORD_BYTES + IP_TCP_BYTES + reply.length() + TLS_RECORD_BYTES +
+                       IP_TCP_BYTES + IP_TCP_BYTES;
+    size_t udpBytes = HEARTBEAT_PACKET_SIZE + IP_UDP_BYTES;
+
+    printf("Heartbeat encode: %.1f us modelled, %.0f ns host\n", modelledUs, hostNs);
+    printf("On the wire: UDP %u bytes in 1 packet | HTTPS POST %u bytes in 3 packets (payload %u, headers %u + %u) "
+           "= %.1fx\n",
+           (unsigned)udpBytes, (unsigned)postBytes, status.length(),
+           request.length() - status.length(), (unsigned)reply.length(), (double)postBytes / udpBytes);
+    TEST_ASSERT_EQUAL(84, udpBytes);
+    TEST_ASSERT_GREATER_THAN(5 * udpBytes, postBytes);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hmac_sha256_matches_rfc_4231);
+    RUN_TEST(test_disabled_without_a_key_or_hub);
+    RUN_TEST(test_first_datagram_layout_and_mac);
+    RUN_TEST(test_forged_datagrams_are_rejected);
+    RUN_TEST(test_replays_are_rejected_across_reboots);
+    RUN_TEST(test_benchmark_encode_and_wire_bytes);
+    return UNITY_END();
+}
@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include <Ultrasonic.h>
+
+// Ultrasonic driver against the simulated HC-SR04: the fixed point
+// conversion, readings through the echo interrupt, and how long update()
+// holds the caller compared to the pulseIn() it replaced.
+
+#define TRIG_PIN 23
+#define ECHO_PIN 22
+
+static sim::Sonar ranger(TRIG_PIN, ECHO_PIN);
+static long rangeCm = 100;
+
+static long scene(uint64_t us)
+{
+    return rangeCm;
+}
+
+void setUp()
+{
+    ranger.distanceCm = scene;
+    rangeCm = 100;
+}
+
+void tearDown()
+{
+}
+
+// The old boards computed duration * 0.034 / 2 in floating point and
+// truncated; the fixed point version rounds instead
+void test_conversion_matches_the_old_float_formula()
+{
+    uint32_t factor = Ultrasonic::soundSpeedFactor(340000);
+    for (uint32_t us = 0; us <= 30000; us++)
+    {
+        long old = (long)(us * 0.034 / 2);
+        long now = Ultrasonic::durationToCm(us, factor);
+        TEST_ASSERT_INT_WITHIN(1, old, now);
+    }
+    TEST_ASSERT_EQUAL(17, Ultrasonic::durationToCm(1000, factor));
+    TEST_ASSERT_EQUAL(0, Ultrasonic::durationToCm(30001, factor)); // Past the echo timeout
+}
+
+void test_temperature_changes_the_speed_of_sound()
+{
+    // 331.3 m/s at 0 C, 343.4 m/s at 20 C: the same echo is 3.6 % further
+    uint32_t cold = Ultrasonic::soundSpeedFactor(331300);
+    uint32_t warm = Ultrasonic::soundSpeedFactor(331300 + 606 * 20);
+    TEST_ASSERT_EQUAL(166, Ultrasonic::durationToCm(10000, cold));
+    TEST_ASSERT_EQUAL(172, Ultrasonic::durationToCm(10000, warm));
+}
+
+static Ultrasonic sonar(TRIG_PIN, ECHO_PIN);
+
+// Runs update() for forMs and returns the readings; the longest single
+// update() call goes to longestUs
+static uint32_t poll(unsigned long forMs, uint32_t &longestUs, long &lastCm)
+{
+    uint32_t readings = 0;
+    longestUs = 0;
+    unsigned long start = millis();
+    while (millis() - start < forMs)
+    {
+        uint32_t before = micros();
+        sonar.update();
+        longestUs = max(longestUs, (uint32_t)(micros() - before));
+        if (sonar.hasNewReading())
+        {
+            readings++;
+            lastCm = sonar.getDistance();
+        }
+        delayMicroseconds(100); // Rest of loop()
+    }
+    return readings;
+}
+
+void test_readings_arrive_without_blocking_on_the_echo()
+{
+    sonar.begin();
+    sonar.setInterval(60);
+    uint32_t longestUs;
+    long lastCm = -1;
+    uint32_t readings = poll(1000, longestUs, lastCm);
+
+    TEST_ASSERT_INT_WITHIN(1, 16, readings);
+    TEST_ASSERT_INT_WITHIN(2, 100, lastCm);
+    // Only the trigger pulse; pulseIn() waited out the whole 5.8 ms echo
+    TEST_ASSERT_LESS_THAN(20, longestUs);
+    printf("update() held the caller for at most %u us; the echo it no longer waits for is %ld us\n",
+           (unsigned)longestUs, rangeCm * 58);
+}
+
+void test_missing_echo_reads_zero()
+{
+    rangeCm = 0;
+    uint32_t longestUs;
+    long lastCm = -1;
+    uint32_t readings = poll(500, longestUs, lastCm);
+    TEST_ASSERT_GREATER_THAN(0, readings);
+    TEST_ASSERT_EQUAL(0, lastCm);
+    TEST_ASSERT_LESS_THAN(20, longestUs);
+}
+
+void test_adaptive_interval_speeds_up_on_activity()
+{
+    sonar.setAdaptiveInterval(500, 40, 100, 2000);
+    rangeCm = 300;
+    uint32_t longestUs;
+    long lastCm;
+    uint32_t idleReadings = poll(3000, longestUs, lastCm);
+    TEST_ASSERT_INT_WITHIN(1, 6, idleReadings);
+    TEST_ASSERT_EQUAL(500, sonar.getInterval());
+
+    // Seen within one idle gap, then 25 Hz
+    rangeCm = 50;
+    uint32_t activeReadings = poll(2000, longestUs, lastCm);
+    TEST_ASSERT_EQUAL(40, sonar.getInterval());
+    TEST_ASSERT_GREATER_THAN(30, activeReadings);
+    TEST_ASSERT_EQUAL(1, sonar.getStats().wakeups);
+
+    // Back to idle once the hold time ran out and the interval doubled up
+    rangeCm = 300;
+    poll(5000, longestUs, lastCm);
+    TEST_ASSERT_EQUAL(500, sonar.getInterval());
+    TEST_ASSERT_EQUAL(0, sonar.activeSince());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_conversion_matches_the_old_float_formula);
+    RUN_TEST(test_temperature_changes_the_speed_of_sound);
+    RUN_TEST(test_readings_arrive_without_blocking_on_the_echo);
+    RUN_TEST(test_missing_echo_reads_zero);
+    RUN_TEST(test_adaptive_interval_speeds_up_on_activity);
+    return UNITY_END();
+}
@@ -0,0 +1,74 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <sim.h>
+#include <WiFiSupervisor.h>
+
+// WiFiSupervisor against the stand-in access point: first join scans, later
+// ones go straight to the cached BSSID and channel but still take a lease.
+
+static WiFiSupervisor supervisor("dumi", "kiki1234");
+
+// Link lost while the access point stays up, e.g. a beacon timeout
+static void bounceLink()
+{
+    sim::dropWifi();
+    sim::accessPoint().up = true;
+    sim::sleepFor(500000);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_first_join_scans_and_leases()
+{
+    sim::AccessPoint &ap = sim::accessPoint();
+    TEST_ASSERT_TRUE(supervisor.begin(10000));
+    TEST_ASSERT_TRUE(supervisor.takeAddressChange());
+    TEST_ASSERT_EQUAL(1, ap.joins);
+    TEST_ASSERT_EQUAL(0, ap.directJoins);
+    TEST_ASSERT_EQUAL(1, ap.dhcpLeases);
+}
+
+void test_reconnect_joins_the_cached_access_point_with_dhcp()
+{
+    sim::AccessPoint &ap = sim::accessPoint();
+    bounceLink();
+    TEST_ASSERT_TRUE(supervisor.waitConnected(5000));
+
+    TEST_ASSERT_EQUAL(2, ap.joins);
+    TEST_ASSERT_EQUAL(1, ap.directJoins);
+    TEST_ASSERT_EQUAL(2, ap.dhcpLeases);
+    TEST_ASSERT_EQUAL(0, ap.staticJoins);
+    TEST_ASSERT_FALSE(supervisor.takeAddressChange());
+    TEST_ASSERT_EQUAL(1, supervisor.getStats().fastConnects);
+}
+
+// The router handed out another address meanwhile: the board takes it
+// instead of squatting on the old one, and reports the change
+void test_moved_lease_is_followed()
+{
+    sim::AccessPoint &ap = sim::accessPoint();
+    ap.leaseIp = 0x1401a8c0; // 192.168.1.20
+    bounceLink();
+    TEST_ASSERT_TRUE(supervisor.waitConnected(5000));
+
+    TEST_ASSERT_EQUAL(2, ap.directJoins);
+    TEST_ASSERT_EQUAL(0, ap.addressConflicts);
+    TEST_ASSERT_EQUAL_STRING("192.168.1.20", WiFi.localIP().toString().c_str());
+    TEST_ASSERT_TRUE(supervisor.takeAddressChange());
+    TEST_ASSERT_EQUAL(1, supervisor.getStats().addressChanges);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_join_scans_and_leases);
+    RUN_TEST(test_reconnect_joins_the_cached_access_point_with_dhcp);
+    RUN_TEST(test_moved_lease_is_followed);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+#include "BoardRuntime.h"
+
+#define BOARD_REGISTER_MIN_BACKOFF_MS 2000
+#define BOARD_REGISTER_MAX_BACKOFF_MS 60000
+
+BoardRuntime::BoardRuntime(const BoardDescriptor &board, WiFiSupervisor &wifi, HubClient &hub,
+                           HubDiscovery &discovery, UdpHeartbeat &heartbeat)
+    : board(board), wifi(wifi), hub(hub), discovery(discovery), heartbeat(heartbeat), channel(NULL), online(false),
+      lastHeartbeatMs(0), registered(false), registerBackoffMs(0), registerAttemptMs(0), registerWaitMs(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void BoardRuntime::setCommandChannel(CommandChannel &commandChannel)
+{
+    channel = &commandChannel;
+}
+
+void BoardRuntime::begin(const String &hubAddress)
+{
+    online = !hubAddress.isEmpty();
+}
+
+bool BoardRuntime::registerBoard()
+{
+    if (!online)
+        return false;
+
+    IPAddress ip = WiFi.localIP();
+    char ipText[16];
+    snprintf(ipText, sizeof(ipText), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+
+    JsonWriter<96> payload;
+    payload.beginObject().field(JSON_KEY("name"), board.name).field(JSON_KEY("ip"), ipText).endObject();
+    int httpCode = hub.post("/register", payload.c_str(), payload.size());
+    if (httpCode == 200)
+    {
+        stats.registrations++;
+        Serial.println("Board registered successfully.");
+        return true;
+    }
+    stats.registrationFailures++;
+    Serial.println("Failed to register board. HTTP code: " + String(httpCode));
+    return false;
+}
+
+const char *BoardRuntime::update(uint8_t state)
+{
+    if (!online || millis() - lastHeartbeatMs < BOARD_HEARTBEAT_INTERVAL_MS || !wifi.isConnected())
+        return NULL;
+    lastHeartbeatMs = millis();
+
+    // First connection, or the board came back with a new address
+    if (wifi.takeAddressChange())
+    {
+        discovery.discover();
+        heartbeat.setHub(discovery.address());
+        registered = false;
+        registerBackoffMs = 0;
+        registerWaitMs = 0;
+    }
+    keepRegistered();
+
+    bool sentUdp = heartbeat.send(state);
+    if (sentUdp)
+    {
+        stats.udpHeartbeats++;
+        wifi.heartbeatSent();
+    }
+
+    // The status POST also carries commands, it only gives way to the UDP
+    // heartbeat when the board takes none or the command stream is up
+    if (sentUdp && (board.commandCount == 0 || (channel != NULL && channel->isStreaming())))
+        return NULL;
+    return sendStatus();
+}
+
+// A failed registration is tried again after a backoff that doubles from
+// 2 s to 60 s, jittered so boards that lost the hub together do not all
+// come back at once; the heartbeat keeps going meanwhile
+void BoardRuntime::keepRegistered()
+{
+    if (registered || millis() - registerAttemptMs < registerWaitMs)
+        return;
+
+    registerAttemptMs = millis();
+    registered = registerBoard();
+    if (registered)
+    {
+        registerBackoffMs = 0;
+        registerWaitMs = 0;
+        return;
+    }
+
+    registerBackoffMs = registerBackoffMs == 0 ? BOARD_REGISTER_MIN_BACKOFF_MS
+                                               : min(registerBackoffMs * 2, (unsigned long)BOARD_REGISTER_MAX_BACKOFF_MS);
+    registerWaitMs = max(registerBackoffMs / 2 + random(registerBackoffMs / 2 + 1),
+                         (unsigned long)BOARD_REGISTER_MIN_BACKOFF_MS);
+    Serial.println("Registering again in " + String(registerWaitMs) + " ms.");
+}
+
+const char *BoardRuntime::sendStatus()
+{
+    int httpCode = hub.post("/send_status", board.statusPayload, board.statusPayloadLength);
+    stats.statusPosts++;
+    if (httpCode <= 0)
+    {
+        stats.statusFailures++;
+        Serial.println("Status not delivered. HTTP code: " + String(httpCode));
+        return NULL;
+    }
+    wifi.heartbeatSent();
+
+    if (httpCode == BOARD_STATUS_NO_COMMAND)
+        return NULL;
+    const BoardCommand *command = findByStatus(httpCode);
+    if (command == NULL)
+        return NULL;
+
+    // Skip commands the stream already delivered
+    if (channel != NULL && !channel->acceptStatusResponse(hub.lastCommandSeq(), hub.lastResponse()))
+        return NULL;
+    return command->name;
+}
+
+// Status codes and name hashes are unique, boardCommandsUnique() checks it
+// at compile time
+const BoardCommand *BoardRuntime::findByStatus(int statusCode) const
+{
+    for (size_t i = 0; i < board.commandCount; i++)
+    {
+        if (board.commands[i].statusCode == statusCode)
+            return &board.commands[i];
+    }
+    return NULL;
+}
+
+bool BoardRuntime::dispatch(const char *command)
+{
+    uint32_t hash = boardCommandHash(command);
+    for (size_t i = 0; i < board.commandCount; i++)
+    {
+        // The hash picks the entry, the name rules out a stray collision
+        if (board.commands[i].hash == hash && strcmp(board.commands[i].name, command) == 0)
+        {
+            Serial.println("Hub command: " + String(command));
+            stats.commands++;
+            board.commands[i].handler();
+            return true;
+        }
+    }
+    Serial.println("Unknown hub command: " + String(command));
+    return false;
+}
+
+const BoardDescriptor &BoardRuntime::descriptor() const
+{
+    return board;
+}
+
+const BoardRuntimeStats &BoardRuntime::getStats() const
+{
+    return stats;
+}
+
+void BoardRuntime::printStats()
+{
+    Serial.println(String(board.name) + ": " + String(stats.registrations) + " registrations (" +
+                   String(stats.registrationFailures) + " failed), " + String(stats.statusPosts) +
+                   " status posts (" + String(stats.statusFailures) + " failed), " + String(stats.udpHeartbeats) +
+                   " UDP heartbeats, " + String(stats.commands) + " commands");
+}
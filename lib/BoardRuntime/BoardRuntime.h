@@ -0,0 +1,147 @@
+#pragma once
+
+#ifndef BOARD_RUNTIME_H
+#define BOARD_RUNTIME_H
+
+#include <Arduino.h>
+#include <HubClient.h>
+#include <HubDiscovery.h>
+#include <CommandChannel.h>
+#include <UdpHeartbeat.h>
+#include <WiFiSupervisor.h>
+#include <JsonWriter.h>
+
+#define BOARD_HEARTBEAT_INTERVAL_MS 1000
+#define BOARD_STATUS_NO_COMMAND 202
+
+// Status POST body, put together by the preprocessor from the board name
+#define BOARD_STATUS_PAYLOAD(name) "{\"message\":\"Board is up\",\"name\":\"" name "\"}"
+
+typedef void (*BoardCommandHandler)();
+
+// FNV-1a of a command name; constexpr, so the descriptor's hashes cost nothing
+// at run time and only the received name is hashed
+constexpr uint32_t boardCommandHash(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name == '\0' ? hash : boardCommandHash(name + 1, (hash ^ (uint8_t)*name) * 16777619u);
+}
+
+// A command the hub can queue for the board. While the command stream is
+// down it comes back as the status code of /send_status instead.
+struct BoardCommand
+{
+    constexpr BoardCommand(const char *name, int statusCode, BoardCommandHandler handler)
+        : name(name), statusCode(statusCode), handler(handler), hash(boardCommandHash(name))
+    {
+    }
+
+    const char *name;
+    int statusCode;
+    BoardCommandHandler handler;
+    uint32_t hash;
+};
+
+struct BoardDescriptor
+{
+    const char *name;
+    const BoardCommand *commands;
+    size_t commandCount;
+    const char *statusPayload; // BOARD_STATUS_PAYLOAD(name)
+    size_t statusPayloadLength;
+};
+
+// True if no two commands share a name hash or a status code, and none uses
+// the code that means no command; dispatch relies on both
+template <size_t Count>
+constexpr bool boardCommandsUnique(const BoardCommand (&commands)[Count], size_t i = 0, size_t j = 1)
+{
+    return i >= Count   ? true
+           : j >= Count ? commands[i].statusCode != BOARD_STATUS_NO_COMMAND &&
+                              boardCommandsUnique(commands, i + 1, i + 2)
+                        : commands[i].hash != commands[j].hash && commands[i].statusCode != commands[j].statusCode &&
+                              boardCommandsUnique(commands, i, j + 1);
+}
+
+template <size_t Count>
+constexpr BoardDescriptor boardDescriptor(const char *name, const char *statusPayload, size_t statusPayloadLength,
+                                          const BoardCommand (&commands)[Count])
+{
+    return BoardDescriptor{name, commands, Count, statusPayload, statusPayloadLength};
+}
+
+constexpr BoardDescriptor boardDescriptor(const char *name, const char *statusPayload, size_t statusPayloadLength)
+{
+    return BoardDescriptor{name, nullptr, 0, statusPayload, statusPayloadLength};
+}
+
+// Descriptors are built at compile time, in the board's main.cpp:
+//   constexpr BoardCommand board_commands[] = {{"activate_alarm", 203, startAlarm}};
+//   static_assert(boardCommandsUnique(board_commands), "...");
+//   constexpr BoardDescriptor board = BOARD_DESCRIPTOR("ProximityBoard", board_commands);
+// The name must be a literal that needs no JSON escaping, JSON_KEY checks it.
+#define BOARD_DESCRIPTOR(boardName, ...)                                                                   \
+    boardDescriptor(JSON_KEY(boardName).name, BOARD_STATUS_PAYLOAD(boardName),                             \
+                    sizeof(BOARD_STATUS_PAYLOAD(boardName)) - 1, ##__VA_ARGS__)
+
+struct BoardRuntimeStats
+{
+    uint32_t registrations;
+    uint32_t registrationFailures;
+    uint32_t statusPosts;
+    uint32_t statusFailures;
+    uint32_t udpHeartbeats;
+    uint32_t commands; // Dispatched, whichever path delivered them
+};
+
+// The hub side of every board: registration whenever the address changes,
+// retried with a jittered backoff until the hub takes it, the 1 Hz heartbeat
+// (UDP when possible, the status POST otherwise) and turning hub commands
+// into calls of the descriptor's handlers.
+class BoardRuntime
+{
+public:
+    BoardRuntime(const BoardDescriptor &board, WiFiSupervisor &wifi, HubClient &hub, HubDiscovery &discovery,
+                 UdpHeartbeat &heartbeat);
+
+    // Boards with a command stream: the status POST then gives way to the
+    // UDP heartbeat while the stream is up, and skips commands it delivered
+    void setCommandChannel(CommandChannel &channel);
+
+    // An empty hub address keeps the board off the hub
+    void begin(const String &hubAddress);
+
+    // Call from the network loop, does nothing between heartbeats. Returns
+    // the name of a command carried by a status response, NULL otherwise.
+    const char *update(uint8_t state);
+
+    // Runs the handler of a command, false when the board has none for it
+    bool dispatch(const char *command);
+
+    bool registerBoard();
+
+    const BoardDescriptor &descriptor() const;
+    const BoardRuntimeStats &getStats() const;
+    void printStats();
+
+private:
+    void keepRegistered();
+    const char *sendStatus();
+    const BoardCommand *findByStatus(int statusCode) const;
+
+    const BoardDescriptor &board;
+    WiFiSupervisor &wifi;
+    HubClient &hub;
+    HubDiscovery &discovery;
+    UdpHeartbeat &heartbeat;
+    CommandChannel *channel;
+    bool online;
+    unsigned long lastHeartbeatMs;
+    bool registered;
+    unsigned long registerBackoffMs;
+    unsigned long registerAttemptMs;
+    unsigned long registerWaitMs;
+
+    BoardRuntimeStats stats;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "CommandChannel.h"
+
+#define COMMAND_QUEUE_LENGTH 8
+#define COMMAND_POLL_TIMEOUT_MS 30000 // Hub holds a poll for 20 s
+#define COMMAND_RETRY_MIN_MS 1000
+#define COMMAND_RETRY_MAX_MS 30000
+#define COMMAND_TASK_STACK 8192
+#define COMMAND_QUEUE_FULL_WAIT_MS 100 // For loop() to make room before polling again
+
+// Guards lastSeq, which the stream task and loop() both update
+static portMUX_TYPE seqMux = portMUX_INITIALIZER_UNLOCKED;
+
+CommandChannel::CommandChannel(const char *boardName)
+    : boardName(boardName), queue(NULL), lastSeq(0), queuedSeq(0), streaming(false)
+{
+}
+
+void CommandChannel::begin(const String &address, BaseType_t core)
+{
+    if (queue != NULL || address.isEmpty())
+        return;
+
+    hubAddress = address;
+    queue = xQueueCreate(COMMAND_QUEUE_LENGTH, sizeof(HubCommand));
+    xTaskCreatePinnedToCore(taskEntry, "hub_commands", COMMAND_TASK_STACK, this, 1, NULL, core);
+}
+
+bool CommandChannel::poll(HubCommand &command)
+{
+    if (queue == NULL)
+        return false;
+    // The status fallback may have handled a queued command meanwhile
+    while (xQueueReceive(queue, &command, 0) == pdTRUE)
+    {
+        if (accept(command.seq))
+            return true;
+    }
+    return false;
+}
+
+bool CommandChannel::accept(uint32_t seq)
+{
+    bool fresh = false;
+    portENTER_CRITICAL(&seqMux);
+    if (seq > lastSeq)
+    {
+        lastSeq = seq;
+        fresh = true;
+    }
+    portEXIT_CRITICAL(&seqMux);
+    return fresh;
+}
+
+bool CommandChannel::acceptStatusResponse(const String &seqHeader, const String &body)
+{
+    if (!seqHeader.isEmpty())
+        return accept(strtoul(seqHeader.c_str(), NULL, 10));
+
+    int key = body.indexOf("\"seq\":");
+    if (key < 0)
+        return true;
+    return accept(strtoul(body.c_str() + key + 6, NULL, 10));
+}
+
+uint32_t CommandChannel::handledSeq()
+{
+    portENTER_CRITICAL(&seqMux);
+    uint32_t seq = lastSeq;
+    portEXIT_CRITICAL(&seqMux);
+    return seq;
+}
+
+bool CommandChannel::isStreaming() const
+{
+    return streaming;
+}
+
+void CommandChannel::taskEntry(void *arg)
+{
+    static_cast<CommandChannel *>(arg)->run();
+}
+
+// Each line of the body is "<seq> <command>"; false if the queue filled up
+bool CommandChannel::handleResponse(const String &body)
+{
+    int start = 0;
+    while (start < (int)body.length())
+    {
+        int end = body.indexOf('\n', start);
+        if (end < 0)
+            end = body.length();
+
+        String line = body.substring(start, end);
+        start = end + 1;
+
+        int space = line.indexOf(' ');
+        if (space <= 0)
+            continue;
+
+        HubCommand command;
+        command.seq = strtoul(line.c_str(), NULL, 10);
+        line.substring(space + 1).toCharArray(command.name, sizeof(command.name));
+
+        if (command.seq <= queuedSeq || command.seq <= handledSeq())
+            continue;
+
+        // Left unacknowledged, so the hub sends it and the rest again
+        if (xQueueSend(queue, &command, 0) != pdTRUE)
+        {
+            Serial.println("Command queue full, deferred: " + String(command.name));
+            return false;
+        }
+        queuedSeq = command.seq;
+    }
+    return true;
+}
+
+void CommandChannel::run()
+{
+    hub.begin(hubAddress);
+    hub.setTimeout(COMMAND_POLL_TIMEOUT_MS);
+
+    unsigned long retryMs = COMMAND_RETRY_MIN_MS;
+    while (true)
+    {
+        uint32_t ack = max(queuedSeq, handledSeq());
+        String path = "/commands?name=" + String(boardName) + "&ack=" + String(ack);
+        int httpCode = hub.get(path.c_str());
+        if (httpCode == 200)
+        {
+            if (!streaming)
+                Serial.println("Command stream connected.");
+            streaming = true;
+            retryMs = COMMAND_RETRY_MIN_MS;
+            if (!handleResponse(hub.lastResponse()))
+                vTaskDelay(pdMS_TO_TICKS(COMMAND_QUEUE_FULL_WAIT_MS));
+            continue;
+        }
+
+        if (streaming)
+            Serial.println("Command stream lost, falling back to status polling. HTTP code: " + String(httpCode));
+        streaming = false;
+
+        vTaskDelay(pdMS_TO_TICKS(retryMs));
+        retryMs = min(retryMs * 2, (unsigned long)COMMAND_RETRY_MAX_MS);
+    }
+}
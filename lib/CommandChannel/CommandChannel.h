@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef COMMAND_CHANNEL_H
+#define COMMAND_CHANNEL_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <HubClient.h>
+
+struct HubCommand
+{
+    uint32_t seq;
+    char name[24];
+};
+
+// Receives hub commands over a long-poll stream (GET /commands) running in
+// its own task, so commands arrive as soon as the hub queues them instead of
+// on the next status poll. Every command carries a sequence number that is
+// acknowledged on the following poll, once the command is in the queue: a
+// command that finds the queue full is not acknowledged and comes again.
+// accept() drops commands that were already handled, whichever path (stream
+// or status code fallback) delivered them; poll() accepts each command as
+// loop() takes it.
+class CommandChannel
+{
+public:
+    CommandChannel(const char *boardName);
+
+    // Starts the stream task pinned to the given core
+    void begin(const String &hubAddress, BaseType_t core = 0);
+
+    // Non-blocking, for loop(): returns the next command received on the
+    // stream that was not handled yet, and marks it handled
+    bool poll(HubCommand &command);
+
+    // Marks a sequence number as handled; false if it was already handled
+    bool accept(uint32_t seq);
+
+    // accept() for a command delivered by the /send_status fallback. The hub
+    // sends its sequence number in the X-Command-Seq header; a hub from
+    // before the header has it as "seq" in the JSON body, which the 204 of
+    // deactivate_alarm loses.
+    bool acceptStatusResponse(const String &seqHeader, const String &body);
+
+    bool isStreaming() const;
+
+private:
+    static void taskEntry(void *arg);
+    void run();
+    bool handleResponse(const String &body);
+    uint32_t handledSeq();
+
+    const char *boardName;
+    String hubAddress;
+    HubClient hub; // Separate connection, the stream task owns it
+    QueueHandle_t queue;
+    uint32_t lastSeq;   // Handled by loop() or the status fallback
+    uint32_t queuedSeq; // Put in the queue, stream task only
+    volatile bool streaming;
+};
+
+#endif
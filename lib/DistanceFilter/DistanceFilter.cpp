@@ -0,0 +1,144 @@
+#include "DistanceFilter.h"
+
+#define DISTANCE_FILTER_FAR_CM 100000 // Stand-in for no target, sorts after any real reading
+#define DISTANCE_FILTER_DEFAULT_ALPHA 96 // ~0.375, settles within a handful of samples
+#define DISTANCE_FILTER_DEFAULT_MAX_JUMP_CM 80
+#define DISTANCE_FILTER_DEFAULT_MAX_REJECTS 2
+
+DistanceFilter::DistanceFilter(long enterCm, long exitCm, long minCm, uint8_t window)
+    : enterCm(enterCm), exitCm(exitCm), minCm(minCm),
+      window(constrain(window, 1, DISTANCE_FILTER_MAX_WINDOW)), enterSamples(2), exitSamples(3),
+      alpha(DISTANCE_FILTER_DEFAULT_ALPHA), maxJumpCm(DISTANCE_FILTER_DEFAULT_MAX_JUMP_CM),
+      maxRejects(DISTANCE_FILTER_DEFAULT_MAX_REJECTS)
+{
+    reset();
+    memset(&stats, 0, sizeof(stats));
+}
+
+void DistanceFilter::setConfirmSamples(uint8_t enter, uint8_t exit)
+{
+    enterSamples = max(enter, (uint8_t)1);
+    exitSamples = max(exit, (uint8_t)1);
+}
+
+void DistanceFilter::setSmoothing(uint16_t newAlpha)
+{
+    alpha = constrain(newAlpha, 1, 256);
+}
+
+void DistanceFilter::setOutlierLimit(long jumpCm, uint8_t rejectsInRow)
+{
+    maxJumpCm = jumpCm;
+    maxRejects = rejectsInRow;
+}
+
+void DistanceFilter::reset()
+{
+    next = 0;
+    filled = 0;
+    rejects = 0;
+    lastRejectedCm = 0;
+    emaX16 = 0;
+    streak = 0;
+    present = false;
+}
+
+PresenceEvent DistanceFilter::update(long rawCm)
+{
+    stats.samples++;
+
+    long sample = rawCm;
+    if (rawCm <= 0 || rawCm < minCm)
+    {
+        stats.outOfRange++;
+        sample = DISTANCE_FILTER_FAR_CM;
+    }
+    else if (emaX16 != 0 && abs(rawCm - emaX16 / 16) > maxJumpCm)
+    {
+        // Stray echo off something else, unless enough readings in a row
+        // agree on the new distance: then it is a real step and the window
+        // restarts from it instead of dragging the old distance along
+        rejects = (rejects > 0 && abs(rawCm - lastRejectedCm) <= maxJumpCm) ? rejects + 1 : 1;
+        lastRejectedCm = rawCm;
+        if (rejects <= maxRejects)
+        {
+            stats.rejected++;
+            return PRESENCE_NONE;
+        }
+        rejects = 0;
+        next = 0;
+        filled = 0;
+        emaX16 = 0;
+    }
+    else
+    {
+        rejects = 0;
+    }
+
+    samples[next] = sample;
+    next = (next + 1) % window;
+    if (filled < window)
+        filled++;
+
+    long m = median();
+    if (m >= DISTANCE_FILTER_FAR_CM)
+    {
+        emaX16 = 0;
+    }
+    else if (emaX16 == 0)
+    {
+        // Target just appeared: start from it instead of crawling in from far
+        emaX16 = m * 16;
+    }
+    else
+    {
+        emaX16 += (m * 16 - emaX16) * (long)alpha / 256;
+    }
+
+    bool crossing = present ? (emaX16 == 0 || emaX16 > exitCm * 16) : (emaX16 != 0 && emaX16 < enterCm * 16);
+    streak = crossing ? streak + 1 : 0;
+    if (!crossing || streak < (present ? exitSamples : enterSamples))
+        return PRESENCE_NONE;
+
+    streak = 0;
+    present = !present;
+    if (present)
+    {
+        stats.presences++;
+        return PRESENCE_BEGIN;
+    }
+    return PRESENCE_END;
+}
+
+// Window is at most DISTANCE_FILTER_MAX_WINDOW long, an insertion sort of a
+// copy is cheaper than keeping it ordered
+long DistanceFilter::median() const
+{
+    long sorted[DISTANCE_FILTER_MAX_WINDOW];
+    for (uint8_t i = 0; i < filled; i++)
+    {
+        long value = samples[i];
+        int8_t j = i - 1;
+        for (; j >= 0 && sorted[j] > value; j--)
+        {
+            sorted[j + 1] = sorted[j];
+        }
+        sorted[j + 1] = value;
+    }
+    return sorted[filled / 2];
+}
+
+bool DistanceFilter::isPresent() const
+{
+    return present;
+}
+
+long DistanceFilter::getDistance() const
+{
+    return (emaX16 + 8) / 16;
+}
+
+const DistanceFilterStats &DistanceFilter::getStats() const
+{
+    return stats;
+}
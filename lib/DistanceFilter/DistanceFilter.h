@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef DISTANCE_FILTER_H
+#define DISTANCE_FILTER_H
+
+#include <Arduino.h>
+
+#define DISTANCE_FILTER_MAX_WINDOW 9
+
+enum PresenceEvent
+{
+    PRESENCE_NONE,
+    PRESENCE_BEGIN,
+    PRESENCE_END
+};
+
+struct DistanceFilterStats
+{
+    uint32_t samples;
+    uint32_t rejected;   // Valid readings dropped as outliers
+    uint32_t outOfRange; // No echo or closer than the minimum distance
+    uint32_t presences;
+};
+
+// Turns raw ultrasonic readings into a stable presence signal. Each reading
+// goes through a median-of-N window (kills single bad echoes), an outlier
+// check against the tracked distance and an EMA; presence then begins below
+// enterCm and only ends above exitCm, so a target hovering at the edge does
+// not toggle it. Everything is fixed size, no allocation.
+class DistanceFilter
+{
+public:
+    // Readings of 0 (no echo) or below minCm count as nothing in range
+    DistanceFilter(long enterCm, long exitCm, long minCm = 1, uint8_t window = 5);
+
+    // Feed one completed measurement, returns the presence edge it caused
+    PresenceEvent update(long rawCm);
+
+    // Consecutive filtered samples needed to begin and to end a presence
+    void setConfirmSamples(uint8_t enterSamples, uint8_t exitSamples);
+
+    // EMA weight of a new sample in 1/256, 256 disables smoothing
+    void setSmoothing(uint16_t alpha);
+
+    // A reading further than maxJumpCm from the tracked distance is dropped,
+    // unless maxRejects readings in a row agree it is a real step
+    void setOutlierLimit(long maxJumpCm, uint8_t maxRejects);
+
+    bool isPresent() const;
+
+    // Filtered distance in cm, 0 while nothing is in range
+    long getDistance() const;
+
+    // Forgets the tracked target and presence, e.g. after readings were not
+    // fed for a while; the stats keep counting
+    void reset();
+    const DistanceFilterStats &getStats() const;
+
+private:
+    long median() const;
+
+    long enterCm;
+    long exitCm;
+    long minCm;
+    uint8_t window;
+    uint8_t enterSamples;
+    uint8_t exitSamples;
+    uint16_t alpha;
+    long maxJumpCm;
+    uint8_t maxRejects;
+
+    long samples[DISTANCE_FILTER_MAX_WINDOW];
+    uint8_t next;
+    uint8_t filled;
+    uint8_t rejects;
+    long lastRejectedCm;
+
+    long emaX16; // Filtered distance in 1/16 cm, 0 while nothing is tracked
+    uint8_t streak;
+    bool present;
+
+    DistanceFilterStats stats;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include "EventOutbox.h"
+#include <LittleFS.h>
+#include <JsonWriter.h>
+
+#define OUTBOX_MAGIC 0x3158424F // "OBX1"
+#define OUTBOX_BATCH_SIZE 8
+#define OUTBOX_EVENT_JSON_OVERHEAD 64 // Keys, id and age around route and body
+#define OUTBOX_RETRY_MIN_MS 1000
+#define OUTBOX_RETRY_MAX_MS 60000
+#define OUTBOX_STATS_INTERVAL_MS 60000
+#define OUTBOX_TASK_STACK 10240
+
+EventOutbox::EventOutbox(const char *boardName, const char *path, uint16_t capacity)
+    : boardName(boardName), path(path), capacity(capacity), sessionFirstId(0), mutex(NULL), task(NULL)
+{
+    memset(&header, 0, sizeof(header));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool EventOutbox::begin(const String &address, BaseType_t core)
+{
+    if (!LittleFS.begin(true))
+    {
+        Serial.println("Failed to mount LittleFS. Outbox disabled.");
+        return false;
+    }
+
+    if (!loadHeader())
+    {
+        // New or incompatible log: start an empty one
+        header.magic = OUTBOX_MAGIC;
+        header.nextId = 1;
+        header.head = 0;
+        header.count = 0;
+        header.capacity = capacity;
+
+        File file = LittleFS.open(path, "w");
+        if (!file)
+        {
+            Serial.println("Failed to create outbox log. Outbox disabled.");
+            return false;
+        }
+        Record empty;
+        memset(&empty, 0, sizeof(empty));
+        file.write((const uint8_t *)&header, sizeof(header));
+        for (uint16_t i = 0; i < capacity; i++)
+        {
+            file.write((const uint8_t *)&empty, sizeof(empty));
+        }
+        file.close();
+    }
+    else if (header.count > 0)
+    {
+        Serial.println("Outbox recovered " + String(header.count) + " pending events.");
+    }
+
+    sessionFirstId = header.nextId;
+    mutex = xSemaphoreCreateMutex();
+
+    hubAddress = address;
+    if (!hubAddress.isEmpty())
+    {
+        xTaskCreatePinnedToCore(taskEntry, "outbox", OUTBOX_TASK_STACK, this, 1, &task, core);
+    }
+    return true;
+}
+
+bool EventOutbox::append(const char *route, const char *payload)
+{
+    if (mutex == NULL || strlen(route) >= OUTBOX_ROUTE_SIZE || strlen(payload) >= OUTBOX_PAYLOAD_SIZE)
+    {
+        Serial.println("Event not stored in outbox: " + String(route));
+        return false;
+    }
+
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.appendedMs = millis();
+    strcpy(record.route, route);
+    strcpy(record.payload, payload);
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    record.id = header.nextId++;
+    uint16_t slot = (header.head + header.count) % capacity;
+    if (header.count == capacity)
+    {
+        header.head = (header.head + 1) % capacity;
+        stats.dropped++;
+    }
+    else
+    {
+        header.count++;
+    }
+
+    bool written = false;
+    File file = LittleFS.open(path, "r+");
+    if (file)
+    {
+        written = file.seek(recordOffset(slot)) && file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+        written = written && file.seek(0) && file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+        file.close();
+    }
+    stats.appended++;
+    xSemaphoreGive(mutex);
+
+    if (!written)
+    {
+        Serial.println("Failed to write event to outbox log.");
+    }
+    if (task != NULL)
+    {
+        xTaskNotifyGive(task);
+    }
+    return written;
+}
+
+uint16_t EventOutbox::depth()
+{
+    if (mutex == NULL)
+        return 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint16_t count = header.count;
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+OutboxStats EventOutbox::getStats()
+{
+    if (mutex == NULL)
+        return stats;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    OutboxStats copy = stats;
+    xSemaphoreGive(mutex);
+    return copy;
+}
+
+void EventOutbox::printStats()
+{
+    OutboxStats s = getStats();
+    Serial.println("Outbox: " + String(depth()) + " pending, " + String(s.appended) + " appended, " +
+                   String(s.sent) + " sent in " + String(s.batches) + " batches (last " + String(s.lastBatchSize) +
+                   " events, " + String(s.lastBatchMs) + " ms, max " + String(s.maxBatchMs) + " ms), latency last " +
+                   String(s.lastLatencyMs) + " ms, max " + String(s.maxLatencyMs) + " ms, " +
+                   String(s.failures) + " failed uploads, " + String(s.dropped) + " dropped");
+}
+
+bool EventOutbox::loadHeader()
+{
+    File file = LittleFS.open(path, "r");
+    if (!file)
+        return false;
+
+    bool valid = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == OUTBOX_MAGIC && header.capacity == capacity &&
+                 header.head < capacity && header.count <= capacity &&
+                 file.size() == recordOffset(capacity);
+    file.close();
+    return valid;
+}
+
+bool EventOutbox::writeHeader()
+{
+    File file = LittleFS.open(path, "r+");
+    if (!file)
+        return false;
+    bool written = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+    file.close();
+    return written;
+}
+
+bool EventOutbox::readRecord(uint16_t slot, Record &record)
+{
+    File file = LittleFS.open(path, "r");
+    if (!file)
+        return false;
+    bool read = file.seek(recordOffset(slot)) && file.read((uint8_t *)&record, sizeof(record)) == sizeof(record);
+    file.close();
+    return read;
+}
+
+size_t EventOutbox::recordOffset(uint16_t slot) const
+{
+    return sizeof(Header) + (size_t)slot * sizeof(Record);
+}
+
+// Uploads up to OUTBOX_BATCH_SIZE of the oldest events. Returns the number
+// of events delivered, 0 if nothing was pending, -1 if the upload failed.
+int EventOutbox::sendBatch()
+{
+    Record records[OUTBOX_BATCH_SIZE];
+    int count = 0;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (; count < OUTBOX_BATCH_SIZE && count < header.count; count++)
+    {
+        if (!readRecord((header.head + count) % capacity, records[count]))
+            break;
+    }
+    xSemaphoreGive(mutex);
+
+    if (count == 0)
+        return 0;
+
+    unsigned long now = millis();
+    JsonWriter<64 + OUTBOX_BATCH_SIZE * (OUTBOX_ROUTE_SIZE + OUTBOX_PAYLOAD_SIZE + OUTBOX_EVENT_JSON_OVERHEAD)> json;
+    json.beginObject().field(JSON_KEY("name"), boardName).beginArray(JSON_KEY("events"));
+    for (int i = 0; i < count; i++)
+    {
+        // Age is unknown for events stored before this boot
+        long age = records[i].id >= sessionFirstId ? (long)(now - records[i].appendedMs) : -1;
+        json.beginObject()
+            .field(JSON_KEY("id"), (unsigned long)records[i].id)
+            .field(JSON_KEY("route"), records[i].route)
+            .field(JSON_KEY("age"), age)
+            .rawField(JSON_KEY("body"), records[i].payload)
+            .endObject();
+    }
+    json.endArray().endObject();
+
+    int httpCode = hub.post("/events", json.c_str(), json.size());
+    unsigned long batchMs = millis() - now;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (httpCode != 200)
+    {
+        stats.failures++;
+        xSemaphoreGive(mutex);
+        return -1;
+    }
+
+    // Ids in the ring are consecutive, so drop everything up to the last
+    // delivered id; appends may have overwritten some of them meanwhile
+    uint32_t oldestId = header.nextId - header.count;
+    uint32_t deliveredThrough = records[count - 1].id;
+    if (deliveredThrough >= oldestId)
+    {
+        uint16_t delivered = min((uint32_t)header.count, deliveredThrough - oldestId + 1);
+        header.head = (header.head + delivered) % capacity;
+        header.count -= delivered;
+        writeHeader();
+    }
+
+    stats.sent += count;
+    stats.batches++;
+    stats.lastBatchSize = count;
+    stats.lastBatchMs = batchMs;
+    stats.maxBatchMs = max(stats.maxBatchMs, (uint32_t)batchMs);
+    if (records[0].id >= sessionFirstId)
+    {
+        stats.lastLatencyMs = millis() - records[0].appendedMs;
+        stats.maxLatencyMs = max(stats.maxLatencyMs, stats.lastLatencyMs);
+    }
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+void EventOutbox::taskEntry(void *arg)
+{
+    static_cast<EventOutbox *>(arg)->run();
+}
+
+void EventOutbox::run()
+{
+    hub.begin(hubAddress);
+
+    unsigned long backoffMs = 0;
+    unsigned long lastStatsPrint = millis();
+    while (true)
+    {
+        int sent = sendBatch();
+
+        if (millis() - lastStatsPrint > OUTBOX_STATS_INTERVAL_MS)
+        {
+            printStats();
+            lastStatsPrint = millis();
+        }
+
+        if (sent > 0)
+        {
+            backoffMs = 0;
+            continue;
+        }
+
+        if (sent < 0)
+        {
+            // Jittered exponential backoff while the hub is unreachable
+            backoffMs = backoffMs == 0 ? OUTBOX_RETRY_MIN_MS : min(backoffMs * 2, (unsigned long)OUTBOX_RETRY_MAX_MS);
+            unsigned long waitMs = backoffMs / 2 + random(backoffMs / 2 + 1);
+            Serial.println("Outbox upload failed, retrying in " + String(waitMs) + " ms.");
+            vTaskDelay(pdMS_TO_TICKS(waitMs));
+            continue;
+        }
+
+        // Nothing pending: sleep until append() wakes the task
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OUTBOX_STATS_INTERVAL_MS));
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef EVENT_OUTBOX_H
+#define EVENT_OUTBOX_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <HubClient.h>
+
+#define OUTBOX_ROUTE_SIZE 28
+#define OUTBOX_PAYLOAD_SIZE 160
+
+// Delivery counters for the outbox
+struct OutboxStats
+{
+    uint32_t appended;
+    uint32_t sent;
+    uint32_t dropped; // Oldest events overwritten while the outbox was full
+    uint32_t batches;
+    uint32_t failures;
+    uint32_t lastBatchSize;
+    uint32_t lastBatchMs; // Upload time of the last batch
+    uint32_t maxBatchMs;
+    uint32_t lastLatencyMs; // Append to delivery time of the oldest event in the last batch
+    uint32_t maxLatencyMs;
+};
+
+// Hub notifications that must not get lost. append() stores the event in a
+// fixed-size ring log on LittleFS and returns right away; a sender task
+// uploads pending events in batches to POST /events over its own keep-alive
+// connection and retries with jittered exponential backoff while the hub is
+// unreachable. Events survive reboots; when the ring is full the oldest
+// event is overwritten.
+class EventOutbox
+{
+public:
+    EventOutbox(const char *boardName, const char *path = "/outbox.log", uint16_t capacity = 64);
+
+    // Mounts LittleFS, recovers pending events and starts the sender task
+    bool begin(const String &hubAddress, BaseType_t core = 0);
+
+    // Safe from any task; false if the event does not fit a record
+    bool append(const char *route, const char *payload);
+
+    uint16_t depth();
+    OutboxStats getStats();
+    void printStats();
+
+private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t nextId;
+        uint16_t head;
+        uint16_t count;
+        uint16_t capacity;
+        uint16_t reserved;
+    };
+
+    struct Record
+    {
+        uint32_t id;
+        uint32_t appendedMs;
+        char route[OUTBOX_ROUTE_SIZE];
+        char payload[OUTBOX_PAYLOAD_SIZE];
+    };
+
+    static void taskEntry(void *arg);
+    void run();
+    bool loadHeader();
+    bool writeHeader();
+    bool readRecord(uint16_t slot, Record &record);
+    size_t recordOffset(uint16_t slot) const;
+    int sendBatch();
+
+    const char *boardName;
+    const char *path;
+    uint16_t capacity;
+    String hubAddress;
+    HubClient hub; // Owned by the sender task
+
+    Header header;
+    uint32_t sessionFirstId; // Older ids were appended before this boot
+    SemaphoreHandle_t mutex;
+    TaskHandle_t task;
+    OutboxStats stats;
+};
+
+#endif
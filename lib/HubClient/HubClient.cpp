@@ -0,0 +1,388 @@
+#include "HubClient.h"
+#include <freertos/FreeRTOS.h>
+
+#define HUB_STATS_INTERVAL_MS 60000
+#define HUB_DEFAULT_TIMEOUT_MS 4000
+#define HUB_BREAKER_FAILURES 3 // Failed requests in a row that open the breaker
+#define HUB_BREAKER_MIN_BACKOFF_MS 2000
+#define HUB_BREAKER_MAX_BACKOFF_MS 60000
+#define HUB_LAN_URL_SIZE 48
+#define HUB_LAN_CONNECT_TIMEOUT_MS 500 // A hub on the LAN accepts within a few ms
+#define HUB_LAN_RETRY_MS 30000         // Cloud only for this long after the LAN hub failed
+
+// LAN hub address shared by every instance, set by the discovery code
+static char lanUrl[HUB_LAN_URL_SIZE];
+static volatile uint32_t lanUrlGeneration = 0;
+static portMUX_TYPE lanUrlMux = portMUX_INITIALIZER_UNLOCKED;
+
+HubClient::HubClient()
+    : activePath(HUB_PATH_CLOUD), lanGeneration(0), lanRetryAtMs(0), client(&plainClient),
+      timeoutMs(HUB_DEFAULT_TIMEOUT_MS), breaker(HUB_BREAKER_CLOSED), consecutiveFailures(0), backoffMs(0),
+      openedMs(0), openForMs(0), lastStatsPrint(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void HubClient::parseUrl(const String &url, Endpoint &endpoint)
+{
+    endpoint.baseUrl = url;
+    while (endpoint.baseUrl.endsWith("/"))
+    {
+        endpoint.baseUrl.remove(endpoint.baseUrl.length() - 1);
+    }
+
+    endpoint.secure = endpoint.baseUrl.startsWith("https://");
+    int hostStart = endpoint.baseUrl.indexOf("://");
+    hostStart = hostStart < 0 ? 0 : hostStart + 3;
+    int hostEnd = endpoint.baseUrl.indexOf('/', hostStart);
+    if (hostEnd < 0)
+    {
+        hostEnd = endpoint.baseUrl.length();
+    }
+
+    endpoint.host = endpoint.baseUrl.substring(hostStart, hostEnd);
+    endpoint.port = endpoint.secure ? 443 : 80;
+    int colon = endpoint.host.indexOf(':');
+    if (colon >= 0)
+    {
+        endpoint.port = endpoint.host.substring(colon + 1).toInt();
+        endpoint.host = endpoint.host.substring(0, colon);
+    }
+}
+
+void HubClient::begin(const String &url)
+{
+    stop();
+    parseUrl(url, endpoints[HUB_PATH_CLOUD]);
+
+    // Same trust model as HTTPClient::begin(url) without a CA certificate
+    secureClient.setInsecure();
+    activePath = HUB_PATH_CLOUD;
+    client = endpoints[HUB_PATH_CLOUD].secure ? &secureClient : &plainClient;
+
+    http.setReuse(true);
+    static const char *headerKeys[] = {HUB_COMMAND_SEQ_HEADER};
+    http.collectHeaders(headerKeys, 1);
+}
+
+void HubClient::setLanAddress(const String &url)
+{
+    portENTER_CRITICAL(&lanUrlMux);
+    snprintf(lanUrl, sizeof(lanUrl), "%s", url.c_str());
+    lanUrlGeneration++;
+    portEXIT_CRITICAL(&lanUrlMux);
+}
+
+void HubClient::refreshLanAddress()
+{
+    if (lanGeneration == lanUrlGeneration)
+        return;
+
+    char url[HUB_LAN_URL_SIZE];
+    portENTER_CRITICAL(&lanUrlMux);
+    memcpy(url, lanUrl, sizeof(url));
+    lanGeneration = lanUrlGeneration;
+    portEXIT_CRITICAL(&lanUrlMux);
+
+    if (activePath == HUB_PATH_LAN)
+    {
+        usePath(HUB_PATH_CLOUD);
+    }
+    parseUrl(String(url), endpoints[HUB_PATH_LAN]);
+    lanRetryAtMs = 0;
+}
+
+// LAN first, unless it failed within the last HUB_LAN_RETRY_MS
+HubPath HubClient::choosePath()
+{
+    refreshLanAddress();
+    if (endpoints[HUB_PATH_LAN].host.isEmpty())
+        return HUB_PATH_CLOUD;
+    if (lanRetryAtMs != 0 && (long)(millis() - lanRetryAtMs) < 0)
+        return HUB_PATH_CLOUD;
+    return HUB_PATH_LAN;
+}
+
+// The kept-alive connection belongs to one path, switching drops it
+void HubClient::usePath(HubPath path)
+{
+    if (path == activePath)
+        return;
+    stop();
+    activePath = path;
+    client = endpoints[path].secure ? &secureClient : &plainClient;
+}
+
+bool HubClient::isConfigured() const
+{
+    return !endpoints[HUB_PATH_CLOUD].host.isEmpty();
+}
+
+void HubClient::setTimeout(uint16_t ms)
+{
+    timeoutMs = ms;
+}
+
+HubBreakerState HubClient::breakerState() const
+{
+    return breaker;
+}
+
+// Open: refuse until the backoff is over, then let a single probe through
+bool HubClient::breakerAllows()
+{
+    if (breaker != HUB_BREAKER_OPEN)
+        return true;
+    if (millis() - openedMs < openForMs)
+        return false;
+
+    breaker = HUB_BREAKER_HALF_OPEN;
+    return true;
+}
+
+void HubClient::recordOutcome(bool ok)
+{
+    if (ok)
+    {
+        if (breaker != HUB_BREAKER_CLOSED)
+        {
+            Serial.println("Hub reachable again, breaker closed.");
+        }
+        breaker = HUB_BREAKER_CLOSED;
+        consecutiveFailures = 0;
+        backoffMs = 0;
+        return;
+    }
+
+    if (consecutiveFailures < 255)
+        consecutiveFailures++;
+    if (breaker != HUB_BREAKER_HALF_OPEN && consecutiveFailures < HUB_BREAKER_FAILURES)
+        return;
+
+    // Jittered exponential backoff, so boards do not probe a recovering hub
+    // in lockstep
+    backoffMs = backoffMs == 0 ? HUB_BREAKER_MIN_BACKOFF_MS
+                               : min(backoffMs * 2, (unsigned long)HUB_BREAKER_MAX_BACKOFF_MS);
+    openForMs = backoffMs / 2 + random(backoffMs / 2 + 1);
+    openedMs = millis();
+    breaker = HUB_BREAKER_OPEN;
+    stats.trips++;
+    Serial.println("Hub breaker open for " + String(openForMs) + " ms after " + String(consecutiveFailures) +
+                   " failed requests.");
+}
+
+int HubClient::get(const char *path)
+{
+    return request("GET", path, NULL, 0, NULL);
+}
+
+int HubClient::post(const char *path, const String &payload)
+{
+    return request("POST", path, (const uint8_t *)payload.c_str(), payload.length(), "application/json");
+}
+
+int HubClient::post(const char *path, const char *payload, size_t length)
+{
+    return request("POST", path, (const uint8_t *)payload, length, "application/json");
+}
+
+int HubClient::post(const char *path, const uint8_t *payload, size_t length, const char *contentType)
+{
+    return request("POST", path, payload, length, contentType);
+}
+
+const String &HubClient::lastResponse() const
+{
+    return response;
+}
+
+const String &HubClient::lastCommandSeq() const
+{
+    return commandSeq;
+}
+
+void HubClient::stop()
+{
+    http.end();
+    client->stop();
+}
+
+const HubClientStats &HubClient::getStats() const
+{
+    return stats;
+}
+
+void HubClient::printStats()
+{
+    unsigned long avgRequestMs = stats.requests ? stats.totalRequestMs / stats.requests : 0;
+    String paths;
+    const char *pathNames[HUB_PATH_COUNT] = {"cloud", "LAN"};
+    for (int i = 0; i < HUB_PATH_COUNT; i++)
+    {
+        if (stats.pathRequests[i] == 0)
+            continue;
+        paths += ", " + String(pathNames[i]) + " " + String(stats.pathRequests[i]) + " answered, rtt last " +
+                 String(stats.pathLastRttMs[i]) + " ms, avg " + String(stats.pathTotalRttMs[i] / stats.pathRequests[i]) +
+                 " ms";
+    }
+    Serial.println("Hub link: " + String(stats.requests) + " requests, " +
+                   String(stats.failures) + " failed, " +
+                   String(stats.handshakes) + " handshakes (last " + String(stats.lastHandshakeMs) +
+                   " ms, max " + String(stats.maxHandshakeMs) + " ms), " +
+                   String(stats.reconnects) + " reconnects, request avg " + String(avgRequestMs) +
+                   " ms, max " + String(stats.maxRequestMs) + " ms, " + String(stats.deadlineMisses) +
+                   " over deadline, breaker " + String(breaker) + " (" + String(stats.trips) + " trips, " +
+                   String(stats.shortCircuits) + " refused), " + String(stats.lanFallbacks) + " LAN fallbacks" +
+                   paths);
+    lastStatsPrint = millis();
+}
+
+// Opens the connection if needed so the handshake can be timed separately.
+// HTTPClient picks an already connected client up and reuses it.
+bool HubClient::ensureConnected(bool &reused, uint32_t connectTimeoutMs)
+{
+    reused = client->connected();
+    if (reused)
+    {
+        return true;
+    }
+
+    const Endpoint &endpoint = endpoints[activePath];
+    unsigned long start = millis();
+    client->stop();
+    bool connected;
+    if (endpoint.secure)
+    {
+        secureClient.setHandshakeTimeout((connectTimeoutMs + 999) / 1000);
+        connected = secureClient.connect(endpoint.host.c_str(), endpoint.port, connectTimeoutMs);
+    }
+    else
+    {
+        connected = plainClient.connect(endpoint.host.c_str(), endpoint.port, connectTimeoutMs);
+    }
+    if (!connected)
+    {
+        Serial.println("Failed to connect to hub " + endpoint.host + ":" + String(endpoint.port));
+        return false;
+    }
+
+    stats.handshakes++;
+    stats.lastHandshakeMs = millis() - start;
+    if (stats.lastHandshakeMs > stats.maxHandshakeMs)
+    {
+        stats.maxHandshakeMs = stats.lastHandshakeMs;
+    }
+    return true;
+}
+
+int HubClient::request(const char *method, const char *path, const uint8_t *payload, size_t size,
+                       const char *contentType)
+{
+    if (!isConfigured())
+    {
+        return HTTPC_ERROR_NOT_CONNECTED;
+    }
+
+    if (!breakerAllows())
+    {
+        stats.shortCircuits++;
+        return HUB_ERROR_BREAKER_OPEN;
+    }
+
+    unsigned long start = millis();
+    int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+    usePath(choosePath());
+
+    // A reused connection may have been closed by the hub while idle; in that
+    // case reconnect and send the request once more. A LAN hub that does not
+    // answer hands the request over to the cloud URL.
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        unsigned long elapsed = millis() - start;
+        if (elapsed >= timeoutMs)
+        {
+            httpCode = HTTPC_ERROR_READ_TIMEOUT;
+            break;
+        }
+
+        bool reused = false;
+        unsigned long attemptStart = millis();
+        uint32_t connectTimeoutMs = timeoutMs - elapsed;
+        if (activePath == HUB_PATH_LAN)
+        {
+            connectTimeoutMs = min(connectTimeoutMs, (uint32_t)HUB_LAN_CONNECT_TIMEOUT_MS);
+        }
+
+        if (ensureConnected(reused, connectTimeoutMs))
+        {
+            // The response gets whatever connecting left of the deadline
+            elapsed = millis() - start;
+            stats.requests++;
+            http.setTimeout(elapsed < timeoutMs ? timeoutMs - elapsed : 1);
+            http.begin(*client, endpoints[activePath].baseUrl + path);
+            if (contentType != NULL)
+            {
+                http.addHeader("Content-Type", contentType);
+            }
+            httpCode = http.sendRequest(method, (uint8_t *)payload, size);
+            response = httpCode > 0 ? http.getString() : String();
+            commandSeq = httpCode > 0 ? http.header(HUB_COMMAND_SEQ_HEADER) : String();
+            http.end();
+
+            if (httpCode > 0)
+            {
+                stats.pathRequests[activePath]++;
+                stats.pathLastRttMs[activePath] = millis() - attemptStart;
+                stats.pathTotalRttMs[activePath] += stats.pathLastRttMs[activePath];
+                if (activePath == HUB_PATH_LAN)
+                {
+                    lanRetryAtMs = 0;
+                }
+                break;
+            }
+
+            client->stop();
+            if (reused)
+            {
+                stats.reconnects++;
+                continue;
+            }
+        }
+
+        if (activePath != HUB_PATH_LAN)
+        {
+            break;
+        }
+
+        // LAN hub gone: this request and the next ones go to the cloud
+        Serial.println("LAN hub not answering, using " + endpoints[HUB_PATH_CLOUD].host);
+        stats.lanFallbacks++;
+        lanRetryAtMs = max(millis() + HUB_LAN_RETRY_MS, 1UL);
+        usePath(HUB_PATH_CLOUD);
+    }
+
+    stats.lastRequestMs = millis() - start;
+    if (httpCode <= 0)
+    {
+        stats.failures++;
+        client->stop();
+        if (stats.lastRequestMs >= timeoutMs)
+        {
+            stats.deadlineMisses++;
+        }
+    }
+    recordOutcome(httpCode > 0 && httpCode < 500);
+
+    stats.totalRequestMs += stats.lastRequestMs;
+    if (stats.lastRequestMs > stats.maxRequestMs)
+    {
+        stats.maxRequestMs = stats.lastRequestMs;
+    }
+
+    if (millis() - lastStatsPrint > HUB_STATS_INTERVAL_MS)
+    {
+        printStats();
+    }
+
+    return httpCode;
+}
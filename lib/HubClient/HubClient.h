@@ -0,0 +1,139 @@
+#pragma once
+
+#ifndef HUB_CLIENT_H
+#define HUB_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+// Returned instead of an HTTP code while the breaker is open; the HTTPClient
+// error codes stop at -11
+#define HUB_ERROR_BREAKER_OPEN -100
+
+// Sequence number of a command handed out through the /send_status code;
+// a header because Express drops the body of a 204
+#define HUB_COMMAND_SEQ_HEADER "X-Command-Seq"
+
+enum HubBreakerState
+{
+    HUB_BREAKER_CLOSED,   // Requests go out
+    HUB_BREAKER_OPEN,     // Hub considered down, requests fail immediately
+    HUB_BREAKER_HALF_OPEN // Backoff over, the next request is a probe
+};
+
+// Ways to reach the hub, index into the per-path stats
+enum HubPath
+{
+    HUB_PATH_CLOUD, // The configured URL
+    HUB_PATH_LAN,   // Hub found on the local network
+    HUB_PATH_COUNT
+};
+
+// Connection and timing counters for the hub link
+struct HubClientStats
+{
+    unsigned long requests;        // Requests sent (including retries)
+    unsigned long failures;        // Requests that got no HTTP status back
+    unsigned long handshakes;      // New TCP/TLS connections opened
+    unsigned long reconnects;      // Reused connections found dead and reopened
+    unsigned long lastHandshakeMs; // Connect + TLS handshake time of the last new connection
+    unsigned long maxHandshakeMs;
+    unsigned long lastRequestMs; // Full request time, handshake included
+    unsigned long maxRequestMs;
+    unsigned long totalRequestMs;
+    unsigned long trips;          // Transitions to open
+    unsigned long shortCircuits;  // Requests refused while open
+    unsigned long deadlineMisses; // Requests cut off by the deadline
+    unsigned long lanFallbacks;   // LAN hub unreachable, request sent to the cloud instead
+    unsigned long pathRequests[HUB_PATH_COUNT]; // Answered requests per path
+    unsigned long pathLastRttMs[HUB_PATH_COUNT];
+    unsigned long pathTotalRttMs[HUB_PATH_COUNT];
+};
+
+// Keeps a single keep-alive connection to the hub open and reuses it for
+// every request, so the TLS handshake is only paid when the link drops.
+// Every request has a hard deadline, and a circuit breaker stops talking to
+// a hub that keeps failing: while it is open requests return
+// HUB_ERROR_BREAKER_OPEN at once, after a jittered backoff one request
+// probes the hub and closes the breaker again if it gets through.
+// When a hub was found on the LAN (setLanAddress()), requests go there
+// first and only fall back to the configured cloud URL while it is
+// unreachable.
+// Not thread safe: each task talking to the hub needs its own instance.
+class HubClient
+{
+public:
+    HubClient();
+
+    void begin(const String &baseUrl);
+    bool isConfigured() const;
+
+    // LAN hub for every instance, picked up on their next request; empty to
+    // go back to the cloud URL only
+    static void setLanAddress(const String &baseUrl);
+
+    // Deadline for a whole request, connect and TLS handshake included;
+    // long-polls need more than the default
+    void setTimeout(uint16_t timeoutMs);
+
+    HubBreakerState breakerState() const;
+
+    int get(const char *path);
+    int post(const char *path, const String &payload);
+    int post(const char *path, const char *payload, size_t length);
+    int post(const char *path, const uint8_t *payload, size_t length, const char *contentType);
+
+    // Response body of the last request, valid until the next one
+    const String &lastResponse() const;
+
+    // HUB_COMMAND_SEQ_HEADER of the last response, empty without one
+    const String &lastCommandSeq() const;
+
+    void stop();
+    const HubClientStats &getStats() const;
+    void printStats();
+
+private:
+    struct Endpoint
+    {
+        String baseUrl;
+        String host;
+        uint16_t port;
+        bool secure;
+    };
+
+    static void parseUrl(const String &url, Endpoint &endpoint);
+    void refreshLanAddress();
+    HubPath choosePath();
+    void usePath(HubPath path);
+    int request(const char *method, const char *path, const uint8_t *payload, size_t size, const char *contentType);
+    bool ensureConnected(bool &reused, uint32_t timeoutMs);
+    bool breakerAllows();
+    void recordOutcome(bool ok);
+
+    Endpoint endpoints[HUB_PATH_COUNT];
+    HubPath activePath;
+    uint32_t lanGeneration;
+    unsigned long lanRetryAtMs;
+
+    WiFiClient plainClient;
+    WiFiClientSecure secureClient;
+    WiFiClient *client;
+    HTTPClient http;
+
+    uint16_t timeoutMs;
+    HubBreakerState breaker;
+    uint8_t consecutiveFailures;
+    unsigned long backoffMs;
+    unsigned long openedMs;
+    unsigned long openForMs;
+
+    String response;
+    String commandSeq;
+    HubClientStats stats;
+    unsigned long lastStatsPrint;
+};
+
+#endif
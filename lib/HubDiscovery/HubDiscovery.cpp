@@ -0,0 +1,62 @@
+#include "HubDiscovery.h"
+#include <ESPmDNS.h>
+#include <Preferences.h>
+#include <HubClient.h>
+
+#define HUB_SERVICE "smarthub"
+#define HUB_SERVICE_PROTO "tcp"
+#define HUB_NVS_NAMESPACE "hub"
+#define HUB_NVS_KEY "lan"
+
+HubDiscovery::HubDiscovery(const char *hostname) : hostname(hostname), started(false)
+{
+}
+
+bool HubDiscovery::discover()
+{
+    if (!started)
+    {
+        started = MDNS.begin(hostname);
+        if (!started)
+        {
+            Serial.println("Failed to start mDNS, LAN hub discovery disabled.");
+        }
+    }
+
+    Preferences prefs;
+    String found;
+    unsigned long start = millis();
+    int count = started ? MDNS.queryService(HUB_SERVICE, HUB_SERVICE_PROTO) : 0;
+    if (count > 0)
+    {
+        IPAddress ip = MDNS.IP(0);
+        found = "http://" + ip.toString() + ":" + String(MDNS.port(0));
+        Serial.println("LAN hub found at " + found + " in " + String(millis() - start) + " ms.");
+
+        if (prefs.begin(HUB_NVS_NAMESPACE, false))
+        {
+            if (prefs.getString(HUB_NVS_KEY, "") != found)
+                prefs.putString(HUB_NVS_KEY, found);
+            prefs.end();
+        }
+    }
+    else if (prefs.begin(HUB_NVS_NAMESPACE, true))
+    {
+        found = prefs.getString(HUB_NVS_KEY, "");
+        prefs.end();
+        if (!found.isEmpty())
+            Serial.println("No LAN hub answered, trying the last one at " + found);
+    }
+
+    if (found != lanAddress)
+    {
+        lanAddress = found;
+        HubClient::setLanAddress(lanAddress);
+    }
+    return !lanAddress.isEmpty();
+}
+
+const String &HubDiscovery::address() const
+{
+    return lanAddress;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef HUB_DISCOVERY_H
+#define HUB_DISCOVERY_H
+
+#include <Arduino.h>
+
+// Finds a hub on the local network through DNS-SD (_smarthub._tcp, which
+// pi_server advertises) and hands it to HubClient::setLanAddress(), so
+// every hub connection of the board goes over the LAN instead of through
+// the cloud. The last hub found is kept in NVS and used when the query
+// comes back empty; HubClient falls back to the cloud URL if it is stale.
+class HubDiscovery
+{
+public:
+    // Also announces the board as <hostname>.local
+    explicit HubDiscovery(const char *hostname);
+
+    // Blocks for the mDNS query, call once the link is up. True when a LAN
+    // hub (found now or cached) is in use.
+    bool discover();
+
+    // LAN hub base URL, empty when there is none
+    const String &address() const;
+
+private:
+    const char *hostname;
+    bool started;
+    String lanAddress;
+};
+
+#endif
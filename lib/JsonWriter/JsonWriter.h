@@ -0,0 +1,289 @@
+#pragma once
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <string.h>
+
+// Field names are checked at compile time: JSON_KEY("name") only compiles
+// if the name is a non-empty literal that needs no escaping, and its length
+// is known up front so writing it is a plain memcpy.
+namespace json_detail
+{
+    constexpr bool keyValid(const char *name, size_t i = 0)
+    {
+        return name[i] == '\0' ? i > 0
+                               : name[i] != '"' && name[i] != '\\' && (unsigned char)name[i] >= 0x20 && keyValid(name, i + 1);
+    }
+}
+
+template <bool Valid, size_t Length>
+struct JsonKey
+{
+    static_assert(Valid, "JSON key must be non-empty and must not contain quotes, backslashes or control characters");
+
+    explicit constexpr JsonKey(const char *name) : name(name) {}
+    const char *name;
+};
+
+#define JSON_KEY(name) (JsonKey<json_detail::keyValid(name), sizeof(name) - 1>(name))
+
+// Serializes JSON into a fixed buffer owned by the writer, usually on the
+// stack, without any heap allocation. Writes past Capacity are dropped and
+// reported by ok(), so an oversized payload is never sent truncated.
+template <size_t Capacity>
+class JsonWriter
+{
+public:
+    JsonWriter() : length(0), overflow(false), needComma(false)
+    {
+        buffer[0] = '\0';
+    }
+
+    JsonWriter &beginObject()
+    {
+        separate();
+        put('{');
+        needComma = false;
+        return *this;
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &beginObject(JsonKey<Valid, Length> key)
+    {
+        writeKey(key);
+        put('{');
+        needComma = false;
+        return *this;
+    }
+
+    JsonWriter &endObject()
+    {
+        put('}');
+        needComma = true;
+        return *this;
+    }
+
+    JsonWriter &beginArray()
+    {
+        separate();
+        put('[');
+        needComma = false;
+        return *this;
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &beginArray(JsonKey<Valid, Length> key)
+    {
+        writeKey(key);
+        put('[');
+        needComma = false;
+        return *this;
+    }
+
+    JsonWriter &endArray()
+    {
+        put(']');
+        needComma = true;
+        return *this;
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &field(JsonKey<Valid, Length> key, const char *value)
+    {
+        writeKey(key);
+        writeString(value);
+        return *this;
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &field(JsonKey<Valid, Length> key, long value)
+    {
+        writeKey(key);
+        writeSigned(value);
+        return *this;
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &field(JsonKey<Valid, Length> key, int value)
+    {
+        return field(key, (long)value);
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &field(JsonKey<Valid, Length> key, unsigned long value)
+    {
+        writeKey(key);
+        writeUnsigned(value);
+        return *this;
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &field(JsonKey<Valid, Length> key, unsigned int value)
+    {
+        return field(key, (unsigned long)value);
+    }
+
+    template <bool Valid, size_t Length>
+    JsonWriter &field(JsonKey<Valid, Length> key, bool value)
+    {
+        writeKey(key);
+        append(value ? "true" : "false", value ? 4 : 5);
+        return *this;
+    }
+
+    // Value that is already serialized JSON, copied as is
+    template <bool Valid, size_t Length>
+    JsonWriter &rawField(JsonKey<Valid, Length> key, const char *json)
+    {
+        writeKey(key);
+        append(json, strlen(json));
+        return *this;
+    }
+
+    // Array elements
+    JsonWriter &value(const char *value)
+    {
+        separate();
+        writeString(value);
+        return *this;
+    }
+
+    JsonWriter &value(long value)
+    {
+        separate();
+        writeSigned(value);
+        return *this;
+    }
+
+    const char *c_str() const
+    {
+        return buffer;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    bool ok() const
+    {
+        return !overflow;
+    }
+
+private:
+    void put(char c)
+    {
+        if (!overflow && length + 1 < Capacity)
+        {
+            buffer[length++] = c;
+            buffer[length] = '\0';
+        }
+        else
+        {
+            overflow = true;
+        }
+    }
+
+    void append(const char *text, size_t count)
+    {
+        if (!overflow && length + count < Capacity)
+        {
+            memcpy(buffer + length, text, count);
+            length += count;
+            buffer[length] = '\0';
+        }
+        else
+        {
+            overflow = true;
+        }
+    }
+
+    void separate()
+    {
+        if (needComma)
+            put(',');
+        needComma = true;
+    }
+
+    template <bool Valid, size_t Length>
+    void writeKey(JsonKey<Valid, Length> key)
+    {
+        separate();
+        put('"');
+        append(key.name, Length);
+        append("\":", 2);
+    }
+
+    void writeString(const char *value)
+    {
+        static const char hex[] = "0123456789abcdef";
+        put('"');
+        for (const char *p = value ? value : ""; *p; p++)
+        {
+            unsigned char c = (unsigned char)*p;
+            if (c == '"' || c == '\\')
+            {
+                put('\\');
+                put((char)c);
+            }
+            else if (c == '\n')
+            {
+                append("\\n", 2);
+            }
+            else if (c == '\r')
+            {
+                append("\\r", 2);
+            }
+            else if (c == '\t')
+            {
+                append("\\t", 2);
+            }
+            else if (c < 0x20)
+            {
+                char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                append(escaped, sizeof(escaped));
+            }
+            else
+            {
+                put((char)c);
+            }
+        }
+        put('"');
+    }
+
+    void writeUnsigned(unsigned long value)
+    {
+        char digits[20];
+        size_t count = 0;
+        do
+        {
+            digits[count++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        while (count > 0)
+            put(digits[--count]);
+    }
+
+    void writeSigned(long value)
+    {
+        if (value < 0)
+        {
+            put('-');
+            writeUnsigned(0UL - (unsigned long)value);
+        }
+        else
+        {
+            writeUnsigned((unsigned long)value);
+        }
+    }
+
+    char buffer[Capacity];
+    size_t length;
+    bool overflow;
+    bool needComma;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "LoopProfiler.h"
+
+LoopProfiler::LoopProfiler(const char *name) : name(name), lastTickUs(0)
+{
+    reset();
+}
+
+void LoopProfiler::reset()
+{
+    windowStartMs = millis();
+    count = 0;
+    maxUs = 0;
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void LoopProfiler::tick()
+{
+    uint32_t now = micros();
+    if (lastTickUs != 0)
+    {
+        uint32_t elapsed = now - lastTickUs;
+        uint8_t bucket = elapsed == 0 ? 0 : 32 - __builtin_clz(elapsed);
+        buckets[min(bucket, (uint8_t)(LOOP_PROFILER_BUCKETS - 1))]++;
+        maxUs = max(maxUs, elapsed);
+        count++;
+    }
+    lastTickUs = now;
+}
+
+uint32_t LoopProfiler::percentileUs(uint8_t percent) const
+{
+    if (count == 0)
+        return 0;
+
+    uint32_t rank = ((uint64_t)count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LOOP_PROFILER_BUCKETS - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return min((uint32_t)1 << i, maxUs);
+    }
+    return maxUs;
+}
+
+void LoopProfiler::report(unsigned long intervalMs)
+{
+    if (millis() - windowStartMs < intervalMs)
+        return;
+
+    Serial.println(String(name) + " loop: " + String(count) + " iterations, p50 " + String(percentileUs(50)) +
+                   " us, p90 " + String(percentileUs(90)) + " us, p99 " + String(percentileUs(99)) +
+                   " us, max " + String(maxUs) + " us");
+    reset();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+
+#define LOOP_PROFILER_BUCKETS 22 // Powers of two from 1 us up to ~2 s, the last one open ended
+
+// Distribution of loop() iteration times. tick() at the top of loop()
+// closes the previous iteration; report() prints percentiles for the last
+// window and starts a new one. A bucket per power of two keeps it to a
+// counter increment per pass.
+class LoopProfiler
+{
+public:
+    explicit LoopProfiler(const char *name);
+
+    void tick();
+
+    // Prints and resets once intervalMs have passed since the last report
+    void report(unsigned long intervalMs);
+
+    // Upper bound of the bucket holding the given percentile, in us
+    uint32_t percentileUs(uint8_t percent) const;
+
+private:
+    void reset();
+
+    const char *name;
+    uint32_t lastTickUs;
+    unsigned long windowStartMs;
+    uint32_t count;
+    uint32_t maxUs;
+    uint32_t buckets[LOOP_PROFILER_BUCKETS];
+};
+
+#endif
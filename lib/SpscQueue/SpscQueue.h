@@ -0,0 +1,61 @@
+#pragma once
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Lock-free single producer / single consumer ring buffer. Exactly one task
+// may call push() and exactly one (possibly on the other core) may call pop().
+// Capacity must be a power of two; one slot is kept free to tell full from empty.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Producer side; false if the queue is full
+    bool push(const T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t next = (h + 1) & (Capacity - 1);
+        if (next == tail.load(std::memory_order_acquire))
+            return false;
+
+        items[h] = item;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false if the queue is empty
+    bool pop(T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+
+        item = items[t];
+        tail.store((t + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (Capacity - 1);
+    }
+
+private:
+    T items[Capacity];
+    std::atomic<size_t> head; // Written by the producer only
+    std::atomic<size_t> tail; // Written by the consumer only
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "UdpHeartbeat.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include <mbedtls/md.h>
+
+#define HEARTBEAT_MAGIC 0x4853 // "SH"
+#define HEARTBEAT_VERSION 1
+#define HEARTBEAT_SIGNED_SIZE (HEARTBEAT_PACKET_SIZE - HEARTBEAT_MAC_SIZE)
+#define HEARTBEAT_NVS_NAMESPACE "heartbeat"
+#define HEARTBEAT_NVS_KEY "boot"
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+UdpHeartbeat::UdpHeartbeat(const char *boardName)
+    : boardName(boardName), key(""), keyLength(0), bootCounter(0), sequence(0), hubKnown(false)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void UdpHeartbeat::begin(const char *psk)
+{
+    key = psk;
+    keyLength = strlen(psk);
+    if (keyLength == 0)
+        return;
+
+    Preferences prefs;
+    if (prefs.begin(HEARTBEAT_NVS_NAMESPACE, false))
+    {
+        bootCounter = prefs.getUInt(HEARTBEAT_NVS_KEY, 0) + 1;
+        prefs.putUInt(HEARTBEAT_NVS_KEY, bootCounter);
+        prefs.end();
+    }
+    else
+    {
+        // Without a boot counter the hub would take our datagrams for replays
+        Serial.println("No NVS for the heartbeat boot counter, UDP heartbeat disabled.");
+        keyLength = 0;
+    }
+}
+
+bool UdpHeartbeat::setHub(const String &baseUrl)
+{
+    int hostStart = baseUrl.indexOf("://");
+    hostStart = hostStart < 0 ? 0 : hostStart + 3;
+    int hostEnd = baseUrl.indexOf(':', hostStart);
+    if (hostEnd < 0)
+        hostEnd = baseUrl.length();
+
+    hubKnown = hubIp.fromString(baseUrl.substring(hostStart, hostEnd));
+    return hubKnown;
+}
+
+bool UdpHeartbeat::isEnabled() const
+{
+    return keyLength > 0;
+}
+
+size_t UdpHeartbeat::encode(uint8_t state, uint8_t *packet)
+{
+    memset(packet, 0, HEARTBEAT_PACKET_SIZE);
+    put16(packet, HEARTBEAT_MAGIC);
+    packet[2] = HEARTBEAT_VERSION;
+    packet[3] = state;
+    put32(packet + 4, bootCounter);
+    put32(packet + 8, ++sequence);
+    put32(packet + 12, millis() / 1000);
+    put32(packet + 16, ESP.getFreeHeap());
+    packet[20] = (uint8_t)(int8_t)WiFi.RSSI();
+    strncpy((char *)packet + 24, boardName, HEARTBEAT_NAME_SIZE);
+
+    uint8_t mac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)key, keyLength, packet,
+                    HEARTBEAT_SIGNED_SIZE, mac);
+    memcpy(packet + HEARTBEAT_SIGNED_SIZE, mac, HEARTBEAT_MAC_SIZE);
+    return HEARTBEAT_PACKET_SIZE;
+}
+
+bool UdpHeartbeat::send(uint8_t state)
+{
+    if (!isEnabled() || !hubKnown)
+        return false;
+
+    uint8_t packet[HEARTBEAT_PACKET_SIZE];
+    uint32_t start = micros();
+    size_t length = encode(state, packet);
+    stats.lastEncodeUs = micros() - start;
+    stats.maxEncodeUs = max(stats.maxEncodeUs, stats.lastEncodeUs);
+
+    bool sent = udp.beginPacket(hubIp, HEARTBEAT_UDP_PORT) && udp.write(packet, length) == length &&
+                udp.endPacket();
+    if (sent)
+        stats.sent++;
+    else
+        stats.sendFailures++;
+    return sent;
+}
+
+const HeartbeatStats &UdpHeartbeat::getStats() const
+{
+    return stats;
+}
+
+void UdpHeartbeat::printStats()
+{
+    Serial.println("UDP heartbeat: " + String(stats.sent) + " sent (" + String(HEARTBEAT_PACKET_SIZE) +
+                   " bytes each), " + String(stats.sendFailures) + " failed, encode last " +
+                   String(stats.lastEncodeUs) + " us, max " + String(stats.maxEncodeUs) + " us");
+}
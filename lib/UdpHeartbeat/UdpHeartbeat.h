@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef UDP_HEARTBEAT_H
+#define UDP_HEARTBEAT_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#define HEARTBEAT_UDP_PORT 5001
+#define HEARTBEAT_NAME_SIZE 16
+#define HEARTBEAT_MAC_SIZE 16 // HMAC-SHA256 truncated to 128 bits
+#define HEARTBEAT_PACKET_SIZE (24 + HEARTBEAT_NAME_SIZE + HEARTBEAT_MAC_SIZE)
+
+// Board state bits carried in every heartbeat
+#define HEARTBEAT_STATE_ALARM 0x01
+#define HEARTBEAT_STATE_PRESENCE 0x02
+#define HEARTBEAT_STATE_LOCKED_OUT 0x04
+
+struct HeartbeatStats
+{
+    uint32_t sent;
+    uint32_t sendFailures;
+    uint32_t lastEncodeUs; // Layout plus HMAC of the last packet
+    uint32_t maxEncodeUs;
+};
+
+// Heartbeat and telemetry as one fixed-layout UDP datagram to the LAN hub,
+// instead of a JSON POST over TLS. Layout, little endian:
+//   0  u16 magic "SH"      2  u8 version        3  u8 state bits
+//   4  u32 boot counter    8  u32 sequence     12  u32 uptime in s
+//  16  u32 free heap      20  i8 RSSI in dBm   21  3 bytes reserved
+//  24  board name, zero padded to 16 bytes
+//  40  HMAC-SHA256 over bytes 0-39 with the pre-shared key, first 16 bytes
+// The boot counter lives in NVS and grows on every boot, so (boot, sequence)
+// only ever increases and the hub drops anything not newer than the last
+// datagram it accepted from the board: replays are rejected.
+class UdpHeartbeat
+{
+public:
+    UdpHeartbeat(const char *boardName);
+
+    // Disabled with an empty key
+    void begin(const char *key);
+
+    // Hub address from its base URL (http://<ip>:<port>), needs a plain IP
+    bool setHub(const String &baseUrl);
+
+    bool isEnabled() const;
+
+    // False when disabled, without a hub or when the datagram could not go out
+    bool send(uint8_t state);
+
+    // Lays out and signs the next packet into HEARTBEAT_PACKET_SIZE bytes
+    size_t encode(uint8_t state, uint8_t *packet);
+
+    const HeartbeatStats &getStats() const;
+    void printStats();
+
+private:
+    const char *boardName;
+    const char *key;
+    size_t keyLength;
+    uint32_t bootCounter;
+    uint32_t sequence;
+    IPAddress hubIp;
+    bool hubKnown;
+    WiFiUDP udp;
+    HeartbeatStats stats;
+};
+
+#endif
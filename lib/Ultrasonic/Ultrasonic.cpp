@@ -0,0 +1,183 @@
+#include "Ultrasonic.h"
+
+#define ULTRASONIC_DEFAULT_INTERVAL_MS 60 // HC-SR04 datasheet measurement cycle
+#define ULTRASONIC_ECHO_TIMEOUT_US 30000  // ~5 m round trip, beyond the sensor range
+#define SOUND_SPEED_DEFAULT_MM_S 340000   // Same constant as the old 0.034 cm/us
+#define ULTRASONIC_RATE_WINDOW_MS 5000
+
+Ultrasonic::Ultrasonic(uint8_t trigPin, uint8_t echoPin)
+    : trigPin(trigPin), echoPin(echoPin), intervalMs(ULTRASONIC_DEFAULT_INTERVAL_MS), lastTriggerMs(0),
+      triggerUs(0), factor(soundSpeedFactor(SOUND_SPEED_DEFAULT_MM_S)), state(IDLE), echoStartUs(0),
+      echoEndUs(0), distance(0), newReading(false), adaptive(false), idleIntervalMs(0), activeIntervalMs(0),
+      holdMs(0), activeRangeCm(0), lastActiveMs(0), activeSinceMs(0), rateWindowStartMs(0), rateWindowReadings(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void Ultrasonic::begin()
+{
+    pinMode(trigPin, OUTPUT);
+    digitalWrite(trigPin, LOW);
+    pinMode(echoPin, INPUT);
+    attachInterruptArg(digitalPinToInterrupt(echoPin), echoIsr, this, CHANGE);
+}
+
+void IRAM_ATTR Ultrasonic::echoIsr(void *arg)
+{
+    Ultrasonic *self = static_cast<Ultrasonic *>(arg);
+    if (self->state != WAITING_FOR_ECHO)
+        return;
+
+    uint32_t now = micros();
+    if (digitalRead(self->echoPin) == HIGH)
+    {
+        self->echoStartUs = now;
+    }
+    else if (self->echoStartUs != 0)
+    {
+        self->echoEndUs = now;
+        self->state = ECHO_DONE;
+    }
+}
+
+void Ultrasonic::update()
+{
+    if (state == ECHO_DONE)
+    {
+        distance = durationToCm(echoEndUs - echoStartUs, factor);
+        newReading = true;
+        state = IDLE;
+        adaptInterval();
+    }
+    else if (state == WAITING_FOR_ECHO && micros() - triggerUs > ULTRASONIC_ECHO_TIMEOUT_US)
+    {
+        // No echo, same result pulseIn() gave on timeout
+        state = IDLE;
+        distance = 0;
+        newReading = true;
+        adaptInterval();
+    }
+
+    if (state != IDLE || millis() - lastTriggerMs < intervalMs)
+        return;
+
+    lastTriggerMs = millis();
+    echoStartUs = 0;
+    state = WAITING_FOR_ECHO;
+
+    digitalWrite(trigPin, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(trigPin, LOW);
+    triggerUs = micros();
+}
+
+bool Ultrasonic::hasNewReading()
+{
+    bool fresh = newReading;
+    newReading = false;
+    return fresh;
+}
+
+long Ultrasonic::getDistance() const
+{
+    return distance;
+}
+
+void Ultrasonic::setInterval(unsigned long ms)
+{
+    intervalMs = ms;
+    adaptive = false;
+}
+
+void Ultrasonic::setAdaptiveInterval(unsigned long idleMs, unsigned long activeMs, long rangeCm,
+                                     unsigned long holdTimeMs)
+{
+    idleIntervalMs = idleMs;
+    activeIntervalMs = activeMs;
+    activeRangeCm = rangeCm;
+    holdMs = holdTimeMs;
+    intervalMs = idleMs;
+    activeSinceMs = 0;
+    adaptive = true;
+}
+
+unsigned long Ultrasonic::getInterval() const
+{
+    return intervalMs;
+}
+
+unsigned long Ultrasonic::activeSince() const
+{
+    return activeSinceMs;
+}
+
+// Called once per completed reading
+void Ultrasonic::adaptInterval()
+{
+    unsigned long now = millis();
+    stats.readings++;
+    rateWindowReadings++;
+    if (now - rateWindowStartMs >= ULTRASONIC_RATE_WINDOW_MS)
+    {
+        stats.sampleRateHz = rateWindowReadings * 1000.0f / (now - rateWindowStartMs);
+        rateWindowStartMs = now;
+        rateWindowReadings = 0;
+    }
+
+    if (!adaptive)
+        return;
+
+    if (distance > 0 && distance < activeRangeCm)
+    {
+        if (activeSinceMs == 0)
+        {
+            // Something may have been in range for up to the whole idle gap
+            // before this reading saw it
+            activeSinceMs = max(now, 1UL);
+            stats.wakeups++;
+            stats.lastWakeGapMs = intervalMs;
+        }
+        intervalMs = activeIntervalMs;
+        lastActiveMs = now;
+    }
+    else if (activeSinceMs != 0 && now - lastActiveMs > holdMs)
+    {
+        intervalMs = min(intervalMs * 2, idleIntervalMs);
+        if (intervalMs == idleIntervalMs)
+        {
+            activeSinceMs = 0;
+        }
+    }
+}
+
+const UltrasonicStats &Ultrasonic::getStats() const
+{
+    return stats;
+}
+
+void Ultrasonic::printStats()
+{
+    Serial.println("Ultrasonic: " + String(stats.readings) + " readings, " + String(stats.sampleRateHz, 1) +
+                   " Hz now (interval " + String(intervalMs) + " ms), " + String(stats.wakeups) +
+                   " wakeups, last after up to " + String(stats.lastWakeGapMs) + " ms idle gap");
+}
+
+// Speed of sound in air: 331.3 m/s + 0.606 m/s per degree Celsius
+void Ultrasonic::setTemperature(int celsius)
+{
+    factor = soundSpeedFactor(331300 + 606 * celsius);
+}
+
+// cm per microsecond of round trip time, in 16.16 fixed point:
+// speed [mm/s] / 10 [mm/cm] / 1e6 [us/s] / 2 [round trip]
+uint32_t Ultrasonic::soundSpeedFactor(uint32_t soundSpeedMmPerS)
+{
+    return (uint32_t)(((uint64_t)soundSpeedMmPerS << 16) / 20000000);
+}
+
+uint32_t Ultrasonic::durationToCm(uint32_t durationUs, uint32_t factor)
+{
+    if (durationUs > ULTRASONIC_ECHO_TIMEOUT_US)
+        return 0;
+    return (durationUs * factor + 0x8000) >> 16;
+}
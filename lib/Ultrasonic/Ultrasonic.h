@@ -0,0 +1,97 @@
+#pragma once
+
+#ifndef ULTRASONIC_H
+#define ULTRASONIC_H
+
+#include <Arduino.h>
+
+struct UltrasonicStats
+{
+    uint32_t readings;
+    uint32_t wakeups;            // Idle to active rate switches
+    unsigned long lastWakeGapMs; // Idle interval in effect when the last activity was seen
+    float sampleRateHz;          // Readings per second over the last rate window
+};
+
+// HC-SR04 driver that never waits for the echo. update() fires the trigger
+// pulse, the echo edges are timestamped from a pin-change interrupt, and the
+// distance is computed on the next update() once the falling edge arrived.
+class Ultrasonic
+{
+public:
+    Ultrasonic(uint8_t trigPin, uint8_t echoPin);
+
+    void begin();
+
+    // Call from loop(); only blocks for the 10 us trigger pulse
+    void update();
+
+    // True once for every completed measurement
+    bool hasNewReading();
+
+    // Latest distance in cm, 0 when the last measurement got no echo
+    long getDistance() const;
+
+    // Minimum time between two trigger pulses
+    void setInterval(unsigned long intervalMs);
+
+    // Samples every idleMs while nothing is closer than activeRangeCm, jumps
+    // to activeMs as soon as something is, and after holdMs without activity
+    // doubles the interval per reading until it is back at idleMs
+    void setAdaptiveInterval(unsigned long idleMs, unsigned long activeMs, long activeRangeCm,
+                             unsigned long holdMs);
+
+    unsigned long getInterval() const;
+
+    // millis() of the reading that switched to the active rate, 0 while idle
+    unsigned long activeSince() const;
+
+    const UltrasonicStats &getStats() const;
+    void printStats();
+
+    // Enables speed of sound compensation for the air temperature
+    void setTemperature(int celsius);
+
+    // Pure conversion, 16.16 fixed point factor from soundSpeedFactor()
+    static uint32_t durationToCm(uint32_t durationUs, uint32_t factor);
+    static uint32_t soundSpeedFactor(uint32_t soundSpeedMmPerS);
+
+private:
+    enum State
+    {
+        IDLE,
+        WAITING_FOR_ECHO,
+        ECHO_DONE
+    };
+
+    static void IRAM_ATTR echoIsr(void *arg);
+    void adaptInterval();
+
+    uint8_t trigPin;
+    uint8_t echoPin;
+    unsigned long intervalMs;
+    unsigned long lastTriggerMs;
+    uint32_t triggerUs;
+    uint32_t factor;
+
+    volatile State state;
+    volatile uint32_t echoStartUs;
+    volatile uint32_t echoEndUs;
+
+    long distance;
+    bool newReading;
+
+    bool adaptive;
+    unsigned long idleIntervalMs;
+    unsigned long activeIntervalMs;
+    unsigned long holdMs;
+    long activeRangeCm;
+    unsigned long lastActiveMs;
+    unsigned long activeSinceMs;
+
+    unsigned long rateWindowStartMs;
+    uint32_t rateWindowReadings;
+    UltrasonicStats stats;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "WiFiSupervisor.h"
+#include <Preferences.h>
+
+#define WIFI_NVS_NAMESPACE "wifi"
+#define WIFI_NVS_KEY "cache"
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000 // Beyond this the cached access point is likely gone
+#define WIFI_POLL_MS 20
+#define WIFI_SUPERVISE_INTERVAL_MS 250
+#define WIFI_RETRY_MIN_MS 2000 // A full scan and association needs at least this long
+#define WIFI_RETRY_MAX_MS 30000
+#define WIFI_TASK_STACK 4096
+
+WiFiSupervisor::WiFiSupervisor(const char *ssid, const char *password)
+    : ssid(ssid), password(password), cacheValid(false), attemptUsedCache(false), connected(false),
+      addressChanged(false), lastIp(0), disconnectedMs(0)
+{
+    memset(&cache, 0, sizeof(cache));
+    memset(&stats, 0, sizeof(stats));
+    portMUX_INITIALIZE(&mux);
+}
+
+void WiFiSupervisor::start(BaseType_t core)
+{
+    // The supervisor does the reconnecting, and the credentials come from
+    // the firmware, no need to rewrite them to flash on every begin()
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+
+    Serial.println("Connecting to Wi-Fi: " + String(ssid));
+    cacheValid = loadCache();
+    xTaskCreatePinnedToCore(taskEntry, "wifi", WIFI_TASK_STACK, this, 1, NULL, core);
+}
+
+bool WiFiSupervisor::waitConnected(unsigned long timeoutMs)
+{
+    unsigned long start = millis();
+    while (!connected)
+    {
+        if (millis() - start >= timeoutMs)
+            return false;
+        delay(WIFI_POLL_MS);
+    }
+    return true;
+}
+
+bool WiFiSupervisor::begin(unsigned long timeoutMs, BaseType_t core)
+{
+    start(core);
+    if (waitConnected(timeoutMs))
+        return true;
+
+    Serial.println("Failed to connect to Wi-Fi: " + String(ssid) + ", retrying in the background.");
+    return false;
+}
+
+bool WiFiSupervisor::isConnected() const
+{
+    return connected;
+}
+
+bool WiFiSupervisor::takeAddressChange()
+{
+    portENTER_CRITICAL(&mux);
+    bool changed = addressChanged;
+    addressChanged = false;
+    portEXIT_CRITICAL(&mux);
+    return changed;
+}
+
+void WiFiSupervisor::heartbeatSent()
+{
+    if (stats.bootToHeartbeatMs != 0)
+        return;
+    stats.bootToHeartbeatMs = millis();
+    Serial.println("Boot to first heartbeat: " + String(stats.bootToHeartbeatMs) + " ms (Wi-Fi up after " +
+                   String(stats.bootToConnectMs) + " ms).");
+}
+
+WiFiSupervisorStats WiFiSupervisor::getStats()
+{
+    portENTER_CRITICAL(&mux);
+    WiFiSupervisorStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+}
+
+void WiFiSupervisor::printStats()
+{
+    WiFiSupervisorStats s = getStats();
+    Serial.println("Wi-Fi: " + String(s.connects) + " connects (" + String(s.fastConnects) + " from cache), " +
+                   String(s.disconnects) + " disconnects, " + String(s.addressChanges) +
+                   " address changes, up " + String(s.bootToConnectMs) + " ms after boot, reconnect last " +
+                   String(s.lastReconnectMs) + " ms, max " + String(s.maxReconnectMs) + " ms");
+}
+
+void WiFiSupervisor::startAttempt(bool useCache)
+{
+    WiFi.disconnect();
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // DHCP
+    if (useCache)
+    {
+        // Known access point and channel skip the scan
+        WiFi.begin(ssid, password, cache.channel, cache.bssid);
+    }
+    else
+    {
+        WiFi.begin(ssid, password);
+    }
+}
+
+void WiFiSupervisor::onConnected()
+{
+    uint32_t ip = (uint32_t)WiFi.localIP();
+    unsigned long now = millis();
+
+    portENTER_CRITICAL(&mux);
+    stats.connects++;
+    if (attemptUsedCache)
+        stats.fastConnects++;
+    if (stats.bootToConnectMs == 0)
+    {
+        stats.bootToConnectMs = now;
+    }
+    else
+    {
+        stats.lastReconnectMs = now - disconnectedMs;
+        stats.maxReconnectMs = max(stats.maxReconnectMs, stats.lastReconnectMs);
+    }
+    if (ip != lastIp)
+    {
+        if (lastIp != 0)
+            stats.addressChanges++;
+        addressChanged = true;
+        lastIp = ip;
+    }
+    connected = true;
+    portEXIT_CRITICAL(&mux);
+    attemptUsedCache = false;
+
+    if (stats.connects == 1)
+        Serial.println("Connected to Wi-Fi: " + String(ssid) + " in " + String(now) + " ms");
+    else
+        Serial.println("Wi-Fi reconnected in " + String(stats.lastReconnectMs) + " ms");
+    Serial.println("IP Address: " + WiFi.localIP().toString());
+
+    saveCache();
+}
+
+void WiFiSupervisor::onDisconnected()
+{
+    portENTER_CRITICAL(&mux);
+    connected = false;
+    stats.disconnects++;
+    portEXIT_CRITICAL(&mux);
+    disconnectedMs = millis();
+    Serial.println("Wi-Fi link lost, reconnecting.");
+}
+
+void WiFiSupervisor::taskEntry(void *arg)
+{
+    static_cast<WiFiSupervisor *>(arg)->run();
+}
+
+// Owns every connection attempt: the cached access point first, then
+// scans with jittered exponential backoff until the link is up
+void WiFiSupervisor::run()
+{
+    unsigned long backoffMs = 0;
+    unsigned long nextAttemptMs = millis();
+    uint32_t attempts = 0;
+    while (true)
+    {
+        bool up = WiFi.status() == WL_CONNECTED;
+        if (up && !connected)
+        {
+            onConnected();
+            attempts = 0;
+            backoffMs = 0;
+        }
+        else if (!up && connected)
+        {
+            onDisconnected();
+            nextAttemptMs = millis();
+        }
+
+        if (!up && (long)(millis() - nextAttemptMs) >= 0)
+        {
+            if (attemptUsedCache)
+            {
+                Serial.println("Cached access point not answering, scanning.");
+                cacheValid = false;
+            }
+
+            attemptUsedCache = attempts == 0 && cacheValid;
+            startAttempt(attemptUsedCache);
+            unsigned long waitMs = WIFI_FAST_CONNECT_TIMEOUT_MS;
+            if (!attemptUsedCache)
+            {
+                backoffMs = backoffMs == 0 ? WIFI_RETRY_MIN_MS : min(backoffMs * 2, (unsigned long)WIFI_RETRY_MAX_MS);
+                waitMs = backoffMs + random(backoffMs / 2 + 1);
+            }
+            nextAttemptMs = millis() + waitMs;
+            attempts++;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(connected ? WIFI_SUPERVISE_INTERVAL_MS : WIFI_POLL_MS));
+    }
+}
+
+bool WiFiSupervisor::loadCache()
+{
+    Preferences prefs;
+    if (!prefs.begin(WIFI_NVS_NAMESPACE, true))
+        return false;
+    // Entries of an older layout have another size and are ignored
+    bool valid = prefs.getBytes(WIFI_NVS_KEY, &cache, sizeof(cache)) == sizeof(cache) && cache.channel != 0;
+    prefs.end();
+    return valid;
+}
+
+// Only writes when something changed, NVS wears like any flash
+void WiFiSupervisor::saveCache()
+{
+    Cache fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    memcpy(fresh.bssid, WiFi.BSSID(), sizeof(fresh.bssid));
+    fresh.channel = WiFi.channel();
+
+    if (cacheValid && memcmp(&fresh, &cache, sizeof(cache)) == 0)
+        return;
+
+    Preferences prefs;
+    if (prefs.begin(WIFI_NVS_NAMESPACE, false))
+    {
+        prefs.putBytes(WIFI_NVS_KEY, &fresh, sizeof(fresh));
+        prefs.end();
+    }
+    cache = fresh;
+    cacheValid = true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef WIFI_SUPERVISOR_H
+#define WIFI_SUPERVISOR_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+struct WiFiSupervisorStats
+{
+    uint32_t connects;
+    uint32_t fastConnects; // Joined straight from the cached BSSID and channel
+    uint32_t disconnects;
+    uint32_t addressChanges;
+    unsigned long bootToConnectMs;
+    unsigned long bootToHeartbeatMs; // First hub heartbeat that got an answer
+    unsigned long lastReconnectMs;   // Link loss to link back
+    unsigned long maxReconnectMs;
+};
+
+// Owns the station link. The BSSID and channel of the last good connection
+// are kept in NVS, so a boot joins that access point directly instead of
+// scanning every channel. The address still comes from DHCP: a lease that
+// moved shows up through takeAddressChange() rather than as a conflict. A
+// background task notices a lost link and reconnects with jittered backoff.
+class WiFiSupervisor
+{
+public:
+    WiFiSupervisor(const char *ssid, const char *password);
+
+    // Starts the supervisor task, which connects in the background
+    void start(BaseType_t core = 0);
+
+    // Waits up to timeoutMs for the link, false on timeout
+    bool waitConnected(unsigned long timeoutMs);
+
+    // start() and waitConnected(); the task keeps trying after a timeout
+    bool begin(unsigned long timeoutMs, BaseType_t core = 0);
+
+    bool isConnected() const;
+
+    // True once after every connection that brought a different address
+    // than the previous one, the first connection after boot included; the
+    // board has to register again then
+    bool takeAddressChange();
+
+    // Call when the hub answered a heartbeat, reports boot to first heartbeat
+    void heartbeatSent();
+
+    WiFiSupervisorStats getStats();
+    void printStats();
+
+private:
+    struct Cache
+    {
+        uint8_t bssid[6];
+        uint8_t channel;
+    };
+
+    static void taskEntry(void *arg);
+    void run();
+    void startAttempt(bool useCache);
+    void onConnected();
+    void onDisconnected();
+    bool loadCache();
+    void saveCache();
+
+    const char *ssid;
+    const char *password;
+    Cache cache;
+    bool cacheValid;
+    bool attemptUsedCache; // The attempt in progress joins from the cache
+
+    volatile bool connected;
+    bool addressChanged;
+    uint32_t lastIp;
+    unsigned long disconnectedMs;
+    portMUX_TYPE mux;
+    WiFiSupervisorStats stats;
+};
+
+#endif
@@ -7,6 +7,9 @@ const morgan = require('morgan');
 const cors = require('cors');
 const { Server } = require('socket.io');
 const http = require('http');
+const { spawn } = require('child_process');
+const dgram = require('dgram');
+const crypto = require('crypto');
 
 const app = express();
 const port = process.env.PORT || 5000;
@@ -16,11 +19,6 @@ app.use(bodyParser.json());
 app.use(morgan('combined'));
 app.use(cors());
 
-// Global Variables
-let send_activate_all_alarms = false;
-let send_deactivate_all_alamrs = false;
-let send_open_door = false;
-
 // Create an HTTP server and bind it to the express app
 const server = http.createServer(app);
 
@@ -51,6 +49,64 @@ const boardStatus = {
 
 const boards_with_alarms = ["FrontDoorESP32", "ProximityBoard"];
 
+// Command channel configuration
+const COMMAND_POLL_HOLD = 20000;     // how long a /commands long-poll is held open
+const COMMAND_STREAM_GRACE = 5000;   // stream counts as down after this long without a poll
+
+// UDP heartbeat configuration, the receiver only runs with a key set
+const HEARTBEAT_PORT = parseInt(process.env.HEARTBEAT_PORT, 10) || 5001;
+const HEARTBEAT_KEY = process.env.HEARTBEAT_KEY || '';
+
+// Per-board command queues. Every command gets a sequence number and stays
+// queued until the board acknowledges it, either with the `ack` parameter of
+// its next /commands poll or by receiving it through the /send_status fallback.
+// Sequence numbers start from the hub boot time so they keep increasing
+// across hub restarts.
+const commandQueues = {};
+boards_with_alarms.forEach((boardName) => {
+    commandQueues[boardName] = {
+        nextSeq: Math.floor(Date.now() / 1000),
+        pending: [],
+        waiter: null,
+        lastPoll: 0
+    };
+});
+
+// Commands that cancel each other while still undelivered
+const supersededCommands = {
+    activate_alarm: 'deactivate_alarm',
+    deactivate_alarm: 'activate_alarm'
+};
+
+const formatCommands = (commands) =>
+    commands.map((cmd) => `${cmd.seq} ${cmd.command}\n`).join('');
+
+const flushCommandWaiter = (queue) => {
+    if (!queue.waiter) {
+        return;
+    }
+    const { res, timer } = queue.waiter;
+    queue.waiter = null;
+    clearTimeout(timer);
+    res.status(200).type('text/plain').send(formatCommands(queue.pending));
+};
+
+const enqueueCommand = (boardName, command) => {
+    const queue = commandQueues[boardName];
+    if (!queue) {
+        return;
+    }
+    const superseded = supersededCommands[command];
+    if (superseded) {
+        queue.pending = queue.pending.filter((cmd) => cmd.command !== superseded);
+    }
+    queue.pending.push({ seq: queue.nextSeq++, command });
+    flushCommandWaiter(queue);
+};
+
+const isCommandStreamActive = (queue) =>
+    queue.waiter !== null || Date.now() - queue.lastPoll < COMMAND_STREAM_GRACE;
+
 // Timeout configuration
 const HEARTBEAT_INTERVAL = 5000; // 10 seconds
 const MAX_FAILED_PINGS = 2;
@@ -62,6 +118,7 @@ const imagesDir = path.join(__dirname, 'images');
 if (!fs.existsSync(imagesDir)) {
     fs.mkdirSync(imagesDir);
 }
+app.use('/images', express.static(imagesDir));
 
 const getCurrentTimestamp = () => new Date().toISOString();
 
@@ -167,10 +224,7 @@ app.get('/notifications', (req, res) => {
 app.get("/activate_alarms", (req, res) => {
 
     // Activate alarms on all boards with alarms
-    if (send_deactivate_all_alamrs) {
-        send_deactivate_all_alamrs = false;
-    }
-    send_activate_all_alarms = true;
+    boards_with_alarms.forEach((boardName) => enqueueCommand(boardName, 'activate_alarm'));
 
     res.status(200).json({
         status: "success",
@@ -181,10 +235,7 @@ app.get("/activate_alarms", (req, res) => {
 app.get("/deactivate_alarms", (req, res) => {
     
     // Deactivate alarms on all boards with alarms
-    if (send_activate_all_alarms) {
-        send_activate_all_alarms = false;
-    }
-    send_deactivate_all_alamrs = true;
+    boards_with_alarms.forEach((boardName) => enqueueCommand(boardName, 'deactivate_alarm'));
 
     res.status(200).json({
         status: "success",
@@ -192,49 +243,87 @@ app.get("/deactivate_alarms", (req, res) => {
     });
 });
 
-// adds a notification to the queue
-app.post('/front_door_alarm', async (req, res) => {
-    const notification = generateNotification('front_door_alarm', 'Front Door Alarm Triggered');
-    io.emit('new-notification', notification);
+// Footage around an event, taken from the camera's pre-event ring
+const CAMERA_STREAM_PORT = 81;
+const EVENT_CLIP_PRE = 5;   // seconds before the event
+const EVENT_CLIP_POST = 5;  // seconds after the event
 
-    res.status(200).json({
-        status: "success",
-        message: "Front Door Alarm Triggered",
-    });
+const saveEventClip = (reason) => {
+    const cameraIp = knownBoards["EntranceCamera"];
+    if (!cameraIp) {
+        return;
+    }
 
-});
+    const fileName = `${reason}_${Date.now()}.mjpeg`;
+    const url = `http://${cameraIp}:${CAMERA_STREAM_PORT}/event_clip?pre=${EVENT_CLIP_PRE}&post=${EVENT_CLIP_POST}`;
+    axios.get(url, { responseType: 'stream', timeout: 5000 })
+        .then((response) => {
+            const file = fs.createWriteStream(path.join(imagesDir, fileName));
+            response.data.pipe(file);
+            file.on('finish', () => console.log(`Saved event clip ${fileName}`));
+        })
+        .catch((err) => console.error('Failed to fetch event clip:', err.message));
+};
 
-// movement event added to the queue
-app.post('/movement_event', async (req, res) => {
+// Board event handlers, shared by the single-event routes and the /events batch
+const handleFrontDoorAlarm = () => {
+    const notification = generateNotification('front_door_alarm', 'Front Door Alarm Triggered');
+    io.emit('new-notification', notification);
+};
 
+const handleMovementEvent = (body) => {
 //    distance obtain from the proximity sensor
-    const { distance } = req.body;
+    const { distance } = body;
     const notification = generateNotification(
         'movement_event',
         `Movement Detected: ${distance} cm`
       );
     io.emit('new-notification', notification);
 
-    res.status(200).json({
-        status: "success",
-        message: "Movement Detected",
-    });
-});
+    saveEventClip('movement');
+};
 
 // three_wrong_guesses activates all alarms
 // frontdoor alarm in this case because the proximity alarm is already activated
-app.post ('/three_wrong_guesses', async (req, res) => {
+const handleThreeWrongGuesses = () => {
     const notification = generateNotification(
         'three_wrong_guesses',
         'Proximity sensor three wrong guesses'
       );
     io.emit('new-notification', notification);
 
-    if (send_deactivate_all_alamrs) {
-        send_deactivate_all_alamrs = false;
-    }
+    boards_with_alarms.forEach((boardName) => enqueueCommand(boardName, 'activate_alarm'));
+};
+
+const eventHandlers = {
+    '/front_door_alarm': handleFrontDoorAlarm,
+    '/movement_event': handleMovementEvent,
+    '/three_wrong_guesses': handleThreeWrongGuesses
+};
 
-    send_activate_all_alarms = true;
+// adds a notification to the queue
+app.post('/front_door_alarm', async (req, res) => {
+    handleFrontDoorAlarm(req.body);
+
+    res.status(200).json({
+        status: "success",
+        message: "Front Door Alarm Triggered",
+    });
+
+});
+
+// movement event added to the queue
+app.post('/movement_event', async (req, res) => {
+    handleMovementEvent(req.body);
+
+    res.status(200).json({
+        status: "success",
+        message: "Movement Detected",
+    });
+});
+
+app.post ('/three_wrong_guesses', async (req, res) => {
+    handleThreeWrongGuesses(req.body);
 
     res.status(200).json({
         status: "success",
@@ -242,6 +331,76 @@ app.post ('/three_wrong_guesses', async (req, res) => {
     });
 });
 
+// Snapshot pushed by the camera when it detects motion:
+// POST /motion_snapshot?name=<board>&score=<changed pixels per mille>, JPEG body
+app.post('/motion_snapshot', bodyParser.raw({ type: 'image/jpeg', limit: '1mb' }), (req, res) => {
+    const { name, score } = req.query;
+
+    if (!Buffer.isBuffer(req.body) || req.body.length === 0) {
+        return res.status(400).json({ status: 'failure', message: 'Missing JPEG body' });
+    }
+
+    const fileName = `motion_${Date.now()}.jpg`;
+    fs.writeFile(path.join(imagesDir, fileName), req.body, (err) => {
+        if (err) {
+            console.error('Failed to save motion snapshot:', err);
+            return res.status(500).json({ status: 'failure', message: 'Failed to save snapshot' });
+        }
+
+        const notification = generateNotification(
+            'motion_detected',
+            `Motion detected by ${name} (score ${score})`
+          );
+        notification.image = `/images/${fileName}`;
+        io.emit('new-notification', notification);
+
+        res.status(200).json({ status: 'success', image: notification.image });
+    });
+});
+
+// Ids of recently processed outbox events per board, so a batch the board
+// retries after a lost response is not processed twice
+const SEEN_EVENT_IDS = 256;
+const seenEventIds = {};
+
+// Batch of events uploaded from a board's outbox:
+// { name, events: [{ id, route, age, body }] }
+app.post('/events', (req, res) => {
+    const { name, events } = req.body;
+
+    if (!Array.isArray(events)) {
+        return res.status(400).json({ status: 'failure', message: 'Missing events' });
+    }
+
+    if (!seenEventIds[name]) {
+        seenEventIds[name] = { ids: new Set(), order: [] };
+    }
+    const seen = seenEventIds[name];
+
+    let processed = 0;
+    events.forEach(({ id, route, age, body }) => {
+        if (seen.ids.has(id)) {
+            return;
+        }
+        seen.ids.add(id);
+        seen.order.push(id);
+        if (seen.order.length > SEEN_EVENT_IDS) {
+            seen.ids.delete(seen.order.shift());
+        }
+
+        const handler = eventHandlers[route];
+        if (!handler) {
+            console.log(`Unknown event route ${route} from ${name}`);
+            return;
+        }
+        console.log(`Event ${id} ${route} from ${name}, queued ${age} ms on the board`);
+        handler(body || {});
+        processed++;
+    });
+
+    res.status(200).json({ status: 'success', processed });
+});
+
 app.post('/send_status', (req, res) => {
     const { name } = req.body;
 
@@ -253,42 +412,62 @@ app.post('/send_status', (req, res) => {
 
     boardStatus[name].lastUpdate = getCurrentTimestamp();
 
-    // Determine response based on global alarm states
-    if (name === 'ProximityBoard') {
-        boardStatus[name].lastUpdate = getCurrentTimestamp();
-        if (send_activate_all_alarms) {
-            send_activate_all_alarms = false;
-            return res.status(203).json({ command: 'activate_alarm' });
-        }
-        else if (send_deactivate_all_alamrs) {
-            send_deactivate_all_alamrs = false;
-            return res.status(204).json({ command: 'deactivate_alarm' });
-        }
-        else {
-            return res.status(202).json({ command: 'no_command' });
-        }
+    // Boards with a live /commands stream get their commands there; otherwise
+    // hand out the oldest pending command through the status code
+    const queue = commandQueues[name];
+    if (!queue || isCommandStreamActive(queue) || queue.pending.length === 0) {
+        return res.status(202).json({ command: 'no_command' });
+    }
 
-    } else if (name === 'FrontDoorESP32') {
-        boardStatus[name].lastUpdate = getCurrentTimestamp();
-        if (send_activate_all_alarms) {
-            send_activate_all_alarms = false;
-            return res.status(203).json({ command: 'activate_alarm' });
-        }
-        else if (send_deactivate_all_alamrs) {
-            send_deactivate_all_alamrs = false;
-            return res.status(204).json({ command: 'deactivate_alarm' });
-        }
-        else if (send_open_door) {
-            send_open_door = false;
-            return res.status(205).json({ command: 'open_door' });
-        } else {
-            return res.status(202).json({ command: 'no_command' });
-        }
-    } else {
-        // camera
-        boardStatus[name].lastUpdate = getCurrentTimestamp();
+    const { seq, command } = queue.pending.shift();
+    // http code 203 -> activate alarm command
+    // http code 204 -> deactivate alarm command
+    // http code 205 -> open door command
+    const statusCodes = {
+        activate_alarm: 203,
+        deactivate_alarm: 204,
+        open_door: 205
+    };
+    // Express drops the body of a 204, so the seq also goes in a header
+    res.set('X-Command-Seq', String(seq));
+    return res.status(statusCodes[command]).json({ command, seq });
+});
+
+// Long-poll command stream for boards with alarms. Acknowledges every command
+// up to `ack`, then answers with the pending commands as "<seq> <command>"
+// lines, holding the request open until one arrives or COMMAND_POLL_HOLD passes.
+app.get('/commands', (req, res) => {
+    const { name } = req.query;
+    const ack = parseInt(req.query.ack, 10) || 0;
+    const queue = commandQueues[name];
+
+    if (!queue) {
+        return res.status(400).json({ status: 'failure', message: 'Unknown board name' });
     }
-    return res.status(202).json({ command: 'no_command' });
+
+    queue.lastPoll = Date.now();
+    queue.pending = queue.pending.filter((cmd) => cmd.seq > ack);
+
+    // A board only keeps one stream open; answer any older poll right away
+    flushCommandWaiter(queue);
+
+    if (queue.pending.length > 0) {
+        return res.status(200).type('text/plain').send(formatCommands(queue.pending));
+    }
+
+    const timer = setTimeout(() => {
+        queue.lastPoll = Date.now();
+        flushCommandWaiter(queue);
+    }, COMMAND_POLL_HOLD);
+    queue.waiter = { res, timer };
+
+    res.on('close', () => {
+        if (queue.waiter && queue.waiter.res === res) {
+            clearTimeout(queue.waiter.timer);
+            queue.waiter = null;
+            queue.lastPoll = Date.now();
+        }
+    });
 });
 
 app.get('/get_esp_camera_address', (req, res) => {
@@ -300,7 +479,7 @@ app.get('/get_esp_camera_address', (req, res) => {
 });
 
 app.get('/open_door', async (req, res) => {
-    send_open_door = true;
+    enqueueCommand('FrontDoorESP32', 'open_door');
     res.status(200).json({
         status: "success",
         message: "Door opened",
@@ -308,8 +487,76 @@ app.get('/open_door', async (req, res) => {
 });
 
 
+// Compact heartbeat of the boards (lib/UdpHeartbeat): a 56-byte datagram,
+// little endian, signed with the pre-shared HEARTBEAT_KEY.
+//   0 u16 magic "SH" | 2 u8 version | 3 u8 state | 4 u32 boot | 8 u32 seq
+//  12 u32 uptime s | 16 u32 free heap | 20 i8 rssi | 24 name[16] | 40 mac[16]
+// (boot, seq) has to grow with every datagram of a board, anything else is a
+// replay and dropped.
+const HEARTBEAT_SIZE = 56;
+const HEARTBEAT_SIGNED_SIZE = 40;
+const heartbeatSeen = {};
+
+function handleHeartbeat(msg) {
+    if (msg.length !== HEARTBEAT_SIZE || msg.readUInt16LE(0) !== 0x4853 || msg[2] !== 1) {
+        return;
+    }
+
+    const mac = crypto.createHmac('sha256', HEARTBEAT_KEY)
+        .update(msg.subarray(0, HEARTBEAT_SIGNED_SIZE))
+        .digest()
+        .subarray(0, HEARTBEAT_SIZE - HEARTBEAT_SIGNED_SIZE);
+    if (!crypto.timingSafeEqual(mac, msg.subarray(HEARTBEAT_SIGNED_SIZE))) {
+        console.log('Heartbeat with a bad signature dropped');
+        return;
+    }
+
+    const name = msg.toString('utf8', 24, 40).replace(/\0+$/, '');
+    if (!boardStatus[name]) {
+        return;
+    }
+
+    const boot = msg.readUInt32LE(4);
+    const seq = msg.readUInt32LE(8);
+    const last = heartbeatSeen[name];
+    if (last && (boot < last.boot || (boot === last.boot && seq <= last.seq))) {
+        console.log(`Replayed heartbeat from ${name} dropped`);
+        return;
+    }
+    heartbeatSeen[name] = { boot, seq };
+
+    boardStatus[name].lastUpdate = getCurrentTimestamp();
+    boardStatus[name].telemetry = {
+        state: msg[3],
+        uptime: msg.readUInt32LE(12),
+        freeHeap: msg.readUInt32LE(16),
+        rssi: msg.readInt8(20)
+    };
+}
+
+function startHeartbeatReceiver() {
+    if (!HEARTBEAT_KEY) {
+        return;
+    }
+    const socket = dgram.createSocket('udp4');
+    socket.on('message', handleHeartbeat);
+    socket.on('error', (err) => console.log(`Heartbeat receiver stopped: ${err.message}`));
+    socket.bind(HEARTBEAT_PORT, () => console.log(`Heartbeat receiver on udp/${HEARTBEAT_PORT}`));
+}
+
+// Advertise the hub on the LAN as _smarthub._tcp so the boards can talk to
+// it directly instead of through the cloud. Uses avahi-utils, which the Pi
+// has; where it is missing (Heroku) the boards simply keep the cloud URL.
+function advertiseHub() {
+    const publisher = spawn('avahi-publish-service', ['SmartHouse hub', '_smarthub._tcp', String(port)], { stdio: 'ignore' });
+    publisher.on('error', () => console.log('avahi-publish-service not available, hub not advertised on the LAN'));
+    process.on('exit', () => publisher.kill());
+}
+
 // Start the server
 server.listen(port, '0.0.0.0', () => {
     console.log(`Server running on http://0.0.0.0:${port}`);
+    advertiseHub();
+    startHeartbeatReceiver();
 });
 
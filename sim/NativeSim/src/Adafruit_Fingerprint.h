@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef NATIVE_SIM_ADAFRUIT_FINGERPRINT_H
+#define NATIVE_SIM_ADAFRUIT_FINGERPRINT_H
+
+#include <Arduino.h>
+
+// Adafruit_Fingerprint talking to sim::fingerprint(). Every command costs
+// its packets on the UART at the port's rate; at a rate the sensor does not
+// use, or without a sensor, it times out after a second.
+
+#define FINGERPRINT_OK 0x00
+#define FINGERPRINT_PACKETRECIEVEERR 0x01
+#define FINGERPRINT_NOFINGER 0x02
+#define FINGERPRINT_IMAGEFAIL 0x03
+#define FINGERPRINT_IMAGEMESS 0x06
+#define FINGERPRINT_FEATUREFAIL 0x07
+#define FINGERPRINT_NOMATCH 0x08
+#define FINGERPRINT_NOTFOUND 0x09
+#define FINGERPRINT_TIMEOUT 0xFF
+
+#define FINGERPRINT_BAUDRATE_9600 0x1
+#define FINGERPRINT_BAUDRATE_19200 0x2
+#define FINGERPRINT_BAUDRATE_28800 0x3
+#define FINGERPRINT_BAUDRATE_38400 0x4
+#define FINGERPRINT_BAUDRATE_48000 0x5
+#define FINGERPRINT_BAUDRATE_57600 0x6
+#define FINGERPRINT_BAUDRATE_67200 0x7
+#define FINGERPRINT_BAUDRATE_76800 0x8
+#define FINGERPRINT_BAUDRATE_86400 0x9
+#define FINGERPRINT_BAUDRATE_96000 0xA
+#define FINGERPRINT_BAUDRATE_105600 0xB
+#define FINGERPRINT_BAUDRATE_115200 0xC
+
+class Adafruit_Fingerprint
+{
+public:
+    Adafruit_Fingerprint(HardwareSerial *serial, uint32_t password = 0x0);
+
+    void begin(uint32_t baud);
+    bool verifyPassword();
+    uint8_t getImage();
+    uint8_t image2Tz(uint8_t slot = 1);
+    uint8_t fingerFastSearch();
+    uint8_t fingerSearch(uint8_t slot = 1);
+    uint8_t setBaudRate(uint8_t baudrate);
+
+    uint16_t fingerID;
+    uint16_t confidence;
+    uint16_t templateCount;
+
+private:
+    bool exchange(uint32_t workUs);
+
+    HardwareSerial *serial;
+    int imageId; // Finger on the last image, -2 for none
+};
+
+#endif
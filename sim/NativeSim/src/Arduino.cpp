@@ -0,0 +1,583 @@
+#include "SimInternal.h"
+#include "Arduino.h"
+#include "soc/gpio_reg.h"
+#include <set>
+
+using namespace sim::detail;
+
+#define SIM_PIN_COUNT 40
+#define SIM_UART_FIFO_BYTES 128
+#define SIM_SERIAL_BYTE_COST_NS 20 // Copying into the UART driver
+#define SIM_FREE_HEAP 180000
+#define SIM_FREE_PSRAM 4000000
+
+// ---- Timing
+
+unsigned long millis()
+{
+    touch(COST_TIME_NS);
+    return (uint32_t)(sim::nowNs() / 1000000);
+}
+
+// 32 bits like on the board, so wraparound arithmetic behaves the same
+unsigned long micros()
+{
+    touch(COST_TIME_NS);
+    return (uint32_t)(sim::nowNs() / 1000);
+}
+
+void delay(uint32_t ms)
+{
+    sleepUntilNs(sim::nowNs() + (uint64_t)ms * 1000000);
+}
+
+// Busy wait, the caller keeps the CPU
+void delayMicroseconds(uint32_t us)
+{
+    touch((uint64_t)us * 1000);
+}
+
+void yield()
+{
+    touch(COST_CALL_NS);
+}
+
+// ---- GPIO
+
+namespace
+{
+    struct Pin
+    {
+        uint8_t mode = 0;
+        int out = LOW;
+        bool external = false; // Driven from outside by the scenario
+        int externalLevel = LOW;
+        int analog = -1;
+
+        void (*isr)(void *) = nullptr;
+        void (*plainIsr)() = nullptr;
+        void *arg = nullptr;
+        int edge = 0;
+        int lastLevel = LOW;
+
+        std::vector<std::function<void(int)>> watchers;
+    };
+
+    Pin pins[SIM_PIN_COUNT];
+    std::set<std::pair<int, int>> contacts;
+    bool evaluating = false;
+    bool changedAgain = false;
+
+    bool validPin(int pin)
+    {
+        return pin >= 0 && pin < SIM_PIN_COUNT;
+    }
+
+    void written(int pin)
+    {
+        for (auto &watcher : pins[pin].watchers)
+            watcher(pins[pin].out);
+    }
+}
+
+namespace sim
+{
+    namespace detail
+    {
+        // A released open-drain output leaves the line to the pull-up
+        bool drives(const Pin &p)
+        {
+            return p.mode == OUTPUT || (p.mode == OUTPUT_OPEN_DRAIN && p.out == LOW);
+        }
+
+        int readPin(int pin)
+        {
+            if (!validPin(pin))
+                return LOW;
+            const Pin &p = pins[pin];
+            if (p.external)
+                return p.externalLevel;
+            if (drives(p))
+                return p.out;
+
+            for (const auto &contact : contacts)
+            {
+                int other = contact.first == pin ? contact.second : contact.second == pin ? contact.first : -1;
+                if (other < 0)
+                    continue;
+                if (pins[other].external)
+                    return pins[other].externalLevel;
+                if (drives(pins[other]))
+                    return pins[other].out;
+            }
+
+            if ((p.mode & PULLUP) != 0)
+                return HIGH;
+            return LOW; // Floating, or pulled down
+        }
+
+        // Fires the pin-change interrupts of every pin whose level moved. An
+        // interrupt handler that changes pins itself gets another pass.
+        void pinsChanged()
+        {
+            if (evaluating)
+            {
+                changedAgain = true;
+                return;
+            }
+            evaluating = true;
+            do
+            {
+                changedAgain = false;
+                for (int pin = 0; pin < SIM_PIN_COUNT; pin++)
+                {
+                    Pin &p = pins[pin];
+                    if (p.isr == nullptr && p.plainIsr == nullptr)
+                        continue;
+                    int level = readPin(pin);
+                    if (level == p.lastLevel)
+                        continue;
+                    p.lastLevel = level;
+                    bool fire = p.edge == CHANGE || (p.edge == RISING && level == HIGH) ||
+                                (p.edge == FALLING && level == LOW);
+                    if (!fire)
+                        continue;
+                    interrupt([&p]
+                              {
+                                  if (p.isr != nullptr)
+                                      p.isr(p.arg);
+                                  else if (p.plainIsr != nullptr)
+                                      p.plainIsr(); });
+                }
+            } while (changedAgain);
+            evaluating = false;
+        }
+    }
+
+    void setPin(int pin, int level)
+    {
+        if (!validPin(pin))
+            return;
+        pins[pin].external = true;
+        pins[pin].externalLevel = level;
+        pinsChanged();
+    }
+
+    void releasePin(int pin)
+    {
+        if (!validPin(pin))
+            return;
+        pins[pin].external = false;
+        pinsChanged();
+    }
+
+    int pinLevel(int pin)
+    {
+        if (!validPin(pin))
+            return LOW;
+        return pins[pin].mode == OUTPUT || pins[pin].mode == OUTPUT_OPEN_DRAIN ? pins[pin].out : readPin(pin);
+    }
+
+    int analogLevel(int pin)
+    {
+        return validPin(pin) ? pins[pin].analog : -1;
+    }
+
+    void onPinWrite(int pin, std::function<void(int level)> fn)
+    {
+        if (validPin(pin))
+            pins[pin].watchers.push_back(fn);
+    }
+
+    void setContact(int pinA, int pinB, bool closed)
+    {
+        std::pair<int, int> contact(std::min(pinA, pinB), std::max(pinA, pinB));
+        if (closed)
+            contacts.insert(contact);
+        else
+            contacts.erase(contact);
+        pinsChanged();
+    }
+
+    // Bouncing contact: closed, open, closed, open, closed over bounceUs
+    static void settle(int rowPin, int colPin, uint64_t atUs, uint32_t bounceUs, bool closed)
+    {
+        int steps = bounceUs > 0 ? 5 : 1;
+        for (int i = 0; i < steps; i++)
+        {
+            bool state = i % 2 == 0 ? closed : !closed;
+            at(atUs + (uint64_t)i * bounceUs / 4, [rowPin, colPin, state]
+               { setContact(rowPin, colPin, state); });
+        }
+    }
+
+    void pressKey(int rowPin, int colPin, uint64_t atUs, uint64_t holdUs, uint32_t bounceUs)
+    {
+        settle(rowPin, colPin, atUs, bounceUs, true);
+        settle(rowPin, colPin, atUs + holdUs, bounceUs, false);
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    touch(COST_GPIO_NS);
+    if (!validPin(pin))
+        return;
+    pins[pin].mode = mode;
+    pinsChanged();
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    touch(COST_GPIO_NS);
+    if (!validPin(pin))
+        return;
+    pins[pin].out = level ? HIGH : LOW;
+    written(pin);
+    pinsChanged();
+}
+
+int digitalRead(uint8_t pin)
+{
+    touch(COST_GPIO_NS);
+    return readPin(pin);
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+    touch(COST_GPIO_NS);
+    if (validPin(pin))
+        pins[pin].analog = value;
+}
+
+int analogRead(uint8_t pin)
+{
+    touch(COST_GPIO_NS);
+    return 0;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode)
+{
+    touch(COST_CALL_NS);
+    if (!validPin(pin))
+        return;
+    pins[pin].plainIsr = handler;
+    pins[pin].isr = nullptr;
+    pins[pin].edge = mode;
+    pins[pin].lastLevel = readPin(pin);
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    touch(COST_CALL_NS);
+    if (!validPin(pin))
+        return;
+    pins[pin].isr = handler;
+    pins[pin].plainIsr = nullptr;
+    pins[pin].arg = arg;
+    pins[pin].edge = mode;
+    pins[pin].lastLevel = readPin(pin);
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (!validPin(pin))
+        return;
+    pins[pin].isr = nullptr;
+    pins[pin].plainIsr = nullptr;
+}
+
+// Output registers set or clear the written bits, input registers return
+// the level of 32 pins at once
+uint32_t simRegRead(uint32_t address)
+{
+    touch(COST_REG_NS);
+    int first = address == GPIO_IN1_REG || address == GPIO_OUT1_REG ? 32 : 0;
+    bool output = address == GPIO_OUT_REG || address == GPIO_OUT1_REG;
+    uint32_t value = 0;
+    for (int bit = 0; bit < 32 && first + bit < SIM_PIN_COUNT; bit++)
+    {
+        int level = output ? pins[first + bit].out : readPin(first + bit);
+        if (level == HIGH)
+            value |= 1u << bit;
+    }
+    return value;
+}
+
+void simRegWrite(uint32_t address, uint32_t value)
+{
+    touch(COST_REG_NS);
+    int first = address == GPIO_OUT1_W1TS_REG || address == GPIO_OUT1_W1TC_REG || address == GPIO_OUT1_REG ? 32 : 0;
+    for (int bit = 0; bit < 32 && first + bit < SIM_PIN_COUNT; bit++)
+    {
+        int pin = first + bit;
+        bool selected = (value & (1u << bit)) != 0;
+        if (address == GPIO_OUT_W1TS_REG || address == GPIO_OUT1_W1TS_REG)
+        {
+            if (!selected)
+                continue;
+            pins[pin].out = HIGH;
+        }
+        else if (address == GPIO_OUT_W1TC_REG || address == GPIO_OUT1_W1TC_REG)
+        {
+            if (!selected)
+                continue;
+            pins[pin].out = LOW;
+        }
+        else
+        {
+            pins[pin].out = selected ? HIGH : LOW;
+        }
+        written(pin);
+    }
+    pinsChanged();
+}
+
+// ---- Misc
+
+long random(long max)
+{
+    touch(COST_CALL_NS);
+    return max > 0 ? (long)(nextRandom() % (uint32_t)max) : 0;
+}
+
+long random(long min, long max)
+{
+    return min >= max ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed)
+{
+    sim::seed(seed);
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+bool psramFound()
+{
+    return true;
+}
+
+void *ps_malloc(size_t size)
+{
+    touch(COST_CALL_NS);
+    return malloc(size);
+}
+
+void *ps_calloc(size_t count, size_t size)
+{
+    touch(COST_CALL_NS);
+    return calloc(count, size);
+}
+
+EspClass ESP;
+
+uint32_t EspClass::getFreeHeap()
+{
+    touch(COST_CALL_NS);
+    return SIM_FREE_HEAP;
+}
+
+uint32_t EspClass::getFreePsram()
+{
+    touch(COST_CALL_NS);
+    return SIM_FREE_PSRAM;
+}
+
+void EspClass::restart()
+{
+    fprintf(stderr, "sim: ESP.restart() called at %llu us\n", (unsigned long long)sim::nowUs());
+    abort();
+}
+
+// ---- Serial
+
+namespace
+{
+    std::vector<sim::SerialLine> lines;
+    std::string pending;
+    uint64_t pendingUs = 0;
+    bool echo = false;
+}
+
+namespace sim
+{
+    namespace detail
+    {
+        void serialWrite(const char *text, size_t length)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                if (pending.empty())
+                    pendingUs = nowUs();
+                if (text[i] == '\r')
+                    continue;
+                if (text[i] != '\n')
+                {
+                    pending += text[i];
+                    continue;
+                }
+                if (echo)
+                    printf("%12.3f ms  %s\n", pendingUs / 1000.0, pending.c_str());
+                lines.push_back(SerialLine{pendingUs, pending});
+                pending.clear();
+            }
+        }
+    }
+
+    void setSerialEcho(bool on)
+    {
+        echo = on;
+    }
+
+    bool serialContains(const char *text, uint64_t sinceUs)
+    {
+        for (const SerialLine &line : lines)
+        {
+            if (line.atUs >= sinceUs && line.text.find(text) != std::string::npos)
+                return true;
+        }
+        return false;
+    }
+
+    const std::vector<SerialLine> &serialLines()
+    {
+        return lines;
+    }
+}
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+
+HardwareSerial::HardwareSerial(int uart) : uart(uart), baud(0), fifoEmptyNs(0)
+{
+}
+
+void HardwareSerial::begin(unsigned long rate, uint32_t config, int8_t rxPin, int8_t txPin)
+{
+    touch(COST_CALL_NS);
+    baud = rate;
+}
+
+void HardwareSerial::end()
+{
+    baud = 0;
+}
+
+unsigned long HardwareSerial::baudRate() const
+{
+    return baud;
+}
+
+HardwareSerial::operator bool() const
+{
+    return true;
+}
+
+int HardwareSerial::available()
+{
+    return 0;
+}
+
+int HardwareSerial::read()
+{
+    return -1;
+}
+
+void HardwareSerial::flush()
+{
+    if (fifoEmptyNs > sim::nowNs())
+        sleepUntilNs(fifoEmptyNs);
+}
+
+// 10 bits per byte on the wire. Without a driver TX buffer the writer
+// waits until everything fits in the hardware FIFO.
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    touch(COST_CALL_NS + size * SIM_SERIAL_BYTE_COST_NS);
+    if (uart == 0)
+        serialWrite((const char *)buffer, size);
+    if (baud == 0)
+        return size;
+
+    uint64_t byteNs = 10000000000ULL / baud;
+    uint64_t now = sim::nowNs();
+    if (fifoEmptyNs < now)
+        fifoEmptyNs = now;
+    uint64_t queued = (fifoEmptyNs - now + byteNs - 1) / byteNs;
+    if (queued + size > SIM_UART_FIFO_BYTES)
+        sleepUntilNs(now + (queued + size - SIM_UART_FIFO_BYTES) * byteNs);
+    fifoEmptyNs += size * byteNs;
+    return size;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const char *text)
+{
+    return write((const uint8_t *)text, strlen(text));
+}
+
+size_t HardwareSerial::print(const String &text)
+{
+    return write((const uint8_t *)text.c_str(), text.length());
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+    return write(text);
+}
+
+size_t HardwareSerial::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(int value, int base)
+{
+    return print(String(value, (unsigned char)base));
+}
+
+size_t HardwareSerial::print(unsigned int value, int base)
+{
+    return print(String(value, (unsigned char)base));
+}
+
+size_t HardwareSerial::print(long value, int base)
+{
+    return print(String(value, (unsigned char)base));
+}
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+    return print(String(value, (unsigned char)base));
+}
+
+size_t HardwareSerial::print(double value, int decimals)
+{
+    return print(String(value, (unsigned char)decimals));
+}
+
+size_t HardwareSerial::println()
+{
+    return write("\r\n");
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (length < 0)
+        return 0;
+    return write((const uint8_t *)buf, std::min((size_t)length, sizeof(buf) - 1));
+}
@@ -0,0 +1,388 @@
+#include "SimInternal.h"
+#include "ESPAsyncWebServer.h"
+#include <algorithm>
+
+using namespace sim::detail;
+
+#define SIM_TCP_SND_BUF 5744       // CONFIG_TCP_SND_BUF_DEFAULT, four segments
+#define SIM_TCP_MSS 1436
+#define SIM_TCP_POLL_NS 500000000ULL // lwIP poll of AsyncTCP, 1 tick of 500 ms
+#define SIM_ASYNC_CONNECT_US 2000    // Handshake on the LAN
+#define SIM_CHUNK_OVERHEAD 8
+#define SIM_RESPONSE_HEAD_BYTES 160
+
+namespace sim
+{
+    struct AsyncConnection
+    {
+        StreamViewer *viewer;
+        uint16_t port;
+        std::string uri;
+        uint32_t bytesPerSecond;
+        AsyncWebServerRequest *request; // Lives as long as the connection, as in the library
+        AsyncWebServerResponse *response;
+        bool handled;
+        bool closing;
+        bool complete; // Last chunk written, the response is freed on async_tcp
+        bool done;
+        double inFlight; // Bytes written but not yet acknowledged
+        uint64_t lastDrainNs;
+        uint64_t startNs;
+        uint64_t nextNs;
+        std::string tail; // End of the data so far, to find part headers
+    };
+}
+
+namespace
+{
+    std::vector<AsyncWebServer *> servers;
+    std::vector<sim::AsyncConnection *> connections;
+    WaitList wake;
+    bool taskStarted = false;
+
+    uint64_t drainNs(const sim::AsyncConnection *c, double bytes)
+    {
+        return (uint64_t)(bytes * 1e9 / std::max<uint32_t>(c->bytesPerSecond, 1)) + 1;
+    }
+
+    void drain(sim::AsyncConnection *c)
+    {
+        uint64_t now = sim::nowNs();
+        c->inFlight = std::max(0.0, c->inFlight - (now - c->lastDrainNs) * 1e-9 * c->bytesPerSecond);
+        c->lastDrainNs = now;
+    }
+
+    // Next time AsyncTCP calls back: the next acknowledged segment, or the poll
+    uint64_t nextCallbackNs(const sim::AsyncConnection *c)
+    {
+        uint64_t now = sim::nowNs();
+        if (c->inFlight > 0)
+            return now + drainNs(c, std::min<double>(c->inFlight, SIM_TCP_MSS));
+        return c->startNs + ((now - c->startNs) / SIM_TCP_POLL_NS + 1) * SIM_TCP_POLL_NS;
+    }
+
+    // Hands bytes to the socket; part headers tell the viewer when a frame starts
+    void deliver(sim::AsyncConnection *c, const uint8_t *data, size_t length, size_t overhead)
+    {
+        sim::StreamViewer *viewer = c->viewer;
+        if (viewer != nullptr)
+        {
+            viewer->bytes += length;
+            size_t before = c->tail.size();
+            c->tail.append((const char *)data, length);
+            size_t at = before > 24 ? before - 24 : 0;
+            while ((at = c->tail.find("X-Frame-Seq: ", at)) != std::string::npos)
+            {
+                size_t end = c->tail.find("\r\n", at);
+                if (end == std::string::npos)
+                    break;
+                viewer->frameSeqs.push_back(strtoul(c->tail.c_str() + at + 13, NULL, 10));
+                viewer->frameUs.push_back((sim::nowNs() + drainNs(c, c->inFlight)) / 1000);
+                at = end;
+            }
+            if (c->tail.size() > 256)
+                c->tail.erase(0, c->tail.size() - 64);
+        }
+        c->inFlight += length + overhead;
+    }
+
+    void finish(sim::AsyncConnection *c)
+    {
+        delete c->response;
+        c->response = nullptr;
+        delete c->request;
+        c->request = nullptr;
+        c->done = true;
+        c->nextNs = NEVER;
+    }
+
+    void dispatch(sim::AsyncConnection *c)
+    {
+        c->handled = true;
+        std::string path = c->uri.substr(0, c->uri.find('?'));
+        AsyncCallbackWebHandler *handler = nullptr;
+        for (AsyncWebServer *server : servers)
+            if (server->simPort() == c->port && server->simListening())
+                handler = server->simFind(String(path), HTTP_GET);
+
+        c->request = new AsyncWebServerRequest(c, String(c->uri), HTTP_GET);
+        if (handler != nullptr)
+            handler->onRequest(c->request);
+        else
+            c->request->send(404);
+        c->response = c->request->simResponse;
+        c->request->simResponse = nullptr;
+        if (c->response == nullptr)
+        {
+            finish(c);
+            return;
+        }
+
+        if (c->viewer != nullptr)
+            c->viewer->code = c->response->simCode();
+        deliver(c, (const uint8_t *)"", 0, SIM_RESPONSE_HEAD_BYTES);
+        if (!c->response->simStreamed())
+        {
+            const String &content = static_cast<AsyncBasicResponse *>(c->response)->simContent();
+            if (c->viewer != nullptr)
+                c->viewer->body = content.c_str();
+            deliver(c, (const uint8_t *)content.c_str(), content.length(), 0);
+            finish(c);
+            return;
+        }
+        c->response->_respond(c->request);
+    }
+
+    // Fills a streamed response as far as the socket takes it. Called on
+    // async_tcp for ACKs and polls, or by whichever task calls _ack().
+    size_t service(sim::AsyncConnection *c)
+    {
+        drain(c);
+        size_t space = (size_t)(SIM_TCP_SND_BUF - std::min<double>(c->inFlight, SIM_TCP_SND_BUF));
+        if (space < SIM_CHUNK_OVERHEAD + 1)
+        {
+            c->nextNs = nextCallbackNs(c);
+            return 0;
+        }
+
+        static uint8_t buffer[SIM_TCP_SND_BUF];
+        touch(COST_CALL_NS);
+        AsyncAbstractResponse *response = static_cast<AsyncAbstractResponse *>(c->response);
+        size_t written = response->_fillBuffer(buffer, space - SIM_CHUNK_OVERHEAD);
+        drain(c);
+        if (written == RESPONSE_TRY_AGAIN)
+        {
+            c->nextNs = nextCallbackNs(c);
+            written = 0;
+        }
+        else if (written == 0)
+        {
+            deliver(c, (const uint8_t *)"", 0, 5); // Last chunk
+            c->complete = true;
+            c->nextNs = sim::nowNs();
+        }
+        else
+        {
+            touch(written * 2); // Copy into the lwIP buffers
+            deliver(c, buffer, written, SIM_CHUNK_OVERHEAD);
+            c->nextNs = nextCallbackNs(c);
+        }
+        // Called from another task, the next callback may now be sooner
+        wake.wakeAll();
+        return written;
+    }
+
+    void asyncTcpTask()
+    {
+        while (true)
+        {
+            sim::AsyncConnection *due = nullptr;
+            uint64_t next = NEVER;
+            for (sim::AsyncConnection *c : connections)
+            {
+                if (c->closing || (!c->done && c->nextNs <= sim::nowNs()))
+                {
+                    due = c;
+                    break;
+                }
+                if (!c->done)
+                    next = std::min(next, c->nextNs);
+            }
+
+            if (due == nullptr)
+            {
+                block(wake, next);
+                continue;
+            }
+
+            if (due->closing)
+            {
+                // Disconnects are handled on this task, responses die here
+                if (!due->done)
+                    finish(due);
+                connections.erase(std::find(connections.begin(), connections.end(), due));
+                delete due;
+            }
+            else if (!due->handled)
+                dispatch(due);
+            else if (due->complete)
+                finish(due);
+            else
+                due->response->_ack(due->request, 0, 0);
+        }
+    }
+}
+
+namespace sim
+{
+    StreamViewer::StreamViewer(uint16_t port, const char *uri, uint32_t bytesPerSecond)
+        : code(0), bytes(0), connection(new AsyncConnection())
+    {
+        AsyncConnection *c = connection;
+        c->viewer = this;
+        c->port = port;
+        c->uri = uri;
+        c->bytesPerSecond = bytesPerSecond;
+        c->request = nullptr;
+        c->response = nullptr;
+        c->handled = false;
+        c->closing = false;
+        c->complete = false;
+        c->done = false;
+        c->inFlight = 0;
+        c->startNs = nowNs() + (uint64_t)SIM_ASYNC_CONNECT_US * 1000;
+        c->lastDrainNs = c->startNs;
+        c->nextNs = c->startNs;
+        connections.push_back(c);
+        wake.wakeAll();
+    }
+
+    StreamViewer::~StreamViewer()
+    {
+        close();
+    }
+
+    void StreamViewer::close()
+    {
+        if (connection == nullptr)
+            return;
+        connection->viewer = nullptr;
+        connection->closing = true;
+        connection = nullptr;
+        wake.wakeAll();
+    }
+
+    bool StreamViewer::isOpen() const
+    {
+        return connection != nullptr && !connection->done;
+    }
+}
+
+AsyncWebServerResponse::AsyncWebServerResponse()
+    : _code(0), _contentLength(0), _sendContentLength(true), _chunked(false)
+{
+}
+
+AsyncWebServerResponse::~AsyncWebServerResponse()
+{
+}
+
+void AsyncWebServerResponse::addHeader(const String &name, const String &value)
+{
+    _headers.push_back(std::make_pair(name, value));
+}
+
+void AsyncAbstractResponse::_respond(AsyncWebServerRequest *request)
+{
+    sim::AsyncConnection *c = request->simConnection();
+    c->nextNs = nextCallbackNs(c);
+}
+
+size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, uint32_t time)
+{
+    sim::AsyncConnection *c = request->simConnection();
+    if (c->complete || c->done)
+        return 0;
+    return service(c);
+}
+
+AsyncBasicResponse::AsyncBasicResponse(int code, const String &contentType, const String &content)
+    : _content(content)
+{
+    _code = code;
+    _contentType = contentType;
+    _contentLength = content.length();
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(sim::AsyncConnection *connection, const String &url,
+                                             WebRequestMethod method)
+    : simResponse(nullptr), connection(connection), _method(method)
+{
+    int query = url.indexOf('?');
+    _url = query < 0 ? url : url.substring(0, query);
+    String rest = query < 0 ? String() : url.substring(query + 1);
+    while (rest.length() > 0)
+    {
+        int amp = rest.indexOf('&');
+        String pair = amp < 0 ? rest : rest.substring(0, amp);
+        int equals = pair.indexOf('=');
+        params.push_back(equals < 0 ? new AsyncWebParameter(pair, String())
+                                    : new AsyncWebParameter(pair.substring(0, equals), pair.substring(equals + 1)));
+        rest = amp < 0 ? String() : rest.substring(amp + 1);
+    }
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+    for (AsyncWebParameter *param : params)
+        delete param;
+    delete simResponse;
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const
+{
+    return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file) const
+{
+    for (AsyncWebParameter *param : params)
+        if (param->name() == name)
+            return param;
+    return nullptr;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    delete simResponse;
+    simResponse = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+    send(new AsyncBasicResponse(code, contentType, content));
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t port) : port(port), listening(false)
+{
+    servers.push_back(this);
+}
+
+AsyncWebServer::~AsyncWebServer()
+{
+    servers.erase(std::find(servers.begin(), servers.end(), this));
+}
+
+void AsyncWebServer::begin()
+{
+    listening = true;
+    if (!taskStarted)
+    {
+        taskStarted = true;
+        createTask("async_tcp", asyncTcpTask);
+    }
+}
+
+void AsyncWebServer::end()
+{
+    listening = false;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethod method,
+                                            ArRequestHandlerFunction onRequest)
+{
+    AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler();
+    handler->uri = uri;
+    handler->method = method;
+    handler->onRequest = onRequest;
+    handlers.push_back(handler);
+    return *handler;
+}
+
+AsyncCallbackWebHandler *AsyncWebServer::simFind(const String &path, WebRequestMethod method)
+{
+    for (AsyncCallbackWebHandler *handler : handlers)
+        if (handler->uri == path && (handler->method & method))
+            return handler;
+    return nullptr;
+}
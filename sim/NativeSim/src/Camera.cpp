@@ -0,0 +1,240 @@
+#include "SimInternal.h"
+#include "esp_camera.h"
+#include "img_converters.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace sim::detail;
+
+// Frame format: FF D8, "SIMJ", width and height (big endian), a luma value
+// per 8x8 block, filler up to the size a real JPEG of that quality would
+// have, FF D9
+#define SIM_JPEG_HEADER 10
+#define SIM_CAMERA_INIT_US 300000
+#define SIM_DECODE_BYTE_NS 1500  // Huffman decoding of the input dominates
+#define SIM_DECODE_PIXEL_NS 40   // Colour conversion per output pixel
+#define SIM_ENCODE_PIXEL_NS 800
+
+namespace
+{
+    sim::CameraSensor cameraSensor;
+    sensor_t sensor;
+    bool initialized = false;
+    uint64_t lastFrameIndex = 0;
+
+    void frameSize(framesize_t size, uint16_t &width, uint16_t &height)
+    {
+        switch (size)
+        {
+        case FRAMESIZE_QQVGA:
+            width = 160, height = 120;
+            break;
+        case FRAMESIZE_QVGA:
+            width = 320, height = 240;
+            break;
+        case FRAMESIZE_CIF:
+            width = 400, height = 296;
+            break;
+        case FRAMESIZE_VGA:
+            width = 640, height = 480;
+            break;
+        case FRAMESIZE_SVGA:
+            width = 800, height = 600;
+            break;
+        case FRAMESIZE_XGA:
+            width = 1024, height = 768;
+            break;
+        default:
+            width = 1600, height = 1200;
+            break;
+        }
+    }
+
+    int setQuality(sensor_t *s, int quality)
+    {
+        touch(COST_CALL_NS);
+        s->status.quality = quality;
+        return 0;
+    }
+
+    int setFramesize(sensor_t *s, framesize_t framesize)
+    {
+        touch(COST_CALL_NS);
+        s->status.framesize = framesize;
+        return 0;
+    }
+
+    // Writes a frame with the given block lumas, padded to targetLen
+    uint8_t *build(uint16_t width, uint16_t height, const std::vector<uint8_t> &grid, size_t targetLen, size_t &len)
+    {
+        len = std::max(targetLen, SIM_JPEG_HEADER + grid.size() + 2);
+        uint8_t *jpeg = (uint8_t *)malloc(len);
+        jpeg[0] = 0xFF;
+        jpeg[1] = 0xD8;
+        memcpy(jpeg + 2, "SIMJ", 4);
+        jpeg[6] = width >> 8;
+        jpeg[7] = width;
+        jpeg[8] = height >> 8;
+        jpeg[9] = height;
+        memcpy(jpeg + SIM_JPEG_HEADER, grid.data(), grid.size());
+        memset(jpeg + SIM_JPEG_HEADER + grid.size(), 0x55, len - SIM_JPEG_HEADER - grid.size() - 2);
+        jpeg[len - 2] = 0xFF;
+        jpeg[len - 1] = 0xD9;
+        return jpeg;
+    }
+
+    // Scene at a given time: fixed texture, sensor noise, and a bright block
+    // crossing the picture while there is motion
+    std::vector<uint8_t> scene(uint16_t gw, uint16_t gh, uint64_t us)
+    {
+        std::vector<uint8_t> grid((size_t)gw * gh);
+        for (uint16_t y = 0; y < gh; y++)
+            for (uint16_t x = 0; x < gw; x++)
+                grid[(size_t)y * gw + x] = 64 + (x * 7 + y * 13) % 64 + nextRandom() % 7;
+
+        for (const auto &motion : cameraSensor.motions)
+        {
+            if (us < motion.first || us >= motion.first + motion.second)
+                continue;
+            uint16_t bw = std::max(gw / 4, 1);
+            uint16_t bh = std::max(gh / 3, 1);
+            uint16_t x0 = (uint16_t)((us - motion.first) * (gw - bw) / motion.second);
+            for (uint16_t y = gh / 3; y < gh / 3 + bh && y < gh; y++)
+                for (uint16_t x = x0; x < x0 + bw; x++)
+                    grid[(size_t)y * gw + x] = 230;
+        }
+        return grid;
+    }
+
+    bool parse(const uint8_t *src, size_t len, uint16_t &width, uint16_t &height)
+    {
+        if (len < SIM_JPEG_HEADER + 2 || src[0] != 0xFF || src[1] != 0xD8 || memcmp(src + 2, "SIMJ", 4) != 0)
+            return false;
+        width = src[6] << 8 | src[7];
+        height = src[8] << 8 | src[9];
+        return len >= SIM_JPEG_HEADER + (size_t)((width + 7) / 8) * ((height + 7) / 8) + 2;
+    }
+}
+
+namespace sim
+{
+    void CameraSensor::motion(uint64_t atUs, uint64_t forUs)
+    {
+        motions.push_back(std::make_pair(atUs, forUs));
+    }
+
+    bool CameraSensor::inMotion(uint64_t us) const
+    {
+        for (const auto &motion : motions)
+            if (us >= motion.first && us < motion.first + motion.second)
+                return true;
+        return false;
+    }
+
+    CameraSensor &camera()
+    {
+        return cameraSensor;
+    }
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    sleepUntilNs(sim::nowNs() + (uint64_t)SIM_CAMERA_INIT_US * 1000);
+    sensor.status.framesize = config->frame_size;
+    sensor.status.quality = config->jpeg_quality;
+    sensor.set_quality = setQuality;
+    sensor.set_framesize = setFramesize;
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit()
+{
+    initialized = false;
+    return ESP_OK;
+}
+
+// Grab-latest: the newest frame the sensor finished, or the next one when
+// that was handed out already
+camera_fb_t *esp_camera_fb_get()
+{
+    touch(COST_CALL_NS);
+    if (!initialized)
+        return NULL;
+    uint64_t interval = std::max<uint32_t>(cameraSensor.frameIntervalUs, 1);
+    uint64_t index = std::max(sim::nowUs() / interval, lastFrameIndex + 1);
+    sleepUntilNs(index * interval * 1000);
+    lastFrameIndex = index;
+    if (cameraSensor.failCapture)
+        return NULL;
+    cameraSensor.captures++;
+
+    uint16_t width, height;
+    frameSize(sensor.status.framesize, width, height);
+    uint64_t frameUs = index * interval;
+    std::vector<uint8_t> grid = scene((width + 7) / 8, (height + 7) / 8, frameUs);
+    size_t targetLen = (size_t)width * height * 10 / (std::max<int>(sensor.status.quality, 1) * 12);
+
+    camera_fb_t *fb = new camera_fb_t();
+    fb->buf = build(width, height, grid, targetLen, fb->len);
+    fb->width = width;
+    fb->height = height;
+    fb->format = PIXFORMAT_JPEG;
+    fb->timestamp.tv_sec = frameUs / 1000000;
+    fb->timestamp.tv_usec = frameUs % 1000000;
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    if (fb == NULL)
+        return;
+    free(fb->buf);
+    delete fb;
+}
+
+sensor_t *esp_camera_sensor_get()
+{
+    return initialized ? &sensor : NULL;
+}
+
+bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t *out, jpg_scale_t scale)
+{
+    uint16_t width, height;
+    if (!parse(src, src_len, width, height))
+        return false;
+    int divisor = 1 << scale;
+    uint16_t gw = (width + 7) / 8;
+    uint16_t w = (width + divisor - 1) / divisor;
+    uint16_t h = (height + divisor - 1) / divisor;
+    for (uint16_t y = 0; y < h; y++)
+        for (uint16_t x = 0; x < w; x++)
+        {
+            uint8_t l = src[SIM_JPEG_HEADER + (size_t)(y * divisor / 8) * gw + x * divisor / 8];
+            uint16_t pixel = (l >> 3) << 11 | (l >> 2) << 5 | (l >> 3);
+            out[((size_t)y * w + x) * 2] = pixel >> 8;
+            out[((size_t)y * w + x) * 2 + 1] = pixel & 0xFF;
+        }
+    touch(src_len * SIM_DECODE_BYTE_NS + (uint64_t)w * h * SIM_DECODE_PIXEL_NS);
+    return true;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+             uint8_t **out, size_t *out_len)
+{
+    if (format != PIXFORMAT_RGB565 || src_len < (size_t)width * height * 2)
+        return false;
+    uint16_t gw = (width + 7) / 8;
+    uint16_t gh = (height + 7) / 8;
+    std::vector<uint8_t> grid((size_t)gw * gh);
+    for (uint16_t y = 0; y < gh; y++)
+        for (uint16_t x = 0; x < gw; x++)
+        {
+            const uint8_t *pixel = src + ((size_t)y * 8 * width + x * 8) * 2;
+            grid[(size_t)y * gw + x] = (pixel[0] & 0xF8) | (pixel[0] & 0xF8) >> 5;
+        }
+    size_t targetLen = (size_t)width * height * (20 + quality * 2) / 1000;
+    *out = build(width, height, grid, targetLen, *out_len);
+    touch((uint64_t)width * height * SIM_ENCODE_PIXEL_NS);
+    return true;
+}
@@ -0,0 +1,217 @@
+#include "SimInternal.h"
+#include "Adafruit_Fingerprint.h"
+#include "ESP32Servo.h"
+
+using namespace sim::detail;
+
+#define SIM_SONAR_ECHO_DELAY_US 450 // Trigger to echo rising on an HC-SR04
+#define SIM_SONAR_NO_ECHO_US 38000
+#define SIM_SONAR_US_PER_CM 58
+#define SIM_FINGER_PACKET_BYTES 24   // Command and acknowledge packets
+#define SIM_FINGER_TIMEOUT_US 1000000 // DEFAULTTIMEOUT of the library
+
+namespace
+{
+    sim::FingerprintSensor sensor;
+    int lastServoAngle = -1;
+
+    void driveTouch()
+    {
+        if (sensor.touchPin >= 0)
+            sim::setPin(sensor.touchPin, sensor.fingerOn() == sensor.touchActiveHigh ? HIGH : LOW);
+    }
+}
+
+namespace sim
+{
+    Sonar::Sonar(int trigPin, int echo) : pings(0), echoPin(echo), trigHighNs(0)
+    {
+        distanceCm = [](uint64_t)
+        { return 0L; };
+        setPin(echoPin, LOW);
+        onPinWrite(trigPin, [this](int level)
+                   {
+                       uint64_t now = nowNs();
+                       if (level == HIGH)
+                       {
+                           trigHighNs = now;
+                           return;
+                       }
+                       // Needs a 10 us pulse; triggers while an echo is out are ignored
+                       if (trigHighNs == 0 || now - trigHighNs < 10000 || readPin(echoPin) == HIGH)
+                           return;
+                       trigHighNs = 0;
+                       pings++;
+                       long cm = distanceCm(now / 1000);
+                       uint64_t widthUs = cm > 0 ? (uint64_t)cm * SIM_SONAR_US_PER_CM : SIM_SONAR_NO_ECHO_US;
+                       uint64_t riseUs = now / 1000 + SIM_SONAR_ECHO_DELAY_US;
+                       int pin = echoPin;
+                       at(riseUs, [pin]
+                          { setPin(pin, HIGH); });
+                       at(riseUs + widthUs, [pin]
+                          { setPin(pin, LOW); }); });
+    }
+
+    void FingerprintSensor::wireTouch(int pin, bool activeHigh)
+    {
+        touchPin = pin;
+        touchActiveHigh = activeHigh;
+        driveTouch();
+    }
+
+    void FingerprintSensor::place(uint64_t atUs, uint64_t holdUs, int id)
+    {
+        at(atUs, [this, id]
+           {
+               currentId = id;
+               driveTouch(); });
+        at(atUs + holdUs, [this]
+           {
+               currentId = -2;
+               driveTouch(); });
+    }
+
+    bool FingerprintSensor::fingerOn() const
+    {
+        return currentId != -2;
+    }
+
+    int FingerprintSensor::fingerId() const
+    {
+        return currentId;
+    }
+
+    FingerprintSensor &fingerprint()
+    {
+        return sensor;
+    }
+
+    int servoAngle()
+    {
+        return lastServoAngle;
+    }
+}
+
+Adafruit_Fingerprint::Adafruit_Fingerprint(HardwareSerial *serial, uint32_t password)
+    : fingerID(0), confidence(0), templateCount(0), serial(serial), imageId(-2)
+{
+}
+
+void Adafruit_Fingerprint::begin(uint32_t baud)
+{
+    serial->begin(baud);
+}
+
+// Command out, workUs in the sensor, acknowledge back. False after the
+// library's timeout when nothing sensible came back.
+bool Adafruit_Fingerprint::exchange(uint32_t workUs)
+{
+    touch(COST_CALL_NS);
+    sensor.commands++;
+    unsigned long baud = serial->baudRate();
+    if (!sensor.present || baud == 0 || baud != sensor.baud)
+    {
+        sleepUntilNs(sim::nowNs() + (uint64_t)SIM_FINGER_TIMEOUT_US * 1000);
+        return false;
+    }
+    uint64_t wireNs = (uint64_t)SIM_FINGER_PACKET_BYTES * 10 * 1000000000ULL / baud;
+    sleepUntilNs(sim::nowNs() + wireNs + (uint64_t)workUs * 1000);
+    return true;
+}
+
+bool Adafruit_Fingerprint::verifyPassword()
+{
+    return exchange(1000);
+}
+
+uint8_t Adafruit_Fingerprint::getImage()
+{
+    bool finger = sensor.fingerOn();
+    if (!exchange(finger ? sensor.imageUs : sensor.noFingerUs))
+        return FINGERPRINT_PACKETRECIEVEERR;
+    if (!finger)
+        return FINGERPRINT_NOFINGER;
+    imageId = sensor.currentId;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::image2Tz(uint8_t slot)
+{
+    if (!exchange(sensor.convertUs))
+        return FINGERPRINT_PACKETRECIEVEERR;
+    if (sensor.badImages > 0)
+    {
+        sensor.badImages--;
+        return FINGERPRINT_IMAGEMESS;
+    }
+    return imageId == -2 ? FINGERPRINT_FEATUREFAIL : FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::fingerFastSearch()
+{
+    if (!exchange(sensor.searchUs))
+        return FINGERPRINT_PACKETRECIEVEERR;
+    if (imageId < 0)
+        return FINGERPRINT_NOTFOUND;
+    fingerID = imageId;
+    confidence = 120;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::fingerSearch(uint8_t slot)
+{
+    return fingerFastSearch();
+}
+
+// The acknowledge still goes out at the old rate
+uint8_t Adafruit_Fingerprint::setBaudRate(uint8_t baudrate)
+{
+    if (!exchange(1000))
+        return FINGERPRINT_PACKETRECIEVEERR;
+    if (sensor.applyBaudAtOnce)
+        sensor.baud = (uint32_t)baudrate * 9600;
+    return FINGERPRINT_OK;
+}
+
+int Servo::attach(int servoPin)
+{
+    return attach(servoPin, 544, 2400);
+}
+
+int Servo::attach(int servoPin, int minUs, int maxUs)
+{
+    touch(COST_CALL_NS);
+    pin = servoPin;
+    pinMode(pin, OUTPUT);
+    return 1;
+}
+
+void Servo::detach()
+{
+    pin = -1;
+}
+
+void Servo::write(int value)
+{
+    touch(COST_CALL_NS);
+    if (value > 180)
+        value = map(value, 544, 2400, 0, 180);
+    angle = constrain(value, 0, 180);
+    if (pin >= 0)
+        lastServoAngle = angle;
+}
+
+void Servo::writeMicroseconds(int value)
+{
+    write(map(value, 544, 2400, 0, 180));
+}
+
+int Servo::read()
+{
+    return angle;
+}
+
+bool Servo::attached()
+{
+    return pin >= 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef NATIVE_SIM_ESP32_SERVO_H
+#define NATIVE_SIM_ESP32_SERVO_H
+
+#include <Arduino.h>
+
+// Servo of the ESP32Servo library; the last angle is sim::servoAngle()
+class Servo
+{
+public:
+    int attach(int pin);
+    int attach(int pin, int minUs, int maxUs);
+    void detach();
+    void write(int value);
+    void writeMicroseconds(int value);
+    int read();
+    bool attached();
+
+private:
+    int pin = -1;
+    int angle = 90;
+};
+
+#endif
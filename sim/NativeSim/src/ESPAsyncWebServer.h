@@ -0,0 +1,158 @@
+#pragma once
+
+#ifndef NATIVE_SIM_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_SIM_ESP_ASYNC_WEB_SERVER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// ESPAsyncWebServer over a model of AsyncTCP. A single async_tcp task runs
+// every handler and calls _ack() when the client acknowledges data; a
+// response that answered RESPONSE_TRY_AGAIN with nothing in flight waits
+// for the next poll, 500 ms, unless another task calls its _ack() sooner.
+
+typedef enum
+{
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncWebParameter
+{
+public:
+    AsyncWebParameter(const String &name, const String &value) : _name(name), _value(value) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+
+private:
+    String _name;
+    String _value;
+};
+
+class AsyncWebServerRequest;
+
+class AsyncWebServerResponse
+{
+public:
+    AsyncWebServerResponse();
+    virtual ~AsyncWebServerResponse();
+
+    void addHeader(const String &name, const String &value);
+    void setCode(int code) { _code = code; }
+    void setContentType(const String &type) { _contentType = type; }
+
+    // Streamed responses only: start, and fill the socket again
+    virtual void _respond(AsyncWebServerRequest *request) {}
+    virtual size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time) { return 0; }
+
+    // Used by the stand-in server
+    virtual bool simStreamed() const { return false; }
+    int simCode() const { return _code; }
+    const std::vector<std::pair<String, String>> &simHeaders() const { return _headers; }
+
+protected:
+    int _code;
+    std::vector<std::pair<String, String>> _headers;
+    String _contentType;
+    size_t _contentLength;
+    bool _sendContentLength;
+    bool _chunked;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse
+{
+public:
+    AsyncBasicResponse(int code, const String &contentType = String(), const String &content = String());
+    const String &simContent() const { return _content; }
+
+private:
+    String _content;
+};
+
+class AsyncAbstractResponse : public AsyncWebServerResponse
+{
+public:
+    AsyncAbstractResponse() {}
+    virtual bool _sourceValid() const { return false; }
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) { return 0; }
+    void _respond(AsyncWebServerRequest *request) override;
+    size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time) override;
+    bool simStreamed() const override { return true; }
+
+protected:
+    AwsResponseFiller _callback;
+};
+
+namespace sim
+{
+    struct AsyncConnection;
+}
+
+class AsyncWebServerRequest
+{
+public:
+    AsyncWebServerRequest(sim::AsyncConnection *connection, const String &url, WebRequestMethod method);
+    ~AsyncWebServerRequest();
+
+    const String &url() const { return _url; }
+    WebRequestMethod method() const { return _method; }
+    bool hasParam(const String &name, bool post = false, bool file = false) const;
+    AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const;
+
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &contentType = String(), const String &content = String());
+
+    AsyncWebServerResponse *simResponse;
+    sim::AsyncConnection *simConnection() const { return connection; }
+
+private:
+    sim::AsyncConnection *connection;
+    String _url;
+    WebRequestMethod _method;
+    std::vector<AsyncWebParameter *> params;
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+
+class AsyncCallbackWebHandler
+{
+public:
+    String uri;
+    WebRequestMethod method;
+    ArRequestHandlerFunction onRequest;
+};
+
+class AsyncWebServer
+{
+public:
+    explicit AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+
+    void begin();
+    void end();
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest);
+
+    // Used by the stand-in server
+    uint16_t simPort() const { return port; }
+    bool simListening() const { return listening; }
+    AsyncCallbackWebHandler *simFind(const String &path, WebRequestMethod method);
+
+private:
+    uint16_t port;
+    bool listening;
+    std::vector<AsyncCallbackWebHandler *> handlers;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#ifndef NATIVE_SIM_ESP_MDNS_H
+#define NATIVE_SIM_ESP_MDNS_H
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+// Answers come from sim::setMdnsHub(); without one a query waits for its
+// full timeout
+class MDNSResponder
+{
+public:
+    bool begin(const char *hostName);
+    void end();
+    int queryService(const char *service, const char *proto);
+    IPAddress IP(int index);
+    uint16_t port(int index);
+    String hostname(int index);
+
+private:
+    IPAddress foundIp;
+    uint16_t foundPort = 0;
+};
+
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#ifndef NATIVE_SIM_FS_H
+#define NATIVE_SIM_FS_H
+
+#include <Arduino.h>
+
+// In-memory flash file system. Writes cost flash time and can be made to
+// fail (sim::setFlashWritesFail) to exercise the error paths.
+namespace fs
+{
+    struct SimFile;
+
+    class File
+    {
+    public:
+        File() : file(nullptr), position_(0), readable(false), writable(false) {}
+        File(SimFile *file, bool readable, bool writable, size_t position)
+            : file(file), position_(position), readable(readable), writable(writable)
+        {
+        }
+
+        operator bool() const { return file != nullptr; }
+
+        size_t write(const uint8_t *buf, size_t size);
+        size_t write(uint8_t c) { return write(&c, 1); }
+        size_t read(uint8_t *buf, size_t size);
+        int read();
+        int available();
+        bool seek(uint32_t pos);
+        size_t position() const { return position_; }
+        size_t size() const;
+        void flush() {}
+        void close() { file = nullptr; }
+
+    private:
+        SimFile *file;
+        size_t position_;
+        bool readable;
+        bool writable;
+    };
+
+    class FS
+    {
+    public:
+        File open(const char *path, const char *mode = "r", bool create = false);
+        File open(const String &path, const char *mode = "r", bool create = false)
+        {
+            return open(path.c_str(), mode, create);
+        }
+        bool exists(const char *path);
+        bool exists(const String &path) { return exists(path.c_str()); }
+        bool remove(const char *path);
+        bool remove(const String &path) { return remove(path.c_str()); }
+    };
+}
+
+using fs::File;
+using fs::FS;
+
+#endif
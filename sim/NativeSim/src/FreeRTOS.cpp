@@ -0,0 +1,328 @@
+#include "SimInternal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include <deque>
+#include <vector>
+#include <string.h>
+
+using namespace sim::detail;
+
+// Queues and semaphores share one implementation; a semaphore is a queue of
+// zero-sized items, a mutex one that starts full
+struct SimQueue
+{
+    size_t length;
+    size_t itemSize;
+    size_t count;
+    std::deque<std::vector<uint8_t>> items;
+    WaitList readers;
+    WaitList writers;
+};
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    mux->owner = portMUX_FREE_VAL;
+    mux->count = 0;
+}
+
+// Interrupts are masked and nothing preempts the holder, as on the core
+// that takes the spinlock
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    enterCritical();
+    mux->count++;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    mux->count--;
+    exitCritical();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+    touch(COST_CALL_NS);
+    SimTask *task = createTask(name, [code, arg]
+                               { code(arg); });
+    if (created != NULL)
+        *created = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *created)
+{
+    return xTaskCreatePinnedToCore(code, name, stackDepth, arg, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    deleteTask(task != NULL ? task : currentTask());
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sleepUntilNs(sim::nowNs() + (uint64_t)ticks * 1000000);
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment)
+{
+    *previousWake += increment;
+    uint64_t wakeNs = (uint64_t)*previousWake * 1000000;
+    if (wakeNs > sim::nowNs())
+        sleepUntilNs(wakeNs);
+    else
+        touch(COST_CALL_NS);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    touch(COST_TIME_NS);
+    return (TickType_t)(sim::nowNs() / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    touch(COST_CALL_NS);
+    return notifyTake(clearOnExit != pdFALSE, ticks);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    touch(COST_CALL_NS);
+    notifyGive(task);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken)
+{
+    notifyGive(task);
+    if (higherPriorityTaskWoken != NULL)
+        *higherPriorityTaskWoken = pdFALSE;
+}
+
+static SimQueue *createQueue(UBaseType_t length, UBaseType_t itemSize, UBaseType_t initialCount)
+{
+    SimQueue *queue = new SimQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->count = initialCount;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    touch(COST_CALL_NS);
+    return createQueue(length, itemSize, 0);
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+static BaseType_t queueSend(SimQueue *queue, const void *item, TickType_t ticks)
+{
+    uint64_t deadline = inInterrupt() ? 0 : tickDeadline(ticks);
+    while (queue->count == queue->length)
+    {
+        if (sim::nowNs() >= deadline)
+            return pdFALSE;
+        block(queue->writers, deadline);
+    }
+
+    if (queue->itemSize > 0)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(item);
+        queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->itemSize));
+    }
+    queue->count++;
+    queue->readers.wakeAll();
+    return pdTRUE;
+}
+
+static BaseType_t queueReceive(SimQueue *queue, void *item, TickType_t ticks)
+{
+    uint64_t deadline = inInterrupt() ? 0 : tickDeadline(ticks);
+    while (queue->count == 0)
+    {
+        if (sim::nowNs() >= deadline)
+            return pdFALSE;
+        block(queue->readers, deadline);
+    }
+
+    if (queue->itemSize > 0)
+    {
+        memcpy(item, queue->items.front().data(), queue->itemSize);
+        queue->items.pop_front();
+    }
+    queue->count--;
+    queue->writers.wakeAll();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    touch(COST_CALL_NS);
+    return queueSend(queue, item, ticks);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    touch(COST_CALL_NS);
+    return queueReceive(queue, item, ticks);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken)
+{
+    if (higherPriorityTaskWoken != NULL)
+        *higherPriorityTaskWoken = pdFALSE;
+    return queueSend(queue, item, 0);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    touch(COST_CALL_NS);
+    return createQueue(1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    touch(COST_CALL_NS);
+    return createQueue(1, 0, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+    touch(COST_CALL_NS);
+    return createQueue(maxCount, 0, initialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    touch(COST_CALL_NS);
+    return queueReceive(semaphore, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    touch(COST_CALL_NS);
+    return queueSend(semaphore, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken)
+{
+    if (higherPriorityTaskWoken != NULL)
+        *higherPriorityTaskWoken = pdFALSE;
+    return queueSend(semaphore, NULL, 0);
+}
+
+// ---- esp_timer
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t periodUs; // 0 for a one-shot timer
+    uint32_t generation; // Bumped on every start and stop, stale events do nothing
+    bool active;
+};
+
+static void armTimer(esp_timer *timer, uint64_t dueUs)
+{
+    uint32_t generation = timer->generation;
+    sim::at(dueUs, [timer, generation, dueUs]
+            {
+                if (!timer->active || timer->generation != generation)
+                    return;
+                if (timer->periodUs == 0)
+                    timer->active = false;
+                timer->callback(timer->arg);
+                if (timer->active && timer->generation == generation && timer->periodUs > 0)
+                    armTimer(timer, dueUs + timer->periodUs); });
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    if (args == NULL || args->callback == NULL || handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+    esp_timer *timer = new esp_timer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->periodUs = 0;
+    timer->generation = 0;
+    timer->active = false;
+    *handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t us, uint64_t periodUs)
+{
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    touch(COST_CALL_NS);
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->generation++;
+    timer->active = true;
+    timer->periodUs = periodUs;
+    armTimer(timer, sim::nowUs() + us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    return startTimer(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs)
+{
+    return startTimer(timer, periodUs, periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    timer->generation++;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    // Events of the timer may still be queued, so it is never freed
+    timer->generation++;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer != NULL && timer->active;
+}
+
+int64_t esp_timer_get_time()
+{
+    touch(COST_TIME_NS);
+    return (int64_t)(sim::nowNs() / 1000);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef NATIVE_SIM_HTTP_CLIENT_H
+#define NATIVE_SIM_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT 5000
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NO_CONTENT 204
+
+// HTTPClient of arduino-esp32 over the sim::HttpServer registry. The server
+// handler runs in the calling task, so a long-poll blocks it like on the board.
+class HTTPClient
+{
+public:
+    HTTPClient();
+    ~HTTPClient();
+
+    bool begin(WiFiClient &client, const String &url);
+    bool begin(const String &url);
+    void end();
+
+    void setReuse(bool reuse);
+    void setTimeout(uint16_t timeoutMs);
+    void setConnectTimeout(int32_t timeoutMs);
+    void addHeader(const String &name, const String &value, bool first = false, bool replace = true);
+    void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+
+    int GET();
+    int POST(uint8_t *payload, size_t size);
+    int POST(const String &payload);
+    int sendRequest(const char *type, uint8_t *payload = NULL, size_t size = 0);
+    int sendRequest(const char *type, const String &payload);
+
+    int getSize();
+    String getString();
+    String header(const char *name);
+    bool hasHeader(const char *name);
+    bool connected();
+    static String errorToString(int error);
+
+private:
+    WiFiClient *client;
+    WiFiClient ownClient;
+    std::string host;
+    uint16_t port;
+    std::string uri;
+    bool reuse;
+    uint16_t timeoutMs;
+    int32_t connectTimeoutMs;
+    std::vector<std::pair<std::string, std::string>> requestHeaders;
+    std::vector<std::string> collect;
+    std::map<std::string, std::string> responseHeaders;
+    String body;
+};
+
+#endif
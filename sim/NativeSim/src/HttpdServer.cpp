@@ -0,0 +1,314 @@
+#include "SimInternal.h"
+#include "esp_http_server.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace sim::detail;
+
+#define SIM_HTTPD_RTT_US 3000          // Client on the same LAN
+#define SIM_HTTPD_HEADER_BYTES 120     // Status line and the default headers
+#define SIM_HTTPD_CHUNK_OVERHEAD 8     // Size line and CRLFs of a chunk
+
+namespace
+{
+    struct HttpdServer
+    {
+        httpd_config_t config;
+        std::vector<httpd_uri_t> handlers;
+        bool busy;
+        WaitList waiters;
+    };
+
+    // Request and response of one call, reached through httpd_req_t::aux
+    struct HttpdExchange
+    {
+        std::map<std::string, std::string> requestHeaders;
+        std::string query;
+        std::string body;
+        size_t bodyRead;
+        uint32_t bytesPerSecond;
+        sim::ClientResponse *response;
+        bool headersSent;
+        bool finished;
+        std::string status;
+        std::string type;
+    };
+
+    std::vector<HttpdServer *> servers;
+
+    std::string lower(std::string text)
+    {
+        for (char &c : text)
+            c = tolower(c);
+        return text;
+    }
+
+    HttpdExchange *exchangeOf(httpd_req_t *r)
+    {
+        return static_cast<HttpdExchange *>(r->aux);
+    }
+
+    // Bytes leave at the client's rate, the httpd task waits for them
+    void transmit(HttpdExchange *exchange, size_t bytes)
+    {
+        touch(COST_CALL_NS + bytes * 5);
+        uint64_t ns = (uint64_t)bytes * 1000000000ULL / std::max<uint32_t>(exchange->bytesPerSecond, 1);
+        sleepUntilNs(sim::nowNs() + ns);
+    }
+
+    void sendHeaders(HttpdExchange *exchange)
+    {
+        if (exchange->headersSent)
+            return;
+        exchange->headersSent = true;
+        exchange->response->code = atoi(exchange->status.c_str());
+        exchange->response->headers["content-type"] = exchange->type;
+        size_t bytes = SIM_HTTPD_HEADER_BYTES + exchange->type.size();
+        for (const auto &header : exchange->response->headers)
+            bytes += header.first.size() + header.second.size() + 4;
+        transmit(exchange, bytes);
+    }
+
+    const char *methodName(int method)
+    {
+        switch (method)
+        {
+        case HTTP_DELETE:
+            return "DELETE";
+        case HTTP_GET:
+            return "GET";
+        case HTTP_HEAD:
+            return "HEAD";
+        case HTTP_POST:
+            return "POST";
+        default:
+            return "PUT";
+        }
+    }
+}
+
+namespace sim
+{
+    ClientResponse httpdRequest(uint16_t port, const char *method, const char *uri,
+                                const std::map<std::string, std::string> &headers, uint32_t bytesPerSecond)
+    {
+        ClientResponse response;
+        response.code = 0;
+        response.startUs = nowUs();
+        sleepFor(SIM_HTTPD_RTT_US / 2);
+
+        HttpdServer *server = nullptr;
+        for (HttpdServer *candidate : servers)
+            if (candidate->config.server_port == port)
+                server = candidate;
+        if (server == nullptr)
+        {
+            response.endUs = nowUs();
+            return response;
+        }
+
+        while (server->busy)
+            block(server->waiters, NEVER);
+        server->busy = true;
+
+        std::string path = uri;
+        std::string query;
+        size_t queryStart = path.find('?');
+        if (queryStart != std::string::npos)
+        {
+            query = path.substr(queryStart + 1);
+            path = path.substr(0, queryStart);
+        }
+
+        const httpd_uri_t *match = nullptr;
+        for (const httpd_uri_t &handler : server->handlers)
+            if (path == handler.uri && strcmp(methodName(handler.method), method) == 0)
+                match = &handler;
+
+        HttpdExchange exchange;
+        for (const auto &header : headers)
+            exchange.requestHeaders[lower(header.first)] = header.second;
+        exchange.query = query;
+        exchange.bodyRead = 0;
+        exchange.bytesPerSecond = bytesPerSecond;
+        exchange.response = &response;
+        exchange.headersSent = false;
+        exchange.finished = false;
+        exchange.status = "200 OK";
+        exchange.type = "text/html";
+
+        if (match == nullptr)
+        {
+            response.code = 404;
+        }
+        else
+        {
+            httpd_req_t request = {};
+            request.handle = server;
+            request.method = match->method;
+            snprintf(request.uri, sizeof(request.uri), "%s", uri);
+            request.aux = &exchange;
+            request.user_ctx = match->user_ctx;
+            if (match->handler(&request) != ESP_OK && !exchange.finished)
+                response.code = 0; // Socket closed without a complete answer
+        }
+
+        server->busy = false;
+        server->waiters.wakeAll();
+        sleepFor(SIM_HTTPD_RTT_US / 2);
+        response.endUs = nowUs();
+        return response;
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    touch(COST_CALL_NS);
+    for (HttpdServer *server : servers)
+        if (server->config.server_port == config->server_port)
+            return ESP_ERR_HTTPD_TASK;
+    HttpdServer *server = new HttpdServer();
+    server->config = *config;
+    server->busy = false;
+    servers.push_back(server);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    HttpdServer *server = static_cast<HttpdServer *>(handle);
+    servers.erase(std::remove(servers.begin(), servers.end(), server), servers.end());
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    HttpdServer *server = static_cast<HttpdServer *>(handle);
+    if (server->handlers.size() >= server->config.max_uri_handlers)
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    server->handlers.push_back(*uri_handler);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    HttpdExchange *exchange = exchangeOf(r);
+    if (exchange->headersSent)
+        return ESP_ERR_HTTPD_RESP_SEND;
+    size_t length = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    exchange->response->headers["content-length"] = std::to_string(length);
+    sendHeaders(exchange);
+    if (length > 0)
+    {
+        exchange->response->body.append(buf, length);
+        transmit(exchange, length);
+    }
+    exchange->finished = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    HttpdExchange *exchange = exchangeOf(r);
+    if (!exchange->headersSent)
+        exchange->response->headers["transfer-encoding"] = "chunked";
+    sendHeaders(exchange);
+    size_t length = buf == NULL ? 0 : buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    exchange->response->body.append(buf == NULL ? "" : buf, length);
+    transmit(exchange, length + SIM_HTTPD_CHUNK_OVERHEAD);
+    if (length == 0)
+        exchange->finished = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send(r, str, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r)
+{
+    httpd_resp_set_status(r, "500 Internal Server Error");
+    httpd_resp_send(r, "Internal Server Error", HTTPD_RESP_USE_STRLEN);
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    exchangeOf(r)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    exchangeOf(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    exchangeOf(r)->response->headers[lower(field)] = value;
+    return ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    return exchangeOf(r)->query.size();
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const std::string &query = exchangeOf(r)->query;
+    if (query.empty())
+        return ESP_ERR_NOT_FOUND;
+    snprintf(buf, buf_len, "%s", query.c_str());
+    return query.size() < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t keyLength = strlen(key);
+    const char *pair = qry;
+    while (pair != NULL && *pair != '\0')
+    {
+        const char *end = strchr(pair, '&');
+        size_t pairLength = end == NULL ? strlen(pair) : (size_t)(end - pair);
+        if (pairLength > keyLength && strncmp(pair, key, keyLength) == 0 && pair[keyLength] == '=')
+        {
+            size_t valueLength = pairLength - keyLength - 1;
+            size_t copied = std::min(valueLength, val_size - 1);
+            memcpy(val, pair + keyLength + 1, copied);
+            val[copied] = '\0';
+            return copied == valueLength ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+        pair = end == NULL ? NULL : end + 1;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    auto &headers = exchangeOf(r)->requestHeaders;
+    auto it = headers.find(lower(field));
+    return it == headers.end() ? 0 : it->second.size();
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    auto &headers = exchangeOf(r)->requestHeaders;
+    auto it = headers.find(lower(field));
+    if (it == headers.end())
+        return ESP_ERR_NOT_FOUND;
+    snprintf(val, val_size, "%s", it->second.c_str());
+    return it->second.size() < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    HttpdExchange *exchange = exchangeOf(r);
+    size_t count = std::min(buf_len, exchange->body.size() - exchange->bodyRead);
+    memcpy(buf, exchange->body.data() + exchange->bodyRead, count);
+    exchange->bodyRead += count;
+    return (int)count;
+}
@@ -0,0 +1,242 @@
+#include "SimInternal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace sim::detail;
+
+// Same values as pi_server/app.js
+#define HUB_COMMAND_POLL_HOLD_US 20000000
+#define HUB_COMMAND_STREAM_GRACE_US 5000000
+#define HUB_HANDLER_NS 500000 // Express routing and JSON parsing
+
+namespace
+{
+    // Long-polls waiting on a queue, and how often it was flushed
+    struct Waiters
+    {
+        WaitList list;
+        uint32_t flushes = 0;
+    };
+    std::map<const void *, Waiters> waiters;
+
+    // Value of "key" in a flat JSON object, as written by JsonWriter
+    std::string jsonString(const std::string &json, const char *key, size_t from = 0)
+    {
+        std::string pattern = std::string("\"") + key + "\":";
+        size_t start = json.find(pattern, from);
+        if (start == std::string::npos)
+            return std::string();
+        start += pattern.size();
+        if (json[start] != '"')
+            return json.substr(start, json.find_first_of(",}", start) - start);
+        size_t end = json.find('"', start + 1);
+        return json.substr(start + 1, end - start - 1);
+    }
+
+    // Balanced object starting at from
+    std::string jsonObject(const std::string &json, size_t from)
+    {
+        int depth = 0;
+        bool inString = false;
+        for (size_t i = from; i < json.size(); i++)
+        {
+            char c = json[i];
+            if (inString)
+            {
+                if (c == '\\')
+                    i++;
+                else if (c == '"')
+                    inString = false;
+            }
+            else if (c == '"')
+                inString = true;
+            else if (c == '{')
+                depth++;
+            else if (c == '}' && --depth == 0)
+                return json.substr(from, i - from + 1);
+        }
+        return std::string();
+    }
+
+    sim::HttpResponse reply(int code, const std::string &body)
+    {
+        sim::HttpResponse response;
+        response.code = code;
+        response.body = body;
+        response.headers["content-type"] = "application/json; charset=utf-8";
+        return response;
+    }
+
+    bool isKnownBoard(const std::string &name)
+    {
+        return name == "EntranceCamera" || name == "FrontDoorESP32" || name == "ProximityBoard";
+    }
+}
+
+namespace sim
+{
+    Hub::Hub(const std::string &baseUrl)
+        : server(baseUrl, [this](const HttpRequest &request)
+                 { return handle(request); })
+    {
+        queues["FrontDoorESP32"];
+        queues["ProximityBoard"];
+    }
+
+    // Drops an undelivered command it cancels and answers a waiting poll
+    void Hub::queueCommand(const std::string &board, const std::string &command)
+    {
+        auto it = queues.find(board);
+        if (it == queues.end())
+            return;
+        Queue &queue = it->second;
+        std::string superseded = command == "activate_alarm"     ? "deactivate_alarm"
+                                 : command == "deactivate_alarm" ? "activate_alarm"
+                                                                 : "";
+        queue.pending.erase(std::remove_if(queue.pending.begin(), queue.pending.end(),
+                                           [&](const Command &pending)
+                                           { return pending.command == superseded; }),
+                            queue.pending.end());
+        Command queued = {queue.nextSeq++, command};
+        queue.pending.push_back(queued);
+        Waiters &waiting = waiters[&queue];
+        waiting.flushes++;
+        waiting.list.wakeAll();
+    }
+
+    const std::vector<Hub::Entry> &Hub::log() const
+    {
+        return entries;
+    }
+
+    const Hub::Entry *Hub::first(const std::string &path, uint64_t sinceUs) const
+    {
+        for (const Entry &entry : entries)
+            if (entry.path == path && entry.atUs >= sinceUs)
+                return &entry;
+        return nullptr;
+    }
+
+    size_t Hub::count(const std::string &path) const
+    {
+        return std::count_if(entries.begin(), entries.end(), [&](const Entry &entry)
+                             { return entry.path == path; });
+    }
+
+    HttpResponse Hub::handle(const HttpRequest &request)
+    {
+        touch(HUB_HANDLER_NS);
+        HttpResponse response;
+        std::string name = request.method == "GET" ? request.query.count("name") ? request.query.at("name") : ""
+                                                   : jsonString(request.body, "name");
+
+        if (request.path == "/register")
+        {
+            response = isKnownBoard(name) ? reply(200, "{\"status\":\"success\"}")
+                                          : reply(400, "{\"status\":\"failure\",\"message\":\"Unknown board name\"}");
+        }
+        else if (request.path == "/send_status")
+        {
+            auto it = queues.find(name);
+            if (!isKnownBoard(name))
+                response = reply(400, "{\"status\":\"failure\",\"message\":\"Unknown board name\"}");
+            else if (it == queues.end() || it->second.waiting ||
+                     nowUs() - it->second.lastPollUs < HUB_COMMAND_STREAM_GRACE_US || it->second.pending.empty())
+                response = reply(202, "{\"command\":\"no_command\"}");
+            else
+            {
+                Command command = it->second.pending.front();
+                it->second.pending.erase(it->second.pending.begin());
+                int code = command.command == "activate_alarm" ? 203 : command.command == "deactivate_alarm" ? 204 : 205;
+                // Express drops the body of a 204, the header carries the seq
+                response = reply(code, code == 204 ? "" : "{\"command\":\"" + command.command +
+                                                              "\",\"seq\":" + std::to_string(command.seq) + "}");
+                response.headers["x-command-seq"] = std::to_string(command.seq);
+                statusCommands++;
+            }
+        }
+        else if (request.path == "/commands")
+        {
+            auto it = queues.find(name);
+            response = it == queues.end() ? reply(400, "{\"status\":\"failure\"}") : commands(request, it->second);
+        }
+        else if (request.path == "/events")
+        {
+            logEvents(request);
+            response = reply(200, "{\"status\":\"success\"}");
+        }
+        else if (request.path == "/front_door_alarm" || request.path == "/movement_event" ||
+                 request.path == "/three_wrong_guesses" || request.path == "/motion_snapshot" ||
+                 request.path == "/proximity_event" || request.path == "/fingerprint_result" ||
+                 request.path == "/test")
+        {
+            response = reply(200, "{\"status\":\"success\"}");
+        }
+        else
+        {
+            response = reply(404, "");
+        }
+
+        Entry entry = {request.atUs, request.method, request.path, request.body, response.code};
+        entries.push_back(entry);
+        return response;
+    }
+
+    // Acknowledges up to ack, then holds the poll until a command is queued,
+    // a newer poll replaces it, the hold ends or the client gives up
+    HttpResponse Hub::commands(const HttpRequest &request, Queue &queue)
+    {
+        uint32_t ack = request.query.count("ack") ? strtoul(request.query.at("ack").c_str(), NULL, 10) : 0;
+        queue.lastPollUs = nowUs();
+        queue.pending.erase(std::remove_if(queue.pending.begin(), queue.pending.end(),
+                                           [ack](const Command &command)
+                                           { return command.seq <= ack; }),
+                            queue.pending.end());
+
+        Waiters &waiting = waiters[&queue];
+        waiting.flushes++;
+        waiting.list.wakeAll();
+
+        uint32_t flushes = waiting.flushes;
+        uint64_t holdEndUs = std::min<uint64_t>(nowUs() + HUB_COMMAND_POLL_HOLD_US, request.deadlineUs);
+        queue.waiting = true;
+        while (queue.pending.empty() && waiting.flushes == flushes && nowUs() < holdEndUs)
+            block(waiting.list, holdEndUs * 1000);
+        if (waiting.flushes == flushes)
+            queue.waiting = false;
+        queue.lastPollUs = nowUs();
+
+        std::string lines;
+        for (const Command &command : queue.pending)
+            lines += std::to_string(command.seq) + " " + command.command + "\n";
+        if (!queue.pending.empty())
+            streamedCommands += queue.pending.size();
+        HttpResponse response;
+        response.code = 200;
+        response.body = lines;
+        response.headers["content-type"] = "text/plain; charset=utf-8";
+        return response;
+    }
+
+    // Each new event of a batch is logged under its route, like the hub runs
+    // the route's handler; ids seen before are skipped
+    void Hub::logEvents(const HttpRequest &request)
+    {
+        std::vector<std::string> &ids = seenEventIds[jsonString(request.body, "name")];
+        size_t at = request.body.find("\"events\":");
+        while (at != std::string::npos && (at = request.body.find("{\"id\":", at)) != std::string::npos)
+        {
+            std::string event = jsonObject(request.body, at);
+            at += event.size();
+            std::string id = jsonString(event, "id");
+            if (std::find(ids.begin(), ids.end(), id) != ids.end())
+                continue;
+            ids.push_back(id);
+            size_t bodyAt = event.find("\"body\":");
+            Entry entry = {request.atUs, request.method, jsonString(event, "route"),
+                           bodyAt == std::string::npos ? "" : jsonObject(event, bodyAt + 7), 200};
+            entries.push_back(entry);
+        }
+    }
+}
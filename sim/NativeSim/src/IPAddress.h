@@ -0,0 +1,47 @@
+#pragma once
+
+#ifndef NATIVE_SIM_IPADDRESS_H
+#define NATIVE_SIM_IPADDRESS_H
+
+#include <stdint.h>
+#include "WString.h"
+
+// IPv4 address, stored like lwIP does: first octet in the low byte
+class IPAddress
+{
+public:
+    IPAddress() : address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address((uint32_t)a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24)
+    {
+    }
+    IPAddress(uint32_t address) : address(address) {}
+
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return (address >> (8 * index)) & 0xff; }
+    bool operator==(const IPAddress &other) const { return address == other.address; }
+    bool operator!=(const IPAddress &other) const { return address != other.address; }
+
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(text);
+    }
+
+    bool fromString(const char *text)
+    {
+        unsigned int a, b, c, d;
+        char extra;
+        if (sscanf(text, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+            return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    bool fromString(const String &text) { return fromString(text.c_str()); }
+
+private:
+    uint32_t address;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#ifndef NATIVE_SIM_LITTLEFS_H
+#define NATIVE_SIM_LITTLEFS_H
+
+#include "FS.h"
+
+namespace fs
+{
+    class LittleFSFS : public FS
+    {
+    public:
+        bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+                   const char *partitionLabel = "spiffs");
+        void end();
+        bool format();
+        size_t totalBytes();
+        size_t usedBytes();
+    };
+}
+
+extern fs::LittleFSFS LittleFS;
+
+#endif
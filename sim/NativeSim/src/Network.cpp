@@ -0,0 +1,728 @@
+#include "SimInternal.h"
+#include "WiFi.h"
+#include "WiFiClientSecure.h"
+#include "HTTPClient.h"
+#include "WiFiUdp.h"
+#include "ESPmDNS.h"
+#include <algorithm>
+
+using namespace sim::detail;
+
+#define SIM_HTTP_REQUEST_OVERHEAD 160  // Request line and the usual headers
+#define SIM_HTTP_RESPONSE_OVERHEAD 120
+#define SIM_MDNS_TIMEOUT_US 3000000
+
+namespace
+{
+    sim::AccessPoint ap;
+    wl_status_t linkStatus = WL_DISCONNECTED;
+    uint32_t joinGeneration = 0;
+    uint32_t linkEpoch = 0; // Bumped whenever the link goes down
+    uint32_t configIp = 0, configGateway = 0, configSubnet = 0, configDns = 0;
+    uint32_t ip = 0, gateway = 0, subnet = 0, dns = 0;
+    std::vector<sim::HttpServer *> servers;
+    std::vector<sim::UdpPacket> packets;
+    std::string mdnsIp;
+    uint16_t mdnsPort = 0;
+    uint32_t mdnsAnswerUs = 0;
+
+    void linkDown()
+    {
+        if (linkStatus == WL_CONNECTED)
+            linkEpoch++;
+        ip = 0;
+    }
+
+    uint64_t transferNs(size_t bytes)
+    {
+        return (uint64_t)bytes * 1000000000ULL / std::max<uint32_t>(ap.bytesPerSecond, 1);
+    }
+
+    bool splitUrl(const std::string &url, bool &tls, std::string &host, uint16_t &port, std::string &rest)
+    {
+        size_t scheme = url.find("://");
+        if (scheme == std::string::npos)
+            return false;
+        tls = url.compare(0, scheme, "https") == 0;
+        size_t hostStart = scheme + 3;
+        size_t pathStart = url.find('/', hostStart);
+        std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos
+                                                                                       : pathStart - hostStart);
+        rest = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+        size_t colon = authority.find(':');
+        host = authority.substr(0, colon);
+        port = colon == std::string::npos ? (tls ? 443 : 80) : (uint16_t)atoi(authority.c_str() + colon + 1);
+        return !host.empty();
+    }
+
+    std::map<std::string, std::string> parseQuery(const std::string &query)
+    {
+        std::map<std::string, std::string> values;
+        size_t start = 0;
+        while (start < query.size())
+        {
+            size_t end = query.find('&', start);
+            if (end == std::string::npos)
+                end = query.size();
+            std::string pair = query.substr(start, end - start);
+            size_t equals = pair.find('=');
+            values[pair.substr(0, equals)] = equals == std::string::npos ? "" : pair.substr(equals + 1);
+            start = end + 1;
+        }
+        return values;
+    }
+
+    std::string lower(std::string text)
+    {
+        for (char &c : text)
+            c = tolower(c);
+        return text;
+    }
+}
+
+namespace sim
+{
+    AccessPoint &accessPoint()
+    {
+        return ap;
+    }
+
+    void dropWifi(uint64_t comeBackUs)
+    {
+        ap.up = false;
+        joinGeneration++;
+        if (linkStatus == WL_CONNECTED)
+            linkStatus = WL_CONNECTION_LOST;
+        linkDown();
+        if (comeBackUs > 0)
+            after(comeBackUs, []
+                  { ap.up = true; });
+    }
+
+    bool wifiConnected()
+    {
+        return linkStatus == WL_CONNECTED;
+    }
+
+    HttpServer::HttpServer(const std::string &host, uint16_t port, bool tls, HttpHandler handler)
+        : host(host), port(port), tls(tls), handler(handler)
+    {
+        servers.push_back(this);
+    }
+
+    HttpServer::HttpServer(const std::string &baseUrl, HttpHandler handler) : port(0), tls(false), handler(handler)
+    {
+        std::string rest;
+        splitUrl(baseUrl, tls, host, port, rest);
+        servers.push_back(this);
+    }
+
+    HttpServer::~HttpServer()
+    {
+        servers.erase(std::remove(servers.begin(), servers.end(), this), servers.end());
+    }
+
+    void HttpServer::setUp(bool isUp)
+    {
+        if (!isUp)
+            epoch++;
+        up = isUp;
+    }
+
+    void HttpServer::restart()
+    {
+        epoch++;
+    }
+
+    void setMdnsHub(const std::string &hubIp, uint16_t port, uint32_t answerUs)
+    {
+        mdnsIp = hubIp;
+        mdnsPort = port;
+        mdnsAnswerUs = answerUs;
+    }
+
+    const std::vector<UdpPacket> &udpPackets()
+    {
+        return packets;
+    }
+
+    namespace detail
+    {
+        HttpServer *findServer(const std::string &host, uint16_t port)
+        {
+            for (HttpServer *server : servers)
+                if (server->host == host && server->port == port)
+                    return server;
+            return nullptr;
+        }
+
+        uint32_t localIp()
+        {
+            return linkStatus == WL_CONNECTED ? ip : 0;
+        }
+
+        bool mdnsQuery(std::string &hubIp, uint16_t &port)
+        {
+            if (linkStatus != WL_CONNECTED || mdnsIp.empty())
+            {
+                sleepUntilNs(sim::nowNs() + (uint64_t)SIM_MDNS_TIMEOUT_US * 1000);
+                return false;
+            }
+            sleepUntilNs(sim::nowNs() + (uint64_t)mdnsAnswerUs * 1000);
+            hubIp = mdnsIp;
+            port = mdnsPort;
+            return true;
+        }
+    }
+}
+
+// ---- WiFi
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t mode)
+{
+    touch(COST_CALL_NS);
+    return true;
+}
+
+void WiFiClass::persistent(bool persistent)
+{
+}
+
+bool WiFiClass::setAutoReconnect(bool autoReconnect)
+{
+    return true;
+}
+
+bool WiFiClass::setSleep(bool enabled)
+{
+    return true;
+}
+
+// All zero goes back to DHCP, as in arduino-esp32
+bool WiFiClass::config(IPAddress localIp, IPAddress gatewayIp, IPAddress subnetMask, IPAddress dns1, IPAddress dns2)
+{
+    touch(COST_CALL_NS);
+    configIp = localIp;
+    configGateway = gatewayIp;
+    configSubnet = subnetMask;
+    configDns = dns1;
+    return true;
+}
+
+// A join with a channel and BSSID goes straight to that access point and
+// never connects when it moved; without them the station scans first
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid,
+                             bool connect)
+{
+    touch(COST_CALL_NS);
+    uint32_t generation = ++joinGeneration;
+    if (linkStatus == WL_CONNECTED)
+        linkDown();
+    linkStatus = WL_DISCONNECTED;
+    if (!connect || !ap.up || (!ap.ssid.empty() && ap.ssid != ssid))
+        return linkStatus;
+
+    bool direct = channel != 0 && bssid != NULL;
+    if (direct && (channel != ap.channel || memcmp(bssid, ap.bssid, 6) != 0))
+        return linkStatus;
+    bool fixed = configIp != 0;
+    uint64_t joinUs = direct ? ap.directJoinUs : ap.scanJoinUs;
+    if (!fixed)
+        joinUs += ap.dhcpUs;
+
+    sim::after(joinUs, [generation, direct, fixed]
+               {
+                   if (generation != joinGeneration || !ap.up)
+                       return;
+                   linkStatus = WL_CONNECTED;
+                   ap.joins++;
+                   if (direct)
+                       ap.directJoins++;
+                   if (fixed)
+                   {
+                       ap.staticJoins++;
+                       if (configIp != ap.leaseIp)
+                           ap.addressConflicts++;
+                       ip = configIp;
+                       gateway = configGateway;
+                       subnet = configSubnet;
+                       dns = configDns != 0 ? configDns : configGateway;
+                   }
+                   else
+                   {
+                       ap.dhcpLeases++;
+                       ip = ap.leaseIp;
+                       gateway = ap.gateway;
+                       subnet = ap.subnet;
+                       dns = ap.dns;
+                   } });
+    return linkStatus;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp)
+{
+    touch(COST_CALL_NS);
+    joinGeneration++;
+    linkDown();
+    linkStatus = WL_DISCONNECTED;
+    return true;
+}
+
+wl_status_t WiFiClass::status()
+{
+    touch(COST_CALL_NS);
+    return linkStatus;
+}
+
+bool WiFiClass::isConnected()
+{
+    return status() == WL_CONNECTED;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return IPAddress(localIp());
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+    return IPAddress(linkStatus == WL_CONNECTED ? gateway : 0);
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+    return IPAddress(linkStatus == WL_CONNECTED ? subnet : 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index)
+{
+    return IPAddress(linkStatus == WL_CONNECTED && index == 0 ? dns : 0);
+}
+
+uint8_t *WiFiClass::BSSID()
+{
+    static uint8_t none[6] = {};
+    return linkStatus == WL_CONNECTED ? ap.bssid : none;
+}
+
+int32_t WiFiClass::channel()
+{
+    return linkStatus == WL_CONNECTED ? ap.channel : 0;
+}
+
+int8_t WiFiClass::RSSI()
+{
+    return linkStatus == WL_CONNECTED ? -58 : 0;
+}
+
+String WiFiClass::macAddress()
+{
+    return String("24:0A:C4:00:00:01");
+}
+
+// ---- WiFiClient
+
+WiFiClient::WiFiClient() : simServer(nullptr), simEpoch(0), simLinkEpoch(0), simLastUseNs(0), simOpen(false)
+{
+}
+
+WiFiClient::~WiFiClient()
+{
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    return connect(ip.toString().c_str(), port, 3000);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs)
+{
+    return connect(ip.toString().c_str(), port, timeoutMs);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    return connect(host, port, 3000);
+}
+
+// SYN and SYN/ACK take a round trip, TLS two more plus the key exchange.
+// An unreachable server costs the whole timeout.
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeoutMs)
+{
+    touch(COST_CALL_NS);
+    stop();
+    uint64_t deadline = sim::nowNs() + (uint64_t)std::max<int32_t>(timeoutMs, 0) * 1000000;
+    sim::HttpServer *server = findServer(host, port);
+    if (linkStatus != WL_CONNECTED || server == nullptr || !server->up)
+    {
+        sleepUntilNs(deadline);
+        return 0;
+    }
+
+    sleepUntilNs(sim::nowNs() + (uint64_t)server->rttUs * 1000);
+    if (simSecure() != server->tls)
+        return 0;
+    if (server->tls)
+    {
+        sleepUntilNs(sim::nowNs() + (uint64_t)server->rttUs * 2000);
+        touch((uint64_t)server->tlsHandshakeUs * 1000);
+        server->stats.tlsHandshakes++;
+    }
+    if (sim::nowNs() > deadline || linkStatus != WL_CONNECTED)
+        return 0;
+
+    server->stats.connections++;
+    simServer = server;
+    simEpoch = server->epoch;
+    simLinkEpoch = linkEpoch;
+    simLastUseNs = sim::nowNs();
+    simOpen = true;
+    return 1;
+}
+
+// A connection the server closed after its keep-alive shows as closed; a
+// restarted server or a lost link does not, the next send finds out
+uint8_t WiFiClient::connected()
+{
+    if (!simOpen)
+        return 0;
+    if (simServer->keepAliveUs > 0 && simEpoch == simServer->epoch &&
+        sim::nowNs() - simLastUseNs > simServer->keepAliveUs * 1000)
+    {
+        simServer->stats.idleCloses++;
+        simOpen = false;
+        return 0;
+    }
+    return 1;
+}
+
+void WiFiClient::stop()
+{
+    simOpen = false;
+}
+
+// ---- HTTPClient
+
+HTTPClient::HTTPClient()
+    : client(nullptr), port(0), reuse(true), timeoutMs(HTTPCLIENT_DEFAULT_TCP_TIMEOUT),
+      connectTimeoutMs(HTTPCLIENT_DEFAULT_TCP_TIMEOUT)
+{
+}
+
+HTTPClient::~HTTPClient()
+{
+    if (client == &ownClient)
+        ownClient.stop();
+}
+
+bool HTTPClient::begin(WiFiClient &wifiClient, const String &url)
+{
+    touch(COST_CALL_NS);
+    bool tls;
+    uint16_t urlPort;
+    std::string urlHost, rest;
+    if (!splitUrl(url.c_str(), tls, urlHost, urlPort, rest))
+        return false;
+    // A new host drops the kept connection, as HTTPClient::begin does
+    if (client != nullptr && (urlHost != host || urlPort != port))
+        client->stop();
+    client = &wifiClient;
+    host = urlHost;
+    port = urlPort;
+    uri = rest;
+    requestHeaders.clear();
+    responseHeaders.clear();
+    body = String();
+    return true;
+}
+
+bool HTTPClient::begin(const String &url)
+{
+    return begin(ownClient, url);
+}
+
+void HTTPClient::end()
+{
+    if (client != nullptr && !reuse)
+        client->stop();
+    requestHeaders.clear();
+}
+
+void HTTPClient::setReuse(bool value)
+{
+    reuse = value;
+}
+
+void HTTPClient::setTimeout(uint16_t value)
+{
+    timeoutMs = value;
+}
+
+void HTTPClient::setConnectTimeout(int32_t value)
+{
+    connectTimeoutMs = value;
+}
+
+void HTTPClient::addHeader(const String &name, const String &value, bool first, bool replace)
+{
+    for (auto &header : requestHeaders)
+        if (lower(header.first) == lower(name.c_str()))
+        {
+            if (replace)
+                header.second = value.c_str();
+            return;
+        }
+    requestHeaders.push_back(std::make_pair(std::string(name.c_str()), std::string(value.c_str())));
+}
+
+void HTTPClient::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+    collect.clear();
+    for (size_t i = 0; i < headerKeysCount; i++)
+        collect.push_back(lower(headerKeys[i]));
+}
+
+int HTTPClient::GET()
+{
+    return sendRequest("GET");
+}
+
+int HTTPClient::POST(uint8_t *payload, size_t size)
+{
+    return sendRequest("POST", payload, size);
+}
+
+int HTTPClient::POST(const String &payload)
+{
+    return sendRequest("POST", (uint8_t *)payload.c_str(), payload.length());
+}
+
+int HTTPClient::sendRequest(const char *type, const String &payload)
+{
+    return sendRequest(type, (uint8_t *)payload.c_str(), payload.length());
+}
+
+// Request out in half a round trip plus its bytes, the handler, the
+// response back the same way. Past the read timeout the answer is dropped.
+int HTTPClient::sendRequest(const char *type, uint8_t *payload, size_t size)
+{
+    touch(COST_CALL_NS);
+    responseHeaders.clear();
+    body = String();
+    if (client == nullptr)
+        return HTTPC_ERROR_NOT_CONNECTED;
+    if (!client->connected() && !client->connect(host.c_str(), port, connectTimeoutMs))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    sim::HttpServer *server = client->simServer;
+    uint64_t deadline = sim::nowNs() + (uint64_t)timeoutMs * 1000000;
+    if (linkStatus != WL_CONNECTED || client->simLinkEpoch != linkEpoch)
+    {
+        // Nothing comes back over a link that is gone
+        client->stop();
+        sleepUntilNs(deadline);
+        return HTTPC_ERROR_READ_TIMEOUT;
+    }
+    if (client->simEpoch != server->epoch || !server->up)
+    {
+        // The server forgot the connection and answers with a reset
+        server->stats.staleSends++;
+        sleepUntilNs(sim::nowNs() + (uint64_t)server->rttUs * 1000);
+        client->stop();
+        return HTTPC_ERROR_CONNECTION_LOST;
+    }
+
+    sim::HttpRequest request;
+    request.method = type;
+    size_t queryStart = uri.find('?');
+    request.path = uri.substr(0, queryStart);
+    if (queryStart != std::string::npos)
+        request.query = parseQuery(uri.substr(queryStart + 1));
+    size_t requestBytes = SIM_HTTP_REQUEST_OVERHEAD + uri.size() + size;
+    for (const auto &header : requestHeaders)
+    {
+        request.headers[lower(header.first)] = header.second;
+        requestBytes += header.first.size() + header.second.size() + 4;
+    }
+    if (payload != NULL)
+        request.body.assign((const char *)payload, size);
+    touch(transferNs(requestBytes) / 20); // lwIP copies into pbufs
+
+    sleepUntilNs(sim::nowNs() + (uint64_t)server->rttUs * 500 + transferNs(requestBytes));
+    request.atUs = sim::nowUs();
+    request.deadlineUs = deadline / 1000;
+    server->stats.requests++;
+    sim::HttpResponse response = server->handler(request);
+
+    size_t responseBytes = SIM_HTTP_RESPONSE_OVERHEAD + response.body.size();
+    for (const auto &header : response.headers)
+        responseBytes += header.first.size() + header.second.size() + 4;
+    sleepUntilNs(sim::nowNs() + (uint64_t)server->rttUs * 500 + transferNs(responseBytes));
+    if (sim::nowNs() > deadline || linkStatus != WL_CONNECTED || client->simLinkEpoch != linkEpoch)
+    {
+        client->stop();
+        return HTTPC_ERROR_READ_TIMEOUT;
+    }
+
+    client->simLastUseNs = sim::nowNs();
+    for (const auto &header : response.headers)
+        if (std::find(collect.begin(), collect.end(), lower(header.first)) != collect.end())
+            responseHeaders[lower(header.first)] = header.second;
+    body = String(response.body);
+    if (!reuse)
+        client->stop();
+    return response.code;
+}
+
+int HTTPClient::getSize()
+{
+    return body.length();
+}
+
+String HTTPClient::getString()
+{
+    return body;
+}
+
+String HTTPClient::header(const char *name)
+{
+    auto it = responseHeaders.find(lower(name));
+    return it == responseHeaders.end() ? String() : String(it->second);
+}
+
+bool HTTPClient::hasHeader(const char *name)
+{
+    return responseHeaders.count(lower(name)) > 0;
+}
+
+bool HTTPClient::connected()
+{
+    return client != nullptr && client->connected();
+}
+
+String HTTPClient::errorToString(int error)
+{
+    switch (error)
+    {
+    case HTTPC_ERROR_CONNECTION_REFUSED:
+        return String("connection refused");
+    case HTTPC_ERROR_NOT_CONNECTED:
+        return String("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST:
+        return String("connection lost");
+    case HTTPC_ERROR_READ_TIMEOUT:
+        return String("read Timeout");
+    default:
+        return String();
+    }
+}
+
+// ---- WiFiUDP
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    open = true;
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    open = false;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    touch(COST_CALL_NS);
+    remoteIp = ip;
+    remotePort = port;
+    packet.clear();
+    return 1;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+    IPAddress ip;
+    if (!ip.fromString(host))
+        return 0;
+    return beginPacket(ip, port);
+}
+
+size_t WiFiUDP::write(uint8_t byte)
+{
+    packet.push_back(byte);
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    packet.insert(packet.end(), buffer, buffer + size);
+    return size;
+}
+
+// Datagrams sent without a link are lost, as on the board
+int WiFiUDP::endPacket()
+{
+    touch(COST_CALL_NS + transferNs(packet.size()) / 20);
+    if (linkStatus != WL_CONNECTED)
+        return 0;
+    sim::UdpPacket sent;
+    sent.atUs = sim::nowUs();
+    sent.ip = remoteIp.toString().c_str();
+    sent.port = remotePort;
+    sent.data = packet;
+    packets.push_back(sent);
+    return 1;
+}
+
+int WiFiUDP::parsePacket()
+{
+    return 0;
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t length)
+{
+    return 0;
+}
+
+// ---- mDNS
+
+MDNSResponder MDNS;
+
+bool MDNSResponder::begin(const char *hostName)
+{
+    touch(COST_CALL_NS);
+    return linkStatus == WL_CONNECTED;
+}
+
+void MDNSResponder::end()
+{
+}
+
+int MDNSResponder::queryService(const char *service, const char *proto)
+{
+    touch(COST_CALL_NS);
+    std::string hubIp;
+    uint16_t hubPort;
+    if (!mdnsQuery(hubIp, hubPort))
+        return 0;
+    foundIp.fromString(hubIp.c_str());
+    foundPort = hubPort;
+    return 1;
+}
+
+IPAddress MDNSResponder::IP(int index)
+{
+    return index == 0 ? foundIp : IPAddress();
+}
+
+uint16_t MDNSResponder::port(int index)
+{
+    return index == 0 ? foundPort : 0;
+}
+
+String MDNSResponder::hostname(int index)
+{
+    return String("smarthub");
+}
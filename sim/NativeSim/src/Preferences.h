@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef NATIVE_SIM_PREFERENCES_H
+#define NATIVE_SIM_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// NVS key-value storage, kept in memory across the scenario (and across
+// simulated reboots until sim::eraseFlash())
+class Preferences
+{
+public:
+    Preferences();
+    ~Preferences();
+
+    bool begin(const char *name, bool readOnly = false, const char *partitionLabel = NULL);
+    void end();
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytes(const char *key, void *buf, size_t maxLength);
+    size_t getBytesLength(const char *key);
+
+    size_t putUInt(const char *key, uint32_t value);
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t putInt(const char *key, int32_t value);
+    int32_t getInt(const char *key, int32_t defaultValue = 0);
+    size_t putULong(const char *key, uint32_t value);
+    uint32_t getULong(const char *key, uint32_t defaultValue = 0);
+    size_t putBool(const char *key, bool value);
+    bool getBool(const char *key, bool defaultValue = false);
+    size_t putString(const char *key, const char *value);
+    size_t putString(const char *key, const String &value);
+    String getString(const char *key, const String &defaultValue = String());
+
+private:
+    size_t put(const char *key, const void *value, size_t length);
+    const std::vector<uint8_t> *find(const char *key);
+
+    std::map<std::string, std::vector<uint8_t>> *space;
+    bool readOnly;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "SimInternal.h"
+#include "mbedtls/md.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace sim::detail;
+
+#define SIM_SHA256_BLOCK_NS 1500 // One 64 byte block on the ESP32 with the hardware unit
+
+namespace
+{
+    const mbedtls_md_info_t sha256Info = {MBEDTLS_MD_SHA256, 32};
+
+    const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    struct Sha256
+    {
+        uint32_t h[8];
+        uint8_t block[64];
+        size_t used;
+        uint64_t total;
+        uint32_t blocks;
+
+        Sha256() : h{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+                   used(0), total(0), blocks(0)
+        {
+        }
+
+        static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+        void compress()
+        {
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++)
+                w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+                       (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+            for (int i = 16; i < 64; i++)
+            {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+            for (int i = 0; i < 64; i++)
+            {
+                uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                k = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+            h[5] += f;
+            h[6] += g;
+            h[7] += k;
+            blocks++;
+        }
+
+        void update(const uint8_t *data, size_t length)
+        {
+            total += length;
+            while (length > 0)
+            {
+                size_t n = std::min(length, sizeof(block) - used);
+                memcpy(block + used, data, n);
+                used += n;
+                data += n;
+                length -= n;
+                if (used == sizeof(block))
+                {
+                    compress();
+                    used = 0;
+                }
+            }
+        }
+
+        void finish(uint8_t *out)
+        {
+            uint64_t bits = total * 8;
+            uint8_t pad = 0x80;
+            update(&pad, 1);
+            pad = 0;
+            while (used != 56)
+                update(&pad, 1);
+            uint8_t length[8];
+            for (int i = 0; i < 8; i++)
+                length[i] = bits >> (56 - 8 * i);
+            update(length, 8);
+            for (int i = 0; i < 8; i++)
+            {
+                out[4 * i] = h[i] >> 24;
+                out[4 * i + 1] = h[i] >> 16;
+                out[4 * i + 2] = h[i] >> 8;
+                out[4 * i + 3] = h[i];
+            }
+        }
+    };
+}
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type)
+{
+    return type == MBEDTLS_MD_SHA256 ? &sha256Info : NULL;
+}
+
+int mbedtls_md(const mbedtls_md_info_t *info, const unsigned char *input, size_t length, unsigned char *output)
+{
+    if (info == NULL)
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    Sha256 sha;
+    sha.update(input, length);
+    sha.finish(output);
+    touch(COST_CALL_NS + sha.blocks * SIM_SHA256_BLOCK_NS);
+    return 0;
+}
+
+// RFC 2104 over SHA-256
+int mbedtls_md_hmac(const mbedtls_md_info_t *info, const unsigned char *key, size_t keyLength,
+                    const unsigned char *input, size_t length, unsigned char *output)
+{
+    if (info == NULL)
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    uint8_t pad[64] = {};
+    uint32_t blocks = 0;
+    if (keyLength > sizeof(pad))
+    {
+        Sha256 keySha;
+        keySha.update(key, keyLength);
+        keySha.finish(pad);
+        blocks += keySha.blocks;
+    }
+    else
+        memcpy(pad, key, keyLength);
+
+    uint8_t inner[32];
+    Sha256 innerSha;
+    for (size_t i = 0; i < sizeof(pad); i++)
+        pad[i] ^= 0x36;
+    innerSha.update(pad, sizeof(pad));
+    innerSha.update(input, length);
+    innerSha.finish(inner);
+
+    Sha256 outerSha;
+    for (size_t i = 0; i < sizeof(pad); i++)
+        pad[i] ^= 0x36 ^ 0x5c;
+    outerSha.update(pad, sizeof(pad));
+    outerSha.update(inner, sizeof(inner));
+    outerSha.finish(output);
+    blocks += innerSha.blocks + outerSha.blocks;
+    touch(COST_CALL_NS + blocks * SIM_SHA256_BLOCK_NS);
+    return 0;
+}
@@ -0,0 +1,424 @@
+#include "SimInternal.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+// One host thread per task, but only the one holding the baton runs. The
+// baton moves in schedule(), which also fires due events in between.
+struct SimTask
+{
+    std::string name;
+    uint64_t wakeNs;
+    uint64_t order; // FIFO among tasks due at the same time
+    bool alive;
+    std::condition_variable resume;
+    std::function<void()> body;
+
+    uint32_t notifyValue;
+    sim::detail::WaitList notifyWaiters;
+};
+
+namespace sim
+{
+    namespace detail
+    {
+        struct Event
+        {
+            uint64_t atNs;
+            uint64_t order;
+            std::function<void()> fn;
+
+            bool operator>(const Event &other) const
+            {
+                return atNs != other.atNs ? atNs > other.atNs : order > other.order;
+            }
+        };
+
+        // Never destroyed: detached task threads may still be parked on it
+        // while the process exits
+        struct Scheduler
+        {
+            std::mutex mutex;
+            SimTask *running = nullptr;
+            std::vector<SimTask *> tasks;
+            std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+            uint64_t now = 0;
+            uint64_t order = 0;
+            int critical = 0;
+            int interruptDepth = 0;
+            std::mt19937 random{1};
+        };
+
+        static Scheduler &scheduler()
+        {
+            static Scheduler *instance = new Scheduler();
+            return *instance;
+        }
+
+        static thread_local SimTask *self = nullptr;
+
+        SimTask *currentTask()
+        {
+            if (self == nullptr)
+            {
+                // The first thread to ask is the test's, it plays loopTask
+                Scheduler &s = scheduler();
+                SimTask *task = new SimTask();
+                task->name = "loopTask";
+                task->wakeNs = s.now;
+                task->order = ++s.order;
+                task->alive = true;
+                task->notifyValue = 0;
+                s.tasks.push_back(task);
+                s.running = task;
+                self = task;
+            }
+            return self;
+        }
+
+        static SimTask *earliestTask()
+        {
+            SimTask *best = nullptr;
+            for (SimTask *task : scheduler().tasks)
+            {
+                if (!task->alive)
+                    continue;
+                if (best == nullptr || task->wakeNs < best->wakeNs ||
+                    (task->wakeNs == best->wakeNs && task->order < best->order))
+                    best = task;
+            }
+            return best;
+        }
+
+        void interrupt(std::function<void()> fn)
+        {
+            Scheduler &s = scheduler();
+            s.interruptDepth++;
+            s.now += COST_ISR_ENTRY_NS;
+            fn();
+            s.interruptDepth--;
+        }
+
+        static void handOver(SimTask *next, bool wait)
+        {
+            Scheduler &s = scheduler();
+            SimTask *me = currentTask();
+            if (next == me)
+                return;
+
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.running = next;
+            next->resume.notify_one();
+            if (wait)
+                me->resume.wait(lock, [&]
+                                { return s.running == me; });
+        }
+
+        // Picks whoever is due next, firing events on the way, and runs it.
+        // Returns once the caller is picked again.
+        static void schedule(bool exiting = false)
+        {
+            Scheduler &s = scheduler();
+            while (true)
+            {
+                SimTask *next = earliestTask();
+                if (!s.events.empty() && (next == nullptr || s.events.top().atNs <= next->wakeNs))
+                {
+                    Event event = s.events.top();
+                    s.events.pop();
+                    s.now = std::max(s.now, event.atNs);
+                    interrupt(event.fn);
+                    continue;
+                }
+
+                if (next == nullptr || next->wakeNs == NEVER)
+                {
+                    fprintf(stderr, "sim: every task is blocked forever\n");
+                    abort();
+                }
+                s.now = std::max(s.now, next->wakeNs);
+                handOver(next, !exiting);
+                return;
+            }
+        }
+
+        SimTask *createTask(const char *name, std::function<void()> body)
+        {
+            Scheduler &s = scheduler();
+            currentTask();
+
+            SimTask *task = new SimTask();
+            task->name = name;
+            task->wakeNs = s.now;
+            task->order = ++s.order;
+            task->alive = true;
+            task->notifyValue = 0;
+            task->body = body;
+            s.tasks.push_back(task);
+
+            std::thread([task]
+                        {
+                            self = task;
+                            {
+                                Scheduler &s = scheduler();
+                                std::unique_lock<std::mutex> lock(s.mutex);
+                                task->resume.wait(lock, [&]
+                                                  { return s.running == task; });
+                            }
+                            task->body();
+                            deleteTask(task); })
+                .detach();
+            return task;
+        }
+
+        // The thread of a deleted task parks for good
+        void deleteTask(SimTask *task)
+        {
+            task->alive = false;
+            if (task != currentTask())
+                return;
+
+            schedule(true);
+            Scheduler &s = scheduler();
+            std::unique_lock<std::mutex> lock(s.mutex);
+            task->resume.wait(lock, []
+                              { return false; });
+        }
+
+        void sleepUntilNs(uint64_t ns)
+        {
+            Scheduler &s = scheduler();
+            SimTask *me = currentTask();
+            if (s.interruptDepth > 0 || s.critical > 0)
+            {
+                // Interrupt handlers and spinlock holders cannot block, waiting
+                // burns CPU instead
+                s.now = std::max(s.now, ns);
+                return;
+            }
+            me->wakeNs = std::max(ns, s.now);
+            me->order = ++s.order;
+            schedule();
+        }
+
+        void block(WaitList &list, uint64_t deadlineNs)
+        {
+            SimTask *me = currentTask();
+            list.waiters.push_back(me);
+            sleepUntilNs(deadlineNs);
+            list.waiters.erase(std::remove(list.waiters.begin(), list.waiters.end(), me), list.waiters.end());
+        }
+
+        void WaitList::wakeAll()
+        {
+            Scheduler &s = scheduler();
+            for (SimTask *task : waiters)
+            {
+                if (task->wakeNs > s.now)
+                {
+                    task->wakeNs = s.now;
+                    task->order = ++s.order;
+                }
+            }
+        }
+
+        void touch(uint64_t costNs)
+        {
+            Scheduler &s = scheduler();
+            uint64_t target = s.now + costNs;
+            if (s.interruptDepth > 0 || s.critical > 0)
+            {
+                s.now = target;
+                return;
+            }
+
+            // Interrupts preempt the work at their own time
+            while (!s.events.empty() && s.events.top().atNs <= target)
+            {
+                Event event = s.events.top();
+                s.events.pop();
+                s.now = std::max(s.now, event.atNs);
+                interrupt(event.fn);
+            }
+            s.now = std::max(s.now, target);
+
+            // Time slicing with the other tasks
+            SimTask *me = currentTask();
+            for (SimTask *task : s.tasks)
+            {
+                if (task != me && task->alive && task->wakeNs <= s.now)
+                {
+                    me->wakeNs = s.now;
+                    me->order = ++s.order;
+                    schedule();
+                    break;
+                }
+            }
+        }
+
+        void enterCritical()
+        {
+            scheduler().critical++;
+        }
+
+        void exitCritical()
+        {
+            scheduler().critical--;
+        }
+
+        bool inInterrupt()
+        {
+            return scheduler().interruptDepth > 0;
+        }
+
+        uint64_t tickDeadline(uint32_t ticks)
+        {
+            if (ticks == 0xffffffffu)
+                return NEVER;
+            return scheduler().now + (uint64_t)ticks * 1000000;
+        }
+
+        uint32_t notifyTake(bool clear, uint32_t ticks)
+        {
+            SimTask *me = currentTask();
+            uint64_t deadline = tickDeadline(ticks);
+            while (me->notifyValue == 0 && scheduler().now < deadline)
+            {
+                block(me->notifyWaiters, deadline);
+            }
+            uint32_t value = me->notifyValue;
+            if (value > 0)
+                me->notifyValue = clear ? 0 : value - 1;
+            return value;
+        }
+
+        void notifyGive(SimTask *task)
+        {
+            task->notifyValue++;
+            task->notifyWaiters.wakeAll();
+        }
+
+        uint32_t nextRandom()
+        {
+            return scheduler().random();
+        }
+    }
+
+    using namespace detail;
+
+    uint64_t nowNs()
+    {
+        return scheduler().now;
+    }
+
+    uint64_t nowUs()
+    {
+        return scheduler().now / 1000;
+    }
+
+    void at(uint64_t us, std::function<void()> fn)
+    {
+        Scheduler &s = scheduler();
+        s.events.push(Event{std::max(us * 1000, s.now), ++s.order, fn});
+    }
+
+    void after(uint64_t us, std::function<void()> fn)
+    {
+        at(nowUs() + us, fn);
+    }
+
+    void charge(uint64_t ns)
+    {
+        touch(ns);
+    }
+
+    void sleepFor(uint64_t us)
+    {
+        sleepUntilNs(nowNs() + us * 1000);
+    }
+
+    void sleepUntil(uint64_t us)
+    {
+        sleepUntilNs(us * 1000);
+    }
+
+    void spawn(const char *name, std::function<void()> body)
+    {
+        createTask(name, body);
+    }
+
+    void seed(uint32_t value)
+    {
+        scheduler().random.seed(value);
+    }
+
+    void runLoop(void (*loop)(), uint64_t forUs, uint32_t passCostUs, Histogram *passes)
+    {
+        uint64_t endNs = nowNs() + forUs * 1000;
+        while (nowNs() < endNs)
+        {
+            uint64_t start = nowNs();
+            loop();
+            touch((uint64_t)passCostUs * 1000);
+            if (passes != nullptr)
+                passes->record((nowNs() - start) / 1000);
+        }
+    }
+
+    void Histogram::record(uint64_t us)
+    {
+        samples.push_back(us);
+        sorted = false;
+    }
+
+    size_t Histogram::count() const
+    {
+        return samples.size();
+    }
+
+    uint64_t Histogram::percentile(double percent) const
+    {
+        if (samples.empty())
+            return 0;
+        if (!sorted)
+        {
+            std::sort(samples.begin(), samples.end());
+            sorted = true;
+        }
+        size_t rank = (size_t)(percent / 100.0 * samples.size());
+        return samples[std::min(rank, samples.size() - 1)];
+    }
+
+    uint64_t Histogram::max() const
+    {
+        return percentile(100);
+    }
+
+    uint64_t Histogram::mean() const
+    {
+        if (samples.empty())
+            return 0;
+        uint64_t sum = 0;
+        for (uint64_t sample : samples)
+            sum += sample;
+        return sum / samples.size();
+    }
+
+    void Histogram::clear()
+    {
+        samples.clear();
+        sorted = true;
+    }
+
+    void Histogram::print(const char *name) const
+    {
+        printf("%-28s n=%-8zu p50 %8llu us  p90 %8llu us  p99 %8llu us  max %8llu us\n", name, count(),
+               (unsigned long long)percentile(50), (unsigned long long)percentile(90),
+               (unsigned long long)percentile(99), (unsigned long long)max());
+    }
+}
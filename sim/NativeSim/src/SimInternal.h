@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef NATIVE_SIM_INTERNAL_H
+#define NATIVE_SIM_INTERNAL_H
+
+#include "sim.h"
+
+// Shared by the stand-in implementations, not meant for tests
+
+// FreeRTOS task handle; one host thread each
+struct SimTask;
+
+namespace sim
+{
+    namespace detail
+    {
+        // CPU cost of the cheap calls, in ns
+        const uint64_t COST_TIME_NS = 100;    // millis(), micros(), esp_timer_get_time()
+        const uint64_t COST_GPIO_NS = 250;    // digitalRead(), digitalWrite()
+        const uint64_t COST_REG_NS = 50;      // One GPIO register access
+        const uint64_t COST_ISR_ENTRY_NS = 2000;
+        const uint64_t COST_CALL_NS = 200;    // Any other stand-in call
+
+        const uint64_t NEVER = UINT64_MAX;
+
+        // Tasks blocked on something; woken when it changes or at their deadline
+        struct WaitList
+        {
+            std::vector<SimTask *> waiters;
+            void wakeAll();
+        };
+
+        SimTask *currentTask();
+        SimTask *createTask(const char *name, std::function<void()> body);
+        void deleteTask(SimTask *task);
+
+        // Blocks until woken through the list or deadlineNs, whichever first
+        void block(WaitList &list, uint64_t deadlineNs);
+        void sleepUntilNs(uint64_t ns);
+
+        // CPU time; lets interrupts fire and due tasks run
+        void touch(uint64_t costNs);
+
+        void enterCritical();
+        void exitCritical();
+        bool inInterrupt();
+
+        // Runs fn as an interrupt handler (nested calls only charge time)
+        void interrupt(std::function<void()> fn);
+
+        // Deadline in ns for a FreeRTOS tick count, NEVER for portMAX_DELAY
+        uint64_t tickDeadline(uint32_t ticks);
+
+        uint32_t notifyTake(bool clear, uint32_t ticks);
+        void notifyGive(SimTask *task);
+
+        uint32_t nextRandom();
+
+        void serialWrite(const char *text, size_t length);
+
+        // GPIO: level seen by the board, and a change of something that drives pins
+        int readPin(int pin);
+        void pinsChanged();
+
+        // Network for the stand-in clients
+        HttpServer *findServer(const std::string &host, uint16_t port);
+        uint32_t localIp();
+        bool mdnsQuery(std::string &ip, uint16_t &port);
+    }
+}
+
+#endif
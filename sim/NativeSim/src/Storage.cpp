@@ -0,0 +1,319 @@
+#include "SimInternal.h"
+#include "LittleFS.h"
+#include "Preferences.h"
+
+using namespace sim::detail;
+
+#define SIM_FS_OPEN_NS 200000      // Path lookup and metadata on LittleFS
+#define SIM_FS_READ_BYTE_NS 500
+#define SIM_FS_WRITE_BYTE_NS 15000 // Program and copy-on-write of the blocks
+#define SIM_NVS_WRITE_NS 1000000   // Flash write with the cache disabled
+#define SIM_NVS_READ_NS 20000
+
+namespace fs
+{
+    struct SimFile
+    {
+        std::vector<uint8_t> data;
+    };
+}
+
+namespace
+{
+    std::map<std::string, fs::SimFile *> files;
+    std::map<std::string, std::map<std::string, std::vector<uint8_t>>> namespaces;
+    sim::FlashStats flashStats = {};
+    bool writesFail = false;
+}
+
+namespace sim
+{
+    FlashStats &flash()
+    {
+        return flashStats;
+    }
+
+    void setFlashWritesFail(bool fail)
+    {
+        writesFail = fail;
+    }
+
+    void eraseFlash()
+    {
+        // Open File objects may still point at the old ones, so they leak
+        files.clear();
+        namespaces.clear();
+    }
+}
+
+namespace fs
+{
+    size_t File::write(const uint8_t *buf, size_t size)
+    {
+        if (file == nullptr || !writable || writesFail)
+            return 0;
+        touch(COST_CALL_NS + size * SIM_FS_WRITE_BYTE_NS);
+        if (file->data.size() < position_ + size)
+            file->data.resize(position_ + size);
+        memcpy(file->data.data() + position_, buf, size);
+        position_ += size;
+        flashStats.bytesWritten += size;
+        return size;
+    }
+
+    size_t File::read(uint8_t *buf, size_t size)
+    {
+        if (file == nullptr || !readable || position_ >= file->data.size())
+            return 0;
+        size_t count = std::min(size, file->data.size() - position_);
+        touch(COST_CALL_NS + count * SIM_FS_READ_BYTE_NS);
+        memcpy(buf, file->data.data() + position_, count);
+        position_ += count;
+        return count;
+    }
+
+    int File::read()
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int File::available()
+    {
+        return file == nullptr || position_ >= file->data.size() ? 0 : (int)(file->data.size() - position_);
+    }
+
+    bool File::seek(uint32_t pos)
+    {
+        if (file == nullptr || pos > file->data.size())
+            return false;
+        position_ = pos;
+        return true;
+    }
+
+    size_t File::size() const
+    {
+        return file == nullptr ? 0 : file->data.size();
+    }
+
+    // Modes as in fopen(): r, r+, w, w+, a, a+
+    File FS::open(const char *path, const char *mode, bool create)
+    {
+        touch(SIM_FS_OPEN_NS);
+        flashStats.opens++;
+        auto it = files.find(path);
+        bool plus = strchr(mode, '+') != nullptr;
+        if (mode[0] == 'r')
+        {
+            if (it == files.end())
+                return File();
+            return File(it->second, true, plus, 0);
+        }
+
+        if (writesFail)
+            return File();
+        SimFile *file = it != files.end() ? it->second : (files[path] = new SimFile());
+        if (mode[0] == 'w')
+            file->data.clear();
+        size_t position = mode[0] == 'a' ? file->data.size() : 0;
+        return File(file, plus, true, position);
+    }
+
+    bool FS::exists(const char *path)
+    {
+        touch(SIM_FS_OPEN_NS);
+        return files.count(path) > 0;
+    }
+
+    bool FS::remove(const char *path)
+    {
+        touch(SIM_FS_OPEN_NS);
+        return files.erase(path) > 0;
+    }
+
+    bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+    {
+        touch(SIM_FS_OPEN_NS);
+        return true;
+    }
+
+    void LittleFSFS::end()
+    {
+    }
+
+    bool LittleFSFS::format()
+    {
+        files.clear();
+        return true;
+    }
+
+    size_t LittleFSFS::totalBytes()
+    {
+        return 1441792;
+    }
+
+    size_t LittleFSFS::usedBytes()
+    {
+        size_t used = 0;
+        for (const auto &file : files)
+            used += file.second->data.size();
+        return used;
+    }
+}
+
+fs::LittleFSFS LittleFS;
+
+Preferences::Preferences() : space(nullptr), readOnly(false)
+{
+}
+
+Preferences::~Preferences()
+{
+    end();
+}
+
+// Read-only access to a namespace that was never written fails, as on NVS
+bool Preferences::begin(const char *name, bool ro, const char *partitionLabel)
+{
+    touch(SIM_NVS_READ_NS);
+    if (space != nullptr)
+        return false;
+    auto it = namespaces.find(name);
+    if (it == namespaces.end())
+    {
+        if (ro)
+            return false;
+        it = namespaces.insert(std::make_pair(std::string(name), std::map<std::string, std::vector<uint8_t>>())).first;
+    }
+    space = &it->second;
+    readOnly = ro;
+    return true;
+}
+
+void Preferences::end()
+{
+    space = nullptr;
+}
+
+bool Preferences::clear()
+{
+    if (space == nullptr || readOnly)
+        return false;
+    space->clear();
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (space == nullptr || readOnly)
+        return false;
+    return space->erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return find(key) != nullptr;
+}
+
+const std::vector<uint8_t> *Preferences::find(const char *key)
+{
+    touch(SIM_NVS_READ_NS);
+    if (space == nullptr)
+        return nullptr;
+    auto it = space->find(key);
+    return it == space->end() ? nullptr : &it->second;
+}
+
+size_t Preferences::put(const char *key, const void *value, size_t length)
+{
+    if (space == nullptr || readOnly || writesFail)
+        return 0;
+    touch(SIM_NVS_WRITE_NS);
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    (*space)[key] = std::vector<uint8_t>(bytes, bytes + length);
+    flashStats.nvsWrites++;
+    flashStats.bytesWritten += length;
+    return length;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    return put(key, value, length);
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLength)
+{
+    const std::vector<uint8_t> *value = find(key);
+    if (value == nullptr || value->size() > maxLength)
+        return 0;
+    memcpy(buf, value->data(), value->size());
+    return value->size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    const std::vector<uint8_t> *value = find(key);
+    return value == nullptr ? 0 : value->size();
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+    return put(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue)
+{
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putInt(const char *key, int32_t value)
+{
+    return put(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char *key, int32_t defaultValue)
+{
+    int32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putULong(const char *key, uint32_t value)
+{
+    return putUInt(key, value);
+}
+
+uint32_t Preferences::getULong(const char *key, uint32_t defaultValue)
+{
+    return getUInt(key, defaultValue);
+}
+
+size_t Preferences::putBool(const char *key, bool value)
+{
+    uint8_t byte = value ? 1 : 0;
+    return put(key, &byte, 1);
+}
+
+bool Preferences::getBool(const char *key, bool defaultValue)
+{
+    uint8_t byte;
+    return getBytes(key, &byte, 1) == 1 ? byte != 0 : defaultValue;
+}
+
+size_t Preferences::putString(const char *key, const char *value)
+{
+    return put(key, value, strlen(value));
+}
+
+size_t Preferences::putString(const char *key, const String &value)
+{
+    return put(key, value.c_str(), value.length());
+}
+
+String Preferences::getString(const char *key, const String &defaultValue)
+{
+    const std::vector<uint8_t> *value = find(key);
+    if (value == nullptr)
+        return defaultValue;
+    return String(std::string(value->begin(), value->end()));
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#ifndef NATIVE_SIM_WSTRING_H
+#define NATIVE_SIM_WSTRING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+
+// Arduino String on top of std::string, same interface as the ESP32 core
+class String
+{
+public:
+    String() {}
+    String(const char *text) : s(text != nullptr ? text : "") {}
+    String(const std::string &text) : s(text) {}
+    String(const String &other) = default;
+    String &operator=(const String &other) = default;
+    explicit String(char c) : s(1, c) {}
+
+    template <typename T, typename = typename std::enable_if<std::is_integral<T>::value &&
+                                                             !std::is_same<T, char>::value>::type>
+    explicit String(T value, unsigned char base = 10)
+    {
+        char buf[72];
+        if (base == 10)
+        {
+            if (std::is_signed<T>::value)
+                snprintf(buf, sizeof(buf), "%lld", (long long)value);
+            else
+                snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+        }
+        else
+        {
+            unsigned long long v = (unsigned long long)value;
+            char *p = buf + sizeof(buf) - 1;
+            *p = '\0';
+            do
+            {
+                int digit = v % base;
+                *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+                v /= base;
+            } while (v != 0);
+            memmove(buf, p, strlen(p) + 1);
+        }
+        s = buf;
+    }
+
+    // Unscoped enums convert to int, as with the int constructor of the core
+    template <typename T, typename = typename std::enable_if<std::is_enum<T>::value>::type, typename = void>
+    explicit String(T value, unsigned char base = 10) : String((int)value, base)
+    {
+    }
+
+    explicit String(float value, unsigned char decimals = 2) : String((double)value, decimals) {}
+    explicit String(double value, unsigned char decimals = 2)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        s = buf;
+    }
+
+    unsigned int length() const { return s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    const char *c_str() const { return s.c_str(); }
+    bool reserve(unsigned int size)
+    {
+        s.reserve(size);
+        return true;
+    }
+
+    char charAt(unsigned int index) const { return index < s.size() ? s[index] : '\0'; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return s[index]; }
+
+    bool concat(const String &other)
+    {
+        s += other.s;
+        return true;
+    }
+    String &operator+=(const String &other)
+    {
+        s += other.s;
+        return *this;
+    }
+    String &operator+=(const char *other)
+    {
+        s += other;
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        s += c;
+        return *this;
+    }
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value &&
+                                                             !std::is_same<T, char>::value>::type>
+    String &operator+=(T value)
+    {
+        s += String(value).s;
+        return *this;
+    }
+
+    bool equals(const String &other) const { return s == other.s; }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(s.c_str(), other.s.c_str()) == 0; }
+    int compareTo(const String &other) const { return s.compare(other.s); }
+    bool operator==(const String &other) const { return s == other.s; }
+    bool operator==(const char *other) const { return s == (other != nullptr ? other : ""); }
+    bool operator!=(const String &other) const { return s != other.s; }
+    bool operator!=(const char *other) const { return !(*this == other); }
+    bool operator<(const String &other) const { return s < other.s; }
+
+    bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return toIndex(s.find(c, from)); }
+    int indexOf(const String &text, unsigned int from = 0) const { return toIndex(s.find(text.s, from)); }
+    int lastIndexOf(char c) const { return toIndex(s.rfind(c)); }
+    int lastIndexOf(const String &text) const { return toIndex(s.rfind(text.s)); }
+
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= s.size())
+            return String();
+        return String(s.substr(from, to - from));
+    }
+
+    void remove(unsigned int index)
+    {
+        if (index < s.size())
+            s.erase(index);
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < s.size())
+            s.erase(index, count);
+    }
+    void replace(const String &from, const String &to)
+    {
+        if (from.s.empty())
+            return;
+        size_t pos = 0;
+        while ((pos = s.find(from.s, pos)) != std::string::npos)
+        {
+            s.replace(pos, from.s.size(), to.s);
+            pos += to.s.size();
+        }
+    }
+    void trim()
+    {
+        size_t start = s.find_first_not_of(" \t\r\n");
+        size_t end = s.find_last_not_of(" \t\r\n");
+        s = start == std::string::npos ? std::string() : s.substr(start, end - start + 1);
+    }
+    void toLowerCase()
+    {
+        for (char &c : s)
+            c = tolower(c);
+    }
+    void toUpperCase()
+    {
+        for (char &c : s)
+            c = toupper(c);
+    }
+
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+
+    void toCharArray(char *buf, unsigned int size, unsigned int index = 0) const
+    {
+        if (size == 0)
+            return;
+        size_t count = index < s.size() ? std::min((size_t)size - 1, s.size() - index) : 0;
+        memcpy(buf, s.c_str() + index, count);
+        buf[count] = '\0';
+    }
+    void getBytes(unsigned char *buf, unsigned int size, unsigned int index = 0) const
+    {
+        toCharArray((char *)buf, size, index);
+    }
+
+private:
+    static int toIndex(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+    std::string s;
+
+    friend String operator+(const String &a, const String &b);
+    friend String operator+(const String &a, const char *b);
+    friend String operator+(const char *a, const String &b);
+    friend String operator+(const String &a, char b);
+};
+
+inline String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+inline String operator+(const String &a, const char *b) { return String(a.s + (b != nullptr ? b : "")); }
+inline String operator+(const char *a, const String &b) { return String((a != nullptr ? a : "") + b.s); }
+inline String operator+(const String &a, char b) { return String(a.s + b); }
+
+template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value &&
+                                                         !std::is_same<T, char>::value>::type>
+inline String operator+(const String &a, T value)
+{
+    return a + String(value);
+}
+
+inline bool operator==(const char *a, const String &b) { return b == a; }
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef NATIVE_SIM_WIFI_H
+#define NATIVE_SIM_WIFI_H
+
+#include <Arduino.h>
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+// Station joining sim::accessPoint(). A join with the BSSID and channel of
+// the access point skips the scan; a fixed address from config() skips DHCP.
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode);
+    void persistent(bool persistent);
+    bool setAutoReconnect(bool autoReconnect);
+    bool setSleep(bool enabled);
+
+    bool config(IPAddress localIp, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0,
+                IPAddress dns2 = (uint32_t)0);
+    wl_status_t begin(const char *ssid, const char *passphrase = NULL, int32_t channel = 0,
+                      const uint8_t *bssid = NULL, bool connect = true);
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+
+    wl_status_t status();
+    bool isConnected();
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    uint8_t *BSSID();
+    int32_t channel();
+    int8_t RSSI();
+    String macAddress();
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#ifndef NATIVE_SIM_WIFI_CLIENT_H
+#define NATIVE_SIM_WIFI_CLIENT_H
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+namespace sim
+{
+    class HttpServer;
+}
+
+// TCP connection to one of the sim::HttpServer instances. It notices the
+// server closing an idle connection; a server restart or a dropped link
+// only shows when the next request goes out.
+class WiFiClient
+{
+public:
+    WiFiClient();
+    virtual ~WiFiClient();
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+    int connect(const char *host, uint16_t port);
+    virtual int connect(const char *host, uint16_t port, int32_t timeoutMs);
+    virtual uint8_t connected();
+    virtual void stop();
+    operator bool() { return connected(); }
+
+    // Used by the HTTPClient stand-in
+    sim::HttpServer *simServer;
+    uint32_t simEpoch;
+    uint32_t simLinkEpoch;
+    uint64_t simLastUseNs;
+    bool simOpen;
+
+protected:
+    virtual bool simSecure() const { return false; }
+};
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#ifndef NATIVE_SIM_WIFI_CLIENT_SECURE_H
+#define NATIVE_SIM_WIFI_CLIENT_SECURE_H
+
+#include "WiFiClient.h"
+
+// TLS on top of WiFiClient: the handshake costs two more round trips and
+// the key exchange on the board's CPU
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setInsecure() {}
+    void setCACert(const char *rootCA) {}
+    void setHandshakeTimeout(unsigned long seconds) { handshakeTimeoutS = seconds; }
+
+protected:
+    bool simSecure() const override { return true; }
+
+private:
+    unsigned long handshakeTimeoutS = 120;
+};
+
+#endif
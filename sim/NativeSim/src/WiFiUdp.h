@@ -0,0 +1,33 @@
+#pragma once
+
+#ifndef NATIVE_SIM_WIFI_UDP_H
+#define NATIVE_SIM_WIFI_UDP_H
+
+#include <Arduino.h>
+#include <vector>
+#include "IPAddress.h"
+
+// Datagrams sent while the link is up end up in sim::udpPackets()
+class WiFiUDP
+{
+public:
+    uint8_t begin(uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char *host, uint16_t port);
+    size_t write(uint8_t byte);
+    size_t write(const uint8_t *buffer, size_t size);
+    int endPacket();
+
+    int parsePacket();
+    int read(uint8_t *buffer, size_t length);
+
+private:
+    IPAddress remoteIp;
+    uint16_t remotePort = 0;
+    std::vector<uint8_t> packet;
+    bool open = false;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef NATIVE_SIM_FREERTOS_H
+#define NATIVE_SIM_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// FreeRTOS as shipped with ESP-IDF, on the virtual-time scheduler of sim.h.
+// Ticks are 1 ms; both cores share one timeline.
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct
+{
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_FREE_VAL 0xB33FFFFF
+#define portMUX_INITIALIZER_UNLOCKED {portMUX_FREE_VAL, 0}
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux);
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portMUX_INITIALIZE(mux) vPortCPUInitializeMutex(mux)
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+#endif
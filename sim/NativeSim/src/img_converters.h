@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef NATIVE_SIM_IMG_CONVERTERS_H
+#define NATIVE_SIM_IMG_CONVERTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_camera.h"
+
+typedef enum
+{
+    JPG_SCALE_NONE,
+    JPG_SCALE_2X,
+    JPG_SCALE_4X,
+    JPG_SCALE_8X,
+    JPG_SCALE_MAX = JPG_SCALE_8X
+} jpg_scale_t;
+
+// Decodes a frame of the camera stand-in to RGB565, high byte first
+bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t *out, jpg_scale_t scale);
+
+// Encodes RGB565 into a frame of the same synthetic format; *out is malloc()ed
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+             uint8_t **out, size_t *out_len);
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef NATIVE_SIM_MBEDTLS_MD_H
+#define NATIVE_SIM_MBEDTLS_MD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Message digests of mbedTLS; only SHA-256 and its HMAC are provided
+
+typedef enum
+{
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6
+} mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t
+{
+    mbedtls_md_type_t type;
+    unsigned char size;
+} mbedtls_md_info_t;
+
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type);
+int mbedtls_md(const mbedtls_md_info_t *info, const unsigned char *input, size_t length, unsigned char *output);
+int mbedtls_md_hmac(const mbedtls_md_info_t *info, const unsigned char *key, size_t keyLength,
+                    const unsigned char *input, size_t length, unsigned char *output);
+
+#endif
@@ -0,0 +1,382 @@
+#pragma once
+
+#ifndef NATIVE_SIM_H
+#define NATIVE_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Scenario side of the native stand-ins. Board code runs unchanged against
+// the Arduino, FreeRTOS and ESP-IDF headers of this library; a test drives
+// it through the functions below.
+//
+// Time is virtual. Every FreeRTOS task (and the test's own thread, which
+// plays the Arduino loop task) is a host thread, but only one of them runs
+// at a time: blocking calls (delay, queue and semaphore waits, network
+// round trips) hand over to whichever task is due next and the clock jumps
+// straight to that moment. Calls that cost CPU on the device (millis(), GPIO,
+// JPEG decoding, ...) advance the clock by a fixed cost instead, so a busy
+// loop still moves time forward. All tasks share one timeline, as if both
+// cores were one: long CPU charges delay the other tasks.
+namespace sim
+{
+    // ---- Virtual time and tasks
+
+    uint64_t nowUs();
+    uint64_t nowNs();
+
+    // Runs fn at the given virtual time in interrupt context: it must not block
+    void at(uint64_t us, std::function<void()> fn);
+    void after(uint64_t us, std::function<void()> fn);
+
+    // CPU time spent by the caller; interrupts and due tasks run in between
+    void charge(uint64_t ns);
+
+    // Blocks the calling task, other tasks and events run meanwhile
+    void sleepFor(uint64_t us);
+    void sleepUntil(uint64_t us);
+
+    // A task running body, e.g. a client making requests against the board
+    void spawn(const char *name, std::function<void()> body);
+
+    // Seeds random() and esp_random(), so runs are repeatable
+    void seed(uint32_t value);
+
+    // Distribution of durations in microseconds; keeps every sample
+    class Histogram
+    {
+    public:
+        void record(uint64_t us);
+        size_t count() const;
+        uint64_t percentile(double percent) const;
+        uint64_t max() const;
+        uint64_t mean() const;
+        void clear();
+
+        // One line: count, p50, p90, p99, max
+        void print(const char *name) const;
+
+    private:
+        mutable std::vector<uint64_t> samples;
+        mutable bool sorted = true;
+    };
+
+    // Calls loop() back to back like the Arduino loop task until forUs of
+    // virtual time passed. passCostUs is charged per pass on top of what the
+    // stand-ins charge, for the code between them. Each pass is recorded in
+    // passes when given.
+    void runLoop(void (*loop)(), uint64_t forUs, uint32_t passCostUs = 0, Histogram *passes = nullptr);
+
+    // ---- Serial
+
+    // Echo board output to stdout, prefixed with the virtual time
+    void setSerialEcho(bool echo);
+
+    // Lines printed at or after sinceUs that contain text
+    bool serialContains(const char *text, uint64_t sinceUs = 0);
+
+    struct SerialLine
+    {
+        uint64_t atUs;
+        std::string text;
+    };
+    const std::vector<SerialLine> &serialLines();
+
+    // ---- GPIO
+
+    // Drives an input pin from outside; releasePin() lets it float again
+    void setPin(int pin, int level);
+    void releasePin(int pin);
+
+    // Level of a pin as the board drives it, analogWrite() duty for PWM pins
+    int pinLevel(int pin);
+    int analogLevel(int pin);
+
+    // Called whenever the board writes the pin, in the writer's context
+    void onPinWrite(int pin, std::function<void(int level)> fn);
+
+    // Contact between two pins, e.g. a key of a matrix keypad: an input
+    // with pull-up reads LOW while it is connected to an output driven LOW
+    void setContact(int pinA, int pinB, bool closed);
+
+    // Key of a matrix keypad pressed at atUs and held for holdUs, with the
+    // contact chattering for bounceUs at either end
+    void pressKey(int rowPin, int colPin, uint64_t atUs, uint64_t holdUs, uint32_t bounceUs = 0);
+
+    // ---- Devices
+
+    // HC-SR04 on the given pins. After each trigger pulse the echo line
+    // goes high for the round trip of distanceCm(trigger time), or for
+    // 38 ms (no echo) when it returns 0.
+    class Sonar
+    {
+    public:
+        Sonar(int trigPin, int echoPin);
+        std::function<long(uint64_t us)> distanceCm;
+        uint32_t pings;
+
+    private:
+        int echoPin;
+        uint64_t trigHighNs;
+    };
+
+    // Fingerprint sensor on Serial2. Fingers are placed on a schedule; an id
+    // of -1 is a finger that is not enrolled.
+    struct FingerprintSensor
+    {
+        uint32_t baud = 57600;       // Rate the sensor currently talks at
+        bool present = true;
+        bool applyBaudAtOnce = true; // false: a new rate needs a power cycle
+        uint32_t imageUs = 150000;   // Taking an image with a finger on it
+        uint32_t noFingerUs = 10000;
+        uint32_t convertUs = 120000;
+        uint32_t searchUs = 50000;
+        uint32_t badImages = 0;      // Next image conversions that fail
+        int touchPin = -1;           // Touch output of the sensor, if wired
+        bool touchActiveHigh = true;
+        uint32_t commands = 0;
+
+        // Touch output on pin, driven from now on
+        void wireTouch(int pin, bool activeHigh);
+        void place(uint64_t atUs, uint64_t holdUs, int id);
+        bool fingerOn() const;
+        int fingerId() const;
+
+        int currentId = -2; // -2 while nothing touches the sensor
+    };
+    FingerprintSensor &fingerprint();
+
+    // Servo angle last written, -1 before the first write
+    int servoAngle();
+
+    // Camera sensor producing synthetic JPEGs. The picture is a fixed
+    // texture with some noise; during motion a bright block moves across it.
+    struct CameraSensor
+    {
+        uint32_t frameIntervalUs = 40000; // Sensor rate at the configured size
+        bool failCapture = false;
+        uint32_t captures = 0;
+
+        void motion(uint64_t atUs, uint64_t forUs);
+        bool inMotion(uint64_t us) const;
+
+        std::vector<std::pair<uint64_t, uint64_t>> motions;
+    };
+    CameraSensor &camera();
+
+    // ---- Flash
+
+    struct FlashStats
+    {
+        uint32_t opens;
+        uint64_t bytesWritten;
+        uint32_t nvsWrites;
+    };
+    FlashStats &flash();
+    void setFlashWritesFail(bool fail);
+
+    // Drops every file and NVS entry, as if the flash was erased
+    void eraseFlash();
+
+    // ---- Wi-Fi
+
+    struct AccessPoint
+    {
+        bool up = true;
+        std::string ssid;       // Empty accepts any SSID
+        uint8_t bssid[6] = {0x24, 0x0a, 0xc4, 0x11, 0x22, 0x33};
+        int channel = 6;
+        uint32_t scanJoinUs = 2500000;  // Scan all channels, then associate
+        uint32_t directJoinUs = 300000; // Known BSSID and channel, no scan
+        uint32_t dhcpUs = 250000;
+        uint32_t leaseIp = 0x0a01a8c0;  // 192.168.1.10, network byte order
+        uint32_t gateway = 0x0101a8c0;
+        uint32_t subnet = 0x00ffffff;
+        uint32_t dns = 0x0101a8c0;
+        uint32_t bytesPerSecond = 1000000;
+
+        uint32_t joins = 0;
+        uint32_t directJoins = 0;
+        uint32_t dhcpLeases = 0;
+        uint32_t staticJoins = 0;       // Joins with a fixed address, no DHCP
+        uint32_t addressConflicts = 0;  // Fixed address that is not the current lease
+    };
+    AccessPoint &accessPoint();
+
+    // Link goes down now; with comeBackUs it returns that much later
+    void dropWifi(uint64_t comeBackUs = 0);
+    bool wifiConnected();
+
+    // ---- HTTP servers the board talks to
+
+    struct HttpRequest
+    {
+        std::string method;
+        std::string path; // Without the query
+        std::map<std::string, std::string> query;
+        std::map<std::string, std::string> headers;
+        std::string body;
+        uint64_t atUs;       // Arrival at the server
+        uint64_t deadlineUs; // Client gives up after this
+    };
+
+    struct HttpResponse
+    {
+        int code;
+        std::string body;
+        std::map<std::string, std::string> headers;
+    };
+
+    typedef std::function<HttpResponse(const HttpRequest &request)> HttpHandler;
+
+    struct HttpServerStats
+    {
+        uint32_t connections;
+        uint32_t tlsHandshakes;
+        uint32_t requests;
+        uint32_t idleCloses; // Keep-alive connections closed by the server
+        uint32_t staleSends; // Requests sent on a connection the server had dropped
+    };
+
+    // Server reachable from the board at host:port. The handler runs in the
+    // requesting task and may block (sim::sleepFor) to hold a long-poll; the
+    // client stops waiting at request.deadlineUs, so it should not hold longer.
+    class HttpServer
+    {
+    public:
+        HttpServer(const std::string &host, uint16_t port, bool tls, HttpHandler handler);
+
+        // Host, port and scheme from a base URL such as the board's HUB
+        HttpServer(const std::string &baseUrl, HttpHandler handler);
+        ~HttpServer();
+
+        // Down: connects time out. A restart drops every connection without
+        // telling the clients, which only notice when they send next.
+        void setUp(bool up);
+        void restart();
+
+        std::string host;
+        uint16_t port;
+        bool tls;
+        HttpHandler handler;
+        uint32_t rttUs = 30000;
+        uint32_t tlsHandshakeUs = 400000; // Key exchange on the board, on top of the round trips
+        uint64_t keepAliveUs = 5000000;   // Idle connections are closed after this, 0 never
+        bool up = true;
+        uint32_t epoch = 0;
+        HttpServerStats stats = {};
+    };
+
+    // Hub stand-in with the routes of pi_server/app.js: registration, the
+    // /send_status command fallback, the /commands long-poll, outbox
+    // batches and the notification routes. Every request is logged.
+    class Hub
+    {
+    public:
+        explicit Hub(const std::string &baseUrl);
+
+        // Queues a command for a board, like /activate_alarms does
+        void queueCommand(const std::string &board, const std::string &command);
+
+        struct Entry
+        {
+            uint64_t atUs;
+            std::string method;
+            std::string path; // Outbox events are logged under their route
+            std::string body;
+            int code;
+        };
+        const std::vector<Entry> &log() const;
+
+        // First request to path at or after sinceUs, nullptr if none
+        const Entry *first(const std::string &path, uint64_t sinceUs = 0) const;
+        size_t count(const std::string &path) const;
+
+        // Commands handed out per delivery path
+        uint32_t streamedCommands = 0;
+        uint32_t statusCommands = 0;
+
+        HttpServer server;
+
+    private:
+        struct Command
+        {
+            uint32_t seq;
+            std::string command;
+        };
+        struct Queue
+        {
+            uint32_t nextSeq = 1000;
+            std::vector<Command> pending;
+            uint64_t lastPollUs = 0;
+            bool waiting = false;
+        };
+
+        HttpResponse handle(const HttpRequest &request);
+        HttpResponse commands(const HttpRequest &request, Queue &queue);
+        void logEvents(const HttpRequest &request);
+
+        std::map<std::string, Queue> queues;
+        std::map<std::string, std::vector<std::string>> seenEventIds;
+        std::vector<Entry> entries;
+    };
+
+    // ---- mDNS and UDP
+
+    // Hub answering mDNS queries for its service; an empty ip stops it
+    void setMdnsHub(const std::string &ip, uint16_t port, uint32_t answerUs = 20000);
+
+    struct UdpPacket
+    {
+        uint64_t atUs;
+        std::string ip;
+        uint16_t port;
+        std::vector<uint8_t> data;
+    };
+    const std::vector<UdpPacket> &udpPackets();
+
+    // ---- Clients of the board's own servers
+
+    struct ClientResponse
+    {
+        int code; // 0 when nothing answered
+        std::map<std::string, std::string> headers;
+        std::string body;
+        uint64_t startUs;
+        uint64_t endUs;
+    };
+
+    // Request to the board's esp_http_server on port, from the calling task.
+    // Requests on one server are handled one after another, as on the board.
+    ClientResponse httpdRequest(uint16_t port, const char *method, const char *uri,
+                                const std::map<std::string, std::string> &headers = {},
+                                uint32_t bytesPerSecond = 500000);
+
+    struct AsyncConnection;
+
+    // Client of the board's ESPAsyncWebServer, e.g. an MJPEG viewer. Its
+    // socket drains at bytesPerSecond; the async_tcp task fills it.
+    class StreamViewer
+    {
+    public:
+        StreamViewer(uint16_t port, const char *uri, uint32_t bytesPerSecond);
+        ~StreamViewer();
+
+        void close();
+        bool isOpen() const;
+
+        int code;
+        uint64_t bytes;
+        std::string body; // Whole body of a response that is not streamed
+        std::vector<uint32_t> frameSeqs; // X-Frame-Seq of every part received
+        std::vector<uint64_t> frameUs;   // When each part started
+
+        AsyncConnection *connection;
+    };
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef NATIVE_SIM_GPIO_REG_H
+#define NATIVE_SIM_GPIO_REG_H
+
+#include <stdint.h>
+
+// GPIO matrix registers of the ESP32, routed to the simulated pins
+#define DR_REG_GPIO_BASE 0x3ff44000
+#define GPIO_OUT_REG (DR_REG_GPIO_BASE + 0x0004)
+#define GPIO_OUT_W1TS_REG (DR_REG_GPIO_BASE + 0x0008)
+#define GPIO_OUT_W1TC_REG (DR_REG_GPIO_BASE + 0x000c)
+#define GPIO_OUT1_REG (DR_REG_GPIO_BASE + 0x0010)
+#define GPIO_OUT1_W1TS_REG (DR_REG_GPIO_BASE + 0x0014)
+#define GPIO_OUT1_W1TC_REG (DR_REG_GPIO_BASE + 0x0018)
+#define GPIO_IN_REG (DR_REG_GPIO_BASE + 0x003c)
+#define GPIO_IN1_REG (DR_REG_GPIO_BASE + 0x0040)
+
+uint32_t simRegRead(uint32_t address);
+void simRegWrite(uint32_t address, uint32_t value);
+
+#define REG_READ(reg) simRegRead((uint32_t)(reg))
+#define REG_WRITE(reg, value) simRegWrite((uint32_t)(reg), (uint32_t)(value))
+
+#endif